@@ -25,10 +25,9 @@ VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
     VertexOut vout = (VertexOut) 0.0f;
     
-    InstanceData instData = gInstanceData[instanceID];
-    float4x4 gWorld = instData.World;
-    float4x4 gTexTransform = instData.TexTransform;
-    uint gMaterialIndex = instData.MaterialIndex;
+    PackedInstance instData = gInstanceData[gInstanceIndices[instanceID]];
+    float4x4 gWorld = InstanceWorld(instData);
+    uint gMaterialIndex = InstanceMaterialIndex(instData);
     
     MaterialData matData = gMaterialData[gMaterialIndex];
     
@@ -37,7 +36,7 @@ VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
     float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
     vout.PosW = posW.xyz;
     
-    vout.NormalW = mul(vin.NormalL, (float3x3) gWorld);
+    vout.NormalW = mul(vin.NormalL, InstanceNormalMatrix(instData));
     
     vout.TangentW = mul(vin.TangentL, (float3x3) gWorld);
     
@@ -45,7 +44,7 @@ VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
     
     vout.SsaoPosH = mul(posW, gViewProjTex);
     
-    float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
+    float4 texC = float4(InstanceTexC(instData, vin.TexC), 0.0f, 1.0f);
     vout.TexC = mul(texC, matData.MatTransform).xy;
     
     vout.ShadowPosH = mul(posW, gShadowTransform);
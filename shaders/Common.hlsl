@@ -24,17 +24,51 @@ struct MaterialData
     float Metallic;
 };
 
-struct InstanceData
+// 76 bytes per instance, see PackedInstance in FrameResource.hpp
+struct PackedInstance
 {
-    float4x4 World;
-    float4x4 InvTpsWorld;
-    float4x4 TexTransform;
-    uint MaterialIndex;
-    uint AOType;
-    uint InstPad1;
-    uint InstPad2;
+    float4 World[3];        // rows of the transposed world matrix, the translation in w
+    float3 TexTransform[2]; // uv' = (dot(TexTransform[0], (uv, 1)), dot(TexTransform[1], (uv, 1)))
+    uint MaterialAndFlags;  // material index in bits 0-23, AOType in bits 24-25, bit 26 for an identity TexTransform
 };
 
+float4x4 InstanceWorld(PackedInstance inst)
+{
+    return transpose(float4x4(inst.World[0], inst.World[1], inst.World[2], float4(0.0f, 0.0f, 0.0f, 1.0f)));
+}
+
+// Normals transform with the inverse transpose of the upper 3x3 of the world. Its adjugate points the same way
+// up to the sign of the determinant and is just three cross products, the length goes away in normalize.
+float3x3 InstanceNormalMatrix(PackedInstance inst)
+{
+    float3 r0 = inst.World[0].xyz;
+    float3 r1 = inst.World[1].xyz;
+    float3 r2 = inst.World[2].xyz;
+    float3 c0 = cross(r1, r2);
+    float3 c1 = cross(r2, r0);
+    float3 c2 = cross(r0, r1);
+    float s = dot(r0, c0) < 0.0f ? -1.0f : 1.0f;
+    return transpose(float3x3(c0, c1, c2)) * s;
+}
+
+float2 InstanceTexC(PackedInstance inst, float2 texC)
+{
+    if (inst.MaterialAndFlags & (1u << 26))
+        return texC;
+    float3 uv = float3(texC, 1.0f);
+    return float2(dot(inst.TexTransform[0], uv), dot(inst.TexTransform[1], uv));
+}
+
+uint InstanceMaterialIndex(PackedInstance inst)
+{
+    return inst.MaterialAndFlags & 0xffffffu;
+}
+
+uint InstanceAOType(PackedInstance inst)
+{
+    return (inst.MaterialAndFlags >> 24) & 3u;
+}
+
 // 所有漫反射贴图
 Texture2D gTextureMap[15] : register(t1);
 TextureCube gCubeMap[2] : register(t16);
@@ -45,7 +79,9 @@ Texture2D gLUT_Eavg : register(t21); // Eavg LUT
 Texture2D gSsaoMap : register(t22);
 
 StructuredBuffer<MaterialData> gMaterialData : register(t0, space1);
-StructuredBuffer<InstanceData> gInstanceData : register(t1, space1);
+// Records of all instances at fixed slots, each draw reads the slots of its instances from gInstanceIndices
+StructuredBuffer<uint> gInstanceIndices : register(t1, space1);
+StructuredBuffer<PackedInstance> gInstanceData : register(t2, space1);
 
 // 7个不同类型的采样器
 SamplerState gsamPointWrap : register(s0);
@@ -1,5 +1,31 @@
 #include "Common.hlsl"
 
+#ifdef COMPACT_VERTEX
+// CompactVertex (VertexCompression.h): the position on the grid of the drawn submesh, normal and tangent
+// octahedral encoded, uvs as halfs. The input assembler expands every field to float.
+struct VertexIn
+{
+    float4 PosQ : POSITION;      // R16G16B16A16_UNORM
+    float2 NormalOct : NORMAL;   // R16G16_SNORM
+    float2 TangentOct : TANGENT; // R16G16_SNORM
+    float2 TexC : TEXCOORD;      // R16G16_FLOAT
+};
+
+// Grid of the drawn submesh, root constants set per draw
+cbuffer cbVertexQuantization : register(b1)
+{
+    float4 gQuantOffset;
+    float4 gQuantExtent;
+};
+
+float3 OctDecode(float2 e)
+{
+    float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    if (n.z < 0.0f)
+        n.xy = (1.0f - abs(e.yx)) * (e >= 0.0f ? float2(1.0f, 1.0f) : float2(-1.0f, -1.0f));
+    return normalize(n);
+}
+#else
 struct VertexIn
 {
     float3 PosL : POSITION;
@@ -7,6 +33,7 @@ struct VertexIn
     float2 TexC : TEXCOORD;
     float3 TangentU : TANGENT;
 };
+#endif
 
 struct VertexOut
 {
@@ -19,6 +46,13 @@ struct VertexOut
     nointerpolation uint MatIndex : MATINDEX;
 };
 
+// Finest uv footprint each material was sampled with, read back by the texture streamer. The root UAV carries
+// no size, the slot count comes from MaxStreamedMaterials on the CPU side.
+#ifndef MAX_STREAMED_MATERIALS
+#define MAX_STREAMED_MATERIALS 64
+#endif
+RWStructuredBuffer<uint> gMipFeedback : register(u0);
+
 struct PixelOut
 {
     float4 Albedo : SV_Target0;
@@ -26,29 +60,58 @@ struct PixelOut
     float4 Pos : SV_Target2;
 };
 
+// Writes log2 of the uv distance covered by one pixel as 8.8 fixed point biased by 64.
+// Only one pixel of every 8x8 tile records to keep the atomics cheap.
+void RecordMipFeedback(uint matIndex, float2 texC, float4 posH)
+{
+    float2 dx = ddx(texC);
+    float2 dy = ddy(texC);
+    float major = max(dot(dx, dx), dot(dy, dy));
+    float minor = min(dot(dx, dx), dot(dy, dy));
+    // Anisotropic filtering (up to 8x) samples along the minor axis
+    float lod = 0.5f * log2(max(max(major / 64.0f, minor), 1e-20f));
+    
+    // Materials past the feedback buffer are not streamed, writing their slot would land outside it
+    uint2 pixel = uint2(posH.xy);
+    if (matIndex < MAX_STREAMED_MATERIALS && ((pixel.x | pixel.y) & 7) == 0)
+    {
+        uint value = (uint) clamp((lod + 64.0f) * 256.0f, 0.0f, 65535.0f);
+        InterlockedMin(gMipFeedback[matIndex], value);
+    }
+}
+
 VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
     VertexOut vout = (VertexOut) 0.0f;
     
-    InstanceData instData = gInstanceData[instanceID];
-    float4x4 gWorld = instData.World;
-    float4x4 gTexTransform = instData.TexTransform;
-    uint gMaterialIndex = instData.MaterialIndex;
+#ifdef COMPACT_VERTEX
+    float3 posL = gQuantOffset.xyz + vin.PosQ.xyz * gQuantExtent.xyz;
+    float3 normalL = OctDecode(vin.NormalOct);
+    float3 tangentU = OctDecode(vin.TangentOct);
+#else
+    float3 posL = vin.PosL;
+    float3 normalL = vin.NormalL;
+    float3 tangentU = vin.TangentU;
+#endif
+    
+    PackedInstance instData = gInstanceData[gInstanceIndices[instanceID]];
+    float4x4 gWorld = InstanceWorld(instData);
+    uint gMaterialIndex = InstanceMaterialIndex(instData);
     
     vout.MatIndex = gMaterialIndex;
     
     MaterialData matData = gMaterialData[gMaterialIndex];
     
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(posL, 1.0f), gWorld);
     vout.PosW = posW.xyz;
     
-    vout.NormalW = mul(vin.NormalL, (float3x3) gWorld);
+    vout.NormalW = mul(normalL, InstanceNormalMatrix(instData));
     
-    vout.TangentW = mul(vin.TangentU, (float3x3) gWorld);
+    vout.TangentW = mul(tangentU, (float3x3) gWorld);
     
     vout.PosH = mul(posW, gViewProj);
     
-    float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
+    float4 texC = float4(InstanceTexC(instData, vin.TexC), 0.0f, 1.0f);
     vout.TexC = mul(texC, matData.MatTransform).xy;
     
     return vout;
@@ -65,6 +128,8 @@ PixelOut PS(VertexOut pin)
     uint normalTexIndex = matData.NormalMapIndex;
     uint cubeMapIndex = matData.CubeMapIndex;
     
+    RecordMipFeedback(pin.MatIndex, pin.TexC, pin.PosH);
+    
     pin.NormalW = normalize(pin.NormalW);
     
     float4 normalMapSample = gTextureMap[normalTexIndex].Sample(gsamAnisotropicWrap, pin.TexC);
@@ -23,24 +23,22 @@ VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
     VertexOut vout = (VertexOut) 0.0f;
 
-    InstanceData instData = gInstanceData[instanceID];
-    float4x4 gWorld = instData.World;
-    float4x4 gInvTpsWorld = instData.InvTpsWorld;
-    float4x4 gTexTransform = instData.TexTransform;
-    uint gMaterialIndex = instData.MaterialIndex;
+    PackedInstance instData = gInstanceData[gInstanceIndices[instanceID]];
+    float4x4 gWorld = InstanceWorld(instData);
+    uint gMaterialIndex = InstanceMaterialIndex(instData);
     
     vout.MatIndex = gMaterialIndex;
     
     MaterialData matData = gMaterialData[gMaterialIndex];
     
-    vout.NormalW = mul(vin.NormalL, (float3x3) gInvTpsWorld);
-    vout.TangentW = mul(vin.TangentU, (float3x3) gInvTpsWorld);
+    vout.NormalW = mul(vin.NormalL, InstanceNormalMatrix(instData));
+    vout.TangentW = mul(vin.TangentU, (float3x3) gWorld);
     
     float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
     vout.PosH = mul(posW, gViewProj);
     
     
-    float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
+    float4 texC = float4(InstanceTexC(instData, vin.TexC), 0.0f, 1.0f);
     vout.TexC = mul(texC, matData.MatTransform).xy;
     
     return vout;
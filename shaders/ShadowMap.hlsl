@@ -15,16 +15,15 @@ struct VertexOut
 VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
     VertexOut vout;
-    InstanceData instData = gInstanceData[instanceID];
-    float4x4 gWorld = instData.World;
-    float4x4 gTexTransform = instData.TexTransform;
-    uint gMaterialIndex = instData.MaterialIndex;
+    PackedInstance instData = gInstanceData[gInstanceIndices[instanceID]];
+    float4x4 gWorld = InstanceWorld(instData);
+    uint gMaterialIndex = InstanceMaterialIndex(instData);
     MaterialData matData = gMaterialData[gMaterialIndex];
     
     float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
     vout.PosH = mul(posW, gViewProj);
     
-    float4 texC = mul(float4(vin.TexCoord, 0.0f, 1.0f), gTexTransform);
+    float4 texC = float4(InstanceTexC(instData, vin.TexCoord), 0.0f, 1.0f);
     vout.UV = mul(texC, matData.MatTransform).xy;
     
     return vout;
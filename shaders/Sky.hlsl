@@ -19,9 +19,9 @@ VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
     VertexOut vout = (VertexOut) 0.0f;
     
-    InstanceData instData = gInstanceData[instanceID];
-    float4x4 gWorld = instData.World;
-    vout.MatIndex = instData.MaterialIndex;
+    PackedInstance instData = gInstanceData[gInstanceIndices[instanceID]];
+    float4x4 gWorld = InstanceWorld(instData);
+    vout.MatIndex = InstanceMaterialIndex(instData);
     
     vout.PosL = vin.PosL;
     float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
@@ -0,0 +1,867 @@
+#include "BCDecoder.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BC_DECODER_AVX2 1
+#endif
+#if defined(__SSSE3__) || defined(_MSC_VER)
+#include <tmmintrin.h>
+#define BC_DECODER_SSSE3 1
+#endif
+
+namespace
+{
+	enum class BlockKind
+	{
+		BC1,
+		BC2,
+		BC3,
+		BC4U,
+		BC4S,
+		BC5U,
+		BC5S,
+		BC7,
+		Unsupported,
+	};
+
+	BlockKind KindOf(DXGI_FORMAT format)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_BC1_TYPELESS:
+		case DXGI_FORMAT_BC1_UNORM:
+		case DXGI_FORMAT_BC1_UNORM_SRGB:
+			return BlockKind::BC1;
+		case DXGI_FORMAT_BC2_TYPELESS:
+		case DXGI_FORMAT_BC2_UNORM:
+		case DXGI_FORMAT_BC2_UNORM_SRGB:
+			return BlockKind::BC2;
+		case DXGI_FORMAT_BC3_TYPELESS:
+		case DXGI_FORMAT_BC3_UNORM:
+		case DXGI_FORMAT_BC3_UNORM_SRGB:
+			return BlockKind::BC3;
+		case DXGI_FORMAT_BC4_TYPELESS:
+		case DXGI_FORMAT_BC4_UNORM:
+			return BlockKind::BC4U;
+		case DXGI_FORMAT_BC4_SNORM:
+			return BlockKind::BC4S;
+		case DXGI_FORMAT_BC5_TYPELESS:
+		case DXGI_FORMAT_BC5_UNORM:
+			return BlockKind::BC5U;
+		case DXGI_FORMAT_BC5_SNORM:
+			return BlockKind::BC5S;
+		case DXGI_FORMAT_BC7_TYPELESS:
+		case DXGI_FORMAT_BC7_UNORM:
+		case DXGI_FORMAT_BC7_UNORM_SRGB:
+			return BlockKind::BC7;
+		default:
+			return BlockKind::Unsupported;
+		}
+	}
+
+	inline std::uint32_t PackRGBA(std::uint32_t r, std::uint32_t g, std::uint32_t b, std::uint32_t a)
+	{
+		return r | (g << 8) | (b << 16) | (a << 24);
+	}
+
+	inline std::uint64_t Load64(const std::uint8_t* p)
+	{
+		std::uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline std::uint32_t Load32(const std::uint8_t* p)
+	{
+		std::uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	// BC1 color endpoints and the two interpolated colors. forceFourColors is the BC2/BC3 behaviour.
+	void ColorPalette(const std::uint8_t* block, bool forceFourColors, std::uint32_t palette[4])
+	{
+		const std::uint32_t c0 = block[0] | (block[1] << 8);
+		const std::uint32_t c1 = block[2] | (block[3] << 8);
+
+		std::uint32_t r[2], g[2], b[2];
+		const std::uint32_t c[2] = { c0, c1 };
+		for (int i = 0; i < 2; ++i)
+		{
+			std::uint32_t r5 = (c[i] >> 11) & 31, g6 = (c[i] >> 5) & 63, b5 = c[i] & 31;
+			r[i] = (r5 << 3) | (r5 >> 2);
+			g[i] = (g6 << 2) | (g6 >> 4);
+			b[i] = (b5 << 3) | (b5 >> 2);
+		}
+
+		palette[0] = PackRGBA(r[0], g[0], b[0], 255);
+		palette[1] = PackRGBA(r[1], g[1], b[1], 255);
+		if (c0 > c1 || forceFourColors)
+		{
+			palette[2] = PackRGBA((2 * r[0] + r[1]) / 3, (2 * g[0] + g[1]) / 3, (2 * b[0] + b[1]) / 3, 255);
+			palette[3] = PackRGBA((r[0] + 2 * r[1]) / 3, (g[0] + 2 * g[1]) / 3, (b[0] + 2 * b[1]) / 3, 255);
+		}
+		else
+		{
+			palette[2] = PackRGBA((r[0] + r[1]) / 2, (g[0] + g[1]) / 2, (b[0] + b[1]) / 2, 255);
+			palette[3] = 0; // transparent black
+		}
+	}
+
+	// BC4 endpoints and interpolated values, in byte order of the index values.
+	void ChannelPalette(const std::uint8_t* block, bool isSigned, std::uint8_t palette[8])
+	{
+		if (!isSigned)
+		{
+			const int r0 = block[0], r1 = block[1];
+			palette[0] = (std::uint8_t)r0;
+			palette[1] = (std::uint8_t)r1;
+			if (r0 > r1)
+			{
+				for (int i = 1; i <= 6; ++i)
+					palette[i + 1] = (std::uint8_t)(((7 - i) * r0 + i * r1 + 3) / 7);
+			}
+			else
+			{
+				for (int i = 1; i <= 4; ++i)
+					palette[i + 1] = (std::uint8_t)(((5 - i) * r0 + i * r1 + 2) / 5);
+				palette[6] = 0;
+				palette[7] = 255;
+			}
+			return;
+		}
+
+		// -128 decodes as -127
+		const int r0 = std::max<int>((std::int8_t)block[0], -127);
+		const int r1 = std::max<int>((std::int8_t)block[1], -127);
+		auto divRound = [](int v, int d) { return v >= 0 ? (v + d / 2) / d : -((-v + d / 2) / d); };
+		palette[0] = (std::uint8_t)(std::int8_t)r0;
+		palette[1] = (std::uint8_t)(std::int8_t)r1;
+		if (r0 > r1)
+		{
+			for (int i = 1; i <= 6; ++i)
+				palette[i + 1] = (std::uint8_t)(std::int8_t)divRound((7 - i) * r0 + i * r1, 7);
+		}
+		else
+		{
+			for (int i = 1; i <= 4; ++i)
+				palette[i + 1] = (std::uint8_t)(std::int8_t)divRound((5 - i) * r0 + i * r1, 5);
+			palette[6] = (std::uint8_t)(std::int8_t)-127;
+			palette[7] = 127;
+		}
+	}
+
+	// 16 channel values of a BC4 block (also the alpha half of BC3 and both halves of BC5).
+	void DecodeChannel(const std::uint8_t* block, bool isSigned, std::uint8_t values[16])
+	{
+		std::uint8_t palette[8];
+		ChannelPalette(block, isSigned, palette);
+		const std::uint64_t bits = Load64(block) >> 16;
+		for (int i = 0; i < 16; ++i)
+			values[i] = palette[(bits >> (3 * i)) & 7];
+	}
+
+	// BC2 explicit 4-bit alpha
+	void DecodeExplicitAlpha(const std::uint8_t* block, std::uint8_t values[16])
+	{
+		const std::uint64_t bits = Load64(block);
+		for (int i = 0; i < 16; ++i)
+			values[i] = (std::uint8_t)(((bits >> (4 * i)) & 15) * 17);
+	}
+
+	// Four rows of four RGBA8 texels under construction.
+	// Color rows come from a 4 entry palette, single channels (alpha, R, G) are inserted afterwards.
+#if BC_DECODER_AVX2
+	struct ShuffleTables
+	{
+		__m128i Color[256];      // index byte of one row -> gather mask into the palette
+		__m256i Channel[4][2];   // channel slot, row pair -> gather mask into 16 channel values
+		__m256i ChannelClear[4]; // keeps every byte but the slot
+		ShuffleTables();
+	};
+
+	struct Rows
+	{
+		__m256i V[2]; // rows 0-1 and 2-3
+	};
+#elif BC_DECODER_SSSE3
+	struct ShuffleTables
+	{
+		__m128i Color[256];
+		__m128i Channel[4][4];
+		__m128i ChannelClear[4];
+		ShuffleTables();
+	};
+
+	struct Rows
+	{
+		__m128i V[4];
+	};
+#else
+	struct Rows
+	{
+		std::uint32_t V[16];
+	};
+#endif
+
+#if BC_DECODER_SSSE3
+	ShuffleTables::ShuffleTables()
+	{
+		alignas(16) std::uint8_t mask[16];
+		for (int b = 0; b < 256; ++b)
+		{
+			for (int k = 0; k < 4; ++k)
+			{
+				int sel = (b >> (2 * k)) & 3;
+				for (int c = 0; c < 4; ++c)
+					mask[k * 4 + c] = (std::uint8_t)(sel * 4 + c);
+			}
+			Color[b] = _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+		}
+
+		for (int slot = 0; slot < 4; ++slot)
+		{
+			__m128i perRow[4];
+			for (int r = 0; r < 4; ++r)
+			{
+				for (int k = 0; k < 4; ++k)
+				{
+					for (int c = 0; c < 4; ++c)
+						mask[k * 4 + c] = c == slot ? (std::uint8_t)(r * 4 + k) : 0x80;
+				}
+				perRow[r] = _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+			}
+			const __m128i clear = _mm_set1_epi32(~(0xff << (8 * slot)));
+#if BC_DECODER_AVX2
+			Channel[slot][0] = _mm256_inserti128_si256(_mm256_castsi128_si256(perRow[0]), perRow[1], 1);
+			Channel[slot][1] = _mm256_inserti128_si256(_mm256_castsi128_si256(perRow[2]), perRow[3], 1);
+			ChannelClear[slot] = _mm256_broadcastsi128_si256(clear);
+#else
+			for (int r = 0; r < 4; ++r)
+				Channel[slot][r] = perRow[r];
+			ChannelClear[slot] = clear;
+#endif
+		}
+	}
+
+	const ShuffleTables& Tables()
+	{
+		static const ShuffleTables tables;
+		return tables;
+	}
+#endif
+
+	inline void ColorRows(const std::uint32_t palette[4], std::uint32_t indices, Rows& rows)
+	{
+#if BC_DECODER_AVX2
+		const ShuffleTables& t = Tables();
+		const __m256i pal = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(palette)));
+		for (int p = 0; p < 2; ++p)
+		{
+			__m256i mask = _mm256_inserti128_si256(
+				_mm256_castsi128_si256(t.Color[(indices >> (16 * p)) & 0xff]), t.Color[(indices >> (16 * p + 8)) & 0xff], 1);
+			rows.V[p] = _mm256_shuffle_epi8(pal, mask);
+		}
+#elif BC_DECODER_SSSE3
+		const ShuffleTables& t = Tables();
+		const __m128i pal = _mm_loadu_si128(reinterpret_cast<const __m128i*>(palette));
+		for (int r = 0; r < 4; ++r)
+			rows.V[r] = _mm_shuffle_epi8(pal, t.Color[(indices >> (8 * r)) & 0xff]);
+#else
+		for (int i = 0; i < 16; ++i)
+			rows.V[i] = palette[(indices >> (2 * i)) & 3];
+#endif
+	}
+
+	inline void SolidRows(std::uint32_t rgba, Rows& rows)
+	{
+#if BC_DECODER_AVX2
+		rows.V[0] = rows.V[1] = _mm256_set1_epi32((int)rgba);
+#elif BC_DECODER_SSSE3
+		for (int r = 0; r < 4; ++r)
+			rows.V[r] = _mm_set1_epi32((int)rgba);
+#else
+		for (int i = 0; i < 16; ++i)
+			rows.V[i] = rgba;
+#endif
+	}
+
+	// Replaces byte slot (0 = R ... 3 = A) of every texel with values[texel].
+	inline void InsertChannel(const std::uint8_t values[16], int slot, Rows& rows)
+	{
+#if BC_DECODER_AVX2
+		const ShuffleTables& t = Tables();
+		const __m256i v = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values)));
+		for (int p = 0; p < 2; ++p)
+		{
+			rows.V[p] = _mm256_or_si256(_mm256_and_si256(rows.V[p], t.ChannelClear[slot]),
+				_mm256_shuffle_epi8(v, t.Channel[slot][p]));
+		}
+#elif BC_DECODER_SSSE3
+		const ShuffleTables& t = Tables();
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values));
+		for (int r = 0; r < 4; ++r)
+		{
+			rows.V[r] = _mm_or_si128(_mm_and_si128(rows.V[r], t.ChannelClear[slot]),
+				_mm_shuffle_epi8(v, t.Channel[slot][r]));
+		}
+#else
+		for (int i = 0; i < 16; ++i)
+			rows.V[i] = (rows.V[i] & ~(0xffu << (8 * slot))) | ((std::uint32_t)values[i] << (8 * slot));
+#endif
+	}
+
+	inline void StoreRows(const Rows& rows, std::uint8_t* dst, size_t rowPitch)
+	{
+#if BC_DECODER_AVX2
+		for (int p = 0; p < 2; ++p)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + (2 * p) * rowPitch), _mm256_castsi256_si128(rows.V[p]));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + (2 * p + 1) * rowPitch), _mm256_extracti128_si256(rows.V[p], 1));
+		}
+#elif BC_DECODER_SSSE3
+		for (int r = 0; r < 4; ++r)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + r * rowPitch), rows.V[r]);
+#else
+		for (int r = 0; r < 4; ++r)
+			memcpy(dst + r * rowPitch, &rows.V[r * 4], 16);
+#endif
+	}
+
+	void DecodeBC1(const std::uint8_t* block, std::uint8_t* dst, size_t rowPitch)
+	{
+		std::uint32_t palette[4];
+		ColorPalette(block, false, palette);
+		Rows rows;
+		ColorRows(palette, Load32(block + 4), rows);
+		StoreRows(rows, dst, rowPitch);
+	}
+
+	void DecodeBC2(const std::uint8_t* block, std::uint8_t* dst, size_t rowPitch)
+	{
+		std::uint32_t palette[4];
+		ColorPalette(block + 8, true, palette);
+		std::uint8_t alpha[16];
+		DecodeExplicitAlpha(block, alpha);
+		Rows rows;
+		ColorRows(palette, Load32(block + 12), rows);
+		InsertChannel(alpha, 3, rows);
+		StoreRows(rows, dst, rowPitch);
+	}
+
+	void DecodeBC3(const std::uint8_t* block, std::uint8_t* dst, size_t rowPitch)
+	{
+		std::uint32_t palette[4];
+		ColorPalette(block + 8, true, palette);
+		std::uint8_t alpha[16];
+		DecodeChannel(block, false, alpha);
+		Rows rows;
+		ColorRows(palette, Load32(block + 12), rows);
+		InsertChannel(alpha, 3, rows);
+		StoreRows(rows, dst, rowPitch);
+	}
+
+	void DecodeBC4(const std::uint8_t* block, bool isSigned, std::uint8_t* dst, size_t rowPitch)
+	{
+		std::uint8_t red[16];
+		DecodeChannel(block, isSigned, red);
+		Rows rows;
+		SolidRows(PackRGBA(0, 0, 0, isSigned ? 127 : 255), rows);
+		InsertChannel(red, 0, rows);
+		StoreRows(rows, dst, rowPitch);
+	}
+
+	void DecodeBC5(const std::uint8_t* block, bool isSigned, std::uint8_t* dst, size_t rowPitch)
+	{
+		std::uint8_t red[16], green[16];
+		DecodeChannel(block, isSigned, red);
+		DecodeChannel(block + 8, isSigned, green);
+		Rows rows;
+		SolidRows(PackRGBA(0, 0, 0, isSigned ? 127 : 255), rows);
+		InsertChannel(red, 0, rows);
+		InsertChannel(green, 1, rows);
+		StoreRows(rows, dst, rowPitch);
+	}
+
+	// ---- BC7 ----
+
+	struct BC7Mode
+	{
+		std::uint8_t NumSubsets;
+		std::uint8_t PartitionBits;
+		std::uint8_t RotationBits;
+		std::uint8_t IndexSelectionBits;
+		std::uint8_t ColorBits;
+		std::uint8_t AlphaBits;
+		std::uint8_t EndpointPBits;
+		std::uint8_t SharedPBits;
+		std::uint8_t IndexBits;
+		std::uint8_t IndexBits2;
+	};
+
+	const BC7Mode BC7Modes[8] =
+	{
+		{ 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+		{ 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+		{ 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+		{ 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+		{ 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+		{ 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+		{ 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+		{ 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+	};
+
+	// Subset 1 texels of the 2 subset partitions, bit i = texel i
+	const std::uint16_t BC7Partitions2[64] =
+	{
+		0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+		0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+		0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+		0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+		0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+		0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+		0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+		0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+	};
+
+	const std::uint8_t BC7Partitions3[64][16] =
+	{
+		{ 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 1, 2, 2, 2, 2 },
+		{ 0, 0, 0, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 2, 1 },
+		{ 0, 0, 0, 0, 2, 0, 0, 1, 2, 2, 1, 1, 2, 2, 1, 1 },
+		{ 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 1, 0, 1, 1, 1 },
+		{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2 },
+		{ 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 2, 2 },
+		{ 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1 },
+		{ 0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1 },
+		{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2 },
+		{ 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2 },
+		{ 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2 },
+		{ 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2 },
+		{ 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2 },
+		{ 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2 },
+		{ 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2, 1, 2, 2, 2 },
+		{ 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0, 2, 2, 2, 0 },
+		{ 0, 0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2 },
+		{ 0, 1, 1, 1, 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0 },
+		{ 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2 },
+		{ 0, 0, 2, 2, 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1 },
+		{ 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2, 0, 2, 2, 2 },
+		{ 0, 0, 0, 1, 0, 0, 0, 1, 2, 2, 2, 1, 2, 2, 2, 1 },
+		{ 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2 },
+		{ 0, 0, 0, 0, 1, 1, 0, 0, 2, 2, 1, 0, 2, 2, 1, 0 },
+		{ 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1, 0, 0, 0, 0 },
+		{ 0, 0, 1, 2, 0, 0, 1, 2, 1, 1, 2, 2, 2, 2, 2, 2 },
+		{ 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1, 0, 1, 1, 0 },
+		{ 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1 },
+		{ 0, 0, 2, 2, 1, 1, 0, 2, 1, 1, 0, 2, 0, 0, 2, 2 },
+		{ 0, 1, 1, 0, 0, 1, 1, 0, 2, 0, 0, 2, 2, 2, 2, 2 },
+		{ 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1 },
+		{ 0, 0, 0, 0, 2, 0, 0, 0, 2, 2, 1, 1, 2, 2, 2, 1 },
+		{ 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 2, 2, 2 },
+		{ 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 2, 0, 0, 1, 1 },
+		{ 0, 0, 1, 1, 0, 0, 1, 2, 0, 0, 2, 2, 0, 2, 2, 2 },
+		{ 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0 },
+		{ 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0 },
+		{ 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0 },
+		{ 0, 1, 2, 0, 2, 0, 1, 2, 1, 2, 0, 1, 0, 1, 2, 0 },
+		{ 0, 0, 1, 1, 2, 2, 0, 0, 1, 1, 2, 2, 0, 0, 1, 1 },
+		{ 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0, 1, 1 },
+		{ 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2 },
+		{ 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1 },
+		{ 0, 0, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2, 1, 1, 2, 2 },
+		{ 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 1, 1 },
+		{ 0, 2, 2, 0, 1, 2, 2, 1, 0, 2, 2, 0, 1, 2, 2, 1 },
+		{ 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 0, 1, 0, 1 },
+		{ 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1 },
+		{ 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2 },
+		{ 0, 2, 2, 2, 0, 1, 1, 1, 0, 2, 2, 2, 0, 1, 1, 1 },
+		{ 0, 0, 0, 2, 1, 1, 1, 2, 0, 0, 0, 2, 1, 1, 1, 2 },
+		{ 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2 },
+		{ 0, 2, 2, 2, 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2 },
+		{ 0, 0, 0, 2, 1, 1, 1, 2, 1, 1, 1, 2, 0, 0, 0, 2 },
+		{ 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2 },
+		{ 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2 },
+		{ 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2, 2, 2, 2, 2 },
+		{ 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2 },
+		{ 0, 0, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2 },
+		{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2 },
+		{ 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 1 },
+		{ 0, 2, 2, 2, 1, 2, 2, 2, 0, 2, 2, 2, 1, 2, 2, 2 },
+		{ 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2 },
+		{ 0, 1, 1, 1, 2, 0, 1, 1, 2, 2, 0, 1, 2, 2, 2, 0 },
+	};
+
+	// Anchor texels, whose index has its top bit implied zero
+	const std::uint8_t BC7Anchor2[64] =
+	{
+		15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+		15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+		15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+		 6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+	};
+
+	const std::uint8_t BC7Anchor3a[64] =
+	{
+		 3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+		 3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+		 8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+		 3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3,
+	};
+
+	const std::uint8_t BC7Anchor3b[64] =
+	{
+		15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+		15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+		15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+		15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8,
+	};
+
+	const std::uint8_t BC7Weights2[4] = { 0, 21, 43, 64 };
+	const std::uint8_t BC7Weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+	const std::uint8_t BC7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	inline const std::uint8_t* BC7Weights(int bits)
+	{
+		return bits == 2 ? BC7Weights2 : (bits == 3 ? BC7Weights3 : BC7Weights4);
+	}
+
+	struct BitReader
+	{
+		std::uint64_t Lo, Hi;
+		int Pos = 0;
+
+		explicit BitReader(const std::uint8_t* block) : Lo(Load64(block)), Hi(Load64(block + 8)) {}
+
+		std::uint32_t Read(int count)
+		{
+			if (count == 0)
+				return 0;
+			std::uint64_t v;
+			if (Pos >= 64)
+				v = Hi >> (Pos - 64);
+			else if (Pos + count <= 64)
+				v = Lo >> Pos;
+			else
+				v = (Lo >> Pos) | (Hi << (64 - Pos));
+			Pos += count;
+			return (std::uint32_t)(v & ((1ull << count) - 1));
+		}
+	};
+
+	inline int BC7Subset(const BC7Mode& mode, std::uint32_t partition, int texel)
+	{
+		if (mode.NumSubsets == 2)
+			return (BC7Partitions2[partition] >> texel) & 1;
+		if (mode.NumSubsets == 3)
+			return BC7Partitions3[partition][texel];
+		return 0;
+	}
+
+	inline bool BC7IsAnchor(const BC7Mode& mode, std::uint32_t partition, int texel)
+	{
+		if (texel == 0)
+			return true;
+		if (mode.NumSubsets == 2)
+			return texel == BC7Anchor2[partition];
+		if (mode.NumSubsets == 3)
+			return texel == BC7Anchor3a[partition] || texel == BC7Anchor3b[partition];
+		return false;
+	}
+
+	inline std::uint32_t BC7Unquantize(std::uint32_t value, int bits)
+	{
+		value <<= (8 - bits);
+		return value | (value >> bits);
+	}
+
+	void DecodeBC7(const std::uint8_t* block, std::uint8_t* dst, size_t rowPitch)
+	{
+		if (block[0] == 0)
+		{
+			// Reserved mode, decodes to transparent black
+			for (int r = 0; r < 4; ++r)
+				memset(dst + r * rowPitch, 0, 16);
+			return;
+		}
+
+		int modeIndex = 0;
+		while (!(block[0] & (1 << modeIndex)))
+			++modeIndex;
+		const BC7Mode& mode = BC7Modes[modeIndex];
+
+		BitReader bits(block);
+		bits.Pos = modeIndex + 1;
+		const std::uint32_t partition = bits.Read(mode.PartitionBits);
+		const std::uint32_t rotation = bits.Read(mode.RotationBits);
+		const std::uint32_t indexSelection = bits.Read(mode.IndexSelectionBits);
+
+		const int numEndpoints = mode.NumSubsets * 2;
+		std::uint32_t endpoints[6][4] = {};
+		for (int c = 0; c < 3; ++c)
+		{
+			for (int e = 0; e < numEndpoints; ++e)
+				endpoints[e][c] = bits.Read(mode.ColorBits);
+		}
+		for (int e = 0; e < numEndpoints; ++e)
+			endpoints[e][3] = bits.Read(mode.AlphaBits);
+
+		std::uint32_t pBits[6] = {};
+		if (mode.EndpointPBits)
+		{
+			for (int e = 0; e < numEndpoints; ++e)
+				pBits[e] = bits.Read(1);
+		}
+		if (mode.SharedPBits)
+		{
+			for (int s = 0; s < mode.NumSubsets; ++s)
+				pBits[2 * s] = pBits[2 * s + 1] = bits.Read(1);
+		}
+
+		const bool hasPBits = mode.EndpointPBits || mode.SharedPBits;
+		for (int e = 0; e < numEndpoints; ++e)
+		{
+			for (int c = 0; c < 4; ++c)
+			{
+				int precision = c < 3 ? mode.ColorBits : mode.AlphaBits;
+				if (precision == 0)
+				{
+					endpoints[e][c] = 255;
+					continue;
+				}
+				std::uint32_t v = endpoints[e][c];
+				if (hasPBits)
+				{
+					v = (v << 1) | pBits[e];
+					++precision;
+				}
+				endpoints[e][c] = BC7Unquantize(v, precision);
+			}
+		}
+
+		std::uint8_t indices[16];
+		std::uint8_t indices2[16] = {};
+		for (int i = 0; i < 16; ++i)
+			indices[i] = (std::uint8_t)bits.Read(mode.IndexBits - (BC7IsAnchor(mode, partition, i) ? 1 : 0));
+		if (mode.IndexBits2)
+		{
+			for (int i = 0; i < 16; ++i)
+				indices2[i] = (std::uint8_t)bits.Read(mode.IndexBits2 - (i == 0 ? 1 : 0));
+		}
+
+		// Mode 4 can swap which index set drives color and which drives alpha
+		const std::uint8_t* colorIndices = indices;
+		const std::uint8_t* alphaIndices = mode.IndexBits2 ? indices2 : indices;
+		int colorBits = mode.IndexBits;
+		int alphaBits = mode.IndexBits2 ? mode.IndexBits2 : mode.IndexBits;
+		if (indexSelection)
+		{
+			std::swap(colorIndices, alphaIndices);
+			std::swap(colorBits, alphaBits);
+		}
+		const std::uint8_t* colorWeights = BC7Weights(colorBits);
+		const std::uint8_t* alphaWeights = BC7Weights(alphaBits);
+
+		for (int i = 0; i < 16; ++i)
+		{
+			const int s = BC7Subset(mode, partition, i);
+			const std::uint32_t* e0 = endpoints[2 * s];
+			const std::uint32_t* e1 = endpoints[2 * s + 1];
+			const std::uint32_t wc = colorWeights[colorIndices[i]];
+			const std::uint32_t wa = alphaWeights[alphaIndices[i]];
+
+			std::uint8_t texel[4];
+			for (int c = 0; c < 3; ++c)
+				texel[c] = (std::uint8_t)((e0[c] * (64 - wc) + e1[c] * wc + 32) >> 6);
+			texel[3] = (std::uint8_t)((e0[3] * (64 - wa) + e1[3] * wa + 32) >> 6);
+
+			if (rotation)
+				std::swap(texel[3], texel[rotation - 1]);
+
+			memcpy(dst + (i / 4) * rowPitch + (i % 4) * 4, texel, 4);
+		}
+	}
+
+	void DecodeBlockKind(BlockKind kind, const std::uint8_t* block, std::uint8_t* dst, size_t rowPitch)
+	{
+		switch (kind)
+		{
+		case BlockKind::BC1: DecodeBC1(block, dst, rowPitch); break;
+		case BlockKind::BC2: DecodeBC2(block, dst, rowPitch); break;
+		case BlockKind::BC3: DecodeBC3(block, dst, rowPitch); break;
+		case BlockKind::BC4U: DecodeBC4(block, false, dst, rowPitch); break;
+		case BlockKind::BC4S: DecodeBC4(block, true, dst, rowPitch); break;
+		case BlockKind::BC5U: DecodeBC5(block, false, dst, rowPitch); break;
+		case BlockKind::BC5S: DecodeBC5(block, true, dst, rowPitch); break;
+		case BlockKind::BC7: DecodeBC7(block, dst, rowPitch); break;
+		default: assert(false && "unsupported block format"); break;
+		}
+	}
+}
+
+bool BC::IsSupported(DXGI_FORMAT format)
+{
+	return KindOf(format) != BlockKind::Unsupported;
+}
+
+const char* BC::FormatName(DXGI_FORMAT format)
+{
+	switch (KindOf(format))
+	{
+	case BlockKind::BC1: return "BC1";
+	case BlockKind::BC2: return "BC2";
+	case BlockKind::BC3: return "BC3";
+	case BlockKind::BC4U: return "BC4";
+	case BlockKind::BC4S: return "BC4 SNORM";
+	case BlockKind::BC5U: return "BC5";
+	case BlockKind::BC5S: return "BC5 SNORM";
+	case BlockKind::BC7: return "BC7";
+	default: return nullptr;
+	}
+}
+
+size_t BC::BlockBytes(DXGI_FORMAT format)
+{
+	switch (KindOf(format))
+	{
+	case BlockKind::BC1:
+	case BlockKind::BC4U:
+	case BlockKind::BC4S:
+		return 8;
+	case BlockKind::Unsupported:
+		return 0;
+	default:
+		return 16;
+	}
+}
+
+void BC::DecodeBlock(DXGI_FORMAT format, const std::uint8_t* block, std::uint8_t* rgba, size_t rowPitch)
+{
+	DecodeBlockKind(KindOf(format), block, rgba, rowPitch);
+}
+
+void BC::DecodeSurface(DXGI_FORMAT format, const std::uint8_t* blocks, size_t blockRowPitch,
+	std::uint32_t width, std::uint32_t height, std::uint8_t* rgba, size_t rgbaRowPitch, bool parallel)
+{
+	const BlockKind kind = KindOf(format);
+	assert(kind != BlockKind::Unsupported);
+
+	const size_t blockBytes = BlockBytes(format);
+	const std::uint32_t blocksWide = (width + 3) / 4;
+	const std::uint32_t blocksHigh = (height + 3) / 4;
+
+	auto decodeRows = [&](size_t begin, size_t end)
+	{
+		for (size_t by = begin; by < end; ++by)
+		{
+			const std::uint8_t* src = blocks + by * blockRowPitch;
+			std::uint8_t* dstRow = rgba + by * 4 * rgbaRowPitch;
+			const std::uint32_t rows = std::min<std::uint32_t>(4, height - (std::uint32_t)by * 4);
+			for (std::uint32_t bx = 0; bx < blocksWide; ++bx, src += blockBytes)
+			{
+				const std::uint32_t cols = std::min<std::uint32_t>(4, width - bx * 4);
+				std::uint8_t* dst = dstRow + bx * 16;
+				if (rows == 4 && cols == 4)
+				{
+					DecodeBlockKind(kind, src, dst, rgbaRowPitch);
+					continue;
+				}
+
+				// Edge block, decode aside and keep the texels inside the surface
+				std::uint8_t texels[64];
+				DecodeBlockKind(kind, src, texels, 16);
+				for (std::uint32_t r = 0; r < rows; ++r)
+					memcpy(dst + r * rgbaRowPitch, texels + r * 16, cols * 4);
+			}
+		}
+	};
+
+	if (parallel)
+		ParallelFor(blocksHigh, 16, decodeRows);
+	else
+		decodeRows(0, blocksHigh);
+}
+
+std::vector<std::uint8_t> BC::DecodeSubresource(DXGI_FORMAT format, const DDS::Subresource& surface, bool parallel)
+{
+	if (!IsSupported(format))
+		return {};
+
+	std::vector<std::uint8_t> rgba((size_t)surface.Width * surface.Height * 4);
+	DecodeSurface(format, surface.Data, surface.RowPitch, surface.Width, surface.Height,
+		rgba.data(), (size_t)surface.Width * 4, parallel);
+	return rgba;
+}
+
+BC::BlockCache::BlockCache(DXGI_FORMAT format, const DDS::Subresource& surface, std::uint32_t capacity)
+	: mFormat(format), mSurface(surface)
+{
+	assert(IsSupported(format));
+	std::uint32_t size = 1;
+	while (size < capacity)
+		size <<= 1;
+	mEntries.resize(size);
+	mBlocksWide = (surface.Width + 3) / 4;
+}
+
+std::uint32_t BC::BlockCache::Fetch(std::uint32_t x, std::uint32_t y)
+{
+	x = std::min(x, mSurface.Width - 1);
+	y = std::min(y, mSurface.Height - 1);
+	const std::uint32_t bx = x >> 2, by = y >> 2;
+	const std::uint32_t blockIndex = by * mBlocksWide + bx;
+
+	// Neighbouring blocks in both directions land in different slots
+	Entry& entry = mEntries[(bx ^ (by * 0x9e37u)) & (std::uint32_t)(mEntries.size() - 1)];
+	if (entry.Block != blockIndex)
+	{
+		const std::uint8_t* block = mSurface.Data + by * mSurface.RowPitch + bx * BlockBytes(mFormat);
+		DecodeBlock(mFormat, block, reinterpret_cast<std::uint8_t*>(entry.Texels), 16);
+		entry.Block = blockIndex;
+		++mMisses;
+	}
+	else
+	{
+		++mHits;
+	}
+	return entry.Texels[(y & 3) * 4 + (x & 3)];
+}
+
+BC::DecodeThroughput BC::MeasureThroughput(DXGI_FORMAT format, std::uint32_t width, std::uint32_t height,
+	int iterations, bool parallel)
+{
+	DecodeThroughput result;
+	result.Format = format;
+	if (!IsSupported(format))
+		return result;
+
+	const size_t blockBytes = BlockBytes(format);
+	const size_t blockRowPitch = ((width + 3) / 4) * blockBytes;
+	std::vector<std::uint8_t> blocks(blockRowPitch * ((height + 3) / 4));
+
+	// xorshift noise exercises every BC1 mode, BC4 palette and BC7 mode and partition
+	std::uint32_t state = 0x12345678u;
+	for (auto& b : blocks)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		b = (std::uint8_t)state;
+	}
+
+	std::vector<std::uint8_t> rgba((size_t)width * height * 4);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; ++i)
+		DecodeSurface(format, blocks.data(), blockRowPitch, width, height, rgba.data(), (size_t)width * 4, parallel);
+	auto end = std::chrono::high_resolution_clock::now();
+
+	result.Texels = (std::uint64_t)width * height * iterations;
+	result.Ms = std::chrono::duration<double, std::milli>(end - start).count();
+	return result;
+}
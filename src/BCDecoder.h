@@ -0,0 +1,70 @@
+#pragma once
+#include "../utils/DDSReader.h"
+#include <cstdint>
+#include <vector>
+
+// CPU decoder for the block compressed formats of the DDS assets (BC1-BC5, BC7).
+// Decoded texels are RGBA8 in memory order R, G, B, A. BC4/BC5 fill R (and G) with B = 0 and A = 1.0,
+// SNORM channels are stored as two's complement bytes like R8G8_SNORM (so A is 127 there).
+namespace BC
+{
+	bool IsSupported(DXGI_FORMAT format);
+
+	// Short name such as "BC1" or "BC5 SNORM" for statistics, nullptr when not supported.
+	const char* FormatName(DXGI_FORMAT format);
+
+	// 8 for BC1/BC4, 16 for the others, 0 when not supported.
+	size_t BlockBytes(DXGI_FORMAT format);
+
+	// Decodes one 4x4 block into 4 rows of 4 texels, rowPitch bytes apart.
+	void DecodeBlock(DXGI_FORMAT format, const std::uint8_t* block, std::uint8_t* rgba, size_t rowPitch = 16);
+
+	// Decodes a whole surface. Block rows are spread over worker threads when parallel is set.
+	void DecodeSurface(DXGI_FORMAT format, const std::uint8_t* blocks, size_t blockRowPitch,
+		std::uint32_t width, std::uint32_t height, std::uint8_t* rgba, size_t rgbaRowPitch, bool parallel = true);
+
+	// Tightly packed width * height RGBA8 copy of a DDS subresource (depth slice 0), empty when the format is not supported.
+	std::vector<std::uint8_t> DecodeSubresource(DXGI_FORMAT format, const DDS::Subresource& surface, bool parallel = true);
+
+	// Random access to single texels, decoding the 4x4 block around them on demand.
+	// Direct mapped on the block coordinates, not thread safe: use one cache per thread.
+	class BlockCache
+	{
+	public:
+		// capacity is rounded up to a power of two blocks
+		BlockCache(DXGI_FORMAT format, const DDS::Subresource& surface, std::uint32_t capacity = 64);
+
+		// RGBA8 texel packed as R | G << 8 | B << 16 | A << 24, coordinates are clamped to the surface.
+		std::uint32_t Fetch(std::uint32_t x, std::uint32_t y);
+
+		std::uint64_t Hits() const { return mHits; }
+		std::uint64_t Misses() const { return mMisses; }
+
+	private:
+		struct Entry
+		{
+			std::uint32_t Block = UINT32_MAX;
+			std::uint32_t Texels[16];
+		};
+
+		DXGI_FORMAT mFormat;
+		DDS::Subresource mSurface;
+		std::uint32_t mBlocksWide = 0;
+		std::vector<Entry> mEntries;
+		std::uint64_t mHits = 0;
+		std::uint64_t mMisses = 0;
+	};
+
+	struct DecodeThroughput
+	{
+		DXGI_FORMAT Format = DXGI_FORMAT_UNKNOWN;
+		std::uint64_t Texels = 0;
+		double Ms = 0.0;
+
+		double MTexelsPerSecond() const { return Ms > 0.0 ? Texels / (Ms * 1000.0) : 0.0; }
+	};
+
+	// Decodes a width x height surface of pseudo random blocks iterations times.
+	DecodeThroughput MeasureThroughput(DXGI_FORMAT format, std::uint32_t width, std::uint32_t height,
+		int iterations, bool parallel);
+}
@@ -0,0 +1,675 @@
+﻿#include "Benchmarks.h"
+#include "FrameResource.hpp"
+#include "GeometryArena.h"
+#include "GeometryGenerator.h"
+#include "ModelImport.h"
+#include "SceneBVH.h"
+#include "UploadBufferResource.h"
+#include "..\ImGui\imgui.h"
+#include <atomic>
+#include <chrono>
+#include <crtdbg.h>
+
+namespace
+{
+	template<typename TMesh>
+	void MergeMeshesRange(const std::vector<TMesh>& src,
+		size_t begin, size_t end,
+		std::vector<Vertex>& outVertices,
+		std::vector<uint32_t>& outIndices)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			const auto& m = src[i];
+
+			// 当前子网格加入前，记录 base
+			const uint32_t baseVertex = static_cast<uint32_t>(outVertices.size());
+
+			// 追加顶点
+			outVertices.insert(outVertices.end(), m.vertices.begin(), m.vertices.end());
+
+			// 追加索引（加上 base 偏移）
+			outIndices.reserve(outIndices.size() + m.indices.size());
+			for (auto idx : m.indices)
+				outIndices.push_back(static_cast<uint32_t>(idx) + baseVertex);
+		}
+	}
+
+	// The model path used before GeometryArena: per mesh vectors, merged vectors, then the blobs.
+	GeometryBuildStats MeasureLegacyModelBuild(const char* modelFilename)
+	{
+		GeometryBuildStats stats;
+		UINT64 live = 0;
+		auto track = [&](UINT64 bytes, UINT64 copied)
+		{
+			live += bytes;
+			stats.PeakBytes = MathHelper::Max(stats.PeakBytes, live);
+			stats.CopiedBytes += copied;
+		};
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		std::vector<Mesh> loaded;
+		LoadModels(modelFilename, loaded);
+		for (const Mesh& m : loaded)
+		{
+			track(m.vertices.capacity() * sizeof(Vertex) + m.indices.capacity() * sizeof(uint32_t),
+				m.vertices.size() * sizeof(Vertex) + m.indices.size() * sizeof(uint32_t));
+		}
+
+		std::vector<Vertex> gunVerts;      gunVerts.reserve(1 << 16);
+		std::vector<uint32_t> gunIndices;  gunIndices.reserve(1 << 16);
+		MergeMeshesRange(loaded, 0, loaded.size(), gunVerts, gunIndices);
+		std::vector<Vertex> caveVerts;      caveVerts.reserve(1 << 16);
+		std::vector<uint32_t> caveIndices;  caveIndices.reserve(1 << 16);
+		track((gunVerts.capacity() + caveVerts.capacity()) * sizeof(Vertex) + (gunIndices.capacity() + caveIndices.capacity()) * sizeof(uint32_t),
+			gunVerts.size() * sizeof(Vertex) + gunIndices.size() * sizeof(uint32_t));
+
+		std::vector<Vertex> vertices;
+		vertices.reserve(gunVerts.size());
+		vertices.insert(vertices.end(), gunVerts.begin(), gunVerts.end());
+		std::vector<uint32_t> indices32;
+		indices32.reserve(gunIndices.size());
+		indices32.insert(indices32.end(), gunIndices.begin(), gunIndices.end());
+		track(vertices.capacity() * sizeof(Vertex) + indices32.capacity() * sizeof(uint32_t),
+			vertices.size() * sizeof(Vertex) + indices32.size() * sizeof(uint32_t));
+
+		const UINT vbByteSize = static_cast<UINT>(vertices.size() * sizeof(Vertex));
+		const UINT ibByteSize = static_cast<UINT>(indices32.size() * sizeof(uint32_t));
+		ComPtr<ID3DBlob> vb, ib;
+		ThrowIfFailed(D3DCreateBlob(vbByteSize, &vb));
+		ThrowIfFailed(D3DCreateBlob(ibByteSize, &ib));
+		memcpy(vb->GetBufferPointer(), vertices.data(), vbByteSize);
+		memcpy(ib->GetBufferPointer(), indices32.data(), ibByteSize);
+		track(vbByteSize + ibByteSize, vbByteSize + ibByteSize);
+
+		auto end = std::chrono::high_resolution_clock::now();
+		stats.BuildMs = std::chrono::duration<double, std::milli>(end - start).count();
+		return stats;
+	}
+
+	GeometryBuildStats MeasureArenaModelBuild(const char* modelFilename)
+	{
+		GeometryBuildStats stats;
+		auto start = std::chrono::high_resolution_clock::now();
+
+		ModelImport model = ImportModel(modelFilename);
+		GeometryArena arena("modelGeo", model.VertexCount, GeometryArena::IndexBytesFor(model.VertexCount, model.IndexCount));
+		ArenaSubmesh gun = arena.Allocate("gun", model.VertexCount, model.IndexCount);
+		WriteModel(model, gun);
+		stats.PeakBytes = arena.CapacityBytes();
+		stats.CopiedBytes = arena.UsedBytes();
+		std::unique_ptr<MeshGeometry> geo = arena.Release();
+
+		auto end = std::chrono::high_resolution_clock::now();
+		stats.BuildMs = std::chrono::duration<double, std::milli>(end - start).count();
+		return stats;
+	}
+
+	// Times shape generation at sizes well beyond what the scene uses, on one thread and on all of them.
+	std::vector<GeneratorTiming> MeasureGeometryGenerator()
+	{
+		auto measure = [](const char* shape, auto create)
+		{
+			GeneratorTiming timing;
+			timing.Shape = shape;
+			for (bool parallel : { false, true })
+			{
+				GeometryGenerator geoGen(parallel);
+				auto start = std::chrono::high_resolution_clock::now();
+				GeometryGenerator::MeshData mesh = create(geoGen);
+				auto end = std::chrono::high_resolution_clock::now();
+				(parallel ? timing.ParallelMs : timing.SerialMs) = std::chrono::duration<double, std::milli>(end - start).count();
+				timing.Vertices = mesh.Vertices.size();
+				timing.Indices = mesh.Indices32.size();
+			}
+			return timing;
+		};
+
+		std::vector<GeneratorTiming> timings;
+		timings.push_back(measure("Geosphere, 6 levels", [](GeometryGenerator& g) { return g.CreateGeosphere(1.0f, 6); }));
+		timings.push_back(measure("Geosphere, 8 levels", [](GeometryGenerator& g) { return g.CreateGeosphere(1.0f, 8); }));
+		timings.push_back(measure("Grid 4096x4096", [](GeometryGenerator& g) { return g.CreateGrid(100.0f, 100.0f, 4096, 4096); }));
+		timings.push_back(measure("Sphere 2048x2048", [](GeometryGenerator& g) { return g.CreateSphere(1.0f, 2048, 2048); }));
+		timings.push_back(measure("Cylinder 2048x2048", [](GeometryGenerator& g) { return g.CreateCylinder(1.0f, 0.5f, 3.0f, 2048, 2048); }));
+		return timings;
+	}
+
+#ifdef _DEBUG
+	std::atomic<UINT64> gAllocationCount{ 0 };
+
+	int CountAllocation(int allocType, void*, size_t, int, long, const unsigned char*, int)
+	{
+		if (allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC)
+			++gAllocationCount;
+		return TRUE;
+	}
+#endif
+
+	// Generates the shapes of BuildGeometry into one preallocated vertex/index buffer, either through
+	// MeshData and a field by field copy (the old path) or straight through a LayoutSink.
+	ShapeBuildTiming MeasureShapeBuild(bool direct, int iterations)
+	{
+		GeometryGenerator geoGen;
+		const GeometryGenerator::MeshSize sizes[] =
+		{
+			GeometryGenerator::BoxSize(3), GeometryGenerator::GridSize(60, 40), GeometryGenerator::GeosphereSize(3),
+			GeometryGenerator::CylinderSize(20, 20), GeometryGenerator::QuadSize(),
+		};
+		size_t vertexCount = 0, indexCount = 0;
+		for (const auto& size : sizes)
+		{
+			vertexCount += size.VertexCount;
+			indexCount += size.IndexCount;
+		}
+		std::vector<Vertex> vertices(vertexCount);
+		std::vector<std::uint32_t> indices(indexCount);
+
+		auto build = [&]()
+		{
+			Vertex* v = vertices.data();
+			std::uint32_t* i = indices.data();
+			auto emit = [&](const GeometryGenerator::MeshSize& size, auto create)
+			{
+				GeometryGenerator::LayoutSink<Vertex, std::uint32_t> sink{ v, i };
+				if (direct)
+				{
+					create(sink);
+				}
+				else
+				{
+					GeometryGenerator::MeshData mesh = create();
+					for (size_t k = 0; k < mesh.Vertices.size(); ++k)
+						sink.SetVertex((UINT)k, mesh.Vertices[k]);
+					const std::vector<std::uint16_t>& indices16 = mesh.GetIndices16();
+					for (size_t k = 0; k < indices16.size(); ++k)
+						sink.SetIndex(k, indices16[k]);
+				}
+				v += size.VertexCount;
+				i += size.IndexCount;
+			};
+			emit(sizes[0], [&](auto&... sink) { return geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3, sink...); });
+			emit(sizes[1], [&](auto&... sink) { return geoGen.CreateGrid(20.0f, 30.0f, 60, 40, sink...); });
+			emit(sizes[2], [&](auto&... sink) { return geoGen.CreateGeosphere(0.5f, 3, sink...); });
+			emit(sizes[3], [&](auto&... sink) { return geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20, sink...); });
+			emit(sizes[4], [&](auto&... sink) { return geoGen.CreateQuad(0.5f, 1.0f, 0.5f, 0.5f, 0.0f, sink...); });
+		};
+
+		ShapeBuildTiming timing;
+#ifdef _DEBUG
+		gAllocationCount = 0;
+		_CRT_ALLOC_HOOK previousHook = _CrtSetAllocHook(CountAllocation);
+#endif
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int k = 0; k < iterations; ++k)
+			build();
+		auto end = std::chrono::high_resolution_clock::now();
+#ifdef _DEBUG
+		_CrtSetAllocHook(previousHook);
+		timing.AllocationsPerCall = (double)gAllocationCount / iterations;
+#endif
+
+		timing.MsPerCall = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+		timing.MVerticesPerSecond = vertexCount / (timing.MsPerCall * 1000.0);
+		return timing;
+	}
+
+	// Random boxes at a constant density, so the frustum sees about the same share of them at every count.
+	// Queries look out of the middle of the cloud in eight directions and are averaged.
+	std::vector<BvhTiming> MeasureSceneBvh()
+	{
+		const BoundingFrustum viewFrustum(XMMatrixPerspectiveFovLH(0.25f * MathHelper::Pi, 16.0f / 9.0f, 1.0f, 1000.0f));
+		const int directions = 8;
+
+		std::vector<BvhTiming> timings;
+		for (UINT count : { 1000u, 100000u, 1000000u })
+		{
+			const float side = 4.0f * cbrtf((float)count);
+			std::vector<BoundingBox> boxes(count);
+			for (auto& box : boxes)
+			{
+				box.Center = XMFLOAT3(MathHelper::RandF(-0.5f, 0.5f) * side, MathHelper::RandF(-0.5f, 0.5f) * side, MathHelper::RandF(-0.5f, 0.5f) * side);
+				box.Extents = XMFLOAT3(MathHelper::RandF(0.25f, 1.0f), MathHelper::RandF(0.25f, 1.0f), MathHelper::RandF(0.25f, 1.0f));
+			}
+
+			BvhTiming timing;
+			timing.Instances = count;
+
+			SceneBVH bvh;
+			auto start = std::chrono::high_resolution_clock::now();
+			bvh.Build(boxes.data(), count);
+			auto end = std::chrono::high_resolution_clock::now();
+			timing.BuildMs = std::chrono::duration<double, std::milli>(end - start).count();
+			timing.Nodes = bvh.NodeCount();
+			timing.Depth = bvh.Depth();
+
+			start = std::chrono::high_resolution_clock::now();
+			for (UINT i = 0; i < count / 100; ++i)
+			{
+				UINT p = (((UINT)rand() << 15) | (UINT)rand()) % count;
+				boxes[p].Center.x += MathHelper::RandF(-1.0f, 1.0f);
+				boxes[p].Center.y += MathHelper::RandF(-1.0f, 1.0f);
+				bvh.SetBounds(p, boxes[p]);
+			}
+			bvh.Refit();
+			end = std::chrono::high_resolution_clock::now();
+			timing.RefitMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+			std::vector<UINT> visible;
+			visible.reserve(count);
+			for (int d = 0; d < directions; ++d)
+			{
+				BoundingFrustum frustum;
+				viewFrustum.Transform(frustum, XMMatrixRotationY(d * XM_2PI / directions));
+
+				visible.clear();
+				start = std::chrono::high_resolution_clock::now();
+				bvh.Query(frustum, XMVectorZero(), visible);
+				end = std::chrono::high_resolution_clock::now();
+				timing.QueryMs += std::chrono::duration<double, std::milli>(end - start).count() / directions;
+				timing.Visible += (UINT)visible.size() / directions;
+
+				UINT bruteForceVisible = 0;
+				start = std::chrono::high_resolution_clock::now();
+				for (const auto& box : boxes)
+					bruteForceVisible += frustum.Intersects(box) ? 1 : 0;
+				end = std::chrono::high_resolution_clock::now();
+				timing.BruteForceMs += std::chrono::duration<double, std::milli>(end - start).count() / directions;
+				timing.BruteForceVisible += bruteForceVisible / directions;
+			}
+			timings.push_back(timing);
+		}
+		return timings;
+	}
+}
+
+const Benchmarks::Entry Benchmarks::sEntries[] =
+{
+	{ "Geometry Build", &Benchmarks::ShowGeometryBuild },
+	{ "Texture Decode", &Benchmarks::ShowTextureDecode },
+	{ "Indirect Draws", &Benchmarks::ShowIndirectDraws },
+	{ "Render Graph", &Benchmarks::ShowRenderGraph },
+	{ "Barriers", &Benchmarks::ShowBarriers },
+	{ "Job System", &Benchmarks::ShowJobSystem },
+	{ "Material Table", &Benchmarks::ShowMaterialTable },
+	{ "Resource Registry", &Benchmarks::ShowResourceRegistry },
+	{ "Scene Store", &Benchmarks::ShowSceneStore },
+	{ "Render Queue", &Benchmarks::ShowRenderQueue },
+	{ "Instance Buffer", &Benchmarks::ShowInstanceBuffer },
+	{ "Scene BVH", &Benchmarks::ShowSceneBvh },
+};
+
+void Benchmarks::Show(const BenchmarkContext& context)
+{
+	ImGui::Begin("Benchmarks");
+	for (const Entry& entry : sEntries)
+	{
+		if (ImGui::CollapsingHeader(entry.Name))
+			(this->*entry.Panel)(context);
+	}
+	ImGui::End();
+}
+
+void Benchmarks::ShowGeometryBuild(const BenchmarkContext&)
+{
+	if (ImGui::Button("Compare With Legacy Path"))
+	{
+		mLegacyBuildStats = MeasureLegacyModelBuild("Models/Cyborg_Weapon.fbx");
+		mArenaBuildStats = MeasureArenaModelBuild("Models/Cyborg_Weapon.fbx");
+	}
+	if (mLegacyBuildStats.PeakBytes > 0)
+	{
+		ImGui::Text("Arena:  %.2f ms  peak %.2f KB  copied %.2f KB",
+			mArenaBuildStats.BuildMs, mArenaBuildStats.PeakBytes / 1024.0, mArenaBuildStats.CopiedBytes / 1024.0);
+		ImGui::Text("Legacy: %.2f ms  peak %.2f KB  copied %.2f KB",
+			mLegacyBuildStats.BuildMs, mLegacyBuildStats.PeakBytes / 1024.0, mLegacyBuildStats.CopiedBytes / 1024.0);
+	}
+
+	if (ImGui::Button("Benchmark Geometry Generator"))
+		mGeneratorTimings = MeasureGeometryGenerator();
+	for (const GeneratorTiming& timing : mGeneratorTimings)
+	{
+		ImGui::Text("%s: %zu verts, %zu indices", timing.Shape, timing.Vertices, timing.Indices);
+		ImGui::Text("  %.1f ms serial, %.1f ms parallel", timing.SerialMs, timing.ParallelMs);
+	}
+
+	if (ImGui::Button("Compare Shape Build Paths"))
+	{
+		mMeshDataShapeBuild = MeasureShapeBuild(false, 200);
+		mDirectShapeBuild = MeasureShapeBuild(true, 200);
+	}
+	if (mDirectShapeBuild.MsPerCall > 0.0)
+	{
+		const std::pair<const char*, const ShapeBuildTiming*> paths[] =
+		{
+			{ "MeshData", &mMeshDataShapeBuild },
+			{ "Direct", &mDirectShapeBuild },
+		};
+		for (const auto& path : paths)
+		{
+			if (path.second->AllocationsPerCall >= 0.0)
+				ImGui::Text("%-8s %.3f ms  %.1f MVerts/s  %.0f allocations", path.first,
+					path.second->MsPerCall, path.second->MVerticesPerSecond, path.second->AllocationsPerCall);
+			else
+				ImGui::Text("%-8s %.3f ms  %.1f MVerts/s", path.first, path.second->MsPerCall, path.second->MVerticesPerSecond);
+		}
+	}
+}
+
+void Benchmarks::ShowTextureDecode(const BenchmarkContext&)
+{
+	if (ImGui::Button("Run Decode Benchmark"))
+		RunTextureDecode();
+	for (size_t i = 0; i < mDecodeSerial.size(); ++i)
+	{
+		ImGui::Text("%-9s %8.1f MTexel/s  %8.1f MTexel/s (parallel)", BC::FormatName(mDecodeSerial[i].Format),
+			mDecodeSerial[i].MTexelsPerSecond(), mDecodeParallel[i].MTexelsPerSecond());
+	}
+	if (mCaveDecodeMips > 0)
+	{
+		ImGui::Text("cave_albedo.dds: %u mips in %.2f ms", mCaveDecodeMips, mCaveDecodeMs);
+		ImGui::Text("Block cache hit rate (random taps): %.1f%%", mCacheHitRate * 100.0);
+	}
+}
+
+void Benchmarks::RunTextureDecode()
+{
+	const DXGI_FORMAT formats[] =
+	{
+		DXGI_FORMAT_BC1_UNORM, DXGI_FORMAT_BC2_UNORM, DXGI_FORMAT_BC3_UNORM,
+		DXGI_FORMAT_BC4_UNORM, DXGI_FORMAT_BC5_UNORM, DXGI_FORMAT_BC7_UNORM,
+	};
+	mDecodeSerial.clear();
+	mDecodeParallel.clear();
+	for (DXGI_FORMAT format : formats)
+	{
+		mDecodeSerial.push_back(BC::MeasureThroughput(format, 1024, 1024, 4, false));
+		mDecodeParallel.push_back(BC::MeasureThroughput(format, 1024, 1024, 4, true));
+	}
+
+	// Real asset: the whole mip chain of the cave albedo, then random taps through the block cache
+	DDS::Reader reader;
+	if (reader.Open("Models/cave/cave_albedo.dds") != DDS::Result::Ok || !BC::IsSupported(reader.Desc().Format))
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (UINT mip = 0; mip < reader.Desc().MipLevels; ++mip)
+		BC::DecodeSubresource(reader.Desc().Format, reader.GetSubresource(mip, 0));
+	auto end = std::chrono::high_resolution_clock::now();
+	mCaveDecodeMs = std::chrono::duration<double, std::milli>(end - start).count();
+	mCaveDecodeMips = reader.Desc().MipLevels;
+
+	// Clustered taps, like a bilinear footprint walking over the surface
+	const DDS::Subresource& top = reader.GetSubresource(0, 0);
+	BC::BlockCache cache(reader.Desc().Format, top);
+	UINT x = 0, y = 0;
+	for (int i = 0; i < 1 << 16; ++i)
+	{
+		x = (x + MathHelper::Rand(0, 3)) % top.Width;
+		y = (y + MathHelper::Rand(0, 3)) % top.Height;
+		cache.Fetch(x, y);
+		cache.Fetch(x + 1, y + 1);
+	}
+	mCacheHitRate = (double)cache.Hits() / (cache.Hits() + cache.Misses());
+}
+
+void Benchmarks::ShowIndirectDraws(const BenchmarkContext& context)
+{
+	if (ImGui::Button("Benchmark Indirect Arguments"))
+	{
+		// 1M instances into scratch upload buffers, over few large and many small draws
+		const UINT instances = 1000000;
+		const UINT maxDraws = 100000;
+		UploadBufferResource<IndirectDraws::Command> commands(context.Device, maxDraws, false);
+		UploadBufferResource<std::uint32_t> slots(context.Device, instances, false);
+		IndirectDraws::Output out;
+		out.Commands = commands.MappedData();
+		out.Slots = slots.MappedData();
+		out.SlotsAddress = slots.Resource()->GetGPUVirtualAddress();
+		mIndirectTimings.clear();
+		for (UINT draws : { 1000u, 16384u, maxDraws })
+			mIndirectTimings.push_back(IndirectDraws::Measure(draws, instances, out, 10, *context.Jobs));
+	}
+	for (const IndirectDraws::Timing& timing : mIndirectTimings)
+	{
+		ImGui::Text("%u draws, %u instances: serial %.3f ms  parallel %.3f ms  kept %u  errors %u", timing.Draws,
+			timing.Instances, timing.SerialMs, timing.ParallelMs, timing.KeptDraws, timing.Errors);
+	}
+}
+
+void Benchmarks::ShowRenderGraph(const BenchmarkContext&)
+{
+	if (ImGui::Button("Compile 1080p and 4K Frames"))
+	{
+		mFrameGraphMemory = MeasureDeferredFrameMemory();
+		mRenderGraphFailure.clear();
+		mRenderGraphFailures = VerifyRenderGraph(&mRenderGraphFailure);
+	}
+	for (const RenderGraphMemory& memory : mFrameGraphMemory)
+	{
+		ImGui::Text("%ux%u %s: %u transients, %.1f MB separate, %.1f MB aliased", memory.Width, memory.Height,
+			memory.Ssr ? "SSR" : "no SSR", memory.Stats.Transients, memory.Stats.TransientBytes / 1048576.0,
+			memory.Stats.AliasedBytes / 1048576.0);
+	}
+	if (!mFrameGraphMemory.empty())
+		ImGui::Text("Graph checks failed: %u %s", mRenderGraphFailures, mRenderGraphFailure.c_str());
+}
+
+void Benchmarks::ShowBarriers(const BenchmarkContext&)
+{
+	if (ImGui::Button("Plan 1080p and 4K Barriers"))
+	{
+		mBarrierReports.clear();
+		mBarrierReports.push_back(MeasureDeferredFrameBarriers(1920, 1080));
+		mBarrierReports.push_back(MeasureDeferredFrameBarriers(3840, 2160));
+		mStateTrackerFailure.clear();
+		mStateTrackerFailures = VerifyResourceStateTracker(&mStateTrackerFailure);
+	}
+	for (const BarrierReport& report : mBarrierReports)
+	{
+		ImGui::Text("%u HiZ mips: hand written %u calls", report.HiZMips, report.HandCalls);
+		ImGui::Text("  tracked: %u calls, %u barriers, %u uses covered", report.Tracked.Calls, report.Tracked.Barriers,
+			report.Tracked.CoveredUses);
+		ImGui::Text("  split: %u calls, %u barriers, %u transitions split", report.TrackedSplit.Calls,
+			report.TrackedSplit.Barriers, report.TrackedSplit.Split);
+	}
+	if (!mBarrierReports.empty())
+		ImGui::Text("Tracker checks failed: %u %s", mStateTrackerFailures, mStateTrackerFailure.c_str());
+}
+
+void Benchmarks::ShowJobSystem(const BenchmarkContext&)
+{
+	if (ImGui::Button("Benchmark Job System"))
+	{
+		mJobTimings.clear();
+		for (UINT threads : { 1u, 2u, 4u, 8u, 16u, 32u })
+			mJobTimings.push_back(MeasureJobSystem(threads, 100000, 1u << 20, 5));
+	}
+	for (const JobThroughput& timing : mJobTimings)
+	{
+		ImGui::Text("%2u threads: empty job %.1f ns  parallel for %.2f ms (%.2fx)  stolen %llu", timing.Threads,
+			timing.NsPerJob(), timing.ParallelForMs, timing.ParallelForMs > 0.0 ? mJobTimings[0].ParallelForMs / timing.ParallelForMs : 0.0,
+			(unsigned long long)timing.Stolen);
+	}
+}
+
+void Benchmarks::ShowMaterialTable(const BenchmarkContext& context)
+{
+	if (ImGui::Button("Benchmark Material Upload"))
+	{
+		// 10k materials into scratch upload buffers, one per frame resource
+		const UINT count = 10000;
+		std::vector<std::unique_ptr<UploadBufferResource<MaterialData>>> buffers;
+		std::vector<MaterialData*> records;
+		for (int i = 0; i < context.FrameResourceCount; ++i)
+		{
+			buffers.push_back(std::make_unique<UploadBufferResource<MaterialData>>(context.Device, count, false));
+			records.push_back(buffers.back()->MappedData());
+		}
+		mMaterialUploadTimings.clear();
+		for (UINT changed : { 0u, 10u, 100u, 1000u, count })
+		{
+			mMaterialUploadTimings.push_back(MeasureMaterialUpload(records.data(), context.FrameResourceCount, count, changed, false, 100));
+			mMaterialUploadTimings.push_back(MeasureMaterialUpload(records.data(), context.FrameResourceCount, count, changed, true, 100));
+		}
+	}
+	for (size_t i = 0; i < mMaterialUploadTimings.size(); ++i)
+	{
+		const MaterialUploadTiming& timing = mMaterialUploadTimings[i];
+		ImGui::Text("%u of %u changed (%s): map walk %.3f ms  table %.3f ms  %u runs", timing.Changed, timing.Materials,
+			i % 2 == 0 ? "scattered" : "block", timing.MapWalkMs, timing.TableMs, timing.Runs);
+	}
+}
+
+void Benchmarks::ShowResourceRegistry(const BenchmarkContext&)
+{
+	if (ImGui::Button("Benchmark Lookups"))
+	{
+		// About the PSO binds of one frame, then a scene that looks something up per draw
+		mRegistryTimings.clear();
+		for (UINT lookups : { 32u, 1000u, 100000u })
+			mRegistryTimings.push_back(MeasureRegistryLookups(64, lookups, 100));
+	}
+	for (const RegistryLookupTiming& timing : mRegistryTimings)
+	{
+		ImGui::Text("%u lookups/frame: string map %.2f us (%u allocations)  handles %.2f us (%u allocations)",
+			timing.LookupsPerFrame, timing.StringMapUs, timing.StringAllocations, timing.HandleUs, timing.HandleAllocations);
+	}
+}
+
+void Benchmarks::ShowSceneStore(const BenchmarkContext&)
+{
+	if (ImGui::Button("Benchmark Scene Store"))
+	{
+		mSceneStoreTimings.clear();
+		for (UINT count : { 10000u, 100000u, 1000000u })
+			mSceneStoreTimings.push_back(MeasureSceneStore(count, count >= 1000000u ? 3 : 10));
+	}
+	for (const SceneStoreTiming& timing : mSceneStoreTimings)
+	{
+		ImGui::Text("%u instances in %u items", timing.Instances, timing.Items);
+		ImGui::Text("  update: items %.3f ms  store %.3f ms", timing.ItemUpdateMs, timing.StoreUpdateMs);
+		ImGui::Text("  cull: items %.3f ms  store %.3f ms  store SIMD %.3f ms  visible %u / %u", timing.ItemCullMs,
+			timing.StoreCullMs, timing.StoreSimdMs, timing.ItemVisible, timing.StoreVisible);
+	}
+}
+
+void Benchmarks::ShowRenderQueue(const BenchmarkContext&)
+{
+	if (ImGui::Button("Benchmark Render Queue"))
+	{
+		mRenderQueueTimings.clear();
+		for (UINT count : { 10000u, 100000u, 1000000u })
+			mRenderQueueTimings.push_back(MeasureRenderQueue(count, 5));
+	}
+	for (const RenderQueueTiming& timing : mRenderQueueTimings)
+	{
+		ImGui::Text("%u items: radix %.3f ms  std::sort %.3f ms  state changes %u unsorted, %u sorted", timing.Items,
+			timing.RadixMs, timing.StdSortMs, timing.Unsorted.Total(), timing.Sorted.Total());
+	}
+}
+
+void Benchmarks::ShowInstanceBuffer(const BenchmarkContext& context)
+{
+	if (ImGui::Button("Benchmark Instance Update"))
+	{
+		// Into scratch upload buffers, so the timings include writing to write combined memory
+		const UINT count = 100000;
+		UploadBufferResource<InstanceData> fullScratch(context.Device, count, false);
+		UploadBufferResource<PackedInstance> scratch(context.Device, count, false);
+		mInstanceUploadTimings.clear();
+		for (UINT changed : { count / 100, count })
+			mInstanceUploadTimings.push_back(MeasureInstanceUpload(fullScratch.MappedData(), scratch.MappedData(), count, changed, 10, *context.Jobs));
+	}
+	for (const InstanceUploadTiming& timing : mInstanceUploadTimings)
+	{
+		ImGui::Text("%u of %u changed: full %.3f ms %.1f MB  packed %.3f ms %.1f MB  dirty only %.3f ms %.1f MB",
+			timing.Changed, timing.Instances, timing.FullMs, timing.FullBytes / 1048576.0, timing.PackedMs,
+			timing.PackedBytes / 1048576.0, timing.DirtyMs, timing.DirtyBytes / 1048576.0);
+	}
+
+	if (ImGui::Button("Verify Instance Packing"))
+		mInstancePackingError = VerifyInstancePacking(10000);
+	if (mInstancePackingError.Instances > 0)
+	{
+		const InstancePackingError& error = mInstancePackingError;
+		ImGui::Text("%u instances: position %.2e  normal %.3f deg  texC %.2e  bad indices %u", error.Instances,
+			error.Position, error.NormalDeg, error.TexC, error.BadIndices);
+	}
+}
+
+void Benchmarks::ShowSceneBvh(const BenchmarkContext& context)
+{
+	if (ImGui::Button("Benchmark BVH"))
+		mBvhTimings = MeasureSceneBvh();
+	for (const BvhTiming& timing : mBvhTimings)
+	{
+		ImGui::Text("%u instances: %u nodes, depth %u", timing.Instances, timing.Nodes, timing.Depth);
+		ImGui::Text("  build %.2f ms  refit 1%% %.3f ms", timing.BuildMs, timing.RefitMs);
+		ImGui::Text("  query %.3f ms (%u visible)  brute force %.3f ms (%u visible)",
+			timing.QueryMs, timing.Visible, timing.BruteForceMs, timing.BruteForceVisible);
+	}
+
+	if (ImGui::Button("Benchmark Culling Kernel"))
+	{
+		mCullTimings.clear();
+		for (UINT count : { 10000u, 100000u, 1000000u })
+			mCullTimings.push_back(Culling::MeasureThroughput(count, 10, *context.Jobs));
+	}
+	for (const Culling::CullThroughput& timing : mCullTimings)
+	{
+		ImGui::Text("%u boxes: scalar %.3f ms  SoA %.3f ms (%.1fx)  threads %.3f ms", timing.Boxes,
+			timing.ScalarMs, timing.SimdMs, timing.Speedup(), timing.ParallelMs);
+		ImGui::Text("  visible %u scalar / %u SoA", timing.ScalarVisible, timing.SimdVisible);
+	}
+
+	if (ImGui::Button("Benchmark Multi-View Culling"))
+	{
+		mMultiViewTimings.clear();
+		for (UINT count : { 10000u, 100000u, 1000000u })
+			mMultiViewTimings.push_back(Culling::MeasureViews(count, 10));
+	}
+	for (const Culling::MultiViewThroughput& timing : mMultiViewTimings)
+	{
+		ImGui::Text("%u boxes, %u views: one by one %.3f ms  single pass %.3f ms (%.2fx)", timing.Boxes, timing.Views,
+			timing.SeparateMs, timing.CombinedMs, timing.Speedup());
+		ImGui::Text("  visible main %u  shadow %u  cube faces %u %u %u %u %u %u", timing.CombinedVisible[0], timing.CombinedVisible[1],
+			timing.CombinedVisible[2], timing.CombinedVisible[3], timing.CombinedVisible[4],
+			timing.CombinedVisible[5], timing.CombinedVisible[6], timing.CombinedVisible[7]);
+	}
+}
+
+int RunRenderGraphReport()
+{
+	std::ofstream out("RenderGraph.txt");
+	std::string failure;
+	const UINT failures = VerifyRenderGraph(&failure);
+	out << "graph checks failed: " << failures << " " << failure << "\n";
+	out << "width, height, ssr, passes, culled passes, transients, separate MB, aliased MB, peak live MB\n";
+	for (const RenderGraphMemory& memory : MeasureDeferredFrameMemory())
+	{
+		out << memory.Width << ", " << memory.Height << ", " << memory.Ssr << ", " << memory.Stats.Passes << ", "
+			<< memory.Stats.CulledPasses << ", " << memory.Stats.Transients << ", " << memory.Stats.TransientBytes / 1048576.0
+			<< ", " << memory.Stats.AliasedBytes / 1048576.0 << ", " << memory.Stats.PeakLiveBytes / 1048576.0 << "\n";
+	}
+	return (int)failures;
+}
+
+int RunBarrierReport()
+{
+	std::ofstream out("Barriers.txt");
+	std::string failure;
+	const UINT failures = VerifyResourceStateTracker(&failure);
+	out << "tracker checks failed: " << failures << " " << failure << "\n";
+	out << "width, height, hiz mips, hand written calls, tracked calls, tracked barriers, covered uses, "
+		"split calls, split barriers, split transitions\n";
+	const UINT sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+	for (const auto& size : sizes)
+	{
+		const BarrierReport report = MeasureDeferredFrameBarriers(size[0], size[1]);
+		out << size[0] << ", " << size[1] << ", " << report.HiZMips << ", " << report.HandCalls << ", "
+			<< report.Tracked.Calls << ", " << report.Tracked.Barriers << ", " << report.Tracked.CoveredUses << ", "
+			<< report.TrackedSplit.Calls << ", " << report.TrackedSplit.Barriers << ", " << report.TrackedSplit.Split << "\n";
+	}
+	return (int)failures;
+}
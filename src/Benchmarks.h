@@ -0,0 +1,131 @@
+#pragma once
+#include "DXHelper.h"
+#include "BCDecoder.h"
+#include "FrustumCulling.h"
+#include "IndirectDraws.h"
+#include "InstanceRecords.h"
+#include "JobSystem.h"
+#include "MaterialTable.h"
+#include "RenderGraph.h"
+#include "RenderQueue.h"
+#include "ResourceRegistry.h"
+#include "ResourceStateTracker.h"
+#include "SceneStore.h"
+
+// What the benchmarks borrow from the app. They measure scratch data of their own and leave the scene alone.
+struct BenchmarkContext
+{
+	ID3D12Device* Device = nullptr;
+	JobSystem* Jobs = nullptr;
+	int FrameResourceCount = 1;
+};
+
+struct GeometryBuildStats
+{
+	double BuildMs = 0.0;    // import included, GPU upload excluded
+	UINT64 PeakBytes = 0;    // CPU geometry memory alive at once, Assimp's scene not counted
+	UINT64 CopiedBytes = 0;  // bytes written between the scene and the final blobs
+};
+
+struct GeneratorTiming
+{
+	const char* Shape = "";
+	size_t Vertices = 0;
+	size_t Indices = 0;
+	double SerialMs = 0.0;
+	double ParallelMs = 0.0;
+};
+
+struct ShapeBuildTiming
+{
+	double MsPerCall = 0.0;
+	double MVerticesPerSecond = 0.0;
+	double AllocationsPerCall = -1.0; // counted through the debug CRT only
+};
+
+struct BvhTiming
+{
+	UINT Instances = 0;
+	UINT Nodes = 0;
+	UINT Depth = 0;
+	double BuildMs = 0.0;
+	double RefitMs = 0.0;      // after moving 1% of the instances
+	double QueryMs = 0.0;
+	double BruteForceMs = 0.0; // BoundingFrustum::Intersects against every box
+	UINT Visible = 0;
+	UINT BruteForceVisible = 0; // lower than Visible by the boxes the plane test can not reject
+};
+
+// The measurement harnesses of the subsystems, in a window of their own next to the debug window. Every entry of
+// the dispatch table draws one collapsing header whose buttons run its measurements, the results are kept until
+// they run again.
+class Benchmarks
+{
+public:
+	void Show(const BenchmarkContext& context);
+
+private:
+	struct Entry
+	{
+		const char* Name;
+		void (Benchmarks::*Panel)(const BenchmarkContext& context);
+	};
+	static const Entry sEntries[];
+
+	void ShowGeometryBuild(const BenchmarkContext& context);
+	void ShowTextureDecode(const BenchmarkContext& context);
+	void ShowIndirectDraws(const BenchmarkContext& context);
+	void ShowRenderGraph(const BenchmarkContext& context);
+	void ShowBarriers(const BenchmarkContext& context);
+	void ShowJobSystem(const BenchmarkContext& context);
+	void ShowMaterialTable(const BenchmarkContext& context);
+	void ShowResourceRegistry(const BenchmarkContext& context);
+	void ShowSceneStore(const BenchmarkContext& context);
+	void ShowRenderQueue(const BenchmarkContext& context);
+	void ShowInstanceBuffer(const BenchmarkContext& context);
+	void ShowSceneBvh(const BenchmarkContext& context);
+
+	void RunTextureDecode();
+
+	GeometryBuildStats mLegacyBuildStats;
+	GeometryBuildStats mArenaBuildStats;
+	std::vector<GeneratorTiming> mGeneratorTimings;
+	ShapeBuildTiming mMeshDataShapeBuild;
+	ShapeBuildTiming mDirectShapeBuild;
+
+	std::vector<BC::DecodeThroughput> mDecodeSerial;
+	std::vector<BC::DecodeThroughput> mDecodeParallel;
+	double mCaveDecodeMs = 0.0;
+	UINT mCaveDecodeMips = 0;
+	double mCacheHitRate = 0.0;
+
+	std::vector<IndirectDraws::Timing> mIndirectTimings;
+
+	std::vector<RenderGraphMemory> mFrameGraphMemory;
+	UINT mRenderGraphFailures = 0;
+	std::string mRenderGraphFailure;
+	// The barriers of the deferred frame planned from declared states, against the hand written ones
+	std::vector<BarrierReport> mBarrierReports;
+	UINT mStateTrackerFailures = 0;
+	std::string mStateTrackerFailure;
+
+	std::vector<JobThroughput> mJobTimings;
+	std::vector<MaterialUploadTiming> mMaterialUploadTimings;
+	std::vector<RegistryLookupTiming> mRegistryTimings;
+	std::vector<SceneStoreTiming> mSceneStoreTimings;
+	std::vector<RenderQueueTiming> mRenderQueueTimings;
+	std::vector<InstanceUploadTiming> mInstanceUploadTimings;
+	InstancePackingError mInstancePackingError;
+
+	std::vector<BvhTiming> mBvhTimings;
+	std::vector<Culling::CullThroughput> mCullTimings;
+	std::vector<Culling::MultiViewThroughput> mMultiViewTimings;
+};
+
+// -render-graph-report: compiles the frame graph at 1080p and 4K without a device, runs the graph checks and
+// writes both to RenderGraph.txt. Returns the number of failed checks.
+int RunRenderGraphReport();
+
+// -barrier-report: plans the barriers of the frame at 1080p and 4K without a device, runs the tracker checks and
+// writes both to Barriers.txt. Returns the number of failed checks.
+int RunBarrierReport();
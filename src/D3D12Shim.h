@@ -0,0 +1,165 @@
+#pragma once
+
+// The D3D12 declarations of the modules that only plan GPU work (RenderGraph, ResourceStateTracker). They never
+// touch a device and record through ID3D12GraphicsCommandList::ResourceBarrier alone, so away from the Windows
+// SDK, where the tests build them, they use the stand-ins below. Values match d3d12.h and dxgiformat.h.
+#ifdef _WIN32
+#include "DXHelper.h"
+#else
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+typedef unsigned int UINT;
+typedef std::uint64_t UINT64;
+
+enum DXGI_FORMAT
+{
+	DXGI_FORMAT_UNKNOWN = 0,
+	DXGI_FORMAT_R32G32B32A32_FLOAT = 2,
+	DXGI_FORMAT_R16G16B16A16_FLOAT = 10,
+	DXGI_FORMAT_R16G16B16A16_UNORM = 11,
+	DXGI_FORMAT_R32G32_FLOAT = 16,
+	DXGI_FORMAT_R8G8B8A8_UNORM = 28,
+	DXGI_FORMAT_R32_FLOAT = 41,
+	DXGI_FORMAT_R24G8_TYPELESS = 44,
+	DXGI_FORMAT_D24_UNORM_S8_UINT = 45,
+	DXGI_FORMAT_R16_TYPELESS = 53,
+	DXGI_FORMAT_R16_FLOAT = 54,
+	DXGI_FORMAT_D16_UNORM = 55,
+	DXGI_FORMAT_R16_UNORM = 56,
+	DXGI_FORMAT_R8_UNORM = 61,
+};
+
+enum D3D12_RESOURCE_STATES
+{
+	D3D12_RESOURCE_STATE_COMMON = 0,
+	D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER = 0x1,
+	D3D12_RESOURCE_STATE_INDEX_BUFFER = 0x2,
+	D3D12_RESOURCE_STATE_RENDER_TARGET = 0x4,
+	D3D12_RESOURCE_STATE_UNORDERED_ACCESS = 0x8,
+	D3D12_RESOURCE_STATE_DEPTH_WRITE = 0x10,
+	D3D12_RESOURCE_STATE_DEPTH_READ = 0x20,
+	D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE = 0x40,
+	D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE = 0x80,
+	D3D12_RESOURCE_STATE_STREAM_OUT = 0x100,
+	D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT = 0x200,
+	D3D12_RESOURCE_STATE_COPY_DEST = 0x400,
+	D3D12_RESOURCE_STATE_COPY_SOURCE = 0x800,
+	D3D12_RESOURCE_STATE_RESOLVE_DEST = 0x1000,
+	D3D12_RESOURCE_STATE_RESOLVE_SOURCE = 0x2000,
+	D3D12_RESOURCE_STATE_GENERIC_READ = 0x1 | 0x2 | 0x40 | 0x80 | 0x200 | 0x800,
+	D3D12_RESOURCE_STATE_PRESENT = 0,
+};
+
+// What DEFINE_ENUM_FLAG_OPERATORS gives the state flags in the SDK
+inline D3D12_RESOURCE_STATES operator|(D3D12_RESOURCE_STATES a, D3D12_RESOURCE_STATES b) { return D3D12_RESOURCE_STATES((int)a | (int)b); }
+inline D3D12_RESOURCE_STATES operator&(D3D12_RESOURCE_STATES a, D3D12_RESOURCE_STATES b) { return D3D12_RESOURCE_STATES((int)a & (int)b); }
+inline D3D12_RESOURCE_STATES operator^(D3D12_RESOURCE_STATES a, D3D12_RESOURCE_STATES b) { return D3D12_RESOURCE_STATES((int)a ^ (int)b); }
+inline D3D12_RESOURCE_STATES operator~(D3D12_RESOURCE_STATES a) { return D3D12_RESOURCE_STATES(~(int)a); }
+inline D3D12_RESOURCE_STATES& operator|=(D3D12_RESOURCE_STATES& a, D3D12_RESOURCE_STATES b) { return a = a | b; }
+inline D3D12_RESOURCE_STATES& operator&=(D3D12_RESOURCE_STATES& a, D3D12_RESOURCE_STATES b) { return a = a & b; }
+
+enum D3D12_RESOURCE_BARRIER_TYPE
+{
+	D3D12_RESOURCE_BARRIER_TYPE_TRANSITION = 0,
+	D3D12_RESOURCE_BARRIER_TYPE_ALIASING = 1,
+	D3D12_RESOURCE_BARRIER_TYPE_UAV = 2,
+};
+
+enum D3D12_RESOURCE_BARRIER_FLAGS
+{
+	D3D12_RESOURCE_BARRIER_FLAG_NONE = 0,
+	D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY = 0x1,
+	D3D12_RESOURCE_BARRIER_FLAG_END_ONLY = 0x2,
+};
+
+const UINT D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES = 0xffffffff;
+const UINT64 D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT = 65536;
+const UINT64 D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT = 4194304;
+
+// Only ever handled through pointers
+struct ID3D12Resource;
+
+struct D3D12_RESOURCE_TRANSITION_BARRIER
+{
+	ID3D12Resource* pResource;
+	UINT Subresource;
+	D3D12_RESOURCE_STATES StateBefore;
+	D3D12_RESOURCE_STATES StateAfter;
+};
+
+struct D3D12_RESOURCE_ALIASING_BARRIER
+{
+	ID3D12Resource* pResourceBefore;
+	ID3D12Resource* pResourceAfter;
+};
+
+struct D3D12_RESOURCE_UAV_BARRIER
+{
+	ID3D12Resource* pResource;
+};
+
+struct D3D12_RESOURCE_BARRIER
+{
+	D3D12_RESOURCE_BARRIER_TYPE Type;
+	D3D12_RESOURCE_BARRIER_FLAGS Flags;
+	union
+	{
+		D3D12_RESOURCE_TRANSITION_BARRIER Transition;
+		D3D12_RESOURCE_ALIASING_BARRIER Aliasing;
+		D3D12_RESOURCE_UAV_BARRIER UAV;
+	};
+};
+
+// The one command the planners record, a test list implements it to see what they recorded
+struct ID3D12GraphicsCommandList
+{
+	virtual ~ID3D12GraphicsCommandList() = default;
+	virtual void ResourceBarrier(UINT NumBarriers, const D3D12_RESOURCE_BARRIER* pBarriers) = 0;
+};
+
+// The helpers of d3dx12.h the planners use
+struct CD3DX12_RESOURCE_BARRIER : public D3D12_RESOURCE_BARRIER
+{
+	CD3DX12_RESOURCE_BARRIER() = default;
+	explicit CD3DX12_RESOURCE_BARRIER(const D3D12_RESOURCE_BARRIER& o) : D3D12_RESOURCE_BARRIER(o) {}
+
+	static CD3DX12_RESOURCE_BARRIER Transition(ID3D12Resource* pResource, D3D12_RESOURCE_STATES stateBefore,
+		D3D12_RESOURCE_STATES stateAfter, UINT subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+		D3D12_RESOURCE_BARRIER_FLAGS flags = D3D12_RESOURCE_BARRIER_FLAG_NONE)
+	{
+		CD3DX12_RESOURCE_BARRIER result = {};
+		D3D12_RESOURCE_BARRIER& barrier = result;
+		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+		barrier.Flags = flags;
+		barrier.Transition.pResource = pResource;
+		barrier.Transition.StateBefore = stateBefore;
+		barrier.Transition.StateAfter = stateAfter;
+		barrier.Transition.Subresource = subresource;
+		return result;
+	}
+
+	static CD3DX12_RESOURCE_BARRIER Aliasing(ID3D12Resource* pResourceBefore, ID3D12Resource* pResourceAfter)
+	{
+		CD3DX12_RESOURCE_BARRIER result = {};
+		D3D12_RESOURCE_BARRIER& barrier = result;
+		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+		barrier.Aliasing.pResourceBefore = pResourceBefore;
+		barrier.Aliasing.pResourceAfter = pResourceAfter;
+		return result;
+	}
+
+	static CD3DX12_RESOURCE_BARRIER UAV(ID3D12Resource* pResource)
+	{
+		CD3DX12_RESOURCE_BARRIER result = {};
+		D3D12_RESOURCE_BARRIER& barrier = result;
+		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+		barrier.UAV.pResource = pResource;
+		return result;
+	}
+};
+#endif
@@ -12,17 +12,51 @@
 #include "SceneColorRT.h"
 #include "GBuffers.h"
 #include "HiZBuffer.h"
+#include "VertexCompression.h"
+#include "Meshlet.h"
+#include "MeshSimplifier.h"
+#include "GeometryArena.h"
+#include "BCDecoder.h"
+#include "TextureCooker.h"
+#include "TextureStreamer.h"
+#include "SceneBVH.h"
+#include "FrustumCulling.h"
+#include "IndirectDraws.h"
+#include "SceneStore.h"
+#include "ResourceRegistry.h"
+#include "MaterialTable.h"
+#include "JobSystem.h"
+#include "RenderGraph.h"
+#include "ResourceStateTracker.h"
+#include "InstanceRecords.h"
+#include "RenderQueue.h"
+#include "ModelImport.h"
+#include "Benchmarks.h"
+#include "FramePipeline.h"
 #include "../utils/DDSTextureLoader.h"
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
-
-#pragma comment(lib, "assimp-vc143-mtd.lib")
+#include <cfloat>
+#include <chrono>
+#include <crtdbg.h>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <thread>
+#include <tuple>
 
 const int gNumFrameResources = 3;
 
 const UINT CubeMapSize = 512;
 
+const int FlyThroughFrameCount = 600;
+
+const UINT MaxLodCount = 5;
+// Stress scene: separate sphere items, each with a few instances of its own
+const UINT StressSphereItems = 2000;
+const UINT StressSphereInstances = 2;
+
+// Feedback slots of the texture streamer, one per MatCBIndex
+const UINT MaxStreamedMaterials = 64;
+
 enum class RenderLayer
 {
 	Opaque = 0,
@@ -34,6 +68,16 @@ enum class RenderLayer
 	Debug,
 	BRDF,
 	GUN,
+	StressSpheres, // many single sphere items, drawn with the opaque ones when mShowStressScene is set
+	Count
+};
+
+// Views culled together every frame, one bit each of the culling masks. Only views a pass of the frame draws:
+// DrawSceneToCubeMap is not part of it, so the cube map faces are not culled.
+enum class CullView
+{
+	Main = 0,
+	Shadow,
 	Count
 };
 
@@ -56,150 +100,165 @@ struct RenderItem
 
 	UINT ObjCBIndex = -1;
 
+	UINT ItemIndex = 0; // in mAllRitems and in the draw states of a frame packet
+
 	Material* Mat = nullptr;
 	MeshGeometry* Geo = nullptr;
+	SubmeshHandle Submesh; // Geo and the draw arguments below are resolved from it by AssignSubmesh
 
 	std::vector<InstanceData> Instances;
 	UINT InstanceCount = 0;
-	UINT InstanceBufferIndex = 0; // Instance buffer index in the FrameResource
+	UINT InstanceBufferIndex = 0; // where the slots of the drawn instances start in the InstanceIndexBuffer of the FrameResource
+	UINT FirstInstanceSlot = 0;   // record slot of instance 0 in the InstanceBuffer, instance i is FirstInstanceSlot + i
 
 	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
 	UINT IndexCount = 0;
 	UINT StartIndexLocation = 0;
 	UINT BaseVertexLocation = 0;
+	DXGI_FORMAT IndexFormat = DXGI_FORMAT_UNKNOWN; // width of the drawn submesh, UNKNOWN uses Geo->IndexFormat
+
+	// Meshlets of the drawn submesh, nullptr when the item is always drawn whole
+	const MeshletMesh* Meshlets = nullptr;
+	UINT MeshletIndexStart = 0; // into the MeshletIndexBuffer of the current frame resource
+	UINT MeshletIndexCount = 0;
+
+	// LOD chain of the drawn submesh, Lods[0] is the full resolution one. Empty when the item has no LODs.
+	std::vector<SubmeshGeometry> Lods;
+	std::vector<UINT> LodOrder;          // instance indices grouped by selected LOD, the instance buffer upload order
+	std::vector<UINT> LodInstanceCounts; // instances per LOD this frame
+
+	// Object-space bounds of the drawn submesh
+	BoundingBox Bounds;
+	// Position grid of its vertices in Geo's compact vertex buffer, shared by its LODs and meshlets
+	VertexQuantizationConstants Quantization;
+	// Sort key fields: the layer the item is drawn in, a small id of Geo and the view depth of its nearest
+	// visible instance this frame
+	UINT Layer = 0;
+	UINT SortGeometry = 0;
+	float SortDepth = 0.0f;
+	// Primitive of instance 0 in the scene BVH, instance i is FirstBvhPrimitive + i. UINT_MAX for items drawn whole.
+	UINT FirstBvhPrimitive = UINT_MAX;
+	// Instances whose World changed, their boxes are refit into the BVH and their records rewritten by the next Update
+	std::vector<UINT> MovedInstances;
+	// Instances that passed the BVH query this frame, drawn in this order
+	std::vector<UINT> VisibleInstances;
+	// The same for the other views and where their slots start in the instance index buffer. The main view uses
+	// VisibleInstances, InstanceBufferIndex and InstanceCount, its entries here stay unused.
+	std::vector<UINT> ViewInstances[(int)CullView::Count];
+	UINT ViewInstanceBufferIndex[(int)CullView::Count] = {};
+	UINT ViewInstanceCount[(int)CullView::Count] = {};
 
 	//UINT SkinnedCBIndex = -1;
 	//SkinnedModelInstance* SkinnedModelInst = nullptr;
 };
 
-struct Mesh
-{
-	std::vector<Vertex> vertices;
-	std::vector<std::uint32_t> indices;
-};
-
-std::vector<Mesh> meshes;
-
-void LoadModels(const char* modelFilename)
+// ImGui's draw data points into draw lists the next NewFrame rewrites, a frame packet keeps a copy of them for
+// the render thread. The lists keep their buffers from the packet's earlier frames.
+struct OverlayDrawData
 {
-	assert(modelFilename != nullptr);
-	const std::string filePath(modelFilename);
-
-	Assimp::Importer importer;
-
-	// 关键：预烘焙节点变换 + 生成法线/切线 + 其它实时友好优化
-	const unsigned int flags =
-		aiProcess_Triangulate |
-		aiProcess_ConvertToLeftHanded |
-		aiProcess_PreTransformVertices |      // ★ 将所有 aiNode 的变换应用到顶点
-		aiProcess_GenSmoothNormals |          // ★ 若模型无法线则生成平滑法线
-		aiProcess_CalcTangentSpace |          // ★ 生成切线/副切线（法线贴图/各向异性用）
-		aiProcess_ImproveCacheLocality |
-		aiProcess_JoinIdenticalVertices |
-		aiProcess_SortByPType;
-
-	const aiScene* scene = importer.ReadFile(filePath.c_str(), flags);
-	assert(scene && scene->HasMeshes());
+	ImDrawData Data;
+	std::vector<std::unique_ptr<ImDrawList>> Lists;
 
-	for (unsigned int mi = 0; mi < scene->mNumMeshes; ++mi)
+	void CopyFrom(const ImDrawData& source)
 	{
-		const aiMesh* mesh = scene->mMeshes[mi];
-		assert(mesh);
-
-		Mesh out;
-		out.vertices.resize(mesh->mNumVertices);
-
-		// 顶点属性（已被 PreTransformVertices 应用节点矩阵）
-		for (unsigned int i = 0; i < mesh->mNumVertices; ++i)
-		{
-			// 位置
-			const aiVector3D& p = mesh->mVertices[i];
-			out.vertices[i].Pos = XMFLOAT3(p.x, p.y, p.z);
-
-			// 法线（若原模型没有，已由 GenSmoothNormals 生成；Assimp 会保证存在）
-			const aiVector3D& n = mesh->mNormals[i];
-			out.vertices[i].Normal = XMFLOAT3(n.x, n.y, n.z);
-
-			// 切线（没有也无所谓，置 0）
-			if (mesh->HasTangentsAndBitangents())
-			{
-				const aiVector3D& t = mesh->mTangents[i];
-				out.vertices[i].TangentU = XMFLOAT3(t.x, t.y, t.z);
-			}
-			else
-			{
-				out.vertices[i].TangentU = XMFLOAT3(0, 0, 0);
-			}
-
-			// UV（若不存在就置零）
-			if (mesh->HasTextureCoords(0))
-			{
-				const aiVector3D& uv = mesh->mTextureCoords[0][i];
-				out.vertices[i].TexC = XMFLOAT2(uv.x, uv.y);
-			}
-			else
-			{
-				out.vertices[i].TexC = XMFLOAT2(0, 0);
-			}
-		}
-
-		// 索引（三角面）
-		out.indices.reserve(mesh->mNumFaces * 3);
-		for (unsigned int f = 0; f < mesh->mNumFaces; ++f)
+		Data.Valid = source.Valid;
+		Data.CmdListsCount = source.CmdListsCount;
+		Data.TotalIdxCount = source.TotalIdxCount;
+		Data.TotalVtxCount = source.TotalVtxCount;
+		Data.DisplayPos = source.DisplayPos;
+		Data.DisplaySize = source.DisplaySize;
+		Data.FramebufferScale = source.FramebufferScale;
+		Data.OwnerViewport = source.OwnerViewport;
+		Data.CmdLists.resize(0);
+		for (int i = 0; i < source.CmdListsCount; ++i)
 		{
-			const aiFace& face = mesh->mFaces[f];
-			assert(face.mNumIndices == 3);
-			out.indices.push_back(face.mIndices[0]);
-			out.indices.push_back(face.mIndices[1]);
-			out.indices.push_back(face.mIndices[2]);
+			if (Lists.size() <= (size_t)i)
+				Lists.push_back(std::make_unique<ImDrawList>(ImGui::GetDrawListSharedData()));
+			const ImDrawList* from = source.CmdLists[i];
+			ImDrawList* to = Lists[i].get();
+			Copy(from->CmdBuffer, to->CmdBuffer);
+			Copy(from->IdxBuffer, to->IdxBuffer);
+			Copy(from->VtxBuffer, to->VtxBuffer);
+			to->Flags = from->Flags;
+			Data.CmdLists.push_back(to);
 		}
-
-		meshes.push_back(std::move(out));
 	}
-}
 
+private:
+	// ImVector's assignment frees the old buffer first
+	template<typename T>
+	static void Copy(const ImVector<T>& from, ImVector<T>& to)
+	{
+		to.resize(from.Size);
+		if (from.Size > 0)
+			memcpy(to.Data, from.Data, from.Size * sizeof(T));
+	}
+};
 
-namespace
+// Points a generator sink at an arena submesh, with the index width the arena picked for it.
+template<typename Generate>
+void GenerateIntoSubmesh(const ArenaSubmesh& submesh, Generate generate)
 {
-	template<typename TMesh>
-	void MergeMeshesRange(const std::vector<TMesh>& src,
-		size_t begin, size_t end,
-		std::vector<Vertex>& outVertices,
-		std::vector<uint32_t>& outIndices)
+	if (submesh.IndexFormat == DXGI_FORMAT_R16_UINT)
 	{
-		for (size_t i = begin; i < end; ++i)
-		{
-			const auto& m = src[i];
-
-			// 当前子网格加入前，记录 base
-			const uint32_t baseVertex = static_cast<uint32_t>(outVertices.size());
-
-			// 追加顶点
-			outVertices.insert(outVertices.end(), m.vertices.begin(), m.vertices.end());
-
-			// 追加索引（加上 base 偏移）
-			outIndices.reserve(outIndices.size() + m.indices.size());
-			for (auto idx : m.indices)
-				outIndices.push_back(static_cast<uint32_t>(idx) + baseVertex);
-		}
+		GeometryGenerator::LayoutSink<Vertex, std::uint16_t> sink{ submesh.Vertices, static_cast<std::uint16_t*>(submesh.Indices) };
+		generate(sink);
+	}
+	else
+	{
+		GeometryGenerator::LayoutSink<Vertex, std::uint32_t> sink{ submesh.Vertices, static_cast<std::uint32_t*>(submesh.Indices) };
+		generate(sink);
 	}
 }
 
+// Sources LoadTextures reads, cooked with mips into Cooked/
+struct TextureCookJob
+{
+	const char* Source;
+	const char* Dest;
+	TextureCooker::TextureKind Kind;
+	DXGI_FORMAT Format;
+};
+
+const TextureCookJob gTextureCookJobs[] =
+{
+	{ "D:\\DX12\\d3d12book\\Textures\\weapon_basecolor.dds", "Cooked\\weapon_basecolor.dds", TextureCooker::TextureKind::Color, DXGI_FORMAT_BC7_UNORM },
+	{ "D:\\DX12\\d3d12book\\Textures\\weapon_normal.dds", "Cooked\\weapon_normal.dds", TextureCooker::TextureKind::NormalMap, DXGI_FORMAT_BC7_UNORM },
+	{ "D:\\DX12\\d3d12book\\Textures\\weapon_roughness.dds", "Cooked\\weapon_roughness.dds", TextureCooker::TextureKind::Linear, DXGI_FORMAT_BC1_UNORM },
+	{ "D:\\DX12\\d3d12book\\Textures\\weapon_metallic.dds", "Cooked\\weapon_metallic.dds", TextureCooker::TextureKind::Linear, DXGI_FORMAT_BC1_UNORM },
+	{ "D:\\DX12\\d3d12book\\Textures\\weapon_occlusion.dds", "Cooked\\weapon_occlusion.dds", TextureCooker::TextureKind::Linear, DXGI_FORMAT_BC1_UNORM },
+	{ "D:\\DX12\\d3d12book\\Textures\\WireFence.dds", "Cooked\\WireFence.dds", TextureCooker::TextureKind::Color, DXGI_FORMAT_BC3_UNORM },
+	{ "Models\\cave\\cave_albedo.dds", "Cooked\\cave_albedo.dds", TextureCooker::TextureKind::Color, DXGI_FORMAT_BC7_UNORM },
+	{ "Models\\cave\\cave_normal.dds", "Cooked\\cave_normal.dds", TextureCooker::TextureKind::NormalMap, DXGI_FORMAT_BC7_UNORM },
+};
+
 class MySoftRasterizationApp : public D3D12App
 {
 public:
 	MySoftRasterizationApp(HINSTANCE hInstance, int nShowCmd)
 		: D3D12App(hInstance, nShowCmd) {
-		mSceneBounds.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
-		mSceneBounds.Radius = sqrtf(10.0f * 10.0f + 15.0f * 15.0f);
 	}
 	~MySoftRasterizationApp() {
-		ImGui_ImplDX12_Shutdown();
-		ImGui_ImplWin32_Shutdown();
+		// The render thread finishes the packets it was given first
+		if (mRenderThread.joinable())
+			SetRenderThread(false);
+		// Frames still in flight reference the resources released below. The queue is null when Init failed early.
+		if (mCommandQueue != nullptr)
+			FlushCmdQueue();
+		// Init may have thrown before the backends were set up
+		if (ImGui::GetCurrentContext() == nullptr)
+			return;
+		if (ImGui::GetIO().BackendRendererUserData != nullptr)
+			ImGui_ImplDX12_Shutdown();
+		if (ImGui::GetIO().BackendPlatformUserData != nullptr)
+			ImGui_ImplWin32_Shutdown();
 		ImGui::DestroyContext();
 	}
 	virtual bool Init() override;
+	// -frame-pipeline-report: renders the scene in a window that is never shown, on one thread and with the render
+	// thread, and writes the throughput and latency of each to FramePipeline.txt
+	int RunFramePipelineReport();
 private:
 	virtual void Draw() override;
 	void BuildDescriptorHeaps();
@@ -214,7 +273,21 @@ private:
 	void BuildGeometry();
 	void BuildMaterial();
 	void BuildRenderItems();
-	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*> ritems);
+	void BuildStressScene();
+	void BuildInstancingGroups();
+	void BuildMeshlets();
+	void BuildSceneBvh();
+	void RegisterResources();
+	void RegisterPSOs();
+	SubmeshHandle FindSubmesh(const std::string& name) const;
+	UINT FindMaterialIndex(const std::string& name) const;
+	void AssignSubmesh(RenderItem& ri, SubmeshHandle submesh);
+	void BuildUpdateGraph();
+	void AppendLods(GeometryArena& arena, const std::string& submeshName);
+	void UploadCompactVertices(MeshGeometry& geo);
+	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*> ritems, bool useMeshlets = false,
+		CullView view = CullView::Main, bool compactVertices = false);
+	void ExecuteIndirectDraws(CullView view);
 
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 7> GetStaticSamplers();
 
@@ -229,6 +302,9 @@ private:
 
 	//void UpdateObjectCBs(GameTime& gt);
 	void UpdateInstanceBuffers(GameTime& gt);
+	void MergeInstancingGroups();
+	void UpdateIndirectDraws();
+	void UpdateSortDepths();
 	void UpdateMainPassCBs();
 	void UpdateMaterialCBs(GameTime& gt);
 	void UpdateCubeMapFacePassCBs();
@@ -236,6 +312,18 @@ private:
 	void UpdateShadowPassCBs();
 	void UpdateSsaoCBs();
 	void UpdateSSRConstants();
+	void UpdateMeshletCulling();
+	void UpdateLodSelection();
+	void UpdateSceneBvh();
+	void UpdateFlyThrough();
+	void CookSceneTextures();
+	void UpdateTextureStreaming();
+
+	struct FramePacket;
+	void FillFramePacket(FramePacket& packet, std::chrono::high_resolution_clock::time_point updateStart);
+	void RenderFrame(FramePacket& packet);
+	void RenderThreadMain();
+	void SetRenderThread(bool enable);
 
 	virtual void CreateDescriptorHeap() override;
 
@@ -249,6 +337,10 @@ private:
 	void DrawNormalsAndDepth();
 	void DrawSceneToGBuffers();
 	void DefferedShadingPass();
+	void DrawSky();
+	void SetSceneRootArguments();
+	void BuildFrameGraph();
+	void PlanTrackedBarriers();
 	void BuildDepthSRV(CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv);
 	void DrawSSR();
 	void DrawSSRComposite();
@@ -264,6 +356,7 @@ private:
 	ComPtr<ID3D12Resource> mCubeDepthStencilBuffer = nullptr;
 
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
+	std::vector<D3D12_INPUT_ELEMENT_DESC> mCompactInputLayout; // CompactVertex, the G-buffer pass
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 	std::vector<std::unique_ptr<FrameResource>> mFrameResources;
@@ -272,8 +365,225 @@ private:
 	std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
 	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
 	std::unordered_map<std::string, std::unique_ptr<Material>> mMaterials;
-	std::unordered_map<std::string, std::unique_ptr<Texture>> mTextures;
+	// GPU records of mMaterials by MatCBIndex, a material edited at run time goes through mMaterialTable.Set
+	MaterialTable mMaterialTable;
+	MaterialTable::UploadStats mMaterialUpload;
+	std::unique_ptr<TextureStreamer> mTextureStreamer;
+	std::unordered_map<std::string, UINT> mTextureIds;
+	std::vector<UINT> mSrvSlotTextures; // gTextureMap index -> streamed texture
+	float mStreamingBudgetMB = 32.0f;
+
+	// The maps above own the resources. The render items are built from these registries by name, they keep the
+	// handles and what the handles resolve to, the frame code goes through the handles resolved once at init.
+	struct SubmeshEntry
+	{
+		GeometryHandle Geo;
+		SubmeshGeometry Args;
+		VertexQuantizationConstants Quantization; // grid of its vertices in the compact vertex buffer
+		const MeshletMesh* Meshlets = nullptr;    // nullptr for LODs, they are drawn whole
+	};
+	Registry<MeshGeometry*, GeometryTag> mGeometryRegistry;
+	Registry<SubmeshEntry, SubmeshTag> mSubmeshRegistry;     // keyed by "geometry/submesh"
+	Registry<Material*, MaterialTag> mMaterialRegistry;
+	Registry<UINT, TextureTag> mTextureRegistry;             // streamed texture id
+	Registry<ID3D12PipelineState*, PsoTag> mPsoRegistry;
+	struct PsoIds
+	{
+		PsoHandle Opaque, WithoutNormalMap, AlphaTested, Transparent, Sky, Shadow, DrawNormals;
+		PsoHandle Brdf, BrdfEu, Eavg;
+		PsoHandle DefferedShadingPass1, DefferedShadingPass2, Ssr, SsrComposite, SceneWithoutSsr;
+		PsoHandle HiZFromDepth, HiZ;
+	} mPsoIds;
+	TextureHandle mSkyTexture;
+
+	VertexCompressionReport mVertexCompressionReport;
+	// Grid of every level 0 submesh in the compact vertex buffers, keyed by "geometry/submesh"
+	std::unordered_map<std::string, VertexQuantizationConstants> mVertexQuantization;
+
+	// keyed by "geometry/submesh"
+	std::unordered_map<std::string, MeshletMesh> mMeshlets;
+	std::vector<std::uint8_t> mMeshletVisible;
+	std::vector<std::uint32_t> mMeshletIndices;
+	BoundingFrustum mCamFrustum;
+	bool mEnableMeshletCulling = true;
+	MeshletCullStats mMeshletStats;
+
+	int mFlyThroughFrame = -1;
+	bool mFlyThroughRestore = false; // the last fly-through frame was culled, put the camera back
+	XMFLOAT3 mFlyThroughSavedPos;
+	XMFLOAT3 mFlyThroughSavedLook;
+	MeshletCullStats mFlyThroughStats;
+
+	SceneBVH mSceneBvh;
+	// The culled instances, dense index p is BVH primitive p. Its world bounds feed the flat culling kernel.
+	SceneStore mScene;
+	bool mEnableBvhCulling = true;
+	bool mUseFlatCulling = false;
+	UINT mBvhVisibleCount = 0;
+	Culling::FrustumPlanes mCullViews[(int)CullView::Count];
+	std::vector<std::uint8_t> mCullMasks; // per BVH primitive, bit v for CullView v
+	UINT mViewVisibleCounts[(int)CullView::Count] = {};
+	bool mTimeSeparateCulls = false;
+	double mSeparateCullMs = 0.0; // the same views culled one at a time
+	UINT mBvhRefitNodes = 0;
+	double mBvhRefitMs = 0.0;
+	double mBvhQueryMs = 0.0;
+
+	InstanceRecords mInstanceRecords;
+	std::vector<std::uint32_t> mInstanceIndices; // the draw lists of the frame, record slots
+	UINT mInstanceRecordsWritten = 0;
+	UINT64 mInstanceUploadBytes = 0;     // records and draw lists written this frame
+	UINT64 mInstanceUploadBytesFull = 0; // the same with 208 byte InstanceData records
+	double mInstanceUpdateMs = 0.0;
+
+	// The per frame update stages after the camera and lights are set, run as a dependency graph
+	JobSystem mJobs;
+	JobGraph mUpdateGraph;
+	bool mParallelUpdate = true;
+	double mUpdateStagesMs = 0.0;
+	double mSerialStagesMs = 0.0;   // moving averages of both modes
+	double mParallelStagesMs = 0.0;
+
+	// Up to gNumFrameResources frames are recorded while the GPU still works on earlier ones, each frame resource
+	// fenced on its own. Off, Draw waits for the GPU at the end of every frame.
+	bool mOverlapFrames = true;
+	double mFenceWaitMs = 0.0;     // Update waiting for the frame resource it is about to fill
+	UINT64 mStreamerFlushes = 0;   // frames that drained the GPU before the streamer rewrote descriptors, render side
+
+	// The passes of Draw, compiled again only when the size or SSR changes. The G-buffer, scene color and SSR
+	// targets are placed in mFrameGraphHeap at the offsets the graph computed.
+	RenderGraph mFrameGraph;
+	ComPtr<ID3D12Heap> mFrameGraphHeap;
+	UINT mFrameGraphWidth = 0;
+	UINT mFrameGraphHeight = 0;
+	bool mFrameGraphSsr = false;
+	// The HiZ mips and the SSR target change state through the barriers planned here, the other resources of the
+	// frame keep their hand written ones
+	ResourceStateTracker mStateTracker;
+	UINT mTrackedHiZ = 0;
+	UINT mTrackedSsr = 0;
+	UINT mHiZMipPass = 0; // the pass of mip 0, the other mips follow in order
+	UINT mSsrPass = 0;
+	UINT mSsrCompositePass = 0;
+
+	// Items of one layer drawing the same submesh, turned into one instanced draw per view by MergeInstancingGroups
+	struct InstancingGroup
+	{
+		std::vector<RenderItem*> Items;
+		bool UsesMeshlets = false; // picked per item in the main view, the group only merges in the others then
+	};
+	std::vector<InstancingGroup> mInstancingGroups;
+	bool mAutoInstancing = true;
+	UINT mMergedItems = 0; // draws saved this frame over all views
+	bool mShowStressScene = false;
+
+	// Commands of the G-buffer and shadow passes when they draw through ExecuteIndirect. Every LOD group and
+	// meshlet list of an item is a command of its own, merged instancing groups are one like in DrawRenderItems.
+	struct IndirectBatch
+	{
+		const MeshGeometry* Geo = nullptr;
+		D3D12_INDEX_BUFFER_VIEW IndexBufferView = {};
+		D3D12_PRIMITIVE_TOPOLOGY Topology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+		const VertexQuantizationConstants* Quantization = nullptr; // compact vertices on this grid, main view only
+		UINT FirstSource = 0;
+		UINT SourceCount = 0;
+		UINT FirstCommand = 0;
+		UINT CommandCount = 0; // sources with visible instances
+	};
+	ComPtr<ID3D12CommandSignature> mIndirectCommandSignature;
+	bool mDrawIndirect = false;
+	bool mValidateIndirectDraws = false; // once, on the next update
+	std::vector<IndirectDraws::Source> mIndirectSources; // grouped by batch, the main view first
+	std::vector<IndirectBatch> mIndirectBatches[(int)CullView::Count];
+	IndirectDraws::Counts mIndirectCounts;
+	double mIndirectBuildMs = 0.0;
+	UINT mIndirectErrors = 0;
+	UINT mIndirectExecutes = 0; // ExecuteIndirect calls of the frame being recorded, render side
+
+	RenderQueue mRenderQueue;
+	bool mSortDraws = true;               // sort keys and skip redundant state, off draws in layer order rebinding everything
+	DrawStateChanges mDrawStateChanges;   // of the frame being recorded, render side like the queue
+	double mRenderQueueMs = 0.0;
+
+	// What Draw reads of a render item that Update changes every frame, by RenderItem::ItemIndex
+	struct ItemDrawState
+	{
+		UINT InstanceBufferIndex[(int)CullView::Count] = {};
+		UINT InstanceCount[(int)CullView::Count] = {};
+		UINT LodCount = 0; // LOD groups of the main view, 0 for items without LODs
+		UINT LodInstanceCounts[MaxLodCount + 1] = {};
+		UINT MeshletIndexStart = 0;
+		UINT MeshletIndexCount = 0;
+		float SortDepth = 0.0f;
+	};
+
+	// What the render thread measured of a frame, handed back to Update with its packet
+	struct FrameRenderStats
+	{
+		UINT64 Frame = 0;
+		DrawStateChanges StateChanges;
+		double RenderQueueMs = 0.0;
+		UINT IndirectExecutes = 0;
+		UINT64 StreamerFlushes = 0;
+		double RenderMs = 0.0;  // recording, submitting and presenting the frame
+		double LatencyMs = 0.0; // from the start of its Update to the end of its Present
+		TextureStreamingStats Streaming;
+		std::vector<StreamedTextureInfo> Textures;
+	};
+
+	// One simulated frame. Update fills it and the frame resource it names, Draw records from both. Update does
+	// not touch either again until the packet came back and the GPU passed the frame resource's fence.
+	struct FramePacket
+	{
+		UINT64 Frame = 0;
+		int FrameResourceIndex = 0;
+		std::chrono::high_resolution_clock::time_point UpdateStart;
+
+		bool OverlapFrames = true;
+		bool SortDraws = true;
+		bool DrawIndirect = false;
+		bool EnableMeshletCulling = false;
+		bool ShowStressScene = false;
+		UINT64 StreamingBudgetBytes = 0;
+		float NearZ = 0.0f;
+		float FarZ = 0.0f;
+		float FovY = 0.0f;
+
+		std::vector<ItemDrawState> Items;
+		std::vector<IndirectBatch> IndirectBatches[(int)CullView::Count];
+		OverlayDrawData Overlay;
+
+		FrameRenderStats Stats; // written by the render thread
+	};
 
+	// Update runs on the main thread and hands every frame to Draw in a packet, one per frame resource. With
+	// mUseRenderThread Draw runs on mRenderThread and records a frame while Update simulates the next ones,
+	// otherwise the main thread draws each packet right after submitting it. The frame graph targets are only
+	// placed again, and the window resized, once the pipeline drained.
+	std::unique_ptr<FramePipeline<FramePacket>> mFramePipeline;
+	std::thread mRenderThread;
+	bool mUseRenderThread = true;
+	std::atomic<bool> mRenderFailed{ false };
+	std::exception_ptr mRenderError; // set before mRenderFailed, thrown again by the next Update
+	UINT64 mFrameCount = 0;
+	double mPacketWaitMs = 0.0;      // Update waiting for a free packet
+	FrameRenderStats mRenderStats;   // of the last packet that came back
+	// Render thread only: the packet being drawn and its frame resource
+	FramePacket* mRenderPacket = nullptr;
+	FrameResource* mRenderFrameResource = nullptr;
+	int mRenderFrameResourceIndex = 0;
+
+	bool mEnableLod = true;
+	float mLodPixelError = 1.0f; // coarsest LOD whose projected error stays below this many pixels
+	UINT64 mTrianglesWithLod = 0;
+	UINT64 mTrianglesWithoutLod = 0;
+	UINT mLodHistogram[MaxLodCount + 1] = {};
+
+	std::vector<TextureCooker::CookReport> mCookReports;
+
+	Benchmarks mBenchmarks;
+
+	// The frame resource Update fills, the one of its packet
 	FrameResource* mCurrFrameResource = nullptr;
 	int mCurrFrameResourceIndex = 0;
 
@@ -352,23 +662,26 @@ private:
 	std::unique_ptr<HiZBuffer> mHiZBuffer = nullptr;
 
 	bool mEnableSSR = true;
-
-	size_t mGunBegin = 0;
-	size_t mGunEnd = 0;
-	size_t mCaveBegin = 0;
-	size_t mCaveEnd = 0;
 };
 
-int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nShowCmd)
+int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR lpCmdLine, int nShowCmd)
 {
 #if defined(DEBUG) | defined(_DEBUG)
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
+	if (lpCmdLine != nullptr && strstr(lpCmdLine, "-render-graph-report") != nullptr)
+		return RunRenderGraphReport();
+	if (lpCmdLine != nullptr && strstr(lpCmdLine, "-barrier-report") != nullptr)
+		return RunBarrierReport();
+	const bool framePipelineReport = lpCmdLine != nullptr && strstr(lpCmdLine, "-frame-pipeline-report") != nullptr;
 	try
 	{
-		MySoftRasterizationApp theApp(hInstance, nShowCmd);
+		// The report draws into a window that is never shown
+		MySoftRasterizationApp theApp(hInstance, framePipelineReport ? SW_HIDE : nShowCmd);
 		if (!theApp.Init())
 			return 0;
+		if (framePipelineReport)
+			return theApp.RunFramePipelineReport();
 		return theApp.Run();
 	}
 	catch (DxException& e)
@@ -418,16 +731,6 @@ bool MySoftRasterizationApp::Init()
 
 	mHiZBuffer = std::make_unique<HiZBuffer>(md3dDevice.Get(), mClientWidth, mClientHeight);
 
-	// 在初始化/加载资源的地方（例如 Init()）：
-	mGunBegin = meshes.size();
-	LoadModels("Models/Cyborg_Weapon.fbx");
-	mGunEnd = meshes.size();   // [mGunBegin, mGunEnd)
-
-	//mCaveBegin = meshes.size();
-	//LoadModels("Models/cave/cave.gltf");
-	//mCaveEnd = meshes.size();  // [mCaveBegin, mCaveEnd)
-
-
 	LoadTextures();
 	BuildRootSignature();
 	BuildSsaoRootSignature();
@@ -437,11 +740,20 @@ bool MySoftRasterizationApp::Init()
 	BuildShadersAndInputLayout();
 	BuildGeometry();
 	BuildModels();
+	BuildMeshlets();
 	BuildMaterial();
+	RegisterResources();
 	BuildRenderItems();
+	BuildSceneBvh();
 	BuildFrameResources();
 	BuildCubeDepthStencil();
 	BuildPSOs();
+	RegisterPSOs();
+	BuildUpdateGraph();
+
+	mFramePipeline = std::make_unique<FramePipeline<FramePacket>>(gNumFrameResources);
+	for (UINT i = 0; i < mFramePipeline->PacketCount(); ++i)
+		mFramePipeline->PacketAt(i).FrameResourceIndex = (int)i;
 
 	mSsao->SetPSOs(
 		mPSOs["ssao"].Get(),
@@ -502,47 +814,37 @@ void MySoftRasterizationApp::BuildDescriptorHeaps()
 
 	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), 1, mCbv_srv_uavDescriptorSize);
 
-	std::vector<ComPtr<ID3D12Resource>> tex2DList =
-	{
-		mTextures["bricksDiffuseMap"]->Resource,
-		mTextures["bricksNormalMap"]->Resource,
-		mTextures["tileDiffuseMap"]->Resource,
-		mTextures["tileNormalMap"]->Resource,
-		mTextures["defaultDiffuseMap"]->Resource,
-		mTextures["defaultNormalMap"]->Resource,
-		mTextures["wireFenceDiffuseMap"]->Resource,
-		mTextures["waterDiffuseMap"]->Resource,
-		mTextures["weaponDiffuseMap"]->Resource,
-		mTextures["weaponNormalMap"]->Resource,
-		mTextures["weaponRoughnessMap"]->Resource,
-		mTextures["weaponMetallicMap"]->Resource,
-		mTextures["weaponAOMap"]->Resource,
-		mTextures["caveDiffuseMap"]->Resource,
-		mTextures["caveNormalMap"]->Resource
+	// gTextureMap order, the streamer rewrites these views whenever residency changes
+	std::vector<std::string> tex2DList =
+	{
+		"bricksDiffuseMap",
+		"bricksNormalMap",
+		"tileDiffuseMap",
+		"tileNormalMap",
+		"defaultDiffuseMap",
+		"defaultNormalMap",
+		"wireFenceDiffuseMap",
+		"waterDiffuseMap",
+		"weaponDiffuseMap",
+		"weaponNormalMap",
+		"weaponRoughnessMap",
+		"weaponMetallicMap",
+		"weaponAOMap",
+		"caveDiffuseMap",
+		"caveNormalMap"
 	};//15
 
-	auto skyCubeMap = mTextures["skyCubeMap"]->Resource;
-
-	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MostDetailedMip = 0;
-	srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-
 	for (UINT i = 0; i < (UINT)tex2DList.size(); ++i)
 	{
-		srvDesc.Format = tex2DList[i]->GetDesc().Format;
-		srvDesc.Texture2D.MipLevels = tex2DList[i]->GetDesc().MipLevels;
-		md3dDevice->CreateShaderResourceView(tex2DList[i].Get(), &srvDesc, hDescriptor);
+		UINT texture = mTextureIds[tex2DList[i]];
+		mSrvSlotTextures.push_back(texture);
+		mTextureStreamer->SetDescriptor(texture, hDescriptor);
 
 		hDescriptor.Offset(1, mCbv_srv_uavDescriptorSize);
 	}
 
 	// Create SRV for the sky cube map
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
-	srvDesc.Format = skyCubeMap->GetDesc().Format;
-	srvDesc.Texture2D.MipLevels = skyCubeMap->GetDesc().MipLevels;
-	md3dDevice->CreateShaderResourceView(skyCubeMap.Get(), &srvDesc, hDescriptor);
+	mTextureStreamer->SetDescriptor(mTextureIds["skyCubeMap"], hDescriptor);
 	mSkyTexSrvIndex = tex2DList.size() + 1; // Sky texture is at the end of the heap
 
 	mDynamicSrvIndex = mSkyTexSrvIndex + 1; // Dynamic texture will be at the next index
@@ -717,7 +1019,7 @@ void MySoftRasterizationApp::BuildCubeMapCamera(float x, float y, float z)
 
 void MySoftRasterizationApp::BuildRootSignature()
 {
-	CD3DX12_ROOT_PARAMETER rootParameters[5];
+	CD3DX12_ROOT_PARAMETER rootParameters[8];
 
 	//SRV for IMGUI
 	rootParameters[0].InitAsDescriptorTable(1, &CD3DX12_DESCRIPTOR_RANGE(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0));
@@ -725,15 +1027,21 @@ void MySoftRasterizationApp::BuildRootSignature()
 	rootParameters[1].InitAsConstantBufferView(0);
 	//ObjectCB
 	//rootParameters[2].InitAsConstantBufferView(1);
-	// InstanceBuffer
+	// InstanceIndexBuffer, the slots of the instances of one draw
 	rootParameters[2].InitAsShaderResourceView(1, 1);
 	//MaterialSB
 	rootParameters[3].InitAsShaderResourceView(0, 1);
 	//SRV for Textures
 	rootParameters[4].InitAsDescriptorTable(1, &CD3DX12_DESCRIPTOR_RANGE(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 32 + 2 * mHiZBuffer->MipLevels() + 1, 1));
+	//Mip feedback of the G-buffer pass
+	rootParameters[5].InitAsUnorderedAccessView(0);
+	// InstanceBuffer, the records of all instances
+	rootParameters[6].InitAsShaderResourceView(2, 1);
+	// Position grid of the drawn submesh, for the passes reading CompactVertex
+	rootParameters[7].InitAsConstants(sizeof(VertexQuantizationConstants) / 4, 1);
 	auto staticSamplers = GetStaticSamplers();
 
-	CD3DX12_ROOT_SIGNATURE_DESC rootSignatureDesc(5, rootParameters,
+	CD3DX12_ROOT_SIGNATURE_DESC rootSignatureDesc(8, rootParameters,
 		(UINT)staticSamplers.size(), staticSamplers.data(),
 		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 	ComPtr<ID3DBlob> serializedRootSig = nullptr;
@@ -742,6 +1050,9 @@ void MySoftRasterizationApp::BuildRootSignature()
 		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf()));
 	ThrowIfFailed(md3dDevice->CreateRootSignature(0, serializedRootSig->GetBufferPointer(),
 		serializedRootSig->GetBufferSize(), IID_PPV_ARGS(&mRootSignature)));
+
+	// ExecuteIndirect of the commands UpdateIndirectDraws builds, each moving the InstanceIndexBuffer view
+	mIndirectCommandSignature = IndirectDraws::CreateCommandSignature(md3dDevice.Get(), mRootSignature.Get(), 2);
 }
 
 void MySoftRasterizationApp::BuildSsaoRootSignature()
@@ -958,8 +1269,17 @@ void MySoftRasterizationApp::BuildShadersAndInputLayout()
 	mShaders["ssaoBlurVS"] = CompileShader(L"shaders\\SsaoBlur.hlsl", nullptr, "VS", "vs_5_1");
 	mShaders["ssaoBlurPS"] = CompileShader(L"shaders\\SsaoBlur.hlsl", nullptr, "PS", "ps_5_1");
 
-	mShaders["DefferedShadingPass1VS"] = CompileShader(L"shaders\\DefferedShadingPass1.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["DefferedShadingPass1PS"] = CompileShader(L"shaders\\DefferedShadingPass1.hlsl", nullptr, "PS", "ps_5_1");
+	// The G-buffer pass reads CompactVertex. The feedback UAV has one slot per streamed material, the shader
+	// skips the materials past it.
+	const std::string maxStreamedMaterials = std::to_string(MaxStreamedMaterials);
+	const D3D_SHADER_MACRO gBufferDefines[] =
+	{
+		"COMPACT_VERTEX", "1",
+		"MAX_STREAMED_MATERIALS", maxStreamedMaterials.c_str(),
+		NULL, NULL
+	};
+	mShaders["DefferedShadingPass1VS"] = CompileShader(L"shaders\\DefferedShadingPass1.hlsl", gBufferDefines, "VS", "vs_5_1");
+	mShaders["DefferedShadingPass1PS"] = CompileShader(L"shaders\\DefferedShadingPass1.hlsl", gBufferDefines, "PS", "ps_5_1");
 
 	mShaders["DefferedShadingPass2VS"] = CompileShader(L"shaders\\DefferedShadingPass2.hlsl", nullptr, "VS", "vs_5_1");
 	mShaders["DefferedShadingPass2PS"] = CompileShader(L"shaders\\DefferedShadingPass2.hlsl", nullptr, "PS", "ps_5_1");
@@ -985,6 +1305,13 @@ void MySoftRasterizationApp::BuildShadersAndInputLayout()
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
 	};
+
+	mCompactInputLayout = {
+		{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, offsetof(CompactVertex, Pos), D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, offsetof(CompactVertex, Normal), D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TANGENT", 0, DXGI_FORMAT_R16G16_SNORM, 0, offsetof(CompactVertex, TangentU), D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, offsetof(CompactVertex, TexC), D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+	};
 }
 
 void MySoftRasterizationApp::BuildPSOs()
@@ -1129,6 +1456,7 @@ void MySoftRasterizationApp::BuildPSOs()
 		reinterpret_cast<BYTE*>(mShaders["DefferedShadingPass1PS"]->GetBufferPointer()),
 		mShaders["DefferedShadingPass1PS"]->GetBufferSize()
 	};
+	defferedShadingPass1PsoDesc.InputLayout = { mCompactInputLayout.data(), (UINT)mCompactInputLayout.size() };
 	defferedShadingPass1PsoDesc.NumRenderTargets = 3;
 	defferedShadingPass1PsoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
 	defferedShadingPass1PsoDesc.RTVFormats[1] = DXGI_FORMAT_R16G16B16A16_FLOAT;
@@ -1210,233 +1538,160 @@ void MySoftRasterizationApp::BuildPSOs()
 
 void MySoftRasterizationApp::BuildFrameResources()
 {
+	// one record slot per instance, every view uploads its own list of visible slots and, for the items merged
+	// by auto instancing, a second copy of theirs
 	UINT InstancesSize = 0;
+	std::vector<const InstanceData*> instanceSources;
 	for (const auto& item : mAllRitems)
 	{
+		item->FirstInstanceSlot = InstancesSize;
 		InstancesSize += (UINT)item->Instances.size();
+		for (const auto& instance : item->Instances)
+			instanceSources.push_back(&instance);
+	}
+	mInstanceRecords.Reset(std::move(instanceSources), gNumFrameResources);
+	// worst case every meshlet of every item survives culling
+	UINT meshletIndexCount = 0;
+	for (const auto& item : mAllRitems)
+	{
+		if (item->Meshlets != nullptr)
+			meshletIndexCount += (UINT)item->Meshlets->Indices.size();
 	}
 	for (int i = 0; i < gNumFrameResources; ++i)
 	{
 		mFrameResources.push_back(std::make_unique<FrameResource>(
-			md3dDevice.Get(), 1 + 6 + 1, InstancesSize, (UINT)mMaterials.size(), 0));
+			md3dDevice.Get(), 1 + 6 + 1, InstancesSize, mMaterialTable.Count(), 0, meshletIndexCount, 2 * InstancesSize * (UINT)CullView::Count,
+			(UINT)mAllRitems.size() * (MaxLodCount + (UINT)CullView::Count)));
 	}
 }
 
 void MySoftRasterizationApp::BuildGeometry()
 {
 	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData box = geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3);
-	GeometryGenerator::MeshData grid = geoGen.CreateGrid(20.0f, 30.0f, 60, 40);
-	GeometryGenerator::MeshData sphere = geoGen.CreateGeosphere(0.5f, 3);
-	GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20);
-	GeometryGenerator::MeshData quad = geoGen.CreateQuad(0.5f, 1.0f, 0.5f, 0.5f, 0.0f);
-
-	UINT boxVertexOffset = 0;
-	UINT gridVertexOffset = (UINT)box.Vertices.size();
-	UINT sphereVertexOffset = (UINT)grid.Vertices.size() + gridVertexOffset;
-	UINT cylinderVertexOffset = (UINT)sphere.Vertices.size() + sphereVertexOffset;
-	UINT quadVertexOffset = (UINT)cylinder.Vertices.size() + cylinderVertexOffset;
-
-	UINT boxIndexOffset = 0;
-	UINT gridIndexOffset = (UINT)box.Indices32.size();
-	UINT sphereIndexOffset = (UINT)grid.Indices32.size() + gridIndexOffset;
-	UINT cylinderIndexOffset = (UINT)sphere.Indices32.size() + sphereIndexOffset;
-	UINT quadIndexOffset = (UINT)cylinder.Indices32.size() + cylinderIndexOffset;
-
-	SubmeshGeometry boxSubmesh;
-	boxSubmesh.IndexCount = (UINT)box.Indices32.size();
-	boxSubmesh.StartIndexLocation = boxIndexOffset;
-	boxSubmesh.BaseVertexLocation = boxVertexOffset;
-
-	SubmeshGeometry gridSubmesh;
-	gridSubmesh.IndexCount = (UINT)grid.Indices32.size();
-	gridSubmesh.StartIndexLocation = gridIndexOffset;
-	gridSubmesh.BaseVertexLocation = gridVertexOffset;
-
-	SubmeshGeometry sphereSubmesh;
-	sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
-	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
-	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
-
-	SubmeshGeometry cylinderSubmesh;
-	cylinderSubmesh.IndexCount = (UINT)cylinder.Indices32.size();
-	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
-	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
-
-	SubmeshGeometry quadSubmesh;
-	quadSubmesh.IndexCount = (UINT)quad.Indices32.size();
-	quadSubmesh.BaseVertexLocation = quadVertexOffset;
-	quadSubmesh.StartIndexLocation = quadIndexOffset;
-
-	size_t totalVertexCount =
-		box.Vertices.size() +
-		grid.Vertices.size() +
-		sphere.Vertices.size() +
-		cylinder.Vertices.size() +
-		quad.Vertices.size();
-	std::vector<Vertex> vertices(totalVertexCount);
-
-	UINT k = 0;
-	for (size_t i = 0; i < box.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = box.Vertices[i].Position;
-		//vertices[k].Color = XMFLOAT4(DirectX::Colors::DarkGreen);
-		vertices[k].Normal = box.Vertices[i].Normal;
-		vertices[k].TexC = box.Vertices[i].TexC;
-		vertices[k].TangentU = box.Vertices[i].TangentU;
-	}
-	for (size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = grid.Vertices[i].Position;
-		//vertices[k].Color = XMFLOAT4(DirectX::Colors::ForestGreen);
-		vertices[k].Normal = grid.Vertices[i].Normal;
-		vertices[k].TexC = grid.Vertices[i].TexC;
-		vertices[k].TangentU = grid.Vertices[i].TangentU;
-	}
-	for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
-		//vertices[k].Color = XMFLOAT4(DirectX::Colors::Crimson);
-		vertices[k].Normal = sphere.Vertices[i].Normal;
-		vertices[k].TexC = sphere.Vertices[i].TexC;
-		vertices[k].TangentU = sphere.Vertices[i].TangentU;
-	}
-	for (size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = cylinder.Vertices[i].Position;
-		//vertices[k].Color = XMFLOAT4(DirectX::Colors::SteelBlue);
-		vertices[k].Normal = cylinder.Vertices[i].Normal;
-		vertices[k].TexC = cylinder.Vertices[i].TexC;
-		vertices[k].TangentU = sphere.Vertices[i].TangentU;
-	}
-	for (int i = 0; i < quad.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = quad.Vertices[i].Position;
-		vertices[k].Normal = quad.Vertices[i].Normal;
-		vertices[k].TexC = quad.Vertices[i].TexC;
-		vertices[k].TangentU = quad.Vertices[i].TangentU;
-	}
-
-	std::vector<std::uint16_t> indices;
-	indices.insert(indices.end(), box.GetIndices16().begin(), box.GetIndices16().end());
-	indices.insert(indices.end(), grid.GetIndices16().begin(), grid.GetIndices16().end());
-	indices.insert(indices.end(), sphere.GetIndices16().begin(), sphere.GetIndices16().end());
-	indices.insert(indices.end(), cylinder.GetIndices16().begin(), cylinder.GetIndices16().end());
-	indices.insert(indices.end(), quad.GetIndices16().begin(), quad.GetIndices16().end());
-
-	//verticesindices
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
-
-	//MeshGeometry
-	auto mGeo = std::make_unique<MeshGeometry>();
-	mGeo->Name = "shapeGeo";
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &mGeo->VertexBufferCPU));
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &mGeo->IndexBufferCPU));
-	CopyMemory(mGeo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-	CopyMemory(mGeo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-	mGeo->VertexBufferGPU = CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(), vertices.data(), vbByteSize, mGeo->VertexBufferUploader);
-	mGeo->IndexBufferGPU = CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(), indices.data(), ibByteSize, mGeo->IndexBufferUploader);
-
-	//MeshGeometry
-	mGeo->VertexByteStride = sizeof(Vertex);
-	mGeo->VertexBufferByteSize = vbByteSize;
-	mGeo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	mGeo->IndexBufferByteSize = ibByteSize;
-
-	mGeo->DrawArgs["box"] = boxSubmesh;
-	mGeo->DrawArgs["grid"] = gridSubmesh;
-	mGeo->DrawArgs["sphere"] = sphereSubmesh;
-	mGeo->DrawArgs["cylinder"] = cylinderSubmesh;
-	mGeo->DrawArgs["quad"] = quadSubmesh;
+	const std::pair<const char*, GeometryGenerator::MeshSize> shapes[] =
+	{
+		{ "box", GeometryGenerator::BoxSize(3) },
+		{ "grid", GeometryGenerator::GridSize(60, 40) },
+		{ "sphere", GeometryGenerator::GeosphereSize(3) },
+		{ "cylinder", GeometryGenerator::CylinderSize(20, 20) },
+		{ "quad", GeometryGenerator::QuadSize() },
+	};
+
+	size_t vertexCapacity = 0;
+	size_t indexBytes = 0;
+	for (const auto& shape : shapes)
+	{
+		vertexCapacity += shape.second.VertexCount;
+		indexBytes += GeometryArena::IndexBytesFor(shape.second.VertexCount, shape.second.IndexCount);
+	}
+
+	// 生成器直接写入最终的 CPU blob，既没有 MeshData 也没有逐字段拷贝
+	GeometryArena arena("shapeGeo", vertexCapacity, indexBytes);
+	for (const auto& shape : shapes)
+		arena.Allocate(shape.first, shape.second.VertexCount, shape.second.IndexCount);
+
+	GenerateIntoSubmesh(arena.Get("box"), [&](auto& sink) { geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3, sink); });
+	GenerateIntoSubmesh(arena.Get("grid"), [&](auto& sink) { geoGen.CreateGrid(20.0f, 30.0f, 60, 40, sink); });
+	GenerateIntoSubmesh(arena.Get("sphere"), [&](auto& sink) { geoGen.CreateGeosphere(0.5f, 3, sink); });
+	GenerateIntoSubmesh(arena.Get("cylinder"), [&](auto& sink) { geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20, sink); });
+	GenerateIntoSubmesh(arena.Get("quad"), [&](auto& sink) { geoGen.CreateQuad(0.5f, 1.0f, 0.5f, 0.5f, 0.0f, sink); });
+
+	auto mGeo = arena.Release();
+	mGeo->VertexBufferGPU = CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
+		mGeo->VertexBufferCPU->GetBufferPointer(), mGeo->VertexBufferByteSize, mGeo->VertexBufferUploader);
+	mGeo->IndexBufferGPU = CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
+		mGeo->IndexBufferCPU->GetBufferPointer(), mGeo->IndexBufferByteSize, mGeo->IndexBufferUploader);
+
+	UploadCompactVertices(*mGeo);
 
 	mGeometries[mGeo->Name] = std::move(mGeo);
 }
 
 void MySoftRasterizationApp::BuildModels()
 {
-	// 确保加载阶段已正确记录区间
-	assert(mGunEnd > mGunBegin && "Gun mesh range is empty or not recorded.");
-	//assert(mCaveEnd > mCaveBegin && "Cave mesh range is empty or not recorded.");
-	//assert(mGunBegin <= mGunEnd && mCaveBegin <= mCaveEnd);
-	//assert(mGunEnd <= meshes.size() && mCaveEnd <= meshes.size());
-	assert(mGunBegin <= mGunEnd);
-	assert(mGunEnd <= meshes.size());
-
-	// 先把 gun 与 cave 各自区间合成“大网格”
-	std::vector<Vertex> gunVerts;      gunVerts.reserve(1 << 16);
-	std::vector<uint32_t> gunIndices;  gunIndices.reserve(1 << 16);
-	MergeMeshesRange(meshes, mGunBegin, mGunEnd, gunVerts, gunIndices);
-
-	std::vector<Vertex> caveVerts;      caveVerts.reserve(1 << 16);
-	std::vector<uint32_t> caveIndices;  caveIndices.reserve(1 << 16);
-	MergeMeshesRange(meshes, mCaveBegin, mCaveEnd, caveVerts, caveIndices);
-
-	// 再把两者拼接进同一 MeshGeometry（cave 索引需要整体再加一次 base）
-	std::vector<Vertex> vertices;
-	vertices.reserve(gunVerts.size() + caveVerts.size());
-	vertices.insert(vertices.end(), gunVerts.begin(), gunVerts.end());
-	vertices.insert(vertices.end(), caveVerts.begin(), caveVerts.end());
-
-	std::vector<uint32_t> indices32;
-	indices32.reserve(gunIndices.size() + caveIndices.size());
-	indices32.insert(indices32.end(), gunIndices.begin(), gunIndices.end());
-
-	const uint32_t baseVertexCave = static_cast<uint32_t>(gunVerts.size());
-	indices32.insert(indices32.end(), caveIndices.begin(), caveIndices.end());
-	// 注意：上面 caveIndices 里已经是“各自子网格相对 gun/cave 各自顶点起点”的偏移；
-	// 由于我们把 cave 的顶点整体接在 gun 后面，这里需要加 baseVertexCave。
-	// 如果你希望显式逐个加偏移（更直观），也可以替换成：
-	// for (auto idx : caveIndices) indices32.push_back(idx + baseVertexCave);
-	// 但上面 insert 的写法更高效，前提是 MergeMeshesRange 里对 caveIndices 的 idx
-	// 是相对于 caveVerts 起点的；如果你沿用上面实现，就是相对起点的，需要 +base：
-	//for (size_t k = gunIndices.size(); k < indices32.size(); ++k)
-	//	indices32[k] += baseVertexCave;
-
-	const UINT vbByteSize = static_cast<UINT>(vertices.size() * sizeof(Vertex));
-	const UINT ibByteSize = static_cast<UINT>(indices32.size() * sizeof(uint32_t));
-
-	auto mGeo = std::make_unique<MeshGeometry>();
-	mGeo->Name = "modelGeo";
-
-	// CPU blobs
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &mGeo->VertexBufferCPU));
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &mGeo->IndexBufferCPU));
-	memcpy(mGeo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-	memcpy(mGeo->IndexBufferCPU->GetBufferPointer(), indices32.data(), ibByteSize);
-
-	// GPU buffers —— 传拼好的连续数据
+	// 先打开场景拿到顶点/索引数量，再一次性分配
+	ModelImport gun = ImportModel("Models/Cyborg_Weapon.fbx");
+	//ModelImport cave = ImportModel("Models/cave/cave.gltf");
+
+	// Each LOD level keeps at most half of the previous one, the whole chain fits in the index count of level 0.
+	GeometryArena arena("modelGeo", gun.VertexCount, GeometryArena::IndexBytesFor(gun.VertexCount, (size_t)gun.IndexCount * 2));
+
+	ArenaSubmesh gunSubmesh = arena.Allocate("gun", gun.VertexCount, gun.IndexCount);
+	WriteModel(gun, gunSubmesh);
+	//ArenaSubmesh caveSubmesh = arena.Allocate("cave", cave.VertexCount, cave.IndexCount);
+	//WriteModel(cave, caveSubmesh);
+
+	// LOD 索引追加在 arena 末尾，共享同一份顶点
+	AppendLods(arena, "gun");
+	//AppendLods(arena, "cave");
+
+	auto mGeo = arena.Release();
+
+	// GPU buffers —— 直接从 arena 的 blob 上传
 	mGeo->VertexBufferGPU = CreateDefaultBuffer(
 		md3dDevice.Get(), mCommandList.Get(),
-		vertices.data(), vbByteSize, mGeo->VertexBufferUploader);
+		mGeo->VertexBufferCPU->GetBufferPointer(), mGeo->VertexBufferByteSize, mGeo->VertexBufferUploader);
 
 	mGeo->IndexBufferGPU = CreateDefaultBuffer(
 		md3dDevice.Get(), mCommandList.Get(),
-		indices32.data(), ibByteSize, mGeo->IndexBufferUploader);
+		mGeo->IndexBufferCPU->GetBufferPointer(), mGeo->IndexBufferByteSize, mGeo->IndexBufferUploader);
+
+	UploadCompactVertices(*mGeo);
+
+	mGeometries[mGeo->Name] = std::move(mGeo);
+}
+
+void MySoftRasterizationApp::UploadCompactVertices(MeshGeometry& geo)
+{
+	// The G-buffer pass reads this copy, the other passes keep the full layout
+	CompactMesh compact;
+	mVertexCompressionReport.Merge(VertexCompression::EncodeGeometry(geo, compact));
 
-	mGeo->VertexByteStride = sizeof(Vertex);
-	mGeo->VertexBufferByteSize = vbByteSize;
+	geo.CompactVertexByteStride = sizeof(CompactVertex);
+	geo.CompactVertexBufferByteSize = (UINT)(compact.Vertices.size() * sizeof(CompactVertex));
+	geo.CompactVertexBufferGPU = CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
+		compact.Vertices.data(), geo.CompactVertexBufferByteSize, geo.CompactVertexBufferUploader);
 
-	// 顶点数可能 > 65535，统一用 32 位索引
-	mGeo->IndexFormat = DXGI_FORMAT_R32_UINT;
-	mGeo->IndexBufferByteSize = ibByteSize;
+	for (const auto& q : compact.Quantization)
+		mVertexQuantization[geo.Name + "/" + q.first] = VertexQuantizationConstants::From(q.second);
+}
 
-	// Submesh 记录
-	SubmeshGeometry submeshGun{};
-	submeshGun.IndexCount = static_cast<UINT>(gunIndices.size());
-	submeshGun.StartIndexLocation = 0;
-	submeshGun.BaseVertexLocation = 0;
+void MySoftRasterizationApp::AppendLods(GeometryArena& arena, const std::string& submeshName)
+{
+	ArenaSubmesh base = arena.Get(submeshName);
 
-	SubmeshGeometry submeshCave{};
-	submeshCave.IndexCount = static_cast<UINT>(caveIndices.size());
-	submeshCave.StartIndexLocation = static_cast<UINT>(gunIndices.size());
-	submeshCave.BaseVertexLocation = static_cast<UINT>(gunVerts.size());
+	std::vector<std::uint32_t> baseIndices(base.IndexCount);
+	for (UINT i = 0; i < base.IndexCount; ++i)
+		baseIndices[i] = base.GetIndex(i);
 
-	mGeo->DrawArgs["gun"] = submeshGun;
-	//mGeo->DrawArgs["cave"] = submeshCave;
+	std::vector<MeshLod> chain = MeshSimplifier::BuildLodChain(base.Vertices, base.VertexCount,
+		baseIndices.data(), baseIndices.size(), MaxLodCount);
 
-	mGeometries[mGeo->Name] = std::move(mGeo);
+	for (size_t i = 0; i < chain.size(); ++i)
+	{
+		const std::string lodName = submeshName + "_lod" + std::to_string(i + 1);
+		ArenaSubmesh lod = arena.AllocateShared(lodName, submeshName, (UINT)chain[i].Indices.size());
+		for (UINT k = 0; k < lod.IndexCount; ++k)
+			lod.SetIndex(k, chain[i].Indices[k]);
+
+		SubmeshGeometry& submesh = arena.Submesh(lodName);
+		submesh.LodLevel = (UINT)i + 1;
+		submesh.LodError = chain[i].Error;
+	}
+}
+
+void MySoftRasterizationApp::BuildMeshlets()
+{
+	for (const auto& geo : mGeometries)
+	{
+		for (const auto& arg : geo.second->DrawArgs)
+		{
+			// LODs are only selected for distant instances and drawn whole
+			if (arg.second.LodLevel > 0)
+				continue;
+			mMeshlets[geo.first + "/" + arg.first] = Meshlets::BuildSubmesh(*geo.second, arg.second);
+		}
+	}
 }
 
 void MySoftRasterizationApp::BuildMaterial()
@@ -1550,15 +1805,38 @@ void MySoftRasterizationApp::BuildMaterial()
 	//cave->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
 	//cave->Roughness = 0.7f;
 	//mMaterials["cave"] = std::move(cave);
+
+	// Feedback is recorded per material, so every material lists the textures it samples
+	for (auto& e : mMaterials)
+	{
+		Material* mat = e.second.get();
+		mTextureStreamer->MapMaterial(mat->MatCBIndex, mSrvSlotTextures[mat->DiffuseSrvHeapIndex]);
+		mTextureStreamer->MapMaterial(mat->MatCBIndex, mSrvSlotTextures[mat->NormalSrvHeapIndex]);
+	}
+	// GunPBR.hlsl samples the roughness, metallic and AO maps with the weapon's uvs
+	for (int i = 10; i <= 12; ++i)
+		mTextureStreamer->MapMaterial(mMaterials["weapon"]->MatCBIndex, mSrvSlotTextures[i]);
+
+	UINT materialCount = 0;
+	for (auto& e : mMaterials)
+		materialCount = std::max(materialCount, (UINT)e.second->MatCBIndex + 1);
+	// Every material has a feedback slot, MapMaterial asserts the same per material
+	assert(materialCount <= MaxStreamedMaterials);
+	mMaterialTable.Reset(materialCount, gNumFrameResources);
+	for (auto& e : mMaterials)
+		mMaterialTable.Set(*e.second);
 }
 
 void MySoftRasterizationApp::BuildRenderItems()
 {
+	const SubmeshHandle sphere = FindSubmesh("shapeGeo/sphere");
+	const SubmeshHandle grid = FindSubmesh("shapeGeo/grid");
+	const SubmeshHandle quad = FindSubmesh("shapeGeo/quad");
+	const SubmeshHandle cylinder = FindSubmesh("shapeGeo/cylinder");
+	const SubmeshHandle gun = FindSubmesh("modelGeo/gun");
+
 	auto sphereRitem = std::make_unique<RenderItem>();
-	sphereRitem->Geo = mGeometries["shapeGeo"].get();
-	sphereRitem->IndexCount = sphereRitem->Geo->DrawArgs["sphere"].IndexCount;
-	sphereRitem->StartIndexLocation = sphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-	sphereRitem->BaseVertexLocation = sphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+	AssignSubmesh(*sphereRitem, sphere);
 	sphereRitem->InstanceCount = 0;
 	sphereRitem->Instances.resize(2);
 	sphereRitem->Instances[0].World = MathHelper::Identity4x4();
@@ -1572,10 +1850,7 @@ void MySoftRasterizationApp::BuildRenderItems()
 	mAllRitems.push_back(std::move(sphereRitem));
 
 	auto gridRitem = std::make_unique<RenderItem>();
-	gridRitem->Geo = mGeometries["shapeGeo"].get();
-	gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-	gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+	AssignSubmesh(*gridRitem, grid);
 	gridRitem->InstanceCount = 0;
 	gridRitem->Instances.resize(1);
 	XMStoreFloat4x4(&gridRitem->Instances[0].World, XMMatrixTranslation(0.0f, -1.0f, 0.0f));
@@ -1585,10 +1860,7 @@ void MySoftRasterizationApp::BuildRenderItems()
 	mAllRitems.push_back(std::move(gridRitem));
 
 	auto withoutNormalMapSphereRitem = std::make_unique<RenderItem>();
-	withoutNormalMapSphereRitem->Geo = mGeometries["shapeGeo"].get();
-	withoutNormalMapSphereRitem->IndexCount = withoutNormalMapSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
-	withoutNormalMapSphereRitem->StartIndexLocation = withoutNormalMapSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-	withoutNormalMapSphereRitem->BaseVertexLocation = withoutNormalMapSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+	AssignSubmesh(*withoutNormalMapSphereRitem, sphere);
 	withoutNormalMapSphereRitem->InstanceCount = 0;
 	withoutNormalMapSphereRitem->Instances.resize(1);
 	XMStoreFloat4x4(&withoutNormalMapSphereRitem->Instances[0].World, XMMatrixTranslation(-2.0f, 0.0f, 0.0f));
@@ -1599,10 +1871,7 @@ void MySoftRasterizationApp::BuildRenderItems()
 	mAllRitems.push_back(std::move(withoutNormalMapSphereRitem));
 
 	auto alphaTestedSphereRitem = std::make_unique<RenderItem>();
-	alphaTestedSphereRitem->Geo = mGeometries["shapeGeo"].get();
-	alphaTestedSphereRitem->IndexCount = alphaTestedSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
-	alphaTestedSphereRitem->StartIndexLocation = alphaTestedSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-	alphaTestedSphereRitem->BaseVertexLocation = alphaTestedSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+	AssignSubmesh(*alphaTestedSphereRitem, sphere);
 	alphaTestedSphereRitem->InstanceCount = 0;
 	alphaTestedSphereRitem->Instances.resize(1);
 	XMStoreFloat4x4(&alphaTestedSphereRitem->Instances[0].World, XMMatrixTranslation(4.0f, 0.0f, 0.0f));
@@ -1613,10 +1882,7 @@ void MySoftRasterizationApp::BuildRenderItems()
 	mAllRitems.push_back(std::move(alphaTestedSphereRitem));
 
 	auto transparentSphereRitem = std::make_unique<RenderItem>();
-	transparentSphereRitem->Geo = mGeometries["shapeGeo"].get();
-	transparentSphereRitem->IndexCount = transparentSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
-	transparentSphereRitem->StartIndexLocation = transparentSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-	transparentSphereRitem->BaseVertexLocation = transparentSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+	AssignSubmesh(*transparentSphereRitem, sphere);
 	transparentSphereRitem->InstanceCount = 0;
 	transparentSphereRitem->Instances.resize(1);
 	XMStoreFloat4x4(&transparentSphereRitem->Instances[0].World, XMMatrixTranslation(6.0f, 0.0f, 0.0f));
@@ -1627,10 +1893,7 @@ void MySoftRasterizationApp::BuildRenderItems()
 	mAllRitems.push_back(std::move(transparentSphereRitem));
 
 	auto skySphereRitem = std::make_unique<RenderItem>();
-	skySphereRitem->Geo = mGeometries["shapeGeo"].get();
-	skySphereRitem->IndexCount = skySphereRitem->Geo->DrawArgs["sphere"].IndexCount;
-	skySphereRitem->StartIndexLocation = skySphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-	skySphereRitem->BaseVertexLocation = skySphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+	AssignSubmesh(*skySphereRitem, sphere);
 	skySphereRitem->InstanceCount = 0;
 	skySphereRitem->Instances.resize(1);
 	XMStoreFloat4x4(&skySphereRitem->Instances[0].World, XMMatrixScaling(1.0f, 1.0f, 1.0f));
@@ -1640,10 +1903,7 @@ void MySoftRasterizationApp::BuildRenderItems()
 	mAllRitems.push_back(std::move(skySphereRitem));
 
 	auto dynamicReflectionSphereRitem = std::make_unique<RenderItem>();
-	dynamicReflectionSphereRitem->Geo = mGeometries["shapeGeo"].get();
-	dynamicReflectionSphereRitem->IndexCount = dynamicReflectionSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
-	dynamicReflectionSphereRitem->StartIndexLocation = dynamicReflectionSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-	dynamicReflectionSphereRitem->BaseVertexLocation = dynamicReflectionSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+	AssignSubmesh(*dynamicReflectionSphereRitem, sphere);
 	dynamicReflectionSphereRitem->InstanceCount = 0;
 	dynamicReflectionSphereRitem->Instances.resize(1);
 	XMStoreFloat4x4(&dynamicReflectionSphereRitem->Instances[0].World, XMMatrixTranslation(8.0f, 0.0f, 0.0f));
@@ -1653,10 +1913,7 @@ void MySoftRasterizationApp::BuildRenderItems()
 	mAllRitems.push_back(std::move(dynamicReflectionSphereRitem));
 
 	auto quadRitem = std::make_unique<RenderItem>();
-	quadRitem->Geo = mGeometries["shapeGeo"].get();
-	quadRitem->IndexCount = quadRitem->Geo->DrawArgs["quad"].IndexCount;
-	quadRitem->StartIndexLocation = quadRitem->Geo->DrawArgs["quad"].StartIndexLocation;
-	quadRitem->BaseVertexLocation = quadRitem->Geo->DrawArgs["quad"].BaseVertexLocation;
+	AssignSubmesh(*quadRitem, quad);
 	quadRitem->InstanceCount = 0;
 	quadRitem->Instances.resize(1);
 	quadRitem->Instances[0].World = MathHelper::Identity4x4();
@@ -1666,10 +1923,7 @@ void MySoftRasterizationApp::BuildRenderItems()
 	mAllRitems.push_back(std::move(quadRitem));
 
 	auto pbrRitem = std::make_unique<RenderItem>();
-	pbrRitem->Geo = mGeometries["shapeGeo"].get();
-	pbrRitem->IndexCount = pbrRitem->Geo->DrawArgs["sphere"].IndexCount;
-	pbrRitem->StartIndexLocation = pbrRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-	pbrRitem->BaseVertexLocation = pbrRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+	AssignSubmesh(*pbrRitem, sphere);
 	pbrRitem->InstanceCount = 0;
 	pbrRitem->Instances.resize(3);
 	for (int i = 0; i < 3; ++i)
@@ -1677,29 +1931,31 @@ void MySoftRasterizationApp::BuildRenderItems()
 		std::string matName = "pbr" + std::to_string(i);
 		XMStoreFloat4x4(&pbrRitem->Instances[i].World, XMMatrixTranslation(-5.0f, -0.5f + i * 1.0f, -2.0f));
 		pbrRitem->Instances[i].TexTransform = MathHelper::Identity4x4();
-		pbrRitem->Instances[i].MaterialIndex = mMaterials[matName]->MatCBIndex;
+		pbrRitem->Instances[i].MaterialIndex = FindMaterialIndex(matName);
 	}
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(pbrRitem.get());
 	mAllRitems.push_back(std::move(pbrRitem));
 
 	auto gunRitem = std::make_unique<RenderItem>();
-	gunRitem->Geo = mGeometries["modelGeo"].get();
-	gunRitem->IndexCount = gunRitem->Geo->DrawArgs["gun"].IndexCount;
-	gunRitem->StartIndexLocation = gunRitem->Geo->DrawArgs["gun"].StartIndexLocation;
-	gunRitem->BaseVertexLocation = gunRitem->Geo->DrawArgs["gun"].BaseVertexLocation;
+	AssignSubmesh(*gunRitem, gun);
 	gunRitem->InstanceCount = 0;
 	gunRitem->Instances.resize(1);
 	XMStoreFloat4x4(&gunRitem->Instances[0].World, XMMatrixTranslation(0.0f, -0.05f, -3.0f) * XMMatrixScaling(3.0f, 3.0f, 3.0f));
 	gunRitem->Instances[0].TexTransform = MathHelper::Identity4x4();
 	gunRitem->Instances[0].MaterialIndex = 42; // Assuming gun material is at index 0
+	gunRitem->Lods.push_back(mSubmeshRegistry[gun].Args);
+	for (UINT lod = 1; lod <= MaxLodCount; ++lod)
+	{
+		SubmeshHandle handle = mSubmeshRegistry.Find("modelGeo/gun_lod" + std::to_string(lod));
+		if (handle.IsNull())
+			break;
+		gunRitem->Lods.push_back(mSubmeshRegistry[handle].Args);
+	}
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(gunRitem.get());
 	mAllRitems.push_back(std::move(gunRitem));
 
 	auto cylinderRitem = std::make_unique<RenderItem>();
-	cylinderRitem->Geo = mGeometries["shapeGeo"].get();
-	cylinderRitem->IndexCount = cylinderRitem->Geo->DrawArgs["cylinder"].IndexCount;
-	cylinderRitem->StartIndexLocation = cylinderRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-	cylinderRitem->BaseVertexLocation = cylinderRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+	AssignSubmesh(*cylinderRitem, cylinder);
 	cylinderRitem->InstanceCount = 0;
 	cylinderRitem->Instances.resize(1);
 	XMStoreFloat4x4(&cylinderRitem->Instances[0].World, XMMatrixTranslation(-2.0f, 0.5f, -4.0f));
@@ -1720,36 +1976,397 @@ void MySoftRasterizationApp::BuildRenderItems()
 	//caveRitem->Instances[0].MaterialIndex = 44; // Assuming gun material is at index 0
 	//mRitemLayer[(int)RenderLayer::Opaque].push_back(caveRitem.get());
 	//mAllRitems.push_back(std::move(caveRitem));
+
+	BuildStressScene();
+	for (UINT i = 0; i < (UINT)mAllRitems.size(); ++i)
+		mAllRitems[i]->ItemIndex = i;
+
+	// Sort key fields that never change
+	for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		for (auto ri : mRitemLayer[layer])
+		{
+			ri->Layer = (UINT)layer;
+			ri->SortGeometry = mSubmeshRegistry[ri->Submesh].Geo.Index();
+		}
+	}
+
+	// Opaque items go through the meshlet culling pass
+	for (auto ri : mRitemLayer[(int)RenderLayer::Opaque])
+		ri->Meshlets = mSubmeshRegistry[ri->Submesh].Meshlets;
+
+	BuildInstancingGroups();
+}
+
+void MySoftRasterizationApp::BuildStressScene()
+{
+	// A grid of sphere items next to the scene, the way a scene built object by object ends up
+	const SubmeshHandle sphere = FindSubmesh("shapeGeo/sphere");
+	UINT pbrMaterials[36];
+	for (UINT m = 0; m < 36; ++m)
+		pbrMaterials[m] = FindMaterialIndex("pbr" + std::to_string(m));
+	for (UINT i = 0; i < StressSphereItems; ++i)
+	{
+		auto ri = std::make_unique<RenderItem>();
+		AssignSubmesh(*ri, sphere);
+		ri->Instances.resize(StressSphereInstances);
+		const float x = 12.0f + 1.5f * (i % 50);
+		const float z = -10.0f + 1.5f * (i / 50);
+		for (UINT j = 0; j < StressSphereInstances; ++j)
+		{
+			XMStoreFloat4x4(&ri->Instances[j].World, XMMatrixTranslation(x, 1.2f * j, z));
+			ri->Instances[j].MaterialIndex = pbrMaterials[(i + j) % 36];
+		}
+		mRitemLayer[(int)RenderLayer::StressSpheres].push_back(ri.get());
+		mAllRitems.push_back(std::move(ri));
+	}
+}
+
+void MySoftRasterizationApp::BuildInstancingGroups()
+{
+	// Items with LODs upload their instances in LOD order and draw per LOD, they stay on their own
+	mInstancingGroups.clear();
+	for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		std::map<std::pair<UINT, D3D12_PRIMITIVE_TOPOLOGY>, InstancingGroup> groups;
+		for (auto ri : mRitemLayer[layer])
+		{
+			if (!ri->Lods.empty())
+				continue;
+			auto key = std::make_pair(ri->Submesh.Value, ri->PrimitiveType);
+			InstancingGroup& group = groups[key];
+			group.Items.push_back(ri);
+			group.UsesMeshlets |= ri->Meshlets != nullptr;
+		}
+		for (auto& group : groups)
+		{
+			if (group.second.Items.size() > 1)
+				mInstancingGroups.push_back(std::move(group.second));
+		}
+	}
+}
+
+void MySoftRasterizationApp::RegisterResources()
+{
+	for (auto& geo : mGeometries)
+	{
+		GeometryHandle geoHandle = mGeometryRegistry.Add(geo.first, geo.second.get());
+		for (auto& arg : geo.second->DrawArgs)
+		{
+			const std::string name = geo.first + "/" + arg.first;
+			SubmeshEntry entry;
+			entry.Geo = geoHandle;
+			entry.Args = arg.second;
+			auto quantization = mVertexQuantization.find(name);
+			if (quantization != mVertexQuantization.end())
+				entry.Quantization = quantization->second;
+			auto meshlets = mMeshlets.find(name);
+			if (meshlets != mMeshlets.end())
+				entry.Meshlets = &meshlets->second;
+			mSubmeshRegistry.Add(name, entry);
+		}
+	}
+	for (auto& mat : mMaterials)
+		mMaterialRegistry.Add(mat.first, mat.second.get());
+	for (auto& texture : mTextureIds)
+		mTextureRegistry.Add(texture.first, texture.second);
+
+	mSkyTexture = mTextureRegistry.Find("skyCubeMap");
+	assert(!mSkyTexture.IsNull());
+}
+
+SubmeshHandle MySoftRasterizationApp::FindSubmesh(const std::string& name) const
+{
+	SubmeshHandle handle = mSubmeshRegistry.Find(name);
+	assert(!handle.IsNull());
+	return handle;
+}
+
+UINT MySoftRasterizationApp::FindMaterialIndex(const std::string& name) const
+{
+	MaterialHandle handle = mMaterialRegistry.Find(name);
+	assert(!handle.IsNull());
+	return (UINT)mMaterialRegistry[handle]->MatCBIndex;
+}
+
+void MySoftRasterizationApp::AssignSubmesh(RenderItem& ri, SubmeshHandle submesh)
+{
+	const SubmeshEntry& entry = mSubmeshRegistry[submesh];
+	ri.Submesh = submesh;
+	ri.Geo = mGeometryRegistry[entry.Geo];
+	ri.IndexCount = entry.Args.IndexCount;
+	ri.StartIndexLocation = entry.Args.StartIndexLocation;
+	ri.BaseVertexLocation = entry.Args.BaseVertexLocation;
+	ri.IndexFormat = entry.Args.IndexFormat;
+	ri.Bounds = entry.Args.Bounds;
+	ri.Quantization = entry.Quantization;
+}
+
+void MySoftRasterizationApp::RegisterPSOs()
+{
+	for (auto& pso : mPSOs)
+		mPsoRegistry.Add(pso.first, pso.second.Get());
+
+	auto find = [this](const char* name)
+	{
+		PsoHandle handle = mPsoRegistry.Find(name);
+		assert(!handle.IsNull());
+		return handle;
+	};
+	mPsoIds.Opaque = find("opaque");
+	mPsoIds.WithoutNormalMap = find("withoutNormalMap");
+	mPsoIds.AlphaTested = find("alphaTested");
+	mPsoIds.Transparent = find("transparent");
+	mPsoIds.Sky = find("sky");
+	mPsoIds.Shadow = find("shadow");
+	mPsoIds.DrawNormals = find("drawNormals");
+	mPsoIds.Brdf = find("brdf");
+	mPsoIds.BrdfEu = find("brdfEu");
+	mPsoIds.Eavg = find("Eavg");
+	mPsoIds.DefferedShadingPass1 = find("DefferedShadingPass1");
+	mPsoIds.DefferedShadingPass2 = find("DefferedShadingPass2");
+	mPsoIds.Ssr = find("ssr");
+	mPsoIds.SsrComposite = find("ssrComposite");
+	mPsoIds.SceneWithoutSsr = find("SceneWithoutSSR");
+	mPsoIds.HiZFromDepth = find("hiZFromDepth");
+	mPsoIds.HiZ = find("hiZ");
+}
+
+void MySoftRasterizationApp::BuildUpdateGraph()
+{
+	// Stages that touch the same data are ordered by an edge, the rest may overlap. The culling results feed the
+	// per item stages, the scene bounds from the BVH feed the shadow transform and the main pass constants are
+	// copied into the shadow and SSAO ones. RunSerial runs them in this order.
+	JobGraph& g = mUpdateGraph;
+	const UINT sceneBvh = g.Add("Scene BVH", [this]() { UpdateSceneBvh(); });
+	const UINT lods = g.Add("LOD Selection", [this]() { UpdateLodSelection(); });
+	const UINT sortDepths = g.Add("Sort Depths", [this]() { UpdateSortDepths(); });
+	const UINT instances = g.Add("Instance Buffers", [this]() { UpdateInstanceBuffers(gt); });
+	const UINT indirect = g.Add("Indirect Draws", [this]() { UpdateIndirectDraws(); });
+	const UINT meshlets = g.Add("Meshlet Culling", [this]() { UpdateMeshletCulling(); });
+	const UINT materials = g.Add("Material Buffer", [this]() { UpdateMaterialCBs(gt); });
+	const UINT shadowTransform = g.Add("Shadow Transform", [this]() { UpdateShadowTransform(); });
+	const UINT mainPass = g.Add("Main Pass CBs", [this]() { UpdateMainPassCBs(); });
+	const UINT shadowPass = g.Add("Shadow Pass CB", [this]() { UpdateShadowPassCBs(); });
+	const UINT ssao = g.Add("SSAO CB", [this]() { UpdateSsaoCBs(); });
+	const UINT ssr = g.Add("SSR CB", [this]() { UpdateSSRConstants(); });
+	(void)materials;
+	(void)ssr;
+
+	for (UINT stage : { lods, sortDepths, meshlets, shadowTransform })
+		g.Depend(stage, sceneBvh);
+	g.Depend(instances, lods);
+	// The commands copy the final draw lists and point at the surviving meshlet indices
+	g.Depend(indirect, instances);
+	g.Depend(indirect, meshlets);
+	g.Depend(mainPass, shadowTransform);
+	g.Depend(shadowPass, mainPass);
+	g.Depend(ssao, mainPass);
+}
+
+void MySoftRasterizationApp::BuildSceneBvh()
+{
+	// Sky and debug items are drawn whole every frame, everything else is placed in the world and culled.
+	const RenderLayer culledLayers[] =
+	{
+		RenderLayer::Opaque, RenderLayer::WithoutNormalMap, RenderLayer::AlphaTested,
+		RenderLayer::Transparent, RenderLayer::OpaqueDynamicReflectors, RenderLayer::StressSpheres,
+	};
+	std::unordered_map<const RenderItem*, UINT> itemIndices;
+	for (UINT i = 0; i < (UINT)mAllRitems.size(); ++i)
+		itemIndices[mAllRitems[i].get()] = i;
+	std::unordered_map<const RenderItem*, UINT> layerMasks;
+	for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		for (auto ri : mRitemLayer[layer])
+			layerMasks[ri] |= 1u << layer;
+	}
+
+	mScene.Clear();
+	for (RenderLayer layer : culledLayers)
+	{
+		for (auto ri : mRitemLayer[(int)layer])
+		{
+			if (ri->FirstBvhPrimitive != UINT_MAX)
+				continue;
+			ri->FirstBvhPrimitive = mScene.Count();
+			for (UINT i = 0; i < (UINT)ri->Instances.size(); ++i)
+			{
+				SceneStore::InstanceDesc desc;
+				desc.World = ri->Instances[i].World;
+				desc.LocalBounds = ri->Bounds;
+				desc.MaterialIndex = ri->Instances[i].MaterialIndex;
+				desc.LayerMask = layerMasks[ri];
+				desc.Item = itemIndices[ri];
+				desc.ItemInstance = i;
+				desc.Name = ri->Geo->Name;
+				desc.Geo = ri->Geo;
+				mScene.Create(desc);
+			}
+		}
+	}
+
+	std::vector<BoundingBox> boxes(mScene.Count());
+	for (UINT p = 0; p < mScene.Count(); ++p)
+		boxes[p] = mScene.WorldBox(p);
+	mSceneBvh.Build(boxes.data(), (UINT)boxes.size());
+
+	mCullMasks.resize(mScene.WorldBounds().PaddedCount());
+
+	for (auto& ri : mAllRitems)
+	{
+		ri->VisibleInstances.resize(ri->Instances.size());
+		for (UINT i = 0; i < (UINT)ri->Instances.size(); ++i)
+			ri->VisibleInstances[i] = i;
+		for (auto& instances : ri->ViewInstances)
+			instances = ri->VisibleInstances;
+	}
 }
 
-void MySoftRasterizationApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*> ritems)
+void MySoftRasterizationApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*> ritems, bool useMeshlets,
+	CullView view, bool compactVertices)
 {
 	//UINT objConstSize = CalcConstantBufferByteSize(sizeof(ObjectConstants));
 
 	//auto objCB = mCurrFrameResource->ObjectCB->Resource();
 
-	for (size_t i = 0; i < ritems.size(); ++i)
+	// What Update left in the items for this frame comes with its packet
+	const FramePacket& packet = *mRenderPacket;
+	const bool mainView = view == CullView::Main;
+	auto instanceCountOf = [&](const RenderItem* ri)
+	{
+		return packet.Items[ri->ItemIndex].InstanceCount[(int)view];
+	};
+
+	// The caller binds one PSO for the whole list. Only the main view sorts by depth, the others just group state.
+	auto start = std::chrono::high_resolution_clock::now();
+	mRenderQueue.Clear();
+	for (UINT i = 0; i < (UINT)ritems.size(); ++i)
+	{
+		const RenderItem* ri = ritems[i];
+		if (instanceCountOf(ri) == 0)
+			continue;
+
+		const UINT material = ri->Mat != nullptr ? (UINT)ri->Mat->MatCBIndex : 0;
+		const UINT depth = mainView ? SortKey::QuantizeDepth(packet.Items[ri->ItemIndex].SortDepth, packet.NearZ, packet.FarZ) : 0;
+		mRenderQueue.Push(ri->Layer == (UINT)RenderLayer::Transparent ?
+			SortKey::Transparent(ri->Layer, 0, ri->SortGeometry, material, depth) :
+			SortKey::Opaque(ri->Layer, 0, ri->SortGeometry, material, depth), i);
+	}
+	if (packet.SortDraws)
+		mRenderQueue.Sort();
+	auto end = std::chrono::high_resolution_clock::now();
+	mRenderQueueMs += std::chrono::duration<double, std::milli>(end - start).count();
+
+	// State bound by the previous draws of this list, a meshlet index buffer leaves boundIndexGeo null
+	const MeshGeometry* boundVertexGeo = nullptr;
+	const MeshGeometry* boundIndexGeo = nullptr;
+	DXGI_FORMAT boundIndexFormat = DXGI_FORMAT_UNKNOWN;
+	D3D12_PRIMITIVE_TOPOLOGY boundTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	auto bindIndexBuffer = [&](const MeshGeometry* geo, DXGI_FORMAT format)
+	{
+		if (format == DXGI_FORMAT_UNKNOWN)
+			format = geo->IndexFormat;
+		if (packet.SortDraws && geo == boundIndexGeo && format == boundIndexFormat)
+			return;
+		cmdList->IASetIndexBuffer(&geo->IndexBufferView(format));
+		boundIndexGeo = geo;
+		boundIndexFormat = format;
+		++mDrawStateChanges.IndexBuffers;
+	};
+
+	for (UINT k = 0; k < mRenderQueue.Size(); ++k)
 	{
-		auto ri = ritems[i];
+		auto ri = ritems[mRenderQueue.Item(k)];
+		const ItemDrawState& item = packet.Items[ri->ItemIndex];
+		const UINT instanceCount = item.InstanceCount[(int)view];
 
-		cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-		cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-		cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+		if (!packet.SortDraws || ri->Geo != boundVertexGeo)
+		{
+			const D3D12_VERTEX_BUFFER_VIEW vbv = compactVertices ? ri->Geo->CompactVertexBufferView() : ri->Geo->VertexBufferView();
+			cmdList->IASetVertexBuffers(0, 1, &vbv);
+			boundVertexGeo = ri->Geo;
+			++mDrawStateChanges.VertexBuffers;
+		}
+		// The PSO decodes positions on the grid of the item's submesh
+		if (compactVertices)
+			cmdList->SetGraphicsRoot32BitConstants(7, sizeof(VertexQuantizationConstants) / 4, &ri->Quantization, 0);
+		if (!packet.SortDraws || ri->PrimitiveType != boundTopology)
+		{
+			cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+			boundTopology = ri->PrimitiveType;
+			++mDrawStateChanges.Topologies;
+		}
 
 		//D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objCB->GetGPUVirtualAddress() + ri->ObjCBIndex * objConstSize;
 
-		auto instanceBuffer = mCurrFrameResource->InstanceBuffer->Resource();
-		D3D12_GPU_VIRTUAL_ADDRESS instanceBufferAddress = instanceBuffer->GetGPUVirtualAddress() +
-			ri->InstanceBufferIndex * sizeof(InstanceData);
+		auto instanceIndexBuffer = mRenderFrameResource->InstanceIndexBuffer->Resource();
+		D3D12_GPU_VIRTUAL_ADDRESS instanceBufferAddress = instanceIndexBuffer->GetGPUVirtualAddress() +
+			item.InstanceBufferIndex[(int)view] * sizeof(std::uint32_t);
 		//cmdList->SetGraphicsRootConstantBufferView(2, objCBAddress);
 		cmdList->SetGraphicsRootShaderResourceView(2, instanceBufferAddress);
 
+		// Indices of the surviving meshlets, relative to the submesh base vertex like the original ones
+		auto drawMeshlets = [&](UINT instanceCount)
+		{
+			if (item.MeshletIndexCount == 0)
+				return;
+
+			D3D12_INDEX_BUFFER_VIEW meshletIbv;
+			meshletIbv.BufferLocation = mRenderFrameResource->MeshletIndexBuffer->Resource()->GetGPUVirtualAddress() +
+				item.MeshletIndexStart * sizeof(std::uint32_t);
+			meshletIbv.SizeInBytes = item.MeshletIndexCount * sizeof(std::uint32_t);
+			meshletIbv.Format = DXGI_FORMAT_R32_UINT;
+			cmdList->IASetIndexBuffer(&meshletIbv);
+			boundIndexGeo = nullptr;
+			++mDrawStateChanges.IndexBuffers;
+
+			cmdList->DrawIndexedInstanced(item.MeshletIndexCount, instanceCount, 0, ri->BaseVertexLocation, 0);
+			++mDrawStateChanges.Draws;
+		};
+
+		// The other views draw their instances in one go at full resolution, LODs and meshlets follow the main camera
+		if (mainView && item.LodCount > 0)
+		{
+			// Instances were uploaded grouped by LOD, one draw per non-empty group
+			UINT firstInstance = 0;
+			for (UINT lod = 0; lod < item.LodCount; ++lod)
+			{
+				UINT count = item.LodInstanceCounts[lod];
+				if (count == 0)
+					continue;
+
+				cmdList->SetGraphicsRootShaderResourceView(2, instanceBufferAddress + firstInstance * sizeof(std::uint32_t));
+				if (lod == 0 && useMeshlets && ri->Meshlets != nullptr)
+				{
+					drawMeshlets(count);
+				}
+				else
+				{
+					const SubmeshGeometry& submesh = ri->Lods[lod];
+					bindIndexBuffer(ri->Geo, submesh.IndexFormat);
+					cmdList->DrawIndexedInstanced(submesh.IndexCount, count, submesh.StartIndexLocation, submesh.BaseVertexLocation, 0);
+					++mDrawStateChanges.Draws;
+				}
+				firstInstance += count;
+			}
+			continue;
+		}
+
+		if (mainView && useMeshlets && ri->Meshlets != nullptr)
+		{
+			drawMeshlets(instanceCount);
+			continue;
+		}
+
+		bindIndexBuffer(ri->Geo, ri->IndexFormat);
 		cmdList->DrawIndexedInstanced(
 			ri->IndexCount, // Index count per instance
-			ri->InstanceCount,      // Instance count
+			instanceCount,      // Instance count
 			ri->StartIndexLocation, // Start index location
 			ri->BaseVertexLocation,  // Base vertex location
 			0);             // Instance start offset
+		++mDrawStateChanges.Draws;
 	}
 }
 
@@ -1771,25 +2388,25 @@ void MySoftRasterizationApp::DrawSceneToCubeMap()
 
 		mCommandList->OMSetRenderTargets(1, &mDynamicCubeMap->Rtv(i), true, &mCubeDSV);
 
-		auto passCB = mCurrFrameResource->PassCB->Resource();
+		auto passCB = mRenderFrameResource->PassCB->Resource();
 		D3D12_GPU_VIRTUAL_ADDRESS passCBAddress = passCB->GetGPUVirtualAddress() + (1 + i) * passCBByteSize;
 		mCommandList->SetGraphicsRootConstantBufferView(1, passCBAddress);
 
 		DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
 
-		mCommandList->SetPipelineState(mPSOs["withoutNormalMap"].Get());
+		mCommandList->SetPipelineState(mPsoRegistry[mPsoIds.WithoutNormalMap]);
 		DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::WithoutNormalMap]);
 
-		mCommandList->SetPipelineState(mPSOs["sky"].Get());
+		mCommandList->SetPipelineState(mPsoRegistry[mPsoIds.Sky]);
 		DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Sky]);
 
-		mCommandList->SetPipelineState(mPSOs["alphaTested"].Get());
+		mCommandList->SetPipelineState(mPsoRegistry[mPsoIds.AlphaTested]);
 		DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTested]);
 
-		mCommandList->SetPipelineState(mPSOs["transparent"].Get());
+		mCommandList->SetPipelineState(mPsoRegistry[mPsoIds.Transparent]);
 		DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Transparent]);
 
-		mCommandList->SetPipelineState(mPSOs["opaque"].Get());
+		mCommandList->SetPipelineState(mPsoRegistry[mPsoIds.Opaque]);
 	}
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
 		mDynamicCubeMap->Resource(),
@@ -1806,11 +2423,20 @@ void MySoftRasterizationApp::DrawSceneToShadowMap()
 	UINT passCBByteSize = CalcConstantBufferByteSize(sizeof(PassConstants));
 	mCommandList->ClearDepthStencilView(mShadowMap->Dsv(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 	mCommandList->OMSetRenderTargets(0, nullptr, false, &mShadowMap->Dsv());
-	auto passCB = mCurrFrameResource->PassCB->Resource();
+	auto passCB = mRenderFrameResource->PassCB->Resource();
 	D3D12_GPU_VIRTUAL_ADDRESS passCBAddress = passCB->GetGPUVirtualAddress() + (1 + 6) * passCBByteSize;
 	mCommandList->SetGraphicsRootConstantBufferView(1, passCBAddress);
-	mCommandList->SetPipelineState(mPSOs["shadow"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+	mCommandList->SetPipelineState(mPsoRegistry[mPsoIds.Shadow]);
+	if (mRenderPacket->DrawIndirect)
+	{
+		ExecuteIndirectDraws(CullView::Shadow);
+	}
+	else
+	{
+		DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque], false, CullView::Shadow);
+		if (mRenderPacket->ShowStressScene)
+			DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::StressSpheres], false, CullView::Shadow);
+	}
 	//DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::GUN]);
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
 		mShadowMap->Resource(),
@@ -1826,7 +2452,7 @@ void MySoftRasterizationApp::DrawSceneToBRDFLUT()
 		D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_RENDER_TARGET));
 	mCommandList->ClearRenderTargetView(mBRDFLUT->Rtv(), Colors::Black, 0, nullptr);
 	mCommandList->OMSetRenderTargets(1, &mBRDFLUT->Rtv(), false, nullptr);
-	mCommandList->SetPipelineState(mPSOs["brdf"].Get());
+	mCommandList->SetPipelineState(mPsoRegistry[mPsoIds.Brdf]);
 
 	mCommandList->IASetVertexBuffers(0, 1, nullptr);
 	mCommandList->IASetIndexBuffer(nullptr);
@@ -1847,7 +2473,7 @@ void MySoftRasterizationApp::DrawSceneToBRDFLUT_Eu()
 		D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_RENDER_TARGET));
 	mCommandList->ClearRenderTargetView(mBRDFLUT_Eu->Rtv(), Colors::Black, 0, nullptr);
 	mCommandList->OMSetRenderTargets(1, &mBRDFLUT_Eu->Rtv(), false, nullptr);
-	mCommandList->SetPipelineState(mPSOs["brdfEu"].Get());
+	mCommandList->SetPipelineState(mPsoRegistry[mPsoIds.BrdfEu]);
 
 	mCommandList->IASetVertexBuffers(0, 1, nullptr);
 	mCommandList->IASetIndexBuffer(nullptr);
@@ -1868,7 +2494,7 @@ void MySoftRasterizationApp::DrawSceneToLUT_Eavg()
 		D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_RENDER_TARGET));
 	mCommandList->ClearRenderTargetView(mLUT_Eavg->Rtv(), Colors::Black, 0, nullptr);
 	mCommandList->OMSetRenderTargets(1, &mLUT_Eavg->Rtv(), false, nullptr);
-	mCommandList->SetPipelineState(mPSOs["Eavg"].Get());
+	mCommandList->SetPipelineState(mPsoRegistry[mPsoIds.Eavg]);
 
 	mCommandList->IASetVertexBuffers(0, 1, nullptr);
 	mCommandList->IASetIndexBuffer(nullptr);
@@ -1896,10 +2522,10 @@ void MySoftRasterizationApp::DrawNormalsAndDepth()
 	mCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 	mCommandList->OMSetRenderTargets(1, &normalMapRtv, true, &DepthStencilView());
 
-	auto passCB = mCurrFrameResource->PassCB->Resource();
+	auto passCB = mRenderFrameResource->PassCB->Resource();
 	mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
 
-	mCommandList->SetPipelineState(mPSOs["drawNormals"].Get());
+	mCommandList->SetPipelineState(mPsoRegistry[mPsoIds.DrawNormals]);
 
 	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::GUN]);
 
@@ -1924,12 +2550,26 @@ void MySoftRasterizationApp::DrawSceneToGBuffers()
 
 	mCommandList->OMSetRenderTargets(3, &mGBuffers->Rtv(GBuffers::GBufferType(0)), true, &DepthStencilView());
 
-	auto passCB = mCurrFrameResource->PassCB->Resource();
+	auto passCB = mRenderFrameResource->PassCB->Resource();
 	mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
 
-	mCommandList->SetPipelineState(mPSOs["DefferedShadingPass1"].Get());
+	mCommandList->SetPipelineState(mPsoRegistry[mPsoIds.DefferedShadingPass1]);
+
+	mTextureStreamer->BeginFeedback(mCommandList.Get(), mRenderFrameResourceIndex);
+	mCommandList->SetGraphicsRootUnorderedAccessView(5, mTextureStreamer->FeedbackAddress(mRenderFrameResourceIndex));
+
+	if (mRenderPacket->DrawIndirect)
+	{
+		ExecuteIndirectDraws(CullView::Main);
+	}
+	else
+	{
+		DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque], mRenderPacket->EnableMeshletCulling, CullView::Main, true);
+		if (mRenderPacket->ShowStressScene)
+			DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::StressSpheres], false, CullView::Main, true);
+	}
 
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+	mTextureStreamer->EndFeedback(mCommandList.Get(), mRenderFrameResourceIndex);
 
 	for (int i = 0; i < static_cast<int>(GBuffers::GBufferType::Count); ++i)
 	{
@@ -1951,7 +2591,7 @@ void MySoftRasterizationApp::DefferedShadingPass()
 	//mCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 	
 	mCommandList->OMSetRenderTargets(1, &mSceneColorRT->Rtv(), true, nullptr);//无需深度测试
-	mCommandList->SetPipelineState(mPSOs["DefferedShadingPass2"].Get());
+	mCommandList->SetPipelineState(mPsoRegistry[mPsoIds.DefferedShadingPass2]);
 	mCommandList->IASetVertexBuffers(0, 1, nullptr);
 	mCommandList->IASetIndexBuffer(nullptr);
 	mCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
@@ -1960,23 +2600,32 @@ void MySoftRasterizationApp::DefferedShadingPass()
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
 		mSceneColorRT->Resource(),
 		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+}
 
-	if (mEnableSSR)
-	{
-		DrawSSR();
+void MySoftRasterizationApp::SetSceneRootArguments()
+{
+	// Materials, textures and instance records, read by every pass drawing render items. Switching to another
+	// root signature (the SSR pass) leaves them undefined, passes after such a switch bind them again.
+	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
 
-		DrawSSRComposite();
-	}
-	else {
-		DrawSceneWithoutSSR();
-	}
+	auto matSB = mRenderFrameResource->MatSB->Resource();
+	mCommandList->SetGraphicsRootShaderResourceView(3, matSB->GetGPUVirtualAddress());
+	mCommandList->SetGraphicsRootShaderResourceView(6, mRenderFrameResource->InstanceBuffer->Resource()->GetGPUVirtualAddress());
 
-	mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
+	CD3DX12_GPU_DESCRIPTOR_HANDLE texDescriptor(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(), 1, mCbv_srv_uavDescriptorSize);
+	mCommandList->SetGraphicsRootDescriptorTable(4, texDescriptor);
+}
+
+void MySoftRasterizationApp::DrawSky()
+{
+	// Runs after the composite, with SSR on the root signature was switched in between
+	SetSceneRootArguments();
+	mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
 
-	auto passCB = mCurrFrameResource->PassCB->Resource();
+	auto passCB = mRenderFrameResource->PassCB->Resource();
 	mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
 
-	mCommandList->SetPipelineState(mPSOs["sky"].Get());
+	mCommandList->SetPipelineState(mPsoRegistry[mPsoIds.Sky]);
 	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Sky]);
 
 	//mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, nullptr); // 无深度
@@ -1992,18 +2641,17 @@ void MySoftRasterizationApp::DrawSSR()
 	mCommandList->RSSetViewports(1, &mSSR->Viewport());
 	mCommandList->RSSetScissorRects(1, &mSSR->ScissorRect());
 
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-		mSSR->Resource(),
-		D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_RENDER_TARGET));
+	// The SSR target to render target and the last HiZ mip to SRV
+	mStateTracker.Record(mCommandList.Get(), mSsrPass);
 
 	float clearColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
 	mCommandList->ClearRenderTargetView(mSSR->Rtv(), clearColor, 0, nullptr);
 	mCommandList->OMSetRenderTargets(1, &mSSR->Rtv(), false, nullptr);
 
 	mCommandList->SetGraphicsRootSignature(mSSRRootSignature.Get());
-	mCommandList->SetPipelineState(mPSOs["ssr"].Get());
+	mCommandList->SetPipelineState(mPsoRegistry[mPsoIds.Ssr]);
 
-	auto ssrPassCB = mCurrFrameResource->SsrCB->Resource();
+	auto ssrPassCB = mRenderFrameResource->SsrCB->Resource();
 	mCommandList->SetGraphicsRootConstantBufferView(0, ssrPassCB->GetGPUVirtualAddress());
 
 	CD3DX12_GPU_DESCRIPTOR_HANDLE texDescriptor(
@@ -2015,22 +2663,19 @@ void MySoftRasterizationApp::DrawSSR()
 	mCommandList->IASetIndexBuffer(nullptr);
 	mCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	mCommandList->DrawInstanced(6, 1, 0, 0);
-
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-		mSSR->Resource(),
-		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_GENERIC_READ));
 }
 
 void MySoftRasterizationApp::DrawSSRComposite()
 {
 	mCommandList->RSSetViewports(1, &viewPort);
 	mCommandList->RSSetScissorRects(1, &scissorRect);
+	mStateTracker.Record(mCommandList.Get(), mSsrCompositePass);
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
 		CurrentBackBuffer(),
 		D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
 	mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, nullptr);//无需深度测试
 	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
-	mCommandList->SetPipelineState(mPSOs["ssrComposite"].Get());
+	mCommandList->SetPipelineState(mPsoRegistry[mPsoIds.SsrComposite]);
 	mCommandList->IASetVertexBuffers(0, 1, nullptr);
 	mCommandList->IASetIndexBuffer(nullptr);
 	mCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
@@ -2049,7 +2694,7 @@ void MySoftRasterizationApp::DrawSceneWithoutSSR()
 		D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
 	mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, nullptr);//无需深度测试
 	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
-	mCommandList->SetPipelineState(mPSOs["SceneWithoutSSR"].Get());
+	mCommandList->SetPipelineState(mPsoRegistry[mPsoIds.SceneWithoutSsr]);
 	mCommandList->IASetVertexBuffers(0, 1, nullptr);
 	mCommandList->IASetIndexBuffer(nullptr);
 	mCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
@@ -2076,7 +2721,8 @@ void MySoftRasterizationApp::GenerateHiZ()
 	);
 
 	// 生成 Mip 链
-	mHiZBuffer->GenerateMips(mCommandList.Get(), mHiZRootSignature.Get(), mPSOs["hiZFromDepth"].Get(), mPSOs["hiZ"].Get(), depthSrv);
+	mHiZBuffer->GenerateMips(mCommandList.Get(), mHiZRootSignature.Get(), mPsoRegistry[mPsoIds.HiZFromDepth], mPsoRegistry[mPsoIds.HiZ], depthSrv,
+		mStateTracker, mHiZMipPass);
 
 	// 转换深度缓冲回写状态
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
@@ -2086,40 +2732,173 @@ void MySoftRasterizationApp::GenerateHiZ()
 	));
 }
 
+void MySoftRasterizationApp::BuildFrameGraph()
+{
+	// The targets are placed again. Update drained the pipeline, the GPU may still render into the old ones.
+	FlushCmdQueue();
+
+	// The passes record their own barriers, the graph decides which of them run and in which order
+	DeferredFramePasses passes;
+	passes.Shadow = [this](ID3D12GraphicsCommandList*) { DrawSceneToShadowMap(); };
+	passes.GBuffer = [this](ID3D12GraphicsCommandList*) { DrawSceneToGBuffers(); };
+	passes.HiZ = [this](ID3D12GraphicsCommandList*) { GenerateHiZ(); };
+	passes.Lighting = [this](ID3D12GraphicsCommandList* cmdList)
+	{
+		CD3DX12_GPU_DESCRIPTOR_HANDLE texDescriptor(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(), 1, mCbv_srv_uavDescriptorSize);
+		cmdList->SetGraphicsRootDescriptorTable(4, texDescriptor);
+		DefferedShadingPass();
+	};
+	passes.Ssr = [this](ID3D12GraphicsCommandList*) { DrawSSR(); };
+	passes.SsrComposite = [this](ID3D12GraphicsCommandList*) { DrawSSRComposite(); };
+	passes.Composite = [this](ID3D12GraphicsCommandList*) { DrawSceneWithoutSSR(); };
+	passes.Sky = [this](ID3D12GraphicsCommandList*) { DrawSky(); };
+	// 渲染 ImGui, the copy Update made of its draw data
+	passes.Overlay = [this](ID3D12GraphicsCommandList* cmdList) { ImGui_ImplDX12_RenderDrawData(&mRenderPacket->Overlay.Data, cmdList); };
+
+	mFrameGraph.Reset();
+	const DeferredFrameTextures textures = DeclareDeferredFrame(mFrameGraph, mClientWidth, mClientHeight, mEnableSSR, passes);
+
+	// The heap is laid out with the sizes the device gives for the targets
+	std::vector<std::pair<UINT, D3D12_RESOURCE_DESC>> targets = {
+		{ textures.Albedo, mGBuffers->ResourceDesc(GBuffers::GBufferType::Albedo) },
+		{ textures.Normal, mGBuffers->ResourceDesc(GBuffers::GBufferType::Normal) },
+		{ textures.Position, mGBuffers->ResourceDesc(GBuffers::GBufferType::Position) },
+		{ textures.SceneColor, mSceneColorRT->ResourceDesc() },
+	};
+	if (mEnableSSR)
+		targets.push_back({ textures.Reflections, mSSR->ResourceDesc() });
+	for (const auto& target : targets)
+	{
+		const D3D12_RESOURCE_ALLOCATION_INFO info = md3dDevice->GetResourceAllocationInfo(0, 1, &target.second);
+		mFrameGraph.SetAllocation(target.first, info.SizeInBytes, info.Alignment);
+	}
+	mFrameGraph.Compile();
+
+	D3D12_HEAP_DESC heapDesc = {};
+	heapDesc.SizeInBytes = mFrameGraph.GetStats().AliasedBytes;
+	heapDesc.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+	heapDesc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+	ComPtr<ID3D12Heap> heap;
+	ThrowIfFailed(md3dDevice->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap)));
+
+	const UINT64 gBufferOffsets[] = { mFrameGraph.Offset(textures.Albedo), mFrameGraph.Offset(textures.Normal),
+		mFrameGraph.Offset(textures.Position) };
+	mGBuffers->PlaceResources(heap.Get(), gBufferOffsets);
+	mSceneColorRT->PlaceResource(heap.Get(), mFrameGraph.Offset(textures.SceneColor));
+	// Without SSR its target gets no place in the new heap, it must not stay in the old one released below
+	if (mEnableSSR)
+		mSSR->PlaceResource(heap.Get(), mFrameGraph.Offset(textures.Reflections));
+	else
+		mSSR->ReleasePlacedResource();
+	mFrameGraphHeap = heap;
+
+	mFrameGraph.SetResource(textures.Albedo, mGBuffers->Resource(GBuffers::GBufferType::Albedo));
+	mFrameGraph.SetResource(textures.Normal, mGBuffers->Resource(GBuffers::GBufferType::Normal));
+	mFrameGraph.SetResource(textures.Position, mGBuffers->Resource(GBuffers::GBufferType::Position));
+	mFrameGraph.SetResource(textures.SceneColor, mSceneColorRT->Resource());
+	if (mEnableSSR)
+		mFrameGraph.SetResource(textures.Reflections, mSSR->Resource());
+
+	// A resize creates the HiZ texture again, with its mip count, and the SSR target was placed again, or created
+	// committed again, in GENERIC_READ. Otherwise the HiZ mips stay where the last frame with SSR left them.
+	if (mFrameGraphWidth != (UINT)mClientWidth || mFrameGraphHeight != (UINT)mClientHeight)
+	{
+		mStateTracker = ResourceStateTracker();
+		mTrackedHiZ = mStateTracker.Register("HiZ", mHiZBuffer->Resource(), mHiZBuffer->MipLevels(), D3D12_RESOURCE_STATE_GENERIC_READ);
+		mTrackedSsr = mStateTracker.Register("SSR", mSSR->Resource(), 1, D3D12_RESOURCE_STATE_GENERIC_READ);
+	}
+	else
+	{
+		mStateTracker.Reset(mTrackedSsr, mSSR->Resource(), D3D12_RESOURCE_STATE_GENERIC_READ);
+	}
+
+	mFrameGraphWidth = (UINT)mClientWidth;
+	mFrameGraphHeight = (UINT)mClientHeight;
+	mFrameGraphSsr = mEnableSSR;
+}
+
+void MySoftRasterizationApp::PlanTrackedBarriers()
+{
+	const D3D12_RESOURCE_STATES ps = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+	const D3D12_RESOURCE_STATES uav = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+	mStateTracker.BeginFrame();
+
+	// Each mip is written as a UAV from the one above it read as an SRV
+	mHiZMipPass = mStateTracker.AddPass("HiZ Mip 0");
+	mStateTracker.Use(mHiZMipPass, mTrackedHiZ, uav, 0);
+	for (UINT mip = 1; mip < mHiZBuffer->MipLevels(); ++mip)
+	{
+		const UINT pass = mStateTracker.AddPass("HiZ Mip");
+		mStateTracker.Use(pass, mTrackedHiZ, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, mip - 1);
+		mStateTracker.Use(pass, mTrackedHiZ, uav, mip);
+	}
+
+	mSsrPass = mStateTracker.AddPass("SSR");
+	mStateTracker.Use(mSsrPass, mTrackedHiZ, ps);
+	mStateTracker.Use(mSsrPass, mTrackedSsr, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	mSsrCompositePass = mStateTracker.AddPass("SSR Composite");
+	mStateTracker.Use(mSsrCompositePass, mTrackedSsr, ps);
+
+	// Not split: a begin before the SSR pass would run ahead of the aliasing barrier of a placed SSR target
+	mStateTracker.Plan(false);
+}
+
 void MySoftRasterizationApp::Draw()
 {
+	// The render thread draws the packet Update submitted on its own
+	if (mRenderThread.joinable())
+		return;
+
+	FramePacket* packet = mFramePipeline->Acquire();
+	RenderFrame(*packet);
+	mFramePipeline->Release(packet);
+}
+
+void MySoftRasterizationApp::RenderFrame(FramePacket& packet)
+{
+	auto renderStart = std::chrono::high_resolution_clock::now();
+	mRenderPacket = &packet;
+	mRenderFrameResourceIndex = packet.FrameResourceIndex;
+	mRenderFrameResource = mFrameResources[packet.FrameResourceIndex].get();
+
 	// Reuse the memory associated with command recording.
 	// We can only reset when the associated command lists have finished execution on the GPU.
-	ThrowIfFailed(mDirectCmdListAlloc->Reset());
+	// With overlapping frames that is the allocator of the frame resource, whose fence Update waited for.
+	ID3D12CommandAllocator* cmdListAlloc = packet.OverlapFrames ? mRenderFrameResource->CmdListAlloc.Get() : mDirectCmdListAlloc.Get();
+	ThrowIfFailed(cmdListAlloc->Reset());
 
 	// A command list can be reset after it has been added to the command queue via ExecuteCommandList.
 	// Reusing the command list reuses memory.
-	ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
+	ThrowIfFailed(mCommandList->Reset(cmdListAlloc, nullptr));
 
-	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
-	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
-
-	//设置根签名
-	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
+	mDrawStateChanges = DrawStateChanges();
+	mRenderQueueMs = 0.0;
+	mIndirectExecutes = 0;
 
-	auto matSB = mCurrFrameResource->MatSB->Resource();
-	mCommandList->SetGraphicsRootShaderResourceView(3, matSB->GetGPUVirtualAddress());
+	// The streamer only runs here, its feedback and descriptors belong to the frames being drawn
+	mTextureStreamer->SetBudget(packet.StreamingBudgetBytes);
+	UpdateTextureStreaming();
 
-	CD3DX12_GPU_DESCRIPTOR_HANDLE texDescriptor(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(), 1, mCbv_srv_uavDescriptorSize);
-	mCommandList->SetGraphicsRootDescriptorTable(4, texDescriptor);
-
-	DrawSceneToShadowMap();
-
-	DrawSceneToGBuffers();
-
-	GenerateHiZ();
+	// Mip swaps are recorded first so every pass of this frame samples the new views. Earlier frames still in
+	// flight sample the descriptors being rewritten, so the GPU drains first when there are any.
+	if (mTextureStreamer->PrepareUpdate() && mFence->GetCompletedValue() < (UINT64)mCurrentFence)
+	{
+		FlushCmdQueue();
+		++mStreamerFlushes;
+	}
+	mTextureStreamer->Update(mCommandList.Get(), mFence->GetCompletedValue(), (UINT64)mCurrentFence + 1);
 
-	mCommandList->SetGraphicsRootDescriptorTable(4, texDescriptor);
+	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
 
-	DefferedShadingPass();
+	//设置根签名
+	SetSceneRootArguments();
 
-	// 渲染 ImGui
-	ImGui_ImplDX12_RenderDrawData(ImGui::GetDrawData(), mCommandList.Get());
+	// HiZ and SSR only run with SSR, the graph culls them otherwise
+	if (mFrameGraphSsr)
+		PlanTrackedBarriers();
+	mFrameGraph.Execute(mCommandList.Get());
 
 	// Indicate a state transition on the resource usage.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -2136,12 +2915,180 @@ void MySoftRasterizationApp::Draw()
 	ThrowIfFailed(mSwapChain->Present(0, 0));
 	mCurrentBackBuffer = (mCurrentBackBuffer + 1) % SwapChainBufferCount;
 
-	// Wait until frame commands are complete.  This waiting is inefficient and is
-	// done for simplicity.  Later we will show how to organize our rendering code
-	// so we do not have to wait per frame.
-	FlushCmdQueue();
+	if (packet.OverlapFrames)
+	{
+		// Update waits for this value before it fills the frame resource again
+		mRenderFrameResource->FenceCPU = ++mCurrentFence;
+		ThrowIfFailed(mCommandQueue->Signal(mFence.Get(), mCurrentFence));
+	}
+	else
+	{
+		FlushCmdQueue();
+	}
+
+	// Update reads these once the packet came back
+	auto renderEnd = std::chrono::high_resolution_clock::now();
+	FrameRenderStats& stats = packet.Stats;
+	stats.Frame = packet.Frame;
+	stats.StateChanges = mDrawStateChanges;
+	stats.RenderQueueMs = mRenderQueueMs;
+	stats.IndirectExecutes = mIndirectExecutes;
+	stats.StreamerFlushes = mStreamerFlushes;
+	stats.RenderMs = std::chrono::duration<double, std::milli>(renderEnd - renderStart).count();
+	stats.LatencyMs = std::chrono::duration<double, std::milli>(renderEnd - packet.UpdateStart).count();
+	stats.Streaming = mTextureStreamer->Stats();
+	stats.Textures.resize(mTextureStreamer->TextureCount());
+	for (UINT t = 0; t < mTextureStreamer->TextureCount(); ++t)
+		stats.Textures[t] = mTextureStreamer->Info(t);
+	mRenderPacket = nullptr;
+}
+
+void MySoftRasterizationApp::RenderThreadMain()
+{
+	while (FramePacket* packet = mFramePipeline->Acquire())
+	{
+		// After a failure the packets only go round, the next Update throws it on the main thread
+		if (!mRenderFailed.load(std::memory_order_relaxed))
+		{
+			try
+			{
+				RenderFrame(*packet);
+			}
+			catch (...)
+			{
+				mRenderError = std::current_exception();
+				mRenderFailed.store(true, std::memory_order_release);
+			}
+		}
+		mFramePipeline->Release(packet);
+	}
 }
 
+void MySoftRasterizationApp::SetRenderThread(bool enable)
+{
+	if (enable)
+	{
+		mRenderThread = std::thread([this]() { RenderThreadMain(); });
+		return;
+	}
+
+	// The render thread draws the packets submitted so far and returns
+	mFramePipeline->Stop();
+	mRenderThread.join();
+	mFramePipeline->Restart();
+}
+
+void MySoftRasterizationApp::FillFramePacket(FramePacket& packet, std::chrono::high_resolution_clock::time_point updateStart)
+{
+	packet.Frame = ++mFrameCount;
+	packet.UpdateStart = updateStart;
+	packet.OverlapFrames = mOverlapFrames;
+	packet.SortDraws = mSortDraws;
+	packet.DrawIndirect = mDrawIndirect;
+	packet.EnableMeshletCulling = mEnableMeshletCulling;
+	packet.ShowStressScene = mShowStressScene;
+	packet.StreamingBudgetBytes = (UINT64)(mStreamingBudgetMB * 1024.0f * 1024.0f);
+	packet.NearZ = mCamera.GetNearZ();
+	packet.FarZ = mCamera.GetFarZ();
+	packet.FovY = mCamera.GetFovY();
+
+	packet.Items.resize(mAllRitems.size());
+	for (const auto& ri : mAllRitems)
+	{
+		ItemDrawState& item = packet.Items[ri->ItemIndex];
+		for (int view = 0; view < (int)CullView::Count; ++view)
+		{
+			const bool mainView = view == (int)CullView::Main;
+			item.InstanceBufferIndex[view] = mainView ? ri->InstanceBufferIndex : ri->ViewInstanceBufferIndex[view];
+			item.InstanceCount[view] = mainView ? ri->InstanceCount : ri->ViewInstanceCount[view];
+		}
+		item.LodCount = (UINT)ri->LodInstanceCounts.size();
+		std::copy(ri->LodInstanceCounts.begin(), ri->LodInstanceCounts.end(), item.LodInstanceCounts);
+		item.MeshletIndexStart = ri->MeshletIndexStart;
+		item.MeshletIndexCount = ri->MeshletIndexCount;
+		item.SortDepth = ri->SortDepth;
+	}
+	for (int view = 0; view < (int)CullView::Count; ++view)
+		packet.IndirectBatches[view] = mIndirectBatches[view];
+
+	packet.Overlay.CopyFrom(*ImGui::GetDrawData());
+}
+
+int MySoftRasterizationApp::RunFramePipelineReport()
+{
+	struct Mode
+	{
+		const char* Name;
+		bool OverlapFrames;
+		bool RenderThread;
+	};
+	const Mode modes[] = {
+		{ "one thread GPU drained every frame", false, false },
+		{ "one thread frames overlapped", true, false },
+		{ "render thread frames overlapped", true, true },
+	};
+	const int warmupFrames = 60;
+	const int measuredFrames = 600;
+
+	// The stress scene gives both threads something to do
+	mShowStressScene = true;
+	std::ofstream out("FramePipeline.txt");
+	out << "Frame pipeline at " << mClientWidth << "x" << mClientHeight << " with the stress scene, " << measuredFrames
+		<< " frames per mode\n";
+	out << "mode,fps,update to present avg ms,update to present max ms,simulation waits,render waits\n";
+
+	MSG msg = {};
+	for (const Mode& mode : modes)
+	{
+		mOverlapFrames = mode.OverlapFrames;
+		mUseRenderThread = mode.RenderThread;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		UINT64 simulationWaits = 0;
+		UINT64 renderWaits = 0;
+		UINT64 lastFrame = 0;
+		double latencySum = 0.0;
+		double latencyMax = 0.0;
+		UINT latencyCount = 0;
+		for (int frame = 0; frame < warmupFrames + measuredFrames; ++frame)
+		{
+			while (PeekMessage(&msg, 0, 0, 0, PM_REMOVE))
+			{
+				TranslateMessage(&msg);
+				DispatchMessage(&msg);
+			}
+			if (frame == warmupFrames)
+			{
+				start = std::chrono::high_resolution_clock::now();
+				simulationWaits = mFramePipeline->SimulationWaits();
+				renderWaits = mFramePipeline->RenderWaits();
+				lastFrame = mRenderStats.Frame;
+			}
+
+			gt.Tick();
+			Update(gt);
+			Draw();
+
+			// Update picks the stats of a frame up when its packet comes back
+			if (frame >= warmupFrames && mRenderStats.Frame != lastFrame)
+			{
+				lastFrame = mRenderStats.Frame;
+				latencySum += mRenderStats.LatencyMs;
+				latencyMax = std::max(latencyMax, mRenderStats.LatencyMs);
+				++latencyCount;
+			}
+		}
+		mFramePipeline->Drain();
+		const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		out << mode.Name << "," << measuredFrames / seconds << "," << (latencyCount > 0 ? latencySum / latencyCount : 0.0) << ","
+			<< latencyMax << "," << mFramePipeline->SimulationWaits() - simulationWaits << ","
+			<< mFramePipeline->RenderWaits() - renderWaits << "\n";
+	}
+	return 0;
+}
+
+
 std::array<const CD3DX12_STATIC_SAMPLER_DESC, 7> MySoftRasterizationApp::GetStaticSamplers()
 {
 	// Applications usually only need a handful of samplers.  So just define them all up front
@@ -2256,6 +3203,10 @@ void MySoftRasterizationApp::OnMouseMove(WPARAM btnState, int x, int y)
 
 void MySoftRasterizationApp::OnResize()
 {
+	// The frames handed to the render thread draw into the old swap chain and targets
+	if (mFramePipeline != nullptr)
+		mFramePipeline->Drain();
+
 	D3D12App::OnResize();
 
 	if (mSsao != nullptr)
@@ -2266,6 +3217,12 @@ void MySoftRasterizationApp::OnResize()
 		mSsao->RebuildDescriptors(mDepthStencilBuffer.Get());
 	}
 
+	// The frame graph places new targets at the next Draw
+	if (mGBuffers != nullptr)
+	{
+		mGBuffers->OnResize(mClientWidth, mClientHeight);
+	}
+
 	if (mSceneColorRT != nullptr)
 	{
 		mSceneColorRT->OnResize(mClientWidth, mClientHeight);
@@ -2287,10 +3244,13 @@ void MySoftRasterizationApp::OnResize()
 	}
 
 	mCamera.SetLens(0.25 * MathHelper::Pi, AspectRatio(), 0.1f, 1000.0f);
+
+	BoundingFrustum::CreateFromMatrix(mCamFrustum, mCamera.GetProj());
 }
 
 void MySoftRasterizationApp::Update(GameTime& gt)
 {
+	auto updateStart = std::chrono::high_resolution_clock::now();
 	OnKeyboardInput(gt);
 	// ImGui 新帧
 	ImGui_ImplDX12_NewFrame();
@@ -2340,11 +3300,250 @@ void MySoftRasterizationApp::Update(GameTime& gt)
 		ImGui::SliderFloat("Light Rotation AngleZ", &mLightRotationAngleZ, 0.0f, XM_2PI);
 	}
 
+	if (ImGui::CollapsingHeader("Vertex Compression"))
+	{
+		const VertexCompressionReport& report = mVertexCompressionReport;
+		ImGui::Text("Vertices: %u (%u -> %u bytes/vertex), the G-buffer pass reads the compact ones", report.VertexCount,
+			(UINT)sizeof(Vertex), (UINT)sizeof(CompactVertex));
+		ImGui::Text("Full: %.2f KB  Compact: %.2f KB  Saved: %.2f KB",
+			report.SourceBytes / 1024.0, report.CompactBytes / 1024.0, report.SavedBytes() / 1024.0);
+		ImGui::Text("Max position error: %.6f", report.MaxPositionError);
+		ImGui::Text("Max normal error: %.4f deg", report.MaxNormalErrorDeg);
+		ImGui::Text("Max tangent error: %.4f deg", report.MaxTangentErrorDeg);
+		ImGui::Text("Max uv error: %.6f", report.MaxTexCError);
+		ImGui::Text("Encode time: %.3f ms", report.EncodeMs);
+	}
+
+	if (ImGui::CollapsingHeader("Texture Cooker"))
+	{
+		if (ImGui::Button("Cook Scene Textures"))
+			CookSceneTextures();
+		for (const auto& report : mCookReports)
+		{
+			const char* name = strrchr(report.Source.c_str(), '\\');
+			name = name ? name + 1 : report.Source.c_str();
+			if (report.Status != DDS::Result::Ok)
+			{
+				ImGui::Text("%s: %s", name, DDS::ResultString(report.Status));
+				continue;
+			}
+			ImGui::Text("%s: %s %ux%u, %u mips", name, BC::FormatName(report.Format), report.Width, report.Height, report.MipLevels);
+			ImGui::Text("  %.1f MPix/s (mips %.1f ms, encode %.1f ms)  PSNR %.2f dB",
+				report.MPixelsPerSecond(), report.MipMs, report.EncodeMs, report.Psnr);
+		}
+	}
+
+	if (ImGui::CollapsingHeader("Texture Streaming"))
+	{
+		// The render thread applies the budget, the numbers are those of the last frame it returned
+		ImGui::SliderFloat("Budget (MB)", &mStreamingBudgetMB, 4.0f, 256.0f);
+		const TextureStreamingStats& stats = mRenderStats.Streaming;
+		ImGui::Text("Resident: %.2f MB / %.2f MB all mips", stats.ResidentBytes / 1048576.0, stats.FullBytes / 1048576.0);
+		ImGui::Text("Loads: %u pending, %llu done  Evictions: %llu", stats.PendingLoads, stats.CompletedLoads, stats.Evictions);
+		ImGui::Text("Request latency: %.1f ms last, %.1f ms avg, %.1f ms max",
+			stats.LastLatencyMs, stats.AverageLatencyMs, stats.MaxLatencyMs);
+		for (const StreamedTextureInfo& info : mRenderStats.Textures)
+		{
+			ImGui::Text("%-20s mip %u (wants %u) of %u  %.2f MB", info.Name.c_str(),
+				info.ResidentMip, info.RequestedMip, info.MipLevels, info.ResidentBytes / 1048576.0);
+		}
+	}
+
+	if (ImGui::CollapsingHeader("Auto Instancing"))
+	{
+		ImGui::Checkbox("Merge Items Sharing a Submesh", &mAutoInstancing);
+		ImGui::Checkbox("Stress Scene", &mShowStressScene);
+		ImGui::SameLine();
+		ImGui::Text("(%u sphere items x %u instances)", StressSphereItems, StressSphereInstances);
+		ImGui::Text("Groups: %u  draws this frame: %u  saved over all views: %u", (UINT)mInstancingGroups.size(),
+			mRenderStats.StateChanges.Draws, mMergedItems);
+	}
+
+	if (ImGui::CollapsingHeader("Indirect Draws"))
+	{
+		ImGui::Checkbox("G-Buffer and Shadows Through ExecuteIndirect", &mDrawIndirect);
+		if (mDrawIndirect)
+		{
+			ImGui::Text("Commands: %u of %u sources  instances: %u  build: %.3f ms", mIndirectCounts.Draws,
+				(UINT)mIndirectSources.size(), mIndirectCounts.Instances, mIndirectBuildMs);
+			ImGui::Text("ExecuteIndirect calls: %u (main %u, shadow %u batches)", mRenderStats.IndirectExecutes,
+				(UINT)mIndirectBatches[(int)CullView::Main].size(), (UINT)mIndirectBatches[(int)CullView::Shadow].size());
+			if (ImGui::Button("Validate"))
+				mValidateIndirectDraws = true;
+			ImGui::SameLine();
+			ImGui::Text("mismatching draws: %u", mIndirectErrors);
+		}
+	}
+
+	if (ImGui::CollapsingHeader("Render Graph"))
+	{
+		const RenderGraph::Stats& stats = mFrameGraph.GetStats();
+		ImGui::Text("Passes: %u  culled: %u  compile: %.3f ms", stats.Passes, stats.CulledPasses, stats.CompileMs);
+		for (UINT pass = 0; pass < mFrameGraph.PassCount(); ++pass)
+			ImGui::Text("  %s%s", mFrameGraph.PassName(pass), mFrameGraph.IsCulled(pass) ? " (culled)" : "");
+		for (UINT texture = 0; texture < mFrameGraph.TextureCount(); ++texture)
+		{
+			const RenderGraph::Lifetime life = mFrameGraph.LifetimeOf(texture);
+			if (mFrameGraph.Offset(texture) == RenderGraph::Invalid)
+				continue;
+			ImGui::Text("  %s: passes %u-%u, %.1f MB at %.1f MB%s", mFrameGraph.TextureName(texture), life.First, life.Last,
+				mFrameGraph.Size(texture) / 1048576.0, mFrameGraph.Offset(texture) / 1048576.0,
+				mFrameGraph.IsAliased(texture) ? " (aliased)" : "");
+		}
+		ImGui::Text("Transient memory: %.1f MB separate, %.1f MB aliased (peak live %.1f MB)", stats.TransientBytes / 1048576.0,
+			stats.AliasedBytes / 1048576.0, stats.PeakLiveBytes / 1048576.0);
+	}
+
+	if (ImGui::CollapsingHeader("Frame Pipeline"))
+	{
+		ImGui::Checkbox("Overlap CPU and GPU", &mOverlapFrames);
+		ImGui::Checkbox("Render on Its Own Thread", &mUseRenderThread);
+		ImGui::Text("Frames in flight: %d  CPU frame: %.3f ms  fence wait: %.3f ms", mOverlapFrames ? gNumFrameResources : 1,
+			gt.DeltaTime() * 1000.0f, mFenceWaitMs);
+		ImGui::Text("Packet wait: %.3f ms  render: %.3f ms  update to present: %.3f ms", mPacketWaitMs,
+			mRenderStats.RenderMs, mRenderStats.LatencyMs);
+		ImGui::Text("Waits for a packet: simulation %llu  render %llu", (unsigned long long)mFramePipeline->SimulationWaits(),
+			(unsigned long long)mFramePipeline->RenderWaits());
+		ImGui::Text("GPU drained for texture streaming: %llu frames", (unsigned long long)mRenderStats.StreamerFlushes);
+	}
+
+	if (ImGui::CollapsingHeader("Job System"))
+	{
+		ImGui::Checkbox("Parallel Update Stages", &mParallelUpdate);
+		ImGui::Text("Threads: %u  update stages: %.3f ms", mJobs.ThreadCount(), mUpdateStagesMs);
+		ImGui::Text("Average serial %.3f ms  parallel %.3f ms  speedup %.2fx", mSerialStagesMs, mParallelStagesMs,
+			mParallelStagesMs > 0.0 ? mSerialStagesMs / mParallelStagesMs : 0.0);
+		for (UINT i = 0; i < mUpdateGraph.Count(); ++i)
+			ImGui::Text("  %s: %.3f ms", mUpdateGraph.Name(i), mUpdateGraph.Ms(i));
+	}
+
+	if (ImGui::CollapsingHeader("Material Table"))
+	{
+		ImGui::Text("Materials: %u  uploaded: %u in %u runs (%llu bytes)", mMaterialTable.Count(), mMaterialUpload.Records,
+			mMaterialUpload.Runs, (unsigned long long)mMaterialUpload.Bytes);
+	}
+
+	if (ImGui::CollapsingHeader("Resource Registry"))
+	{
+		ImGui::Text("Geometries: %u  submeshes: %u  materials: %u  textures: %u  PSOs: %u", mGeometryRegistry.Count(),
+			mSubmeshRegistry.Count(), mMaterialRegistry.Count(), mTextureRegistry.Count(), mPsoRegistry.Count());
+	}
+
+	if (ImGui::CollapsingHeader("Scene Store"))
+	{
+		ImGui::Text("Instances: %u", mScene.Count());
+	}
+
+	if (ImGui::CollapsingHeader("Render Queue"))
+	{
+		ImGui::Checkbox("Sort Draws and Skip Redundant State", &mSortDraws);
+		const DrawStateChanges& changes = mRenderStats.StateChanges;
+		ImGui::Text("Draws: %u  state changes: %u (vertex buffers %u, index buffers %u, topologies %u)", changes.Draws,
+			changes.Total(), changes.VertexBuffers, changes.IndexBuffers, changes.Topologies);
+		ImGui::Text("Key build and sort: %.3f ms", mRenderStats.RenderQueueMs);
+	}
+
+	if (ImGui::CollapsingHeader("Instance Buffer"))
+	{
+		ImGui::Text("Records: %u  rewritten this frame: %u  still dirty: %u", mInstanceRecords.SlotCount(),
+			mInstanceRecordsWritten, mInstanceRecords.DirtyCount());
+		ImGui::Text("Draw list entries: %u  update: %.3f ms", (UINT)mInstanceIndices.size(), mInstanceUpdateMs);
+		ImGui::Text("Uploaded this frame: %.1f KB (%.1f KB with %u byte records)", mInstanceUploadBytes / 1024.0,
+			mInstanceUploadBytesFull / 1024.0, (UINT)sizeof(InstanceData));
+	}
+
+	if (ImGui::CollapsingHeader("Scene BVH"))
+	{
+		ImGui::Checkbox("Enable BVH Culling", &mEnableBvhCulling);
+		ImGui::Checkbox("Flat SoA Kernel Instead", &mUseFlatCulling);
+		ImGui::Text("Instances: %u visible / %u", mBvhVisibleCount, mSceneBvh.PrimitiveCount());
+		ImGui::Text("Nodes: %u  Depth: %u", mSceneBvh.NodeCount(), mSceneBvh.Depth());
+		ImGui::Text("Refit: %.3f ms (%u nodes)  Query: %.3f ms", mBvhRefitMs, mBvhRefitNodes, mBvhQueryMs);
+		ImGui::Text("Visible per view: main %u  shadow %u", mViewVisibleCounts[(int)CullView::Main], mViewVisibleCounts[(int)CullView::Shadow]);
+		ImGui::Checkbox("Time Separate Per-View Culls", &mTimeSeparateCulls);
+		if (mTimeSeparateCulls)
+			ImGui::Text("  %d views one by one: %.3f ms", (int)CullView::Count, mSeparateCullMs);
+		ImGui::Text("Scene bounds: radius %.2f", mSceneBounds.Radius);
+	}
+
+	if (ImGui::CollapsingHeader("Level of Detail"))
+	{
+		ImGui::Checkbox("Enable LOD", &mEnableLod);
+		ImGui::SliderFloat("Max Pixel Error", &mLodPixelError, 0.25f, 16.0f);
+		ImGui::Text("Triangles: %llu with LOD / %llu without", mTrianglesWithLod, mTrianglesWithoutLod);
+		for (UINT k = 0; k <= MaxLodCount; ++k)
+		{
+			if (mLodHistogram[k] > 0)
+				ImGui::Text("LOD%u: %u instances", k, mLodHistogram[k]);
+		}
+	}
+
+	if (ImGui::CollapsingHeader("Meshlet Culling"))
+	{
+		ImGui::Checkbox("Enable Meshlet Culling", &mEnableMeshletCulling);
+		const MeshletCullStats& stats = mMeshletStats;
+		ImGui::Text("Meshlets: %u visible / %u tested", stats.VisibleMeshlets, stats.Meshlets);
+		ImGui::Text("Frustum culled: %u  Cone culled: %u", stats.FrustumCulled, stats.ConeCulled);
+		ImGui::Text("Triangles: %llu / %llu (%.1f%% culled)", stats.VisibleTriangles, stats.Triangles, stats.CulledFraction() * 100.0f);
+		ImGui::Text("Cull time: %.3f ms", stats.CullMs);
+
+		if (mFlyThroughFrame < 0)
+		{
+			if (ImGui::Button("Run Fly-through"))
+			{
+				mFlyThroughSavedPos = mCamera.GetPosition3f();
+				mFlyThroughSavedLook = mCamera.GetLook3f();
+				mFlyThroughStats = MeshletCullStats();
+				mFlyThroughFrame = 0;
+			}
+		}
+		else
+		{
+			ImGui::Text("Fly-through frame %d / %d", mFlyThroughFrame, FlyThroughFrameCount);
+		}
+
+		if (mFlyThroughStats.Triangles > 0)
+		{
+			ImGui::Text("Fly-through: %.1f%% triangles culled, %.3f ms cull/frame",
+				mFlyThroughStats.CulledFraction() * 100.0f, mFlyThroughStats.CullMs / FlyThroughFrameCount);
+			ImGui::Text("Fly-through meshlets: %u frustum / %u cone culled of %u",
+				mFlyThroughStats.FrustumCulled, mFlyThroughStats.ConeCulled, mFlyThroughStats.Meshlets);
+		}
+	}
+
 	ImGui::End();
 
+	BenchmarkContext benchmarkContext;
+	benchmarkContext.Device = md3dDevice.Get();
+	benchmarkContext.Jobs = &mJobs;
+	benchmarkContext.FrameResourceCount = gNumFrameResources;
+	mBenchmarks.Show(benchmarkContext);
+
+	// The render thread only starts or stops between packets
+	if (mUseRenderThread != mRenderThread.joinable())
+		SetRenderThread(mUseRenderThread);
+
+	// The graph and its placed targets only change with the size or SSR. A minimized window keeps the last ones.
+	const bool resized = mFrameGraphWidth != (UINT)mClientWidth || mFrameGraphHeight != (UINT)mClientHeight;
+	if ((resized || mFrameGraphSsr != mEnableSSR) && mClientWidth > 0 && mClientHeight > 0)
+	{
+		mFramePipeline->Drain();
+		BuildFrameGraph();
+	}
+
+	// The packet comes back once the render thread recorded its last frame, the frame resource once the GPU ran it
+	auto packetWaitStart = std::chrono::high_resolution_clock::now();
+	FramePacket* packet = mFramePipeline->BeginFrame();
+	mPacketWaitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - packetWaitStart).count();
+	if (mRenderFailed.load(std::memory_order_acquire))
+		std::rethrow_exception(mRenderError);
+	if (packet->Stats.Frame != 0)
+		mRenderStats = packet->Stats;
+
 	//UpdateCamera(gt);
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	mCurrFrameResourceIndex = packet->FrameResourceIndex;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
+	auto fenceWaitStart = std::chrono::high_resolution_clock::now();
 	if (mCurrFrameResource->FenceCPU != 0 && mFence->GetCompletedValue() < mCurrFrameResource->FenceCPU)
 	{
 		HANDLE eventHandle = CreateEvent(nullptr,
@@ -2355,6 +3554,8 @@ void MySoftRasterizationApp::Update(GameTime& gt)
 		WaitForSingleObject(eventHandle, INFINITE);
 		CloseHandle(eventHandle);
 	}
+	mFenceWaitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - fenceWaitStart).count();
+	UpdateFlyThrough();
 	mCamera.UpdateViewMatrix();
 
 	//mLightRotationAngle += 0.1f * gt.DeltaTime();
@@ -2367,15 +3568,20 @@ void MySoftRasterizationApp::Update(GameTime& gt)
 	}
 
 	//UpdateObjectCBs(gt);
-	UpdateInstanceBuffers(gt);
-	UpdateMaterialCBs(gt);
-	UpdateShadowTransform();
-	UpdateMainPassCBs();
-	UpdateShadowPassCBs();
-	UpdateSsaoCBs();
-	UpdateSSRConstants();
+	auto start = std::chrono::high_resolution_clock::now();
+	if (mParallelUpdate)
+		mUpdateGraph.Run(mJobs);
+	else
+		mUpdateGraph.RunSerial();
+	auto end = std::chrono::high_resolution_clock::now();
+	mUpdateStagesMs = std::chrono::duration<double, std::milli>(end - start).count();
+	double& average = mParallelUpdate ? mParallelStagesMs : mSerialStagesMs;
+	average = average == 0.0 ? mUpdateStagesMs : 0.95 * average + 0.05 * mUpdateStagesMs;
 	// 渲染 ImGui
 	ImGui::Render();
+
+	FillFramePacket(*packet, updateStart);
+	mFramePipeline->Submit(packet);
 }
 
 void MySoftRasterizationApp::UpdateCamera(GameTime& gt)
@@ -2472,56 +3678,587 @@ void MySoftRasterizationApp::UpdateMainPassCBs()
 
 void MySoftRasterizationApp::UpdateInstanceBuffers(GameTime& gt)
 {
-	auto currInstanceBuffer = mCurrFrameResource->InstanceBuffer.get();
-	int instanceIndex = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Records only change with their instance, the draw lists are rebuilt from the culling results every frame
+	mInstanceRecordsWritten = mInstanceRecords.Update(mCurrFrameResource->InstanceBuffer->MappedData(), mAOType, &mJobs);
+
+	mInstanceIndices.clear();
+	for (auto& e : mAllRitems)
+	{
+		const UINT visibleCount = (UINT)e->VisibleInstances.size();
+		e->InstanceBufferIndex = (UINT)mInstanceIndices.size();
+		for (UINT k = 0; k < visibleCount; ++k)
+		{
+			// LOD items are drawn grouped by their selected LOD
+			UINT i = e->LodOrder.empty() ? e->VisibleInstances[k] : e->LodOrder[k];
+			mInstanceIndices.push_back(e->FirstInstanceSlot + i);
+		}
+		e->InstanceCount = visibleCount;
+	}
+
+	// The other views follow, each with its own list per item
+	for (int view = (int)CullView::Main + 1; view < (int)CullView::Count; ++view)
+	{
+		for (auto& e : mAllRitems)
+		{
+			e->ViewInstanceBufferIndex[view] = (UINT)mInstanceIndices.size();
+			e->ViewInstanceCount[view] = (UINT)e->ViewInstances[view].size();
+			for (UINT i : e->ViewInstances[view])
+				mInstanceIndices.push_back(e->FirstInstanceSlot + i);
+		}
+	}
+
+	mMergedItems = 0;
+	if (mAutoInstancing)
+		MergeInstancingGroups();
+
+	if (!mInstanceIndices.empty())
+		mCurrFrameResource->InstanceIndexBuffer->CopyRange(0, mInstanceIndices.data(), (UINT)mInstanceIndices.size());
+
+	const UINT64 indexBytes = mInstanceIndices.size() * sizeof(std::uint32_t);
+	mInstanceUploadBytes = (UINT64)mInstanceRecordsWritten * sizeof(PackedInstance) + indexBytes;
+	mInstanceUploadBytesFull = (UINT64)mInstanceRecordsWritten * sizeof(InstanceData) + indexBytes;
+
+	auto end = std::chrono::high_resolution_clock::now();
+	mInstanceUpdateMs = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void MySoftRasterizationApp::UpdateIndirectDraws()
+{
+	for (auto& batches : mIndirectBatches)
+		batches.clear();
+	mIndirectSources.clear();
+	if (!mDrawIndirect)
+		return;
+
+	// The draws of DrawSceneToGBuffers and DrawSceneToShadowMap, taken from the final draw lists: the slots are
+	// the ones DrawRenderItems would point gInstanceIndices at, so FirstSlot stays 0
+	struct PendingDraw
+	{
+		CullView View;
+		IndirectBatch Batch;
+		IndirectDraws::Source Source;
+	};
+	std::vector<PendingDraw> pending;
+	auto add = [&](const RenderItem* ri, CullView view, const D3D12_INDEX_BUFFER_VIEW& ibv, UINT indexCount, UINT startIndex,
+		UINT baseVertex, const std::uint32_t* slots, UINT count)
+	{
+		PendingDraw draw;
+		draw.View = view;
+		draw.Batch.Geo = ri->Geo;
+		draw.Batch.IndexBufferView = ibv;
+		draw.Batch.Topology = ri->PrimitiveType;
+		draw.Batch.Quantization = view == CullView::Main ? &ri->Quantization : nullptr;
+		draw.Source.IndexCountPerInstance = indexCount;
+		draw.Source.StartIndexLocation = startIndex;
+		draw.Source.BaseVertexLocation = (INT)baseVertex;
+		draw.Source.Visible = slots;
+		draw.Source.VisibleCount = count;
+		pending.push_back(draw);
+	};
+	auto addLod = [&](const RenderItem* ri, const SubmeshGeometry& submesh, const std::uint32_t* slots, UINT count)
+	{
+		add(ri, CullView::Main, ri->Geo->IndexBufferView(submesh.IndexFormat), submesh.IndexCount, submesh.StartIndexLocation,
+			submesh.BaseVertexLocation, slots, count);
+	};
+	auto addMeshlets = [&](const RenderItem* ri, const std::uint32_t* slots, UINT count)
+	{
+		if (ri->MeshletIndexCount == 0)
+			return;
+		D3D12_INDEX_BUFFER_VIEW meshletIbv;
+		meshletIbv.BufferLocation = mCurrFrameResource->MeshletIndexBuffer->Resource()->GetGPUVirtualAddress();
+		meshletIbv.SizeInBytes = (UINT)mCurrFrameResource->MeshletIndexBuffer->Resource()->GetDesc().Width;
+		meshletIbv.Format = DXGI_FORMAT_R32_UINT;
+		add(ri, CullView::Main, meshletIbv, ri->MeshletIndexCount, ri->MeshletIndexStart, ri->BaseVertexLocation, slots, count);
+	};
+
+	for (int layer : { (int)RenderLayer::Opaque, (int)RenderLayer::StressSpheres })
+	{
+		if (layer == (int)RenderLayer::StressSpheres && !mShowStressScene)
+			continue;
+		const bool useMeshlets = layer == (int)RenderLayer::Opaque && mEnableMeshletCulling;
+		for (const RenderItem* ri : mRitemLayer[layer])
+		{
+			const D3D12_INDEX_BUFFER_VIEW ibv = ri->Geo->IndexBufferView(ri->IndexFormat);
+			if (ri->InstanceCount > 0)
+			{
+				const std::uint32_t* slots = mInstanceIndices.data() + ri->InstanceBufferIndex;
+				if (!ri->LodInstanceCounts.empty())
+				{
+					UINT firstInstance = 0;
+					for (size_t lod = 0; lod < ri->Lods.size(); ++lod)
+					{
+						const UINT count = ri->LodInstanceCounts[lod];
+						if (count == 0)
+							continue;
+						if (lod == 0 && useMeshlets && ri->Meshlets != nullptr)
+							addMeshlets(ri, slots + firstInstance, count);
+						else
+							addLod(ri, ri->Lods[lod], slots + firstInstance, count);
+						firstInstance += count;
+					}
+				}
+				else if (useMeshlets && ri->Meshlets != nullptr)
+				{
+					addMeshlets(ri, slots, ri->InstanceCount);
+				}
+				else
+				{
+					add(ri, CullView::Main, ibv, ri->IndexCount, ri->StartIndexLocation, ri->BaseVertexLocation, slots, ri->InstanceCount);
+				}
+			}
+
+			const UINT shadowCount = ri->ViewInstanceCount[(int)CullView::Shadow];
+			if (shadowCount > 0)
+			{
+				add(ri, CullView::Shadow, ibv, ri->IndexCount, ri->StartIndexLocation, ri->BaseVertexLocation,
+					mInstanceIndices.data() + ri->ViewInstanceBufferIndex[(int)CullView::Shadow], shadowCount);
+			}
+		}
+	}
+
+	// Group the draws of a view by their input assembler state and grid, each group is one ExecuteIndirect. Items
+	// of one submesh share the grid, so the stress spheres end up in a single group.
+	auto key = [](const PendingDraw& draw)
+	{
+		return std::make_tuple((int)draw.View, draw.Batch.Geo, draw.Batch.IndexBufferView.BufferLocation,
+			draw.Batch.IndexBufferView.Format, draw.Batch.Topology);
+	};
+	auto compareGrids = [](const PendingDraw& a, const PendingDraw& b)
+	{
+		if (a.Batch.Quantization == nullptr || b.Batch.Quantization == nullptr)
+			return 0;
+		return memcmp(a.Batch.Quantization, b.Batch.Quantization, sizeof(VertexQuantizationConstants));
+	};
+	std::stable_sort(pending.begin(), pending.end(), [&](const PendingDraw& a, const PendingDraw& b)
+	{
+		if (key(a) != key(b))
+			return key(a) < key(b);
+		return compareGrids(a, b) < 0;
+	});
+
+	for (size_t i = 0; i < pending.size(); ++i)
+	{
+		const PendingDraw& draw = pending[i];
+		auto& batches = mIndirectBatches[(int)draw.View];
+		if (i == 0 || key(pending[i - 1]) != key(draw) || compareGrids(pending[i - 1], draw) != 0)
+		{
+			batches.push_back(draw.Batch);
+			batches.back().FirstSource = (UINT)mIndirectSources.size();
+		}
+		batches.back().SourceCount++;
+		mIndirectSources.push_back(draw.Source);
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	IndirectDraws::Output out;
+	out.Commands = mCurrFrameResource->IndirectCommandBuffer->MappedData();
+	out.Slots = mCurrFrameResource->IndirectSlotBuffer->MappedData();
+	out.SlotsAddress = mCurrFrameResource->IndirectSlotBuffer->Resource()->GetGPUVirtualAddress();
+	mIndirectCounts = IndirectDraws::Build(mIndirectSources.data(), (UINT)mIndirectSources.size(), out, &mJobs);
+	auto end = std::chrono::high_resolution_clock::now();
+	mIndirectBuildMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+	// Build keeps the source order, so a batch's commands follow the kept draws of the batches before it
+	UINT command = 0;
+	for (int view : { (int)CullView::Main, (int)CullView::Shadow })
+	{
+		for (IndirectBatch& batch : mIndirectBatches[view])
+		{
+			batch.FirstCommand = command;
+			batch.CommandCount = IndirectDraws::Count(&mIndirectSources[batch.FirstSource], batch.SourceCount).Draws;
+			command += batch.CommandCount;
+		}
+	}
+
+	if (mValidateIndirectDraws)
+	{
+		mValidateIndirectDraws = false;
+		mIndirectErrors = IndirectDraws::Validate(mIndirectSources.data(), (UINT)mIndirectSources.size(), out, mIndirectCounts);
+	}
+}
+
+void MySoftRasterizationApp::ExecuteIndirectDraws(CullView view)
+{
+	ID3D12Resource* commands = mRenderFrameResource->IndirectCommandBuffer->Resource();
+	for (const IndirectBatch& batch : mRenderPacket->IndirectBatches[(int)view])
+	{
+		if (batch.CommandCount == 0)
+			continue;
+
+		const D3D12_VERTEX_BUFFER_VIEW vbv = batch.Quantization != nullptr ? batch.Geo->CompactVertexBufferView() : batch.Geo->VertexBufferView();
+		mCommandList->IASetVertexBuffers(0, 1, &vbv);
+		mCommandList->IASetIndexBuffer(&batch.IndexBufferView);
+		mCommandList->IASetPrimitiveTopology(batch.Topology);
+		if (batch.Quantization != nullptr)
+			mCommandList->SetGraphicsRoot32BitConstants(7, sizeof(VertexQuantizationConstants) / 4, batch.Quantization, 0);
+		mCommandList->ExecuteIndirect(mIndirectCommandSignature.Get(), batch.CommandCount, commands,
+			(UINT64)batch.FirstCommand * sizeof(IndirectDraws::Command), nullptr, 0);
+
+		++mIndirectExecutes;
+		++mDrawStateChanges.VertexBuffers;
+		++mDrawStateChanges.IndexBuffers;
+		++mDrawStateChanges.Topologies;
+		mDrawStateChanges.Draws += batch.CommandCount;
+	}
+}
+
+void MySoftRasterizationApp::MergeInstancingGroups()
+{
+	// The slot lists of the items of a group are appended once more back to back, the first item with instances
+	// in the view draws them all and the others are skipped. The records themselves never move.
+	for (const InstancingGroup& group : mInstancingGroups)
+	{
+		for (int view = 0; view < (int)CullView::Count; ++view)
+		{
+			const bool mainView = view == (int)CullView::Main;
+			if (mainView && group.UsesMeshlets && mEnableMeshletCulling)
+				continue;
+
+			UINT drawn = 0;
+			for (const RenderItem* ri : group.Items)
+				drawn += (mainView ? ri->InstanceCount : ri->ViewInstanceCount[view]) > 0 ? 1 : 0;
+			if (drawn < 2)
+				continue;
+
+			const UINT start = (UINT)mInstanceIndices.size();
+			RenderItem* leader = nullptr;
+			for (RenderItem* ri : group.Items)
+			{
+				UINT& count = mainView ? ri->InstanceCount : ri->ViewInstanceCount[view];
+				const UINT first = mainView ? ri->InstanceBufferIndex : ri->ViewInstanceBufferIndex[view];
+				for (UINT k = 0; k < count; ++k)
+				{
+					const UINT slot = mInstanceIndices[first + k];
+					mInstanceIndices.push_back(slot);
+				}
+				if (count > 0 && leader == nullptr)
+					leader = ri;
+				count = 0;
+			}
+
+			const UINT total = (UINT)mInstanceIndices.size() - start;
+			if (mainView)
+			{
+				leader->InstanceBufferIndex = start;
+				leader->InstanceCount = total;
+			}
+			else
+			{
+				leader->ViewInstanceBufferIndex[view] = start;
+				leader->ViewInstanceCount[view] = total;
+			}
+			mMergedItems += drawn - 1;
+		}
+	}
+}
+
+void MySoftRasterizationApp::UpdateSortDepths()
+{
+	// View depth of the bounds center of the nearest visible instance, items without one are not drawn
+	XMMATRIX view = mCamera.GetView();
 	for (auto& e : mAllRitems)
 	{
-		const auto& instanceData = e->Instances;
-		e->InstanceBufferIndex = instanceIndex;
-		for (UINT i = 0; i < (UINT)instanceData.size(); ++i)
+		float depth = FLT_MAX;
+		for (UINT i : e->VisibleInstances)
 		{
-			XMMATRIX world = XMLoadFloat4x4(&instanceData[i].World);
+			XMMATRIX world = XMLoadFloat4x4(&e->Instances[i].World);
+			XMVECTOR center = XMVector3TransformCoord(XMLoadFloat3(&e->Bounds.Center), world * view);
+			depth = std::min(depth, XMVectorGetZ(center));
+		}
+		e->SortDepth = depth;
+	}
+}
+
+void MySoftRasterizationApp::UpdateMeshletCulling()
+{
+	mMeshletStats = MeshletCullStats();
+	if (!mEnableMeshletCulling)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
 
+	XMMATRIX view = mCamera.GetView();
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+	XMVECTOR eyePosW = mCamera.GetPosition();
+
+	mMeshletIndices.clear();
+	for (auto ri : mRitemLayer[(int)RenderLayer::Opaque])
+	{
+		if (ri->Meshlets == nullptr)
+			continue;
+
+		// A meshlet is drawn for all instances as soon as one of them sees it.
+		mMeshletVisible.assign(ri->Meshlets->Meshlets.size(), 0);
+		for (UINT i : ri->VisibleInstances)
+		{
+			XMMATRIX world = XMLoadFloat4x4(&ri->Instances[i].World);
 			XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(world), world);
-			XMMATRIX invTpsWorld = XMMatrixTranspose(invWorld);
 
-			InstanceData data;
-			XMStoreFloat4x4(&data.World, XMMatrixTranspose(XMLoadFloat4x4(&instanceData[i].World)));
-			XMStoreFloat4x4(&data.InvTpsWorld, invTpsWorld);
-			XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&instanceData[i].TexTransform)));
-			data.MaterialIndex = instanceData[i].MaterialIndex;
-			data.AOType = mAOType;
+			// Cull in object space, the cone test assumes the world matrix has no non-uniform scale.
+			BoundingFrustum localFrustum;
+			mCamFrustum.Transform(localFrustum, XMMatrixMultiply(invView, invWorld));
+			XMFLOAT3 localEyePos;
+			XMStoreFloat3(&localEyePos, XMVector3TransformCoord(eyePosW, invWorld));
 
-			currInstanceBuffer->CopyData(instanceIndex++, data);
+			Meshlets::Cull(*ri->Meshlets, localFrustum, localEyePos, mMeshletVisible, mMeshletStats);
+		}
+
+		ri->MeshletIndexStart = (UINT)mMeshletIndices.size();
+		ri->MeshletIndexCount = Meshlets::Compact(*ri->Meshlets, mMeshletVisible, mMeshletIndices);
+
+		mMeshletStats.Triangles += (UINT64)ri->Meshlets->TriangleCount() * ri->VisibleInstances.size();
+		mMeshletStats.VisibleTriangles += (UINT64)(ri->MeshletIndexCount / 3) * ri->VisibleInstances.size();
+	}
+
+	if (!mMeshletIndices.empty())
+		mCurrFrameResource->MeshletIndexBuffer->CopyRange(0, mMeshletIndices.data(), (UINT)mMeshletIndices.size());
+
+	auto end = std::chrono::high_resolution_clock::now();
+	mMeshletStats.CullMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+	if (mFlyThroughFrame >= 0)
+	{
+		mFlyThroughStats.Merge(mMeshletStats);
+		// The other update stages read the camera concurrently, it is restored before the next frame's ones
+		if (++mFlyThroughFrame == FlyThroughFrameCount)
+		{
+			mFlyThroughFrame = -1;
+			mFlyThroughRestore = true;
 		}
-		e->InstanceCount = (UINT)instanceData.size();
 	}
 }
 
-void MySoftRasterizationApp::UpdateMaterialCBs(GameTime& gt)
+void MySoftRasterizationApp::UpdateLodSelection()
 {
-	auto currMatSB = mCurrFrameResource->MatSB.get();
-	for (auto& e : mMaterials)
+	mTrianglesWithLod = 0;
+	mTrianglesWithoutLod = 0;
+	memset(mLodHistogram, 0, sizeof(mLodHistogram));
+
+	XMVECTOR eyePosW = mCamera.GetPosition();
+	const float fovY = mCamera.GetFovY();
+	const float viewportHeight = (float)mClientHeight;
+
+	for (auto& e : mAllRitems)
 	{
-		Material* mat = e.second.get();
-		if (mat->NumFramesDirty > 0)
+		if (e->Lods.empty())
+			continue;
+
+		const UINT instanceCount = (UINT)e->VisibleInstances.size();
+		std::vector<UINT> selected(instanceCount, 0);
+		e->LodInstanceCounts.assign(e->Lods.size(), 0);
+
+		for (UINT k = 0; k < instanceCount; ++k)
+		{
+			UINT lod = 0;
+			if (mEnableLod)
+			{
+				XMMATRIX world = XMLoadFloat4x4(&e->Instances[e->VisibleInstances[k]].World);
+				const BoundingBox& bounds = e->Lods[0].Bounds;
+
+				// Errors are measured in object space, scale them with the largest axis of the world matrix.
+				float scale = MathHelper::Max(XMVectorGetX(XMVector3Length(world.r[0])),
+					MathHelper::Max(XMVectorGetX(XMVector3Length(world.r[1])), XMVectorGetX(XMVector3Length(world.r[2]))));
+				XMVECTOR center = XMVector3TransformCoord(XMLoadFloat3(&bounds.Center), world);
+				float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Extents))) * scale;
+				float distance = MathHelper::Max(XMVectorGetX(XMVector3Length(center - eyePosW)) - radius, mCamera.GetNearZ());
+
+				for (UINT k = (UINT)e->Lods.size() - 1; k > 0; --k)
+				{
+					if (MeshSimplifier::ProjectedError(e->Lods[k].LodError * scale, distance, fovY, viewportHeight) <= mLodPixelError)
+					{
+						lod = k;
+						break;
+					}
+				}
+			}
+
+			selected[k] = lod;
+			e->LodInstanceCounts[lod]++;
+			mLodHistogram[lod]++;
+		}
+
+		// Counting sort of the instances by LOD
+		std::vector<UINT> offsets(e->Lods.size(), 0);
+		for (size_t k = 1; k < e->Lods.size(); ++k)
+			offsets[k] = offsets[k - 1] + e->LodInstanceCounts[k - 1];
+		e->LodOrder.resize(instanceCount);
+		for (UINT k = 0; k < instanceCount; ++k)
+			e->LodOrder[offsets[selected[k]]++] = e->VisibleInstances[k];
+	}
+
+	// Triangles submitted by the opaque pass with and without the LOD selection
+	for (auto ri : mRitemLayer[(int)RenderLayer::Opaque])
+	{
+		UINT64 fullTriangles = (UINT64)(ri->IndexCount / 3) * ri->VisibleInstances.size();
+		mTrianglesWithoutLod += fullTriangles;
+		if (ri->Lods.empty())
+		{
+			mTrianglesWithLod += fullTriangles;
+			continue;
+		}
+		for (size_t k = 0; k < ri->Lods.size(); ++k)
+			mTrianglesWithLod += (UINT64)(ri->Lods[k].IndexCount / 3) * ri->LodInstanceCounts[k];
+	}
+}
+
+void MySoftRasterizationApp::UpdateSceneBvh()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	for (const auto& ri : mAllRitems)
+	{
+		for (UINT i : ri->MovedInstances)
+			mInstanceRecords.MarkDirty(ri->FirstInstanceSlot + i);
+		if (ri->FirstBvhPrimitive == UINT_MAX)
 		{
-			MaterialData matData;
-			matData.DiffuseAlbedo = mat->DiffuseAlbedo;
-			matData.FresnelR0 = mat->FresnelR0;
-			matData.Roughness = mat->Roughness;
-			XMStoreFloat4x4(&matData.MatTransform, XMMatrixTranspose(XMLoadFloat4x4(&mat->MatTransform)));
-			matData.DiffuseMapIndex = mat->DiffuseSrvHeapIndex;
-			matData.NormalMapIndex = mat->NormalSrvHeapIndex;
-			matData.CubeMapIndex = mat->CubeMapInex;
-			matData.Metallic = mat->metallic;
-
-			currMatSB->CopyData(mat->MatCBIndex, matData);
-			mat->NumFramesDirty--;
+			ri->MovedInstances.clear();
+			continue;
 		}
+		for (UINT i : ri->MovedInstances)
+			mScene.SetWorld(ri->FirstBvhPrimitive + i, ri->Instances[i].World);
+		ri->MovedInstances.clear();
+	}
+	for (UINT p : mScene.Moved())
+		mSceneBvh.SetBounds(p, mScene.WorldBox(p));
+	mScene.ClearMoved();
+	mBvhRefitNodes = mSceneBvh.Refit();
+	auto end = std::chrono::high_resolution_clock::now();
+	mBvhRefitMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+	// The shadow map is fitted around the scene bounds in UpdateShadowTransform
+	BoundingSphere::CreateFromBoundingBox(mSceneBounds, mSceneBvh.Bounds());
+
+	// The light volume of UpdateShadowTransform is fitted around the whole scene and would keep everything.
+	// The shadow view is the camera frustum swept along the light across the scene instead: whatever can
+	// throw a shadow into the view stays.
+	XMMATRIX viewProj = XMMatrixMultiply(mCamera.GetView(), mCamera.GetProj());
+	mCullViews[(int)CullView::Main] = Culling::ExtractPlanes(viewProj);
+	mCullViews[(int)CullView::Shadow] = mCullViews[(int)CullView::Main];
+	Culling::SweepPlanes(mCullViews[(int)CullView::Shadow], XMLoadFloat3(&mRotatedLightDirections[0]) * (2.0f * mSceneBounds.Radius));
+
+	// All views in one pass, through the BVH or over the flat box streams
+	auto cullViews = [this](const Culling::FrustumPlanes* views, UINT viewCount, std::uint8_t* masks)
+	{
+		if (mUseFlatCulling)
+			Culling::CullViews(mScene.WorldBounds(), views, viewCount, masks, nullptr, &mJobs);
+		else
+			mSceneBvh.QueryViews(views, viewCount, masks);
+	};
+
+	start = std::chrono::high_resolution_clock::now();
+	if (mEnableBvhCulling)
+		cullViews(mCullViews, (UINT)CullView::Count, mCullMasks.data());
+	else
+		std::fill(mCullMasks.begin(), mCullMasks.end(), (std::uint8_t)((1u << (int)CullView::Count) - 1u));
+	// Instances of hidden layers are in no view
+	if (!mShowStressScene)
+		mScene.KeepLayers(~(1u << (int)RenderLayer::StressSpheres), mCullMasks.data());
+
+	for (const auto& ri : mAllRitems)
+	{
+		if (ri->FirstBvhPrimitive == UINT_MAX)
+			continue;
+		ri->VisibleInstances.clear();
+		for (auto& instances : ri->ViewInstances)
+			instances.clear();
+	}
+	memset(mViewVisibleCounts, 0, sizeof(mViewVisibleCounts));
+	const SceneStore::Owner* owners = mScene.Owners();
+	for (UINT p = 0; p < mScene.Count(); ++p)
+	{
+		UINT mask = mCullMasks[p];
+		if (mask == 0)
+			continue;
+		RenderItem* ri = mAllRitems[owners[p].Item].get();
+		const UINT instance = owners[p].ItemInstance;
+		if (mask & (1u << (int)CullView::Main))
+			ri->VisibleInstances.push_back(instance);
+		for (int view = 0; view < (int)CullView::Count; ++view)
+		{
+			if ((mask & (1u << view)) == 0)
+				continue;
+			mViewVisibleCounts[view]++;
+			if (view != (int)CullView::Main)
+				ri->ViewInstances[view].push_back(instance);
+		}
+	}
+	end = std::chrono::high_resolution_clock::now();
+	mBvhQueryMs = std::chrono::duration<double, std::milli>(end - start).count();
+	mBvhVisibleCount = mViewVisibleCounts[(int)CullView::Main];
+
+	// The single pass against the same views culled one by one, masks only
+	mSeparateCullMs = 0.0;
+	if (mTimeSeparateCulls && mEnableBvhCulling)
+	{
+		std::vector<std::uint8_t> masks(mCullMasks.size());
+		start = std::chrono::high_resolution_clock::now();
+		for (int view = 0; view < (int)CullView::Count; ++view)
+			cullViews(&mCullViews[view], 1, masks.data());
+		end = std::chrono::high_resolution_clock::now();
+		mSeparateCullMs = std::chrono::duration<double, std::milli>(end - start).count();
+	}
+}
+
+void MySoftRasterizationApp::UpdateFlyThrough()
+{
+	if (mFlyThroughRestore)
+	{
+		mFlyThroughRestore = false;
+		mCamera.LookAt(mFlyThroughSavedPos,
+			XMFLOAT3(mFlyThroughSavedPos.x + mFlyThroughSavedLook.x,
+				mFlyThroughSavedPos.y + mFlyThroughSavedLook.y,
+				mFlyThroughSavedPos.z + mFlyThroughSavedLook.z),
+			XMFLOAT3(0.0f, 1.0f, 0.0f));
+	}
+	if (mFlyThroughFrame < 0)
+		return;
+
+	// Spiral around the scene, moving in from outside the scene bounds and back out again,
+	// so the recorded frames mix close ups (cone culling) with wide views (frustum culling).
+	float t = (float)mFlyThroughFrame / FlyThroughFrameCount;
+	float angle = t * XM_2PI * 2.0f;
+	float radius = 3.0f + (mSceneBounds.Radius - 3.0f) * fabsf(cosf(t * XM_PI));
+	XMFLOAT3 target(0.0f, 0.0f, -6.0f);
+	XMFLOAT3 pos(
+		target.x + radius * cosf(angle),
+		1.0f + 3.0f * sinf(t * XM_2PI),
+		target.z + radius * sinf(angle));
+	mCamera.LookAt(pos, target, XMFLOAT3(0.0f, 1.0f, 0.0f));
+}
+
+void MySoftRasterizationApp::CookSceneTextures()
+{
+	CreateDirectoryW(L"Cooked", nullptr);
+
+	mCookReports.clear();
+	for (const TextureCookJob& job : gTextureCookJobs)
+	{
+		TextureCooker::CookSettings settings;
+		settings.Kind = job.Kind;
+		settings.Format = job.Format;
+		mCookReports.push_back(TextureCooker::CookFile(job.Source, job.Dest, settings));
 	}
 }
 
+void MySoftRasterizationApp::UpdateTextureStreaming()
+{
+	// Update waited for the GPU to complete the frame resource, so its feedback is ready
+	mTextureStreamer->ReadFeedback(mRenderFrameResourceIndex);
+
+	// The sky is not part of the G-buffer pass: match a face texel to a pixel at the current fov
+	UINT sky = mTextureRegistry[mSkyTexture];
+	float pixelsPerRadian = 0.5f * mFrameGraphHeight / tanf(0.5f * mRenderPacket->FovY);
+	float texelsPerRadian = mTextureStreamer->Info(sky).Width / XM_PIDIV2;
+	float skyMip = log2f(texelsPerRadian / pixelsPerRadian);
+	mTextureStreamer->RequestMip(sky, skyMip <= 0.0f ? 0 : (UINT)skyMip);
+}
+
+void MySoftRasterizationApp::UpdateMaterialCBs(GameTime& gt)
+{
+	mMaterialUpload = mMaterialTable.Upload(mCurrFrameResourceIndex, mCurrFrameResource->MatSB->MappedData());
+}
+
 void MySoftRasterizationApp::UpdateCubeMapFacePassCBs()
 {
 	for (int i = 0; i < 6; ++i)
@@ -2732,15 +4469,13 @@ void MySoftRasterizationApp::LoadTextures()
 		L"D:\\DX12\\MyDX12Renderer\\MySoftRasterizer\\Models\\cave\\cave_normal.dds",
 	};
 
+	mTextureStreamer = std::make_unique<TextureStreamer>(md3dDevice.Get(), gNumFrameResources,
+		MaxStreamedMaterials, (UINT64)(mStreamingBudgetMB * 1024.0f * 1024.0f));
+
+	// Only the mip tails go up with the initialization commands, the rest streams in on demand
 	for (int i = 0; i < (int)texNames.size(); ++i)
 	{
-		auto texMap = std::make_unique<Texture>();
-		texMap->Name = texNames[i];
-		texMap->Filename = texFilenames[i];
-		ThrowIfFailed(CreateDDSTextureFromFile12(md3dDevice.Get(),
-			mCommandList.Get(), texMap->Filename.c_str(),
-			texMap->Resource, texMap->UploadHeap));
-
-		mTextures[texMap->Name] = std::move(texMap);
+		mTextureIds[texNames[i]] = mTextureStreamer->AddTexture(texNames[i], texFilenames[i],
+			mCommandList.Get(), (UINT64)mCurrentFence + 1);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,187 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Platform neutral: the pipeline only moves packet pointers between two threads, so it builds with the tests
+// everywhere.
+
+// Bounded single producer single consumer ring. The producer only writes mTail and the consumer only mHead, each
+// on its own cache line, so neither side takes a lock or writes a line the other one writes.
+template<typename T, std::uint32_t Capacity>
+class SpscQueue
+{
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	// Producer side, false when full
+	bool TryPush(const T& value)
+	{
+		const std::uint32_t tail = mTail.load(std::memory_order_relaxed);
+		if (tail - mHead.load(std::memory_order_acquire) == Capacity)
+			return false;
+		mSlots[tail & (Capacity - 1)] = value;
+		mTail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side, false when empty
+	bool TryPop(T& value)
+	{
+		const std::uint32_t head = mHead.load(std::memory_order_relaxed);
+		if (head == mTail.load(std::memory_order_acquire))
+			return false;
+		value = mSlots[head & (Capacity - 1)];
+		mHead.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side: what TryPop can take at least, the producer may have pushed more since
+	std::uint32_t Size() const
+	{
+		return mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_relaxed);
+	}
+
+private:
+	alignas(64) std::atomic<std::uint32_t> mHead{ 0 }; // next slot to pop
+	alignas(64) std::atomic<std::uint32_t> mTail{ 0 }; // next slot to push
+	alignas(64) T mSlots[Capacity];
+};
+
+// Two stage frame pipeline: the simulation thread fills packets and the render thread consumes them. The packets
+// go round through two SPSC queues, submitted ones to the render thread and released ones back, and there are
+// only packetCount of them. The simulation does not touch a packet again until the render thread released it,
+// so neither side locks while it works on one, and the simulation runs at most packetCount - 1 frames ahead of
+// the frame being rendered. A side that finds its queue empty spins briefly and then sleeps until the other one
+// pushes. Both sides may be the same thread, which submits a packet and then acquires it itself.
+template<typename Packet>
+class FramePipeline
+{
+public:
+	static const std::uint32_t MaxPackets = 8;
+
+	explicit FramePipeline(std::uint32_t packetCount)
+	{
+		assert(packetCount > 0 && packetCount <= MaxPackets);
+		for (std::uint32_t i = 0; i < packetCount; ++i)
+		{
+			mPackets.push_back(std::make_unique<Packet>());
+			mFree.TryPush(mPackets.back().get());
+		}
+	}
+	FramePipeline(const FramePipeline&) = delete;
+	FramePipeline& operator=(const FramePipeline&) = delete;
+
+	std::uint32_t PacketCount() const { return (std::uint32_t)mPackets.size(); }
+	// For setting the packets up before the first frame
+	Packet& PacketAt(std::uint32_t index) { return *mPackets[index]; }
+
+	// Simulation thread: a free packet to fill, in the order they were first handed out. Waits while all of
+	// them are submitted or being rendered.
+	Packet* BeginFrame()
+	{
+		Packet* packet = nullptr;
+		if (WaitFor([&]() { return mFree.TryPop(packet); }))
+			mSimulationWaits.fetch_add(1, std::memory_order_relaxed);
+		++mHeld;
+		return packet;
+	}
+
+	void Submit(Packet* packet)
+	{
+		// Never full: there are no more packets than slots
+		bool pushed = mReady.TryPush(packet);
+		assert(pushed);
+		(void)pushed;
+		--mHeld;
+		Wake();
+	}
+
+	// Simulation thread: waits until the render thread released every submitted packet. It then waits in Acquire
+	// and touches nothing the simulation may change, until the next Submit.
+	void Drain()
+	{
+		WaitFor([&]() { return mFree.Size() + mHeld == PacketCount(); });
+	}
+
+	// Acquire returns nullptr once the packets submitted so far were taken
+	void Stop()
+	{
+		mStopped.store(true, std::memory_order_release);
+		Wake();
+	}
+
+	// Undoes Stop once the render thread returned
+	void Restart()
+	{
+		mStopped.store(false, std::memory_order_release);
+	}
+
+	// Render thread: the oldest submitted packet, nullptr after Stop once every submitted packet was taken
+	Packet* Acquire()
+	{
+		Packet* packet = nullptr;
+		bool stopped = false;
+		// Stop is read before the queue, so a packet submitted before it is never missed
+		if (WaitFor([&]()
+		{
+			stopped = mStopped.load(std::memory_order_acquire);
+			return mReady.TryPop(packet) || stopped;
+		}))
+			mRenderWaits.fetch_add(1, std::memory_order_relaxed);
+		return packet;
+	}
+
+	void Release(Packet* packet)
+	{
+		bool pushed = mFree.TryPush(packet);
+		assert(pushed);
+		(void)pushed;
+		Wake();
+	}
+
+	// BeginFrame calls that found no free packet and Acquire calls that found no submitted one
+	std::uint64_t SimulationWaits() const { return mSimulationWaits.load(std::memory_order_relaxed); }
+	std::uint64_t RenderWaits() const { return mRenderWaits.load(std::memory_order_relaxed); }
+
+private:
+	// Returns whether attempt failed at first. The other side usually answers within a few hundred cycles, a
+	// side still waiting after that sleeps until the next push.
+	template<typename Try>
+	bool WaitFor(const Try& attempt)
+	{
+		if (attempt())
+			return false;
+		for (int spin = 0; spin < 64; ++spin)
+		{
+			if (attempt())
+				return true;
+		}
+		std::unique_lock<std::mutex> lock(mSleepLock);
+		mWake.wait(lock, attempt);
+		return true;
+	}
+
+	// The lock orders the push before the wait of a side that checked its queue just before it
+	void Wake()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mSleepLock);
+		}
+		mWake.notify_all();
+	}
+
+	std::vector<std::unique_ptr<Packet>> mPackets;
+	SpscQueue<Packet*, MaxPackets> mReady; // simulation -> render
+	SpscQueue<Packet*, MaxPackets> mFree;  // render -> simulation
+	std::uint32_t mHeld = 0;               // popped by BeginFrame and not submitted yet, simulation thread only
+	std::atomic<bool> mStopped{ false };
+	std::mutex mSleepLock;
+	std::condition_variable mWake;
+	std::atomic<std::uint64_t> mSimulationWaits{ 0 };
+	std::atomic<std::uint64_t> mRenderWaits{ 0 };
+};
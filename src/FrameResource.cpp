@@ -1,6 +1,7 @@
 #include "FrameResource.hpp"
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objCount, UINT matCount, UINT skinnedObjectCount)
+FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objCount, UINT matCount, UINT skinnedObjectCount, UINT meshletIndexCount,
+	UINT instanceIndexCount, UINT indirectDrawCount)
 {
 	ThrowIfFailed(device->CreateCommandAllocator(
 		D3D12_COMMAND_LIST_TYPE_DIRECT,
@@ -9,8 +10,17 @@ FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objCount
 	SsaoCB = std::make_unique<UploadBufferResource<SsaoConstants>>(device, 1, true);
 	SsrCB = std::make_unique<UploadBufferResource<SSRConstants>>(device, 1, true);
 	//ObjectCB = std::make_unique<UploadBufferResource<ObjectConstants>>(device, objCount, true);
-	InstanceBuffer = std::make_unique<UploadBufferResource<InstanceData>>(device, objCount, false);
+	InstanceBuffer = std::make_unique<UploadBufferResource<PackedInstance>>(device, objCount, false);
 	MatSB = std::make_unique<UploadBufferResource<MaterialData>>(device, matCount, false);
+	if (meshletIndexCount > 0)
+		MeshletIndexBuffer = std::make_unique<UploadBufferResource<std::uint32_t>>(device, meshletIndexCount, false);
+	if (instanceIndexCount > 0)
+		InstanceIndexBuffer = std::make_unique<UploadBufferResource<std::uint32_t>>(device, instanceIndexCount, false);
+	if (indirectDrawCount > 0)
+	{
+		IndirectCommandBuffer = std::make_unique<UploadBufferResource<IndirectDraws::Command>>(device, indirectDrawCount, false);
+		IndirectSlotBuffer = std::make_unique<UploadBufferResource<std::uint32_t>>(device, instanceIndexCount, false);
+	}
 	//SkinnedCB = std::make_unique<UploadBufferResource<SkinnedConstants>>(device, skinnedObjectCount, true);
 }
 
@@ -3,6 +3,7 @@
 #include "DXHelper.h"
 #include "..\utils\MathHelper.h"
 #include "UploadBufferResource.h"
+#include "IndirectDraws.h"
 
 
 //嶥ṹ
@@ -24,6 +25,7 @@ struct ObjectConstants {
 	UINT objPad2;
 };
 
+//CPU side description of an instance, InstanceRecords packs it into a PackedInstance for the GPU
 struct InstanceData
 {
 	XMFLOAT4X4 World = MathHelper::Identity4x4();
@@ -36,6 +38,20 @@ struct InstanceData
 	UINT InstancePad2;
 };
 
+//GPU record of an instance, 76 bytes instead of the 208 an InstanceData takes. The shaders rebuild the world
+//matrix and derive the normal matrix from its adjugate (Common.hlsl), the TexTransform keeps its 2x3 affine part.
+struct PackedInstance
+{
+	XMFLOAT4 World[3];          //rows of the transposed world matrix, the translation in w
+	XMFLOAT3 TexTransform[2];   //uv' = (dot(TexTransform[0], (uv, 1)), dot(TexTransform[1], (uv, 1)))
+	UINT MaterialAndFlags = 0;  //material index in bits 0-23, AOType in bits 24-25, PackedIdentityTexTransform
+};
+static_assert(sizeof(PackedInstance) == 76, "PackedInstance must match the HLSL layout");
+
+const UINT PackedMaterialIndexMask = 0xffffff;
+const UINT PackedAOTypeShift = 24;
+const UINT PackedIdentityTexTransform = 1u << 26; //the shaders skip the texture transform
+
 struct PassConstants {
 	XMFLOAT4X4 View = MathHelper::Identity4x4();
 	XMFLOAT4X4 InvView = MathHelper::Identity4x4();
@@ -112,7 +128,8 @@ struct MaterialData
 
 struct FrameResource {
 public:
-	FrameResource(ID3D12Device* device, UINT passCount, UINT objCount, UINT matCount, UINT skinnedObjectCount);
+	FrameResource(ID3D12Device* device, UINT passCount, UINT objCount, UINT matCount, UINT skinnedObjectCount, UINT meshletIndexCount = 0,
+		UINT instanceIndexCount = 0, UINT indirectDrawCount = 0);
 	//ÿ캯͸ֵֹ⿽ΪǶռģܱ
 	FrameResource(const FrameResource& rhs) = delete;
 	FrameResource& operator = (const FrameResource& rhs) = delete;
@@ -120,11 +137,19 @@ public:
 
 	ComPtr<ID3D12CommandAllocator> CmdListAlloc;
 	//std::unique_ptr<UploadBufferResource<ObjectConstants>> ObjectCB = nullptr;
-	std::unique_ptr<UploadBufferResource<InstanceData>> InstanceBuffer = nullptr;
+	std::unique_ptr<UploadBufferResource<PackedInstance>> InstanceBuffer = nullptr;
+	//slots of InstanceBuffer each draw reads its instances from, when the records are not in draw order
+	std::unique_ptr<UploadBufferResource<std::uint32_t>> InstanceIndexBuffer = nullptr;
 	std::unique_ptr<UploadBufferResource<PassConstants>> PassCB = nullptr;
 	std::unique_ptr<UploadBufferResource<SsaoConstants>> SsaoCB = nullptr;
 	std::unique_ptr<UploadBufferResource<MaterialData>> MatSB = nullptr;
 	std::unique_ptr<UploadBufferResource<SSRConstants>> SsrCB = nullptr;
+	//compacted index lists of the meshlets that survived culling this frame
+	std::unique_ptr<UploadBufferResource<std::uint32_t>> MeshletIndexBuffer = nullptr;
+	//ExecuteIndirect commands of the visible instances, see IndirectDraws.h: one per draw with instances,
+	//pointing gInstanceIndices into the compacted slots of all of them
+	std::unique_ptr<UploadBufferResource<IndirectDraws::Command>> IndirectCommandBuffer = nullptr;
+	std::unique_ptr<UploadBufferResource<std::uint32_t>> IndirectSlotBuffer = nullptr;
 	//std::unique_ptr<UploadBufferResource<SkinnedConstants>> SkinnedCB = nullptr;
 
 	UINT64 FenceCPU = 0;
@@ -0,0 +1,667 @@
+#include "FrustumCulling.h"
+#include "JobSystem.h"
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FRUSTUM_CULLING_AVX2 1
+#elif defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FRUSTUM_CULLING_SSE2 1
+#endif
+
+namespace
+{
+	const UINT ChunkBoxes = 16384; // per worker task, a multiple of 8
+	const UINT ParallelThreshold = 4 * ChunkBoxes;
+
+	// For every mask of surviving lanes, the lane numbers of the survivors in order, then zeros.
+	// Adding the index of the first box of the group turns a row into the indices to store.
+	template<UINT Lanes>
+	struct CompactTable
+	{
+		UINT Indices[1u << Lanes][Lanes];
+		UINT Count[1u << Lanes];
+
+		CompactTable()
+		{
+			for (UINT mask = 0; mask < (1u << Lanes); ++mask)
+			{
+				UINT n = 0;
+				for (UINT lane = 0; lane < Lanes; ++lane)
+				{
+					if (mask & (1u << lane))
+						Indices[mask][n++] = lane;
+				}
+				Count[mask] = n;
+				for (UINT k = n; k < Lanes; ++k)
+					Indices[mask][k] = 0;
+			}
+		}
+	};
+
+	// Planes split into components, with the absolute normals for the box radius
+	struct PlaneStreams
+	{
+		float NX[6], NY[6], NZ[6], D[6];
+		float AX[6], AY[6], AZ[6];
+
+		explicit PlaneStreams(const Culling::FrustumPlanes& planes)
+		{
+			for (int k = 0; k < 6; ++k)
+			{
+				NX[k] = planes.Planes[k].x;
+				NY[k] = planes.Planes[k].y;
+				NZ[k] = planes.Planes[k].z;
+				D[k] = planes.Planes[k].w;
+				AX[k] = fabsf(NX[k]);
+				AY[k] = fabsf(NY[k]);
+				AZ[k] = fabsf(NZ[k]);
+			}
+		}
+	};
+
+	// Turns the lane mask of one view into per box bytes: byte l of Spread[mask] is bit l of mask, so shifting
+	// the row left by v and or-ing it in sets bit v of the bytes of the boxes the view keeps.
+	struct ViewMaskTable
+	{
+		std::uint64_t Spread[256];
+		UINT Count[256];
+
+		ViewMaskTable()
+		{
+			for (UINT mask = 0; mask < 256; ++mask)
+			{
+				Spread[mask] = 0;
+				Count[mask] = 0;
+				for (UINT lane = 0; lane < 8; ++lane)
+				{
+					if (mask & (1u << lane))
+					{
+						Spread[mask] |= 1ull << (8 * lane);
+						++Count[mask];
+					}
+				}
+			}
+		}
+	};
+
+#if defined(FRUSTUM_CULLING_AVX2) || defined(FRUSTUM_CULLING_SSE2)
+	// Mask of the boxes of [first, first + 8) that also lie below count
+	UINT ValidLanes(UINT first, UINT count)
+	{
+		return count - first >= 8 ? 0xffu : (1u << (count - first)) - 1u;
+	}
+#endif
+
+	// Culls the groups of 8 in [begin, end) and writes the survivors to out, returns how many.
+	// Each group stores a whole row of indices at the current write position, which never runs past
+	// the group's own slots [i, i + 8) of out: fewer boxes survived than were tested so far.
+	UINT CullRange(const Culling::InstanceBoxes& boxes, const PlaneStreams& p, UINT begin, UINT end, UINT* out)
+	{
+		UINT n = 0;
+
+#if defined(FRUSTUM_CULLING_AVX2)
+		static const CompactTable<8> table;
+
+		__m256 nx[6], ny[6], nz[6], d[6], ax[6], ay[6], az[6];
+		for (int k = 0; k < 6; ++k)
+		{
+			nx[k] = _mm256_set1_ps(p.NX[k]);
+			ny[k] = _mm256_set1_ps(p.NY[k]);
+			nz[k] = _mm256_set1_ps(p.NZ[k]);
+			d[k] = _mm256_set1_ps(p.D[k]);
+			ax[k] = _mm256_set1_ps(p.AX[k]);
+			ay[k] = _mm256_set1_ps(p.AY[k]);
+			az[k] = _mm256_set1_ps(p.AZ[k]);
+		}
+		const __m256 zero = _mm256_setzero_ps();
+
+		for (UINT i = begin; i < end; i += 8)
+		{
+			const __m256 cx = _mm256_loadu_ps(&boxes.CenterX[i]);
+			const __m256 cy = _mm256_loadu_ps(&boxes.CenterY[i]);
+			const __m256 cz = _mm256_loadu_ps(&boxes.CenterZ[i]);
+			const __m256 ex = _mm256_loadu_ps(&boxes.ExtentX[i]);
+			const __m256 ey = _mm256_loadu_ps(&boxes.ExtentY[i]);
+			const __m256 ez = _mm256_loadu_ps(&boxes.ExtentZ[i]);
+
+			// Outside as soon as center distance + projected radius is negative for one plane
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int k = 0; k < 6; ++k)
+			{
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, nx[k]), _mm256_mul_ps(cy, ny[k])),
+					_mm256_add_ps(_mm256_mul_ps(cz, nz[k]), d[k]));
+				__m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, ax[k]), _mm256_mul_ps(ey, ay[k])), _mm256_mul_ps(ez, az[k]));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_GE_OQ));
+			}
+
+			const UINT mask = (UINT)_mm256_movemask_ps(inside) & ValidLanes(i, boxes.Count);
+			const __m256i lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(table.Indices[mask]));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + n), _mm256_add_epi32(lanes, _mm256_set1_epi32((int)i)));
+			n += table.Count[mask];
+		}
+#elif defined(FRUSTUM_CULLING_SSE2)
+		static const CompactTable<4> table;
+
+		__m128 nx[6], ny[6], nz[6], d[6], ax[6], ay[6], az[6];
+		for (int k = 0; k < 6; ++k)
+		{
+			nx[k] = _mm_set1_ps(p.NX[k]);
+			ny[k] = _mm_set1_ps(p.NY[k]);
+			nz[k] = _mm_set1_ps(p.NZ[k]);
+			d[k] = _mm_set1_ps(p.D[k]);
+			ax[k] = _mm_set1_ps(p.AX[k]);
+			ay[k] = _mm_set1_ps(p.AY[k]);
+			az[k] = _mm_set1_ps(p.AZ[k]);
+		}
+		const __m128 zero = _mm_setzero_ps();
+
+		// 8 boxes per iteration as two halves, which keeps both dependency chains in flight
+		for (UINT i = begin; i < end; i += 8)
+		{
+			__m128 inside[2];
+			for (int h = 0; h < 2; ++h)
+			{
+				const UINT j = i + 4 * h;
+				const __m128 cx = _mm_loadu_ps(&boxes.CenterX[j]);
+				const __m128 cy = _mm_loadu_ps(&boxes.CenterY[j]);
+				const __m128 cz = _mm_loadu_ps(&boxes.CenterZ[j]);
+				const __m128 ex = _mm_loadu_ps(&boxes.ExtentX[j]);
+				const __m128 ey = _mm_loadu_ps(&boxes.ExtentY[j]);
+				const __m128 ez = _mm_loadu_ps(&boxes.ExtentZ[j]);
+
+				inside[h] = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for (int k = 0; k < 6; ++k)
+				{
+					__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, nx[k]), _mm_mul_ps(cy, ny[k])),
+						_mm_add_ps(_mm_mul_ps(cz, nz[k]), d[k]));
+					__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ax[k]), _mm_mul_ps(ey, ay[k])), _mm_mul_ps(ez, az[k]));
+					inside[h] = _mm_and_ps(inside[h], _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+				}
+			}
+
+			const UINT valid = ValidLanes(i, boxes.Count);
+			for (int h = 0; h < 2; ++h)
+			{
+				const UINT mask = (UINT)_mm_movemask_ps(inside[h]) & (valid >> (4 * h));
+				const __m128i lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table.Indices[mask]));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + n), _mm_add_epi32(lanes, _mm_set1_epi32((int)(i + 4 * h))));
+				n += table.Count[mask];
+			}
+		}
+#else
+		for (UINT i = begin; i < end && i < boxes.Count; ++i)
+		{
+			bool inside = true;
+			for (int k = 0; k < 6 && inside; ++k)
+			{
+				float distance = boxes.CenterX[i] * p.NX[k] + boxes.CenterY[i] * p.NY[k] + boxes.CenterZ[i] * p.NZ[k] + p.D[k];
+				float radius = boxes.ExtentX[i] * p.AX[k] + boxes.ExtentY[i] * p.AY[k] + boxes.ExtentZ[i] * p.AZ[k];
+				inside = distance + radius >= 0.0f;
+			}
+			if (inside)
+				out[n++] = i;
+		}
+#endif
+
+		return n;
+	}
+
+	// The planes of several views, with the normals they have in common stored once. The swept shadow view only
+	// moves the planes of the main camera and the six faces of a cube map get by with 9 normals between them, so
+	// n.c and |n|.e are computed per distinct normal and each plane then just adds its own offset.
+	struct SharedPlanes
+	{
+		struct Plane
+		{
+			UINT Normal;
+			float Sign; // the plane normal is Sign times the shared one
+			float D;
+		};
+
+		std::vector<XMFLOAT3> Normals;
+		Plane Planes[Culling::MaxViews][6];
+		UINT ViewCount = 0;
+
+		SharedPlanes(const Culling::FrustumPlanes* views, UINT viewCount) : ViewCount(viewCount)
+		{
+			for (UINT v = 0; v < viewCount; ++v)
+			{
+				for (int k = 0; k < 6; ++k)
+				{
+					const XMFLOAT4& plane = views[v].Planes[k];
+					Plane& shared = Planes[v][k];
+					shared.D = plane.w;
+
+					// Only exact matches share, anything else would change the result
+					UINT u = 0;
+					for (; u < (UINT)Normals.size(); ++u)
+					{
+						const XMFLOAT3& n = Normals[u];
+						if (n.x == plane.x && n.y == plane.y && n.z == plane.z)
+						{
+							shared.Sign = 1.0f;
+							break;
+						}
+						if (n.x == -plane.x && n.y == -plane.y && n.z == -plane.z)
+						{
+							shared.Sign = -1.0f;
+							break;
+						}
+					}
+					if (u == (UINT)Normals.size())
+					{
+						Normals.push_back(XMFLOAT3(plane.x, plane.y, plane.z));
+						shared.Sign = 1.0f;
+					}
+					shared.Normal = u;
+				}
+			}
+		}
+	};
+
+	// Writes the view masks of the groups of 8 in [begin, end) and adds the survivors of each view to counts.
+	// Every group is loaded once, its distances to the shared normals computed once and then reused by all views.
+	void CullViewsRange(const Culling::InstanceBoxes& boxes, const SharedPlanes& shared, UINT begin, UINT end,
+		std::uint8_t* masks, UINT* counts)
+	{
+		static const ViewMaskTable table;
+		const UINT normalCount = (UINT)shared.Normals.size();
+		const UINT viewCount = shared.ViewCount;
+
+#if defined(FRUSTUM_CULLING_AVX2)
+		__m256 nx[Culling::MaxViews * 6], ny[Culling::MaxViews * 6], nz[Culling::MaxViews * 6];
+		__m256 ax[Culling::MaxViews * 6], ay[Culling::MaxViews * 6], az[Culling::MaxViews * 6];
+		for (UINT u = 0; u < normalCount; ++u)
+		{
+			const XMFLOAT3& n = shared.Normals[u];
+			nx[u] = _mm256_set1_ps(n.x);
+			ny[u] = _mm256_set1_ps(n.y);
+			nz[u] = _mm256_set1_ps(n.z);
+			ax[u] = _mm256_set1_ps(fabsf(n.x));
+			ay[u] = _mm256_set1_ps(fabsf(n.y));
+			az[u] = _mm256_set1_ps(fabsf(n.z));
+		}
+		// Per plane the sign bit to flip the shared distance with and the offset
+		__m256 flip[Culling::MaxViews][6], d[Culling::MaxViews][6];
+		for (UINT v = 0; v < viewCount; ++v)
+		{
+			for (int k = 0; k < 6; ++k)
+			{
+				flip[v][k] = _mm256_set1_ps(shared.Planes[v][k].Sign < 0.0f ? -0.0f : 0.0f);
+				d[v][k] = _mm256_set1_ps(shared.Planes[v][k].D);
+			}
+		}
+		const __m256 zero = _mm256_setzero_ps();
+
+		__m256 distance[Culling::MaxViews * 6], radius[Culling::MaxViews * 6];
+		for (UINT i = begin; i < end; i += 8)
+		{
+			const __m256 cx = _mm256_loadu_ps(&boxes.CenterX[i]);
+			const __m256 cy = _mm256_loadu_ps(&boxes.CenterY[i]);
+			const __m256 cz = _mm256_loadu_ps(&boxes.CenterZ[i]);
+			const __m256 ex = _mm256_loadu_ps(&boxes.ExtentX[i]);
+			const __m256 ey = _mm256_loadu_ps(&boxes.ExtentY[i]);
+			const __m256 ez = _mm256_loadu_ps(&boxes.ExtentZ[i]);
+			for (UINT u = 0; u < normalCount; ++u)
+			{
+				distance[u] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, nx[u]), _mm256_mul_ps(cy, ny[u])), _mm256_mul_ps(cz, nz[u]));
+				radius[u] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, ax[u]), _mm256_mul_ps(ey, ay[u])), _mm256_mul_ps(ez, az[u]));
+			}
+			const UINT valid = ValidLanes(i, boxes.Count);
+
+			std::uint64_t bytes = 0;
+			for (UINT v = 0; v < viewCount; ++v)
+			{
+				__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+				for (int k = 0; k < 6; ++k)
+				{
+					const UINT u = shared.Planes[v][k].Normal;
+					__m256 outer = _mm256_add_ps(_mm256_add_ps(_mm256_xor_ps(distance[u], flip[v][k]), d[v][k]), radius[u]);
+					inside = _mm256_and_ps(inside, _mm256_cmp_ps(outer, zero, _CMP_GE_OQ));
+				}
+
+				const UINT mask = (UINT)_mm256_movemask_ps(inside) & valid;
+				bytes |= table.Spread[mask] << v;
+				counts[v] += table.Count[mask];
+			}
+			memcpy(masks + i, &bytes, sizeof(bytes));
+		}
+#elif defined(FRUSTUM_CULLING_SSE2)
+		__m128 nx[Culling::MaxViews * 6], ny[Culling::MaxViews * 6], nz[Culling::MaxViews * 6];
+		__m128 ax[Culling::MaxViews * 6], ay[Culling::MaxViews * 6], az[Culling::MaxViews * 6];
+		for (UINT u = 0; u < normalCount; ++u)
+		{
+			const XMFLOAT3& n = shared.Normals[u];
+			nx[u] = _mm_set1_ps(n.x);
+			ny[u] = _mm_set1_ps(n.y);
+			nz[u] = _mm_set1_ps(n.z);
+			ax[u] = _mm_set1_ps(fabsf(n.x));
+			ay[u] = _mm_set1_ps(fabsf(n.y));
+			az[u] = _mm_set1_ps(fabsf(n.z));
+		}
+		__m128 flip[Culling::MaxViews][6], d[Culling::MaxViews][6];
+		for (UINT v = 0; v < viewCount; ++v)
+		{
+			for (int k = 0; k < 6; ++k)
+			{
+				flip[v][k] = _mm_set1_ps(shared.Planes[v][k].Sign < 0.0f ? -0.0f : 0.0f);
+				d[v][k] = _mm_set1_ps(shared.Planes[v][k].D);
+			}
+		}
+		const __m128 zero = _mm_setzero_ps();
+
+		// 8 boxes per iteration as two halves, the same groups and masks as the AVX2 path
+		__m128 distance[Culling::MaxViews * 6][2], radius[Culling::MaxViews * 6][2];
+		for (UINT i = begin; i < end; i += 8)
+		{
+			for (int h = 0; h < 2; ++h)
+			{
+				const UINT j = i + 4 * h;
+				const __m128 cx = _mm_loadu_ps(&boxes.CenterX[j]);
+				const __m128 cy = _mm_loadu_ps(&boxes.CenterY[j]);
+				const __m128 cz = _mm_loadu_ps(&boxes.CenterZ[j]);
+				const __m128 ex = _mm_loadu_ps(&boxes.ExtentX[j]);
+				const __m128 ey = _mm_loadu_ps(&boxes.ExtentY[j]);
+				const __m128 ez = _mm_loadu_ps(&boxes.ExtentZ[j]);
+				for (UINT u = 0; u < normalCount; ++u)
+				{
+					distance[u][h] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, nx[u]), _mm_mul_ps(cy, ny[u])), _mm_mul_ps(cz, nz[u]));
+					radius[u][h] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ax[u]), _mm_mul_ps(ey, ay[u])), _mm_mul_ps(ez, az[u]));
+				}
+			}
+			const UINT valid = ValidLanes(i, boxes.Count);
+
+			std::uint64_t bytes = 0;
+			for (UINT v = 0; v < viewCount; ++v)
+			{
+				__m128 inside[2] = { _mm_castsi128_ps(_mm_set1_epi32(-1)), _mm_castsi128_ps(_mm_set1_epi32(-1)) };
+				for (int k = 0; k < 6; ++k)
+				{
+					const UINT u = shared.Planes[v][k].Normal;
+					for (int h = 0; h < 2; ++h)
+					{
+						__m128 outer = _mm_add_ps(_mm_add_ps(_mm_xor_ps(distance[u][h], flip[v][k]), d[v][k]), radius[u][h]);
+						inside[h] = _mm_and_ps(inside[h], _mm_cmpge_ps(outer, zero));
+					}
+				}
+
+				const UINT mask = ((UINT)_mm_movemask_ps(inside[0]) | ((UINT)_mm_movemask_ps(inside[1]) << 4)) & valid;
+				bytes |= table.Spread[mask] << v;
+				counts[v] += table.Count[mask];
+			}
+			memcpy(masks + i, &bytes, sizeof(bytes));
+		}
+#else
+		std::vector<float> distance(normalCount), radius(normalCount);
+		for (UINT i = begin; i < end; ++i)
+		{
+			std::uint8_t mask = 0;
+			if (i < boxes.Count)
+			{
+				for (UINT u = 0; u < normalCount; ++u)
+				{
+					const XMFLOAT3& n = shared.Normals[u];
+					distance[u] = boxes.CenterX[i] * n.x + boxes.CenterY[i] * n.y + boxes.CenterZ[i] * n.z;
+					radius[u] = boxes.ExtentX[i] * fabsf(n.x) + boxes.ExtentY[i] * fabsf(n.y) + boxes.ExtentZ[i] * fabsf(n.z);
+				}
+				for (UINT v = 0; v < viewCount; ++v)
+				{
+					bool inside = true;
+					for (int k = 0; k < 6 && inside; ++k)
+					{
+						const SharedPlanes::Plane& plane = shared.Planes[v][k];
+						inside = plane.Sign * distance[plane.Normal] + plane.D + radius[plane.Normal] >= 0.0f;
+					}
+					if (inside)
+					{
+						mask |= (std::uint8_t)(1u << v);
+						++counts[v];
+					}
+				}
+			}
+			masks[i] = mask;
+		}
+		(void)table;
+#endif
+	}
+
+	// Boxes up to 2 units wide in a cube of the given side around the origin
+	void RandomBoxes(UINT count, float side, std::vector<BoundingBox>& boxes, Culling::InstanceBoxes& streams)
+	{
+		std::uint32_t state = 0x12345678u;
+		auto random = [&state](float a, float b)
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return a + (b - a) * (state >> 8) * (1.0f / 16777216.0f);
+		};
+
+		boxes.resize(count);
+		streams.Resize(count);
+		for (UINT i = 0; i < count; ++i)
+		{
+			boxes[i].Center = XMFLOAT3(random(-0.5f, 0.5f) * side, random(-0.5f, 0.5f) * side, random(-0.5f, 0.5f) * side);
+			boxes[i].Extents = XMFLOAT3(random(0.1f, 1.0f), random(0.1f, 1.0f), random(0.1f, 1.0f));
+			streams.Set(i, boxes[i]);
+		}
+	}
+}
+
+void Culling::InstanceBoxes::Resize(UINT count)
+{
+	Count = count;
+	const size_t padded = PaddedCount();
+	for (auto* stream : { &CenterX, &CenterY, &CenterZ, &ExtentX, &ExtentY, &ExtentZ })
+		stream->resize(padded, 0.0f);
+}
+
+void Culling::InstanceBoxes::Set(UINT i, const BoundingBox& box)
+{
+	assert(i < Count);
+	CenterX[i] = box.Center.x;
+	CenterY[i] = box.Center.y;
+	CenterZ[i] = box.Center.z;
+	ExtentX[i] = box.Extents.x;
+	ExtentY[i] = box.Extents.y;
+	ExtentZ[i] = box.Extents.z;
+}
+
+Culling::FrustumPlanes Culling::ExtractPlanes(FXMMATRIX viewProj)
+{
+	// clip = v * viewProj, so every clip coordinate is a dot product with a column
+	XMMATRIX columns = XMMatrixTranspose(viewProj);
+	const XMVECTOR planes[6] =
+	{
+		XMVectorAdd(columns.r[3], columns.r[0]),      // -w <= x
+		XMVectorSubtract(columns.r[3], columns.r[0]), // x <= w
+		XMVectorAdd(columns.r[3], columns.r[1]),      // -w <= y
+		XMVectorSubtract(columns.r[3], columns.r[1]), // y <= w
+		columns.r[2],                                 // 0 <= z
+		XMVectorSubtract(columns.r[3], columns.r[2]), // z <= w
+	};
+
+	FrustumPlanes result;
+	for (int k = 0; k < 6; ++k)
+		XMStoreFloat4(&result.Planes[k], XMPlaneNormalize(planes[k]));
+	return result;
+}
+
+void Culling::SweepPlanes(FrustumPlanes& planes, FXMVECTOR sweep)
+{
+	// The box and its moved copy are bounded by a box around their midpoint with the half sweep added
+	// to the extents. Its distance to a plane grows by n.h and its radius by |n|.|h|.
+	XMVECTOR half = XMVectorScale(sweep, 0.5f);
+	for (auto& plane : planes.Planes)
+	{
+		XMVECTOR n = XMLoadFloat4(&plane);
+		plane.w += XMVectorGetX(XMVector3Dot(n, half)) + XMVectorGetX(XMVector3Dot(XMVectorAbs(n), XMVectorAbs(half)));
+	}
+}
+
+UINT Culling::Cull(const InstanceBoxes& boxes, const FrustumPlanes& planes, UINT* out, JobSystem* jobs)
+{
+	const PlaneStreams streams(planes);
+	const UINT end = boxes.PaddedCount();
+	if (jobs == nullptr || boxes.Count < ParallelThreshold)
+		return CullRange(boxes, streams, 0, end, out);
+
+	// Every chunk compacts into its own part of out, then the parts are moved together in order.
+	const UINT chunks = (end + ChunkBoxes - 1) / ChunkBoxes;
+	std::vector<UINT> survivors(chunks);
+	jobs->ParallelFor(chunks, 1, [&](size_t first, size_t last)
+	{
+		for (size_t c = first; c < last; ++c)
+		{
+			UINT begin = (UINT)c * ChunkBoxes;
+			survivors[c] = CullRange(boxes, streams, begin, std::min(begin + ChunkBoxes, end), out + begin);
+		}
+	});
+
+	UINT n = survivors[0];
+	for (UINT c = 1; c < chunks; ++c)
+	{
+		memmove(out + n, out + (size_t)c * ChunkBoxes, survivors[c] * sizeof(UINT));
+		n += survivors[c];
+	}
+	return n;
+}
+
+Culling::CullThroughput Culling::MeasureThroughput(UINT count, int iterations, JobSystem& jobs)
+{
+	CullThroughput result;
+	result.Boxes = count;
+
+	// Boxes in a cube around the origin, viewed from one of its sides
+	const float side = 4.0f * cbrtf((float)count);
+	std::vector<BoundingBox> boxes;
+	InstanceBoxes streams;
+	RandomBoxes(count, side, boxes, streams);
+
+	XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0.0f, 0.2f * side, -0.6f * side, 1.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f * XM_PI, 16.0f / 9.0f, 0.1f, 1000.0f);
+
+	BoundingFrustum frustum;
+	BoundingFrustum(proj).Transform(frustum, XMMatrixInverse(nullptr, view));
+	const FrustumPlanes planes = ExtractPlanes(XMMatrixMultiply(view, proj));
+
+	std::vector<UINT> visible(streams.PaddedCount());
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+	{
+		UINT n = 0;
+		for (UINT i = 0; i < count; ++i)
+		{
+			if (boxes[i].Intersects(frustum))
+				visible[n++] = i;
+		}
+		result.ScalarVisible = n;
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	result.ScalarMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+
+	for (bool parallel : { false, true })
+	{
+		start = std::chrono::high_resolution_clock::now();
+		for (int it = 0; it < iterations; ++it)
+			result.SimdVisible = Cull(streams, planes, visible.data(), parallel ? &jobs : nullptr);
+		end = std::chrono::high_resolution_clock::now();
+		(parallel ? result.ParallelMs : result.SimdMs) = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+	}
+	return result;
+}
+
+void Culling::CullViews(const InstanceBoxes& boxes, const FrustumPlanes* views, UINT viewCount, std::uint8_t* masks,
+	UINT* visibleCounts, JobSystem* jobs)
+{
+	assert(viewCount <= MaxViews);
+	const SharedPlanes shared(views, viewCount);
+
+	const UINT end = boxes.PaddedCount();
+	UINT counts[MaxViews] = {};
+	if (jobs == nullptr || boxes.Count < ParallelThreshold)
+	{
+		CullViewsRange(boxes, shared, 0, end, masks, counts);
+	}
+	else
+	{
+		// The masks of every chunk go straight to their place, only the counts are summed afterwards
+		const UINT chunks = (end + ChunkBoxes - 1) / ChunkBoxes;
+		std::vector<UINT> chunkCounts((size_t)chunks * MaxViews, 0);
+		jobs->ParallelFor(chunks, 1, [&](size_t first, size_t last)
+		{
+			for (size_t c = first; c < last; ++c)
+			{
+				UINT begin = (UINT)c * ChunkBoxes;
+				CullViewsRange(boxes, shared, begin, std::min(begin + ChunkBoxes, end), masks, &chunkCounts[c * MaxViews]);
+			}
+		});
+		for (UINT c = 0; c < chunks; ++c)
+		{
+			for (UINT v = 0; v < viewCount; ++v)
+				counts[v] += chunkCounts[(size_t)c * MaxViews + v];
+		}
+	}
+
+	if (visibleCounts != nullptr)
+		memcpy(visibleCounts, counts, viewCount * sizeof(UINT));
+}
+
+Culling::MultiViewThroughput Culling::MeasureViews(UINT count, int iterations)
+{
+	MultiViewThroughput result;
+	result.Boxes = count;
+	result.Views = MaxViews;
+
+	const float side = 4.0f * cbrtf((float)count);
+	std::vector<BoundingBox> boxes;
+	InstanceBoxes streams;
+	RandomBoxes(count, side, boxes, streams);
+
+	// The views of a frame of the renderer: the main camera, the shadow casters for it and a cube map in the middle
+	FrustumPlanes views[MaxViews];
+	XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0.0f, 0.2f * side, -0.6f * side, 1.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f * XM_PI, 16.0f / 9.0f, 0.1f, 1000.0f);
+	views[0] = ExtractPlanes(XMMatrixMultiply(view, proj));
+	views[1] = views[0];
+	SweepPlanes(views[1], XMVectorScale(XMVector3Normalize(XMVectorSet(0.57735f, -0.57735f, 0.57735f, 0.0f)), side));
+
+	const XMVECTOR targets[6] =
+	{
+		XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f), XMVectorSet(-1.0f, 0.0f, 0.0f, 0.0f),
+		XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), XMVectorSet(0.0f, -1.0f, 0.0f, 0.0f),
+		XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMVectorSet(0.0f, 0.0f, -1.0f, 0.0f),
+	};
+	const XMVECTOR ups[6] =
+	{
+		XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f),
+		XMVectorSet(0.0f, 0.0f, -1.0f, 0.0f), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f),
+		XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f),
+	};
+	XMMATRIX cubeProj = XMMatrixPerspectiveFovLH(0.5f * XM_PI, 1.0f, 0.1f, 100.0f);
+	for (int i = 0; i < 6; ++i)
+		views[2 + i] = ExtractPlanes(XMMatrixMultiply(XMMatrixLookToLH(XMVectorZero(), targets[i], ups[i]), cubeProj));
+
+	std::vector<UINT> visible(streams.PaddedCount());
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+	{
+		for (UINT v = 0; v < MaxViews; ++v)
+			result.SeparateVisible[v] = Cull(streams, views[v], visible.data());
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	result.SeparateMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+
+	std::vector<std::uint8_t> masks(streams.PaddedCount());
+	start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+		CullViews(streams, views, MaxViews, masks.data(), result.CombinedVisible);
+	end = std::chrono::high_resolution_clock::now();
+	result.CombinedMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+	return result;
+}
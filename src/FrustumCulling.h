@@ -0,0 +1,81 @@
+#pragma once
+#include "DXHelper.h"
+
+class JobSystem;
+
+// Frustum culling of many boxes at once. Boxes live in separate center and extent streams so one
+// SIMD load fetches the same component of 8 boxes, which are then tested together against 6 planes.
+namespace Culling
+{
+	// Box streams, padded to a multiple of 8 boxes so the kernel always loads whole groups.
+	struct InstanceBoxes
+	{
+		std::vector<float> CenterX, CenterY, CenterZ;
+		std::vector<float> ExtentX, ExtentY, ExtentZ;
+		UINT Count = 0;
+
+		void Resize(UINT count);
+		void Set(UINT i, const BoundingBox& box);
+		// Entries the index list of Cull needs, Count rounded up to 8
+		UINT PaddedCount() const { return (Count + 7) & ~7u; }
+	};
+
+	// Normalized planes with the normals pointing into the frustum, left, right, bottom, top, near, far.
+	struct FrustumPlanes
+	{
+		XMFLOAT4 Planes[6];
+	};
+
+	// Planes of the view volume of viewProj (row vectors, D3D clip space with 0 <= z <= w),
+	// e.g. Camera::GetView() * Camera::GetProj() for world space boxes.
+	FrustumPlanes ExtractPlanes(FXMMATRIX viewProj);
+
+	// Moves the planes out so that a box also passes when its copy moved by sweep overlaps the frustum.
+	void SweepPlanes(FrustumPlanes& planes, FXMVECTOR sweep);
+
+	// Writes the indices of the boxes overlapping the frustum to out in ascending order and returns how many.
+	// out must hold boxes.PaddedCount() entries, the ones past the returned count are scratch.
+	// Large arrays are split over the threads of jobs when one is given.
+	UINT Cull(const InstanceBoxes& boxes, const FrustumPlanes& planes, UINT* out, JobSystem* jobs = nullptr);
+
+	struct CullThroughput
+	{
+		UINT Boxes = 0;
+		double ScalarMs = 0.0;   // BoundingBox::Intersects(BoundingFrustum) one box at a time
+		double SimdMs = 0.0;     // Cull on the calling thread
+		double ParallelMs = 0.0; // Cull on the threads of the job system
+		UINT ScalarVisible = 0;
+		UINT SimdVisible = 0;    // can be a little higher, the plane test keeps boxes straddling a frustum corner
+
+		double Speedup() const { return SimdMs > 0.0 ? ScalarMs / SimdMs : 0.0; }
+	};
+
+	// Culls count pseudo random boxes scattered around a camera iterations times with each method.
+	CullThroughput MeasureThroughput(UINT count, int iterations, JobSystem& jobs);
+
+	// Views one CullViews pass handles, one bit each of the masks
+	const UINT MaxViews = 8;
+
+	// Tests every box against all viewCount <= MaxViews views in a single pass over the streams and writes one
+	// byte per box to masks, bit v set when the box overlaps views[v]. masks must hold boxes.PaddedCount() bytes,
+	// the padding ones come out 0. visibleCounts, when given, receives the number of boxes each view keeps.
+	// Large arrays are split over the threads of jobs when one is given.
+	void CullViews(const InstanceBoxes& boxes, const FrustumPlanes* views, UINT viewCount, std::uint8_t* masks,
+		UINT* visibleCounts = nullptr, JobSystem* jobs = nullptr);
+
+	struct MultiViewThroughput
+	{
+		UINT Boxes = 0;
+		UINT Views = 0;
+		double SeparateMs = 0.0; // one Cull per view
+		double CombinedMs = 0.0; // one CullViews for all of them
+		UINT SeparateVisible[MaxViews] = {};
+		UINT CombinedVisible[MaxViews] = {};
+
+		double Speedup() const { return CombinedMs > 0.0 ? SeparateMs / CombinedMs : 0.0; }
+	};
+
+	// Culls count pseudo random boxes against a main camera, a swept shadow view and the six faces of a cube map,
+	// once view by view and once in a single pass, iterations times each on the calling thread.
+	MultiViewThroughput MeasureViews(UINT count, int iterations);
+}
@@ -44,6 +44,27 @@ void GBuffers::BuildResource()
 	));
 }
 
+void GBuffers::PlaceResources(ID3D12Heap* heap, const UINT64* offsets)
+{
+	for (uint32_t i = 0; i < GetGBufferCount(); ++i)
+	{
+		const D3D12_RESOURCE_DESC texDesc = ResourceDesc(GBufferType(i));
+		optClear.Format = texDesc.Format;
+		mGBufferResources[i].Reset();
+		ThrowIfFailed(md3dDevice->CreatePlacedResource(
+			heap,
+			offsets[i],
+			&texDesc,
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			&optClear,
+			IID_PPV_ARGS(&mGBufferResources[i])
+		));
+	}
+	mPlaced = true;
+
+	BuildDescriptors();
+}
+
 void GBuffers::BuildDescriptors(
 	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
 	CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
@@ -122,6 +143,10 @@ void GBuffers::OnResize(UINT width, UINT height)
 
 		mViewport = { 0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f };
 		mScissorRect = { 0, 0, (int)width, (int)height };
-		BuildResource();
+		if (!mPlaced)
+		{
+			BuildResource();
+			BuildDescriptors();
+		}
 	}
 }
\ No newline at end of file
@@ -49,8 +49,17 @@ public:
 		UINT rtvDescriptorSize
 	);
 
+	// Once the targets are placed OnResize leaves building new ones to the owner of the heap
 	void OnResize(UINT width, UINT height);
 
+	D3D12_RESOURCE_DESC ResourceDesc(GBufferType type) const
+	{
+		return CD3DX12_RESOURCE_DESC::Tex2D(type == GBufferType::Albedo ? mAlbedoFormat : mNormalPosFormat,
+			mWidth, mHeight, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+	}
+	// Replaces the targets with ones placed in heap, offsets[type] for each, and rebuilds their views
+	void PlaceResources(ID3D12Heap* heap, const UINT64* offsets);
+
 	void CleanAll(ID3D12GraphicsCommandList* cmdList)
 	{
 		for (int i = 0; i < static_cast<int>(GBufferType::Count); ++i)
@@ -88,6 +97,7 @@ private:
 	CD3DX12_CLEAR_VALUE optClear = { mAlbedoFormat, mClearColor };
 
 	ComPtr<ID3D12Resource> mGBufferResources[static_cast<uint32_t>(GBufferType::Count)];
+	bool mPlaced = false;
 	
 	UINT mRTVDescriptorSize = 0;
 	UINT mSRVDescriptorSize = 0;
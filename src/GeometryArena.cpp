@@ -0,0 +1,131 @@
+#include "GeometryArena.h"
+
+namespace
+{
+	inline UINT IndexSize(DXGI_FORMAT format)
+	{
+		return format == DXGI_FORMAT_R16_UINT ? 2 : 4;
+	}
+}
+
+GeometryArena::GeometryArena(const std::string& name, size_t vertexCapacity, size_t indexByteCapacity)
+	: mVertexCapacity(vertexCapacity), mIndexByteCapacity(indexByteCapacity)
+{
+	mGeo = std::make_unique<MeshGeometry>();
+	mGeo->Name = name;
+	mGeo->VertexByteStride = sizeof(Vertex);
+
+	ThrowIfFailed(D3DCreateBlob(MathHelper::Max<size_t>(mVertexCapacity * sizeof(Vertex), 1), &mGeo->VertexBufferCPU));
+	ThrowIfFailed(D3DCreateBlob(MathHelper::Max<size_t>(mIndexByteCapacity, 1), &mGeo->IndexBufferCPU));
+}
+
+DXGI_FORMAT GeometryArena::IndexFormatFor(UINT vertexCount)
+{
+	return vertexCount <= 0x10000 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+}
+
+size_t GeometryArena::IndexBytesFor(UINT vertexCount, size_t indexCount)
+{
+	// 2 bytes of slack cover aligning a 32-bit range, or rounding the buffer size up after a 16-bit one.
+	return indexCount * IndexSize(IndexFormatFor(vertexCount)) + 2;
+}
+
+ArenaSubmesh GeometryArena::Allocate(const std::string& name, UINT vertexCount, UINT indexCount)
+{
+	assert(mGeo != nullptr && "GeometryArena already released");
+	assert(mGeo->DrawArgs.find(name) == mGeo->DrawArgs.end());
+	assert(mVertexCount + vertexCount <= mVertexCapacity && "GeometryArena vertex capacity exceeded");
+
+	SubmeshGeometry submesh;
+	submesh.BaseVertexLocation = (INT)mVertexCount;
+	submesh.VertexCount = vertexCount;
+	submesh.IndexFormat = IndexFormatFor(vertexCount);
+	mVertexCount += vertexCount;
+
+	// Align the range to its own index size, StartIndexLocation is counted in that size.
+	const UINT indexSize = IndexSize(submesh.IndexFormat);
+	mIndexByteSize = (mIndexByteSize + indexSize - 1) / indexSize * indexSize;
+	assert(mIndexByteSize + indexCount * indexSize <= mIndexByteCapacity && "GeometryArena index capacity exceeded");
+	submesh.StartIndexLocation = (UINT)(mIndexByteSize / indexSize);
+	submesh.IndexCount = indexCount;
+	mIndexByteSize += indexCount * indexSize;
+
+	mGeo->DrawArgs[name] = submesh;
+	return MakeView(submesh);
+}
+
+ArenaSubmesh GeometryArena::AllocateShared(const std::string& name, const std::string& vertexOwner, UINT indexCount)
+{
+	assert(mGeo != nullptr && "GeometryArena already released");
+	assert(mGeo->DrawArgs.find(name) == mGeo->DrawArgs.end());
+
+	SubmeshGeometry submesh = Submesh(vertexOwner);
+
+	const UINT indexSize = IndexSize(submesh.IndexFormat);
+	mIndexByteSize = (mIndexByteSize + indexSize - 1) / indexSize * indexSize;
+	assert(mIndexByteSize + indexCount * indexSize <= mIndexByteCapacity && "GeometryArena index capacity exceeded");
+	submesh.StartIndexLocation = (UINT)(mIndexByteSize / indexSize);
+	submesh.IndexCount = indexCount;
+	mIndexByteSize += indexCount * indexSize;
+
+	mGeo->DrawArgs[name] = submesh;
+	return MakeView(submesh);
+}
+
+ArenaSubmesh GeometryArena::Get(const std::string& name)
+{
+	return MakeView(Submesh(name));
+}
+
+SubmeshGeometry& GeometryArena::Submesh(const std::string& name)
+{
+	assert(mGeo != nullptr && "GeometryArena already released");
+	auto it = mGeo->DrawArgs.find(name);
+	assert(it != mGeo->DrawArgs.end());
+	return it->second;
+}
+
+std::unique_ptr<MeshGeometry> GeometryArena::Release()
+{
+	assert(mGeo != nullptr && "GeometryArena already released");
+
+	// The blobs keep their capacity, the byte sizes only cover what was allocated.
+	mIndexByteSize = (mIndexByteSize + 3) & ~size_t(3);
+	assert(mIndexByteSize <= mIndexByteCapacity);
+	mGeo->VertexBufferByteSize = (UINT)(mVertexCount * sizeof(Vertex));
+	mGeo->IndexBufferByteSize = (UINT)mIndexByteSize;
+
+	// Object-space bounds of every submesh, culling and LOD selection read them. Shared submeshes cover the
+	// vertex range of their owner and end up with the same box.
+	const Vertex* vertices = static_cast<const Vertex*>(mGeo->VertexBufferCPU->GetBufferPointer());
+	for (auto& arg : mGeo->DrawArgs)
+	{
+		SubmeshGeometry& submesh = arg.second;
+		if (submesh.VertexCount > 0)
+			BoundingBox::CreateFromPoints(submesh.Bounds, submesh.VertexCount, &vertices[submesh.BaseVertexLocation].Pos, sizeof(Vertex));
+	}
+
+	// The geometry wide format is the one used by all submeshes, 32-bit when they are mixed.
+	mGeo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	for (const auto& arg : mGeo->DrawArgs)
+	{
+		if (arg.second.IndexFormat == DXGI_FORMAT_R32_UINT)
+			mGeo->IndexFormat = DXGI_FORMAT_R32_UINT;
+	}
+
+	return std::move(mGeo);
+}
+
+ArenaSubmesh GeometryArena::MakeView(const SubmeshGeometry& submesh) const
+{
+	BYTE* vertexBase = static_cast<BYTE*>(mGeo->VertexBufferCPU->GetBufferPointer());
+	BYTE* indexBase = static_cast<BYTE*>(mGeo->IndexBufferCPU->GetBufferPointer());
+
+	ArenaSubmesh view;
+	view.Vertices = reinterpret_cast<Vertex*>(vertexBase) + submesh.BaseVertexLocation;
+	view.Indices = indexBase + (size_t)submesh.StartIndexLocation * IndexSize(submesh.IndexFormat);
+	view.VertexCount = submesh.VertexCount;
+	view.IndexCount = submesh.IndexCount;
+	view.IndexFormat = submesh.IndexFormat;
+	return view;
+}
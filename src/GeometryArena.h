@@ -0,0 +1,75 @@
+#pragma once
+#include "FrameResource.hpp"
+#include "MeshGeometry.hpp"
+
+// Slice of a GeometryArena owned by one submesh, writers fill it in place.
+struct ArenaSubmesh
+{
+	Vertex* Vertices = nullptr;
+	void* Indices = nullptr;
+	UINT VertexCount = 0;
+	UINT IndexCount = 0;
+	DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
+
+	void SetIndex(UINT i, std::uint32_t value)
+	{
+		assert(i < IndexCount);
+		if (IndexFormat == DXGI_FORMAT_R16_UINT)
+			static_cast<std::uint16_t*>(Indices)[i] = static_cast<std::uint16_t>(value);
+		else
+			static_cast<std::uint32_t*>(Indices)[i] = value;
+	}
+
+	std::uint32_t GetIndex(UINT i) const
+	{
+		assert(i < IndexCount);
+		if (IndexFormat == DXGI_FORMAT_R16_UINT)
+			return static_cast<const std::uint16_t*>(Indices)[i];
+		return static_cast<const std::uint32_t*>(Indices)[i];
+	}
+};
+
+// Builds the vertex and index buffers of one MeshGeometry in place.
+// Both CPU blobs are created once from the capacities given up front and every submesh is a
+// sub-allocation of them, so importers and generators write straight into the final buffers.
+// Each submesh gets 16-bit indices when its vertices fit, 32-bit otherwise; ranges are aligned
+// to their own index size so one index buffer view per format covers the whole buffer.
+class GeometryArena
+{
+public:
+	// indexByteCapacity is the sum of IndexBytesFor over the submeshes that will be allocated.
+	GeometryArena(const std::string& name, size_t vertexCapacity, size_t indexByteCapacity);
+	GeometryArena(const GeometryArena& rhs) = delete;
+	GeometryArena& operator=(const GeometryArena& rhs) = delete;
+
+	// New submesh with its own vertex range.
+	ArenaSubmesh Allocate(const std::string& name, UINT vertexCount, UINT indexCount);
+
+	// New submesh drawing the vertices of an existing one, e.g. a LOD level.
+	ArenaSubmesh AllocateShared(const std::string& name, const std::string& vertexOwner, UINT indexCount);
+
+	// Writable view of a submesh allocated earlier.
+	ArenaSubmesh Get(const std::string& name);
+	SubmeshGeometry& Submesh(const std::string& name);
+
+	// Hands the blobs and DrawArgs over to a MeshGeometry with the Bounds of every submesh computed from
+	// the vertices written so far. GPU buffers are left to the caller.
+	std::unique_ptr<MeshGeometry> Release();
+
+	static DXGI_FORMAT IndexFormatFor(UINT vertexCount);
+	// Index bytes of a submesh including the worst case alignment padding.
+	static size_t IndexBytesFor(UINT vertexCount, size_t indexCount);
+
+	UINT64 CapacityBytes() const { return mVertexCapacity * sizeof(Vertex) + mIndexByteCapacity; }
+	UINT64 UsedBytes() const { return mVertexCount * sizeof(Vertex) + mIndexByteSize; }
+
+private:
+	ArenaSubmesh MakeView(const SubmeshGeometry& submesh) const;
+
+	std::unique_ptr<MeshGeometry> mGeo;
+
+	size_t mVertexCapacity = 0;
+	size_t mIndexByteCapacity = 0;
+	size_t mVertexCount = 0;
+	size_t mIndexByteSize = 0;
+};
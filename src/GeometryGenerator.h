@@ -1,10 +1,10 @@
 //***************************************************************************************
 // GeometryGenerator.h by Frank Luna (C) 2011 All Rights Reserved.
-//   
-// Defines a static class for procedurally generating the geometry of 
+//
+// Defines a static class for procedurally generating the geometry of
 // common mathematical objects.
 //
-// All triangles are generated "outward" facing.  If you want "inward" 
+// All triangles are generated "outward" facing.  If you want "inward"
 // facing triangles (for example, if you want to place the camera inside
 // a sphere to simulate a sky), you will need to:
 //   1. Change the Direct3D cull mode or manually reverse the winding order.
@@ -17,6 +17,7 @@
 #include <cstdint>
 #include <DirectXMath.h>
 #include <vector>
+#include "ParallelFor.h"
 
 class GeometryGenerator
 {
@@ -25,26 +26,32 @@ public:
     using uint16 = std::uint16_t;
     using uint32 = std::uint32_t;
 
+	///<summary>
+	/// With parallel set, large meshes are generated in blocks of rows on worker threads.
+	/// The output is the same either way.
+	///</summary>
+	explicit GeometryGenerator(bool parallel = true) : mParallel(parallel) {}
+
 	struct Vertex
 	{
 		Vertex(){}
         Vertex(
-            const DirectX::XMFLOAT3& p, 
-            const DirectX::XMFLOAT3& n, 
-            const DirectX::XMFLOAT3& t, 
+            const DirectX::XMFLOAT3& p,
+            const DirectX::XMFLOAT3& n,
+            const DirectX::XMFLOAT3& t,
             const DirectX::XMFLOAT2& uv) :
-            Position(p), 
-            Normal(n), 
-            TangentU(t), 
+            Position(p),
+            Normal(n),
+            TangentU(t),
             TexC(uv){}
 		Vertex(
-			float px, float py, float pz, 
+			float px, float py, float pz,
 			float nx, float ny, float nz,
 			float tx, float ty, float tz,
-			float u, float v) : 
-            Position(px,py,pz), 
+			float u, float v) :
+            Position(px,py,pz),
             Normal(nx,ny,nz),
-			TangentU(tx, ty, tz), 
+			TangentU(tx, ty, tz),
             TexC(u,v){}
 
         DirectX::XMFLOAT3 Position;
@@ -74,6 +81,45 @@ public:
 		std::vector<uint16> mIndices16;
 	};
 
+	///<summary>
+	/// Vertex and index counts of a shape, for sizing the buffers a sink writes to.
+	///</summary>
+	struct MeshSize
+	{
+		uint32 VertexCount = 0;
+		uint32 IndexCount = 0;
+	};
+
+	///<summary>
+	/// Sink writing straight into caller owned arrays: any vertex struct with Pos, Normal,
+	/// TexC and TangentU members (the renderer's Vertex) and 16 or 32 bit indices.
+	/// Generators call SetVertex/SetIndex from several threads, each element exactly once.
+	///</summary>
+	template<typename VertexT, typename IndexT>
+	struct LayoutSink
+	{
+		VertexT* Vertices = nullptr;
+		IndexT* Indices = nullptr;
+
+		void SetVertex(uint32 i, const Vertex& v)
+		{
+			VertexT& dst = Vertices[i];
+			dst.Pos = v.Position;
+			dst.Normal = v.Normal;
+			dst.TexC = v.TexC;
+			dst.TangentU = v.TangentU;
+		}
+
+		void SetIndex(size_t i, uint32 index) { Indices[i] = static_cast<IndexT>(index); }
+	};
+
+	static MeshSize BoxSize(uint32 numSubdivisions);
+	static MeshSize SphereSize(uint32 sliceCount, uint32 stackCount);
+	static MeshSize GeosphereSize(uint32 numSubdivisions);
+	static MeshSize CylinderSize(uint32 sliceCount, uint32 stackCount);
+	static MeshSize GridSize(uint32 m, uint32 n);
+	static MeshSize QuadSize();
+
 	///<summary>
 	/// Creates a box centered at the origin with the given dimensions, where each
     /// face has m rows and n columns of vertices.
@@ -88,12 +134,12 @@ public:
 
 	///<summary>
 	/// Creates a geosphere centered at the origin with the given radius.  The
-	/// depth controls the level of tessellation.
+	/// depth controls the level of tessellation, up to 8 levels.
 	///</summary>
     MeshData CreateGeosphere(float radius, uint32 numSubdivisions);
 
 	///<summary>
-	/// Creates a cylinder parallel to the y-axis, and centered about the origin.  
+	/// Creates a cylinder parallel to the y-axis, and centered about the origin.
 	/// The bottom and top radius can vary to form various cone shapes rather than true
 	// cylinders.  The slices and stacks parameters control the degree of tessellation.
 	///</summary>
@@ -110,10 +156,530 @@ public:
 	///</summary>
     MeshData CreateQuad(float x, float y, float w, float h, float depth);
 
+	///<summary>
+	/// Direct-to-layout versions of the above.  The sink receives exactly the element
+	/// counts given by the matching *Size function; no intermediate MeshData is built.
+	///</summary>
+	template<typename Sink> void CreateBox(float width, float height, float depth, uint32 numSubdivisions, Sink& sink);
+	template<typename Sink> void CreateSphere(float radius, uint32 sliceCount, uint32 stackCount, Sink& sink);
+	template<typename Sink> void CreateGeosphere(float radius, uint32 numSubdivisions, Sink& sink);
+	template<typename Sink> void CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, Sink& sink);
+	template<typename Sink> void CreateGrid(float width, float depth, uint32 m, uint32 n, Sink& sink);
+	template<typename Sink> void CreateQuad(float x, float y, float w, float h, float depth, Sink& sink);
+
 private:
-	void Subdivide(MeshData& meshData);
-    Vertex MidPoint(const Vertex& v0, const Vertex& v1);
-    void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
-    void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
+	///<summary>
+	/// Splits every triangle into four.  Each edge gets one midpoint vertex that the
+	/// triangles sharing it reuse, so the mesh stays indexed without duplicates.
+	///</summary>
+	void Subdivide(std::vector<DirectX::XMFLOAT3>& positions, std::vector<uint32>& indices);
+
+	///<summary>
+	/// Unprojected geosphere positions: the subdivided icosahedron.
+	///</summary>
+	void BuildIcosahedron(uint32 numSubdivisions, std::vector<DirectX::XMFLOAT3>& positions, std::vector<uint32>& indices);
+
+	template<typename Sink> void BuildCylinderCap(float radius, float height, bool top, uint32 sliceCount, uint32 baseVertex, size_t baseIndex, Sink& sink);
+
+	// Calls body(firstRow, endRow) over blocks of rows, on worker threads if mParallel is set.
+	// Small meshes fit in a single block and never leave the calling thread.
+	template<typename Body> void ForEachRowBlock(size_t rowCount, size_t itemsPerRow, Body&& body) const;
+
+	static const size_t RowBlockItems = 16384; // vertices or quads per parallel task
+
+	bool mParallel = true;
 };
 
+template<typename Body>
+void GeometryGenerator::ForEachRowBlock(size_t rowCount, size_t itemsPerRow, Body&& body) const
+{
+	if(!mParallel)
+	{
+		body(size_t(0), rowCount);
+		return;
+	}
+	size_t grain = RowBlockItems / (itemsPerRow > 0 ? itemsPerRow : 1);
+	ParallelFor(rowCount, grain > 0 ? grain : 1, body);
+}
+
+template<typename Sink>
+void GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions, Sink& sink)
+{
+	using namespace DirectX;
+
+	// Every face is a regular grid with its diagonals parallel to the corner-to-corner
+	// diagonal of the unsubdivided face, exactly what repeated subdivision produces.
+	uint32 segments = 1u << (numSubdivisions < 6 ? numSubdivisions : 6);
+	uint32 faceRow = segments + 1;
+
+	float w2 = 0.5f*width;
+	float h2 = 0.5f*height;
+	float d2 = 0.5f*depth;
+
+	// Corners 0-3 of each face (triangles 0,1,2 and 0,2,3), then normal and tangent.
+	const XMFLOAT3 faces[6][6] =
+	{
+		{ XMFLOAT3(-w2, -h2, -d2), XMFLOAT3(-w2, +h2, -d2), XMFLOAT3(+w2, +h2, -d2), XMFLOAT3(+w2, -h2, -d2), XMFLOAT3(0.0f, 0.0f, -1.0f), XMFLOAT3(1.0f, 0.0f, 0.0f) },  // front
+		{ XMFLOAT3(-w2, -h2, +d2), XMFLOAT3(+w2, -h2, +d2), XMFLOAT3(+w2, +h2, +d2), XMFLOAT3(-w2, +h2, +d2), XMFLOAT3(0.0f, 0.0f, 1.0f), XMFLOAT3(-1.0f, 0.0f, 0.0f) },  // back
+		{ XMFLOAT3(-w2, +h2, -d2), XMFLOAT3(-w2, +h2, +d2), XMFLOAT3(+w2, +h2, +d2), XMFLOAT3(+w2, +h2, -d2), XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT3(1.0f, 0.0f, 0.0f) },   // top
+		{ XMFLOAT3(-w2, -h2, -d2), XMFLOAT3(+w2, -h2, -d2), XMFLOAT3(+w2, -h2, +d2), XMFLOAT3(-w2, -h2, +d2), XMFLOAT3(0.0f, -1.0f, 0.0f), XMFLOAT3(-1.0f, 0.0f, 0.0f) }, // bottom
+		{ XMFLOAT3(-w2, -h2, +d2), XMFLOAT3(-w2, +h2, +d2), XMFLOAT3(-w2, +h2, -d2), XMFLOAT3(-w2, -h2, -d2), XMFLOAT3(-1.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, -1.0f) }, // left
+		{ XMFLOAT3(+w2, -h2, -d2), XMFLOAT3(+w2, +h2, -d2), XMFLOAT3(+w2, +h2, +d2), XMFLOAT3(+w2, -h2, +d2), XMFLOAT3(1.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 1.0f) },   // right
+	};
+	const XMFLOAT2 faceUVs[6][4] =
+	{
+		{ XMFLOAT2(0.0f, 1.0f), XMFLOAT2(0.0f, 0.0f), XMFLOAT2(1.0f, 0.0f), XMFLOAT2(1.0f, 1.0f) },
+		{ XMFLOAT2(1.0f, 1.0f), XMFLOAT2(0.0f, 1.0f), XMFLOAT2(0.0f, 0.0f), XMFLOAT2(1.0f, 0.0f) },
+		{ XMFLOAT2(0.0f, 1.0f), XMFLOAT2(0.0f, 0.0f), XMFLOAT2(1.0f, 0.0f), XMFLOAT2(1.0f, 1.0f) },
+		{ XMFLOAT2(1.0f, 1.0f), XMFLOAT2(0.0f, 1.0f), XMFLOAT2(0.0f, 0.0f), XMFLOAT2(1.0f, 0.0f) },
+		{ XMFLOAT2(0.0f, 1.0f), XMFLOAT2(0.0f, 0.0f), XMFLOAT2(1.0f, 0.0f), XMFLOAT2(1.0f, 1.0f) },
+		{ XMFLOAT2(0.0f, 1.0f), XMFLOAT2(0.0f, 0.0f), XMFLOAT2(1.0f, 0.0f), XMFLOAT2(1.0f, 1.0f) },
+	};
+
+	for(uint32 f = 0; f < 6; ++f)
+	{
+		XMVECTOR c0 = XMLoadFloat3(&faces[f][0]);
+		XMVECTOR toC1 = XMLoadFloat3(&faces[f][1]) - c0;
+		XMVECTOR toC3 = XMLoadFloat3(&faces[f][3]) - c0;
+		XMVECTOR uv0 = XMLoadFloat2(&faceUVs[f][0]);
+		XMVECTOR toUV1 = XMLoadFloat2(&faceUVs[f][1]) - uv0;
+		XMVECTOR toUV3 = XMLoadFloat2(&faceUVs[f][3]) - uv0;
+
+		uint32 baseVertex = f*faceRow*faceRow;
+		size_t baseIndex = (size_t)f*segments*segments*6;
+
+		// Row i walks from corner 0 towards corner 1, column j from corner 0 towards corner 3.
+		for(uint32 i = 0; i <= segments; ++i)
+		{
+			for(uint32 j = 0; j <= segments; ++j)
+			{
+				float s = (float)i/segments;
+				float t = (float)j/segments;
+
+				Vertex v;
+				XMStoreFloat3(&v.Position, c0 + s*toC1 + t*toC3);
+				XMStoreFloat2(&v.TexC, uv0 + s*toUV1 + t*toUV3);
+				v.Normal = faces[f][4];
+				v.TangentU = faces[f][5];
+				sink.SetVertex(baseVertex + i*faceRow + j, v);
+			}
+		}
+
+		size_t k = baseIndex;
+		for(uint32 i = 0; i < segments; ++i)
+		{
+			for(uint32 j = 0; j < segments; ++j)
+			{
+				uint32 v0 = baseVertex + i*faceRow + j;
+				uint32 v1 = v0 + faceRow;
+				uint32 v2 = v1 + 1;
+				uint32 v3 = v0 + 1;
+
+				sink.SetIndex(k++, v0); sink.SetIndex(k++, v1); sink.SetIndex(k++, v2);
+				sink.SetIndex(k++, v0); sink.SetIndex(k++, v2); sink.SetIndex(k++, v3);
+			}
+		}
+	}
+}
+
+template<typename Sink>
+void GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount, Sink& sink)
+{
+	using namespace DirectX;
+
+	//
+	// Compute the vertices stating at the top pole and moving down the stacks.
+	//
+
+	// Poles: note that there will be texture coordinate distortion as there is
+	// not a unique point on the texture map to assign to the pole when mapping
+	// a rectangular texture onto a sphere.
+	uint32 ringVertexCount = sliceCount + 1;
+	uint32 southPoleIndex = 1 + (stackCount-1)*ringVertexCount;
+	sink.SetVertex(0, Vertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f));
+	sink.SetVertex(southPoleIndex, Vertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f));
+
+	float phiStep   = XM_PI/stackCount;
+	float thetaStep = 2.0f*XM_PI/sliceCount;
+
+	// Compute vertices for each stack ring (do not count the poles as rings).
+	ForEachRowBlock(stackCount-1, ringVertexCount, [&](size_t firstRing, size_t endRing)
+	{
+		for(uint32 i = (uint32)firstRing+1; i <= (uint32)endRing; ++i)
+		{
+			float phi = i*phiStep;
+
+			// Vertices of ring.
+			for(uint32 j = 0; j <= sliceCount; ++j)
+			{
+				float theta = j*thetaStep;
+
+				Vertex v;
+
+				// spherical to cartesian
+				v.Position.x = radius*sinf(phi)*cosf(theta);
+				v.Position.y = radius*cosf(phi);
+				v.Position.z = radius*sinf(phi)*sinf(theta);
+
+				// Partial derivative of P with respect to theta
+				v.TangentU.x = -radius*sinf(phi)*sinf(theta);
+				v.TangentU.y = 0.0f;
+				v.TangentU.z = +radius*sinf(phi)*cosf(theta);
+
+				XMVECTOR T = XMLoadFloat3(&v.TangentU);
+				XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
+
+				XMVECTOR p = XMLoadFloat3(&v.Position);
+				XMStoreFloat3(&v.Normal, XMVector3Normalize(p));
+
+				v.TexC.x = theta / XM_2PI;
+				v.TexC.y = phi / XM_PI;
+
+				sink.SetVertex(1 + (i-1)*ringVertexCount + j, v);
+			}
+		}
+	});
+
+	//
+	// Compute indices for top stack.  The top stack was written first to the vertex buffer
+	// and connects the top pole to the first ring.
+	//
+
+	size_t k = 0;
+    for(uint32 i = 1; i <= sliceCount; ++i)
+	{
+		sink.SetIndex(k++, 0);
+		sink.SetIndex(k++, i+1);
+		sink.SetIndex(k++, i);
+	}
+
+	//
+	// Compute indices for inner stacks (not connected to poles).
+	//
+
+	// Offset the indices to the index of the first vertex in the first ring.
+	// This is just skipping the top pole vertex.
+    uint32 baseIndex = 1;
+	size_t innerStart = k;
+	ForEachRowBlock(stackCount-2, sliceCount, [&](size_t firstStack, size_t endStack)
+	{
+		for(uint32 i = (uint32)firstStack; i < (uint32)endStack; ++i)
+		{
+			size_t q = innerStart + (size_t)i*sliceCount*6;
+			for(uint32 j = 0; j < sliceCount; ++j)
+			{
+				sink.SetIndex(q++, baseIndex + i*ringVertexCount + j);
+				sink.SetIndex(q++, baseIndex + i*ringVertexCount + j+1);
+				sink.SetIndex(q++, baseIndex + (i+1)*ringVertexCount + j);
+
+				sink.SetIndex(q++, baseIndex + (i+1)*ringVertexCount + j);
+				sink.SetIndex(q++, baseIndex + i*ringVertexCount + j+1);
+				sink.SetIndex(q++, baseIndex + (i+1)*ringVertexCount + j+1);
+			}
+		}
+	});
+	k = innerStart + (size_t)(stackCount-2)*sliceCount*6;
+
+	//
+	// Compute indices for bottom stack.  The bottom stack was written last to the vertex buffer
+	// and connects the bottom pole to the bottom ring.
+	//
+
+	// Offset the indices to the index of the first vertex in the last ring.
+	baseIndex = southPoleIndex - ringVertexCount;
+
+	for(uint32 i = 0; i < sliceCount; ++i)
+	{
+		sink.SetIndex(k++, southPoleIndex);
+		sink.SetIndex(k++, baseIndex+i);
+		sink.SetIndex(k++, baseIndex+i+1);
+	}
+}
+
+template<typename Sink>
+void GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions, Sink& sink)
+{
+	using namespace DirectX;
+
+	// Subdivision only needs positions, every other attribute follows from the projection.
+	std::vector<XMFLOAT3> positions;
+	std::vector<uint32> indices;
+	BuildIcosahedron(numSubdivisions, positions, indices);
+
+	// Project vertices onto sphere and scale.
+	ForEachRowBlock(positions.size(), 1, [&](size_t first, size_t end)
+	{
+		for(size_t i = first; i < end; ++i)
+		{
+			Vertex v;
+
+			// Project onto unit sphere.
+			XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&positions[i]));
+
+			// Project onto sphere.
+			XMVECTOR p = radius*n;
+
+			XMStoreFloat3(&v.Position, p);
+			XMStoreFloat3(&v.Normal, n);
+
+			// Derive texture coordinates from spherical coordinates.
+			float theta = atan2f(v.Position.z, v.Position.x);
+
+			// Put in [0, 2pi].
+			if(theta < 0.0f)
+				theta += XM_2PI;
+
+			float phi = acosf(v.Position.y / radius);
+
+			v.TexC.x = theta/XM_2PI;
+			v.TexC.y = phi/XM_PI;
+
+			// Partial derivative of P with respect to theta
+			v.TangentU.x = -radius*sinf(phi)*sinf(theta);
+			v.TangentU.y = 0.0f;
+			v.TangentU.z = +radius*sinf(phi)*cosf(theta);
+
+			XMVECTOR T = XMLoadFloat3(&v.TangentU);
+			XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
+
+			sink.SetVertex((uint32)i, v);
+		}
+	});
+
+	ForEachRowBlock(indices.size(), 1, [&](size_t first, size_t end)
+	{
+		for(size_t i = first; i < end; ++i)
+			sink.SetIndex(i, indices[i]);
+	});
+}
+
+template<typename Sink>
+void GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, Sink& sink)
+{
+	using namespace DirectX;
+
+	//
+	// Build Stacks.
+	//
+
+	float stackHeight = height / stackCount;
+
+	// Amount to increment radius as we move up each stack level from bottom to top.
+	float radiusStep = (topRadius - bottomRadius) / stackCount;
+
+	uint32 ringCount = stackCount+1;
+
+	// Add one because we duplicate the first and last vertex per ring
+	// since the texture coordinates are different.
+	uint32 ringVertexCount = sliceCount+1;
+
+	// Compute vertices for each stack ring starting at the bottom and moving up.
+	ForEachRowBlock(ringCount, ringVertexCount, [&](size_t firstRing, size_t endRing)
+	{
+		for(uint32 i = (uint32)firstRing; i < (uint32)endRing; ++i)
+		{
+			float y = -0.5f*height + i*stackHeight;
+			float r = bottomRadius + i*radiusStep;
+
+			// vertices of ring
+			float dTheta = 2.0f*XM_PI/sliceCount;
+			for(uint32 j = 0; j <= sliceCount; ++j)
+			{
+				Vertex vertex;
+
+				float c = cosf(j*dTheta);
+				float s = sinf(j*dTheta);
+
+				vertex.Position = XMFLOAT3(r*c, y, r*s);
+
+				vertex.TexC.x = (float)j/sliceCount;
+				vertex.TexC.y = 1.0f - (float)i/stackCount;
+
+				// Cylinder can be parameterized as follows, where we introduce v
+				// parameter that goes in the same direction as the v tex-coord
+				// so that the bitangent goes in the same direction as the v tex-coord.
+				//   Let r0 be the bottom radius and let r1 be the top radius.
+				//   y(v) = h - hv for v in [0,1].
+				//   r(v) = r1 + (r0-r1)v
+				//
+				//   x(t, v) = r(v)*cos(t)
+				//   y(t, v) = h - hv
+				//   z(t, v) = r(v)*sin(t)
+				//
+				//  dx/dt = -r(v)*sin(t)
+				//  dy/dt = 0
+				//  dz/dt = +r(v)*cos(t)
+				//
+				//  dx/dv = (r0-r1)*cos(t)
+				//  dy/dv = -h
+				//  dz/dv = (r0-r1)*sin(t)
+
+				// This is unit length.
+				vertex.TangentU = XMFLOAT3(-s, 0.0f, c);
+
+				float dr = bottomRadius-topRadius;
+				XMFLOAT3 bitangent(dr*c, -height, dr*s);
+
+				XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
+				XMVECTOR B = XMLoadFloat3(&bitangent);
+				XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
+				XMStoreFloat3(&vertex.Normal, N);
+
+				sink.SetVertex(i*ringVertexCount + j, vertex);
+			}
+		}
+	});
+
+	// Compute indices for each stack.
+	ForEachRowBlock(stackCount, sliceCount, [&](size_t firstStack, size_t endStack)
+	{
+		for(uint32 i = (uint32)firstStack; i < (uint32)endStack; ++i)
+		{
+			size_t k = (size_t)i*sliceCount*6;
+			for(uint32 j = 0; j < sliceCount; ++j)
+			{
+				sink.SetIndex(k++, i*ringVertexCount + j);
+				sink.SetIndex(k++, (i+1)*ringVertexCount + j);
+				sink.SetIndex(k++, (i+1)*ringVertexCount + j+1);
+
+				sink.SetIndex(k++, i*ringVertexCount + j);
+				sink.SetIndex(k++, (i+1)*ringVertexCount + j+1);
+				sink.SetIndex(k++, i*ringVertexCount + j+1);
+			}
+		}
+	});
+
+	uint32 capVertex = ringCount*ringVertexCount;
+	size_t capIndex = (size_t)stackCount*sliceCount*6;
+	BuildCylinderCap(topRadius, height, true, sliceCount, capVertex, capIndex, sink);
+	BuildCylinderCap(bottomRadius, height, false, sliceCount, capVertex + sliceCount+2, capIndex + sliceCount*3, sink);
+}
+
+template<typename Sink>
+void GeometryGenerator::BuildCylinderCap(float radius, float height, bool top, uint32 sliceCount, uint32 baseVertex, size_t baseIndex, Sink& sink)
+{
+	using namespace DirectX;
+
+	float y = top ? 0.5f*height : -0.5f*height;
+	float normalY = top ? 1.0f : -1.0f;
+	float dTheta = 2.0f*XM_PI/sliceCount;
+
+	// Duplicate cap ring vertices because the texture coordinates and normals differ.
+	for(uint32 i = 0; i <= sliceCount; ++i)
+	{
+		float x = radius*cosf(i*dTheta);
+		float z = radius*sinf(i*dTheta);
+
+		// Scale down by the height to try and make top cap texture coord area
+		// proportional to base.
+		float u = x/height + 0.5f;
+		float v = z/height + 0.5f;
+
+		sink.SetVertex(baseVertex + i, Vertex(x, y, z, 0.0f, normalY, 0.0f, 1.0f, 0.0f, 0.0f, u, v));
+	}
+
+	// Cap center vertex.
+	uint32 centerIndex = baseVertex + sliceCount+1;
+	sink.SetVertex(centerIndex, Vertex(0.0f, y, 0.0f, 0.0f, normalY, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f));
+
+	// The top cap faces up and the bottom cap down, so their windings are mirrored.
+	size_t k = baseIndex;
+	for(uint32 i = 0; i < sliceCount; ++i)
+	{
+		sink.SetIndex(k++, centerIndex);
+		sink.SetIndex(k++, baseVertex + (top ? i+1 : i));
+		sink.SetIndex(k++, baseVertex + (top ? i : i+1));
+	}
+}
+
+template<typename Sink>
+void GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n, Sink& sink)
+{
+	using namespace DirectX;
+
+	//
+	// Create the vertices.
+	//
+
+	float halfWidth = 0.5f*width;
+	float halfDepth = 0.5f*depth;
+
+	float dx = width / (n-1);
+	float dz = depth / (m-1);
+
+	float du = 1.0f / (n-1);
+	float dv = 1.0f / (m-1);
+
+	ForEachRowBlock(m, n, [&](size_t firstRow, size_t endRow)
+	{
+		for(uint32 i = (uint32)firstRow; i < (uint32)endRow; ++i)
+		{
+			float z = halfDepth - i*dz;
+			for(uint32 j = 0; j < n; ++j)
+			{
+				float x = -halfWidth + j*dx;
+
+				// Stretch texture over grid.
+				sink.SetVertex(i*n+j, Vertex(x, 0.0f, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, j*du, i*dv));
+			}
+		}
+	});
+
+    //
+	// Create the indices.
+	//
+
+	// Iterate over each quad and compute indices, one row of quads after another.
+	ForEachRowBlock(m-1, n-1, [&](size_t firstRow, size_t endRow)
+	{
+		for(uint32 i = (uint32)firstRow; i < (uint32)endRow; ++i)
+		{
+			size_t k = (size_t)i*(n-1)*6;
+			for(uint32 j = 0; j < n-1; ++j)
+			{
+				sink.SetIndex(k,   i*n+j);
+				sink.SetIndex(k+1, i*n+j+1);
+				sink.SetIndex(k+2, (i+1)*n+j);
+
+				sink.SetIndex(k+3, (i+1)*n+j);
+				sink.SetIndex(k+4, i*n+j+1);
+				sink.SetIndex(k+5, (i+1)*n+j+1);
+
+				k += 6; // next quad
+			}
+		}
+	});
+}
+
+template<typename Sink>
+void GeometryGenerator::CreateQuad(float x, float y, float w, float h, float depth, Sink& sink)
+{
+	// Position coordinates specified in NDC space.
+	sink.SetVertex(0, Vertex(
+        x, y - h, depth,
+		0.0f, 0.0f, -1.0f,
+		1.0f, 0.0f, 0.0f,
+		0.0f, 1.0f));
+
+	sink.SetVertex(1, Vertex(
+		x, y, depth,
+		0.0f, 0.0f, -1.0f,
+		1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f));
+
+	sink.SetVertex(2, Vertex(
+		x+w, y, depth,
+		0.0f, 0.0f, -1.0f,
+		1.0f, 0.0f, 0.0f,
+		1.0f, 0.0f));
+
+	sink.SetVertex(3, Vertex(
+		x+w, y-h, depth,
+		0.0f, 0.0f, -1.0f,
+		1.0f, 0.0f, 0.0f,
+		1.0f, 1.0f));
+
+	const uint32 indices[6] = { 0, 1, 2, 0, 2, 3 };
+	for(uint32 i = 0; i < 6; ++i)
+		sink.SetIndex(i, indices[i]);
+}
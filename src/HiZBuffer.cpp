@@ -1,4 +1,5 @@
 #include "HiZBuffer.h"
+#include "ResourceStateTracker.h"
 #include <algorithm>
 
 HiZBuffer::HiZBuffer(ID3D12Device* device, UINT width, UINT height)
@@ -13,8 +14,8 @@ UINT HiZBuffer::CalculateMipLevels(UINT width, UINT height)
     UINT levels = 1;
     while (width > 1 || height > 1)
     {
-        width = max(1u, width / 2);
-        height = max(1u, height / 2);
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
         levels++;
     }
     return levels;
@@ -106,16 +107,15 @@ void HiZBuffer::GenerateMips(
     ID3D12RootSignature* rootSig,
     ID3D12PipelineState* psoFromDepth,
 	ID3D12PipelineState* pso,
-    CD3DX12_GPU_DESCRIPTOR_HANDLE inputSrv)
+    CD3DX12_GPU_DESCRIPTOR_HANDLE inputSrv,
+    const ResourceStateTracker& tracker,
+    UINT firstPass)
 {
     cmdList->SetComputeRootSignature(rootSig);
     cmdList->SetPipelineState(psoFromDepth);
 
-    // תUAV״̬
-    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-        mHiZBuffer.Get(),
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+    // Mip 0 to UAV, the source mip of every later one from UAV to SRV
+    tracker.Record(cmdList, firstPass);
 
     UINT width = mWidth;
     UINT height = mHeight;
@@ -132,17 +132,14 @@ void HiZBuffer::GenerateMips(
         UINT threadGroupY = (height + 7) / 8;
 
         cmdList->Dispatch(threadGroupX, threadGroupY, 1);
-
-        // ȴ
-        cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(mHiZBuffer.Get()));
     }
 
 	cmdList->SetPipelineState(pso);
     // ɺ Mip 𣨴ǰһ Mip
     for (UINT mipLevel = 1; mipLevel < mMipLevels; ++mipLevel)
     {
-        width = max(1u, width / 2);
-        height = max(1u, height / 2);
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
 
         // Դ Mip ǰһΪ SRV
         // ע⣺Ҫ mGpuSrv ƫƣΪҪ mip  SRV
@@ -154,21 +151,13 @@ void HiZBuffer::GenerateMips(
         CD3DX12_GPU_DESCRIPTOR_HANDLE dstUav = mGpuUav;
         dstUav.Offset(mipLevel, mUavDescriptorSize);
         cmdList->SetComputeRootDescriptorTable(1, dstUav);
+        tracker.Record(cmdList, firstPass + mipLevel);
 
         UINT threadGroupX = (width + 7) / 8;
         UINT threadGroupY = (height + 7) / 8;
 
         cmdList->Dispatch(threadGroupX, threadGroupY, 1);
-
-        // ȴ
-        cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(mHiZBuffer.Get()));
     }
-
-    // תͨöȡ״̬
-    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-        mHiZBuffer.Get(),
-        D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-        D3D12_RESOURCE_STATE_GENERIC_READ));
 }
 
 void HiZBuffer::OnResize(UINT width, UINT height)
@@ -3,6 +3,8 @@
 
 using Microsoft::WRL::ComPtr;
 
+class ResourceStateTracker;
+
 class HiZBuffer
 {
 public:
@@ -47,7 +49,10 @@ public:
         ID3D12RootSignature* rootSig,
         ID3D12PipelineState* pso0,
         ID3D12PipelineState* pso1,
-		CD3DX12_GPU_DESCRIPTOR_HANDLE inputSrv
+		CD3DX12_GPU_DESCRIPTOR_HANDLE inputSrv,
+        // Passes firstPass + mip of tracker hold the barriers each mip needs before its dispatch
+        const ResourceStateTracker& tracker,
+        UINT firstPass
     );
 
     static const DXGI_FORMAT HiZFormat = DXGI_FORMAT_R32_FLOAT;
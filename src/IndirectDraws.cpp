@@ -0,0 +1,192 @@
+#include "IndirectDraws.h"
+#include "JobSystem.h"
+#include <chrono>
+#include <cstring>
+#include <random>
+
+namespace
+{
+	void WriteChunk(const IndirectDraws::Source* sources, UINT begin, UINT end, IndirectDraws::Counts at, const IndirectDraws::Output& out)
+	{
+		for (UINT i = begin; i < end; ++i)
+		{
+			const IndirectDraws::Source& source = sources[i];
+			if (source.VisibleCount == 0)
+				continue;
+
+			IndirectDraws::Command command;
+			command.InstanceIndices = out.SlotsAddress + (D3D12_GPU_VIRTUAL_ADDRESS)at.Instances * sizeof(UINT);
+			command.Draw.IndexCountPerInstance = source.IndexCountPerInstance;
+			command.Draw.InstanceCount = source.VisibleCount;
+			command.Draw.StartIndexLocation = source.StartIndexLocation;
+			command.Draw.BaseVertexLocation = source.BaseVertexLocation;
+			command.Draw.StartInstanceLocation = 0;
+			memcpy(&out.Commands[at.Draws], &command, sizeof(command));
+
+			UINT* slots = out.Slots + at.Instances;
+			for (UINT k = 0; k < source.VisibleCount; ++k)
+				slots[k] = source.FirstSlot + source.Visible[k];
+
+			at.Draws++;
+			at.Instances += source.VisibleCount;
+		}
+	}
+}
+
+ComPtr<ID3D12CommandSignature> IndirectDraws::CreateCommandSignature(ID3D12Device* device, ID3D12RootSignature* rootSignature, UINT rootParameter)
+{
+	D3D12_INDIRECT_ARGUMENT_DESC arguments[2] = {};
+	arguments[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW;
+	arguments[0].ShaderResourceView.RootParameterIndex = rootParameter;
+	arguments[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+	D3D12_COMMAND_SIGNATURE_DESC desc = {};
+	desc.ByteStride = sizeof(Command);
+	desc.NumArgumentDescs = _countof(arguments);
+	desc.pArgumentDescs = arguments;
+
+	ComPtr<ID3D12CommandSignature> signature;
+	ThrowIfFailed(device->CreateCommandSignature(&desc, rootSignature, IID_PPV_ARGS(&signature)));
+	return signature;
+}
+
+IndirectDraws::Counts IndirectDraws::Count(const Source* sources, UINT count)
+{
+	Counts counts;
+	for (UINT i = 0; i < count; ++i)
+	{
+		counts.Draws += sources[i].VisibleCount > 0 ? 1 : 0;
+		counts.Instances += sources[i].VisibleCount;
+	}
+	return counts;
+}
+
+IndirectDraws::Counts IndirectDraws::Build(const Source* sources, UINT count, const Output& out, JobSystem* jobs)
+{
+	if (jobs == nullptr || count < ParallelThreshold)
+	{
+		WriteChunk(sources, 0, count, Counts(), out);
+		return Count(sources, count);
+	}
+
+	// Visible instances and kept draws per chunk, then an exclusive scan over the chunks gives every chunk
+	// the place of its first record and the chunks are written independently
+	const UINT chunkCount = (count + ChunkDraws - 1) / ChunkDraws;
+	std::vector<Counts> chunkStarts(chunkCount + 1);
+	jobs->ParallelFor(chunkCount, 1, [&](size_t first, size_t last)
+	{
+		for (size_t c = first; c < last; ++c)
+		{
+			const UINT begin = (UINT)c * ChunkDraws;
+			chunkStarts[c + 1] = Count(sources + begin, std::min(ChunkDraws, count - begin));
+		}
+	});
+	for (UINT c = 0; c < chunkCount; ++c)
+	{
+		chunkStarts[c + 1].Draws += chunkStarts[c].Draws;
+		chunkStarts[c + 1].Instances += chunkStarts[c].Instances;
+	}
+
+	jobs->ParallelFor(chunkCount, 1, [&](size_t first, size_t last)
+	{
+		for (size_t c = first; c < last; ++c)
+		{
+			const UINT begin = (UINT)c * ChunkDraws;
+			WriteChunk(sources, begin, std::min(begin + ChunkDraws, count), chunkStarts[c], out);
+		}
+	});
+	return chunkStarts[chunkCount];
+}
+
+UINT IndirectDraws::Validate(const Source* sources, UINT count, const Output& out, const Counts& counts)
+{
+	UINT errors = 0;
+	UINT draw = 0;
+	UINT instance = 0;
+	for (UINT i = 0; i < count; ++i)
+	{
+		const Source& source = sources[i];
+		if (source.VisibleCount == 0)
+			continue;
+		if (draw >= counts.Draws)
+		{
+			++errors;
+			continue;
+		}
+
+		// The slots the shaders see as gInstanceIndices[0, InstanceCount)
+		const Command& command = out.Commands[draw];
+		const D3D12_DRAW_INDEXED_ARGUMENTS& a = command.Draw;
+		const UINT64 slotBytes = command.InstanceIndices - out.SlotsAddress;
+		bool ok = a.IndexCountPerInstance == source.IndexCountPerInstance && a.InstanceCount == source.VisibleCount &&
+			a.StartIndexLocation == source.StartIndexLocation && a.BaseVertexLocation == source.BaseVertexLocation &&
+			a.StartInstanceLocation == 0 && slotBytes == (UINT64)instance * sizeof(UINT) &&
+			instance + source.VisibleCount <= counts.Instances;
+		for (UINT k = 0; ok && k < source.VisibleCount; ++k)
+			ok = out.Slots[instance + k] == source.FirstSlot + source.Visible[k];
+		errors += ok ? 0 : 1;
+
+		++draw;
+		instance += source.VisibleCount;
+	}
+	errors += draw < counts.Draws ? counts.Draws - draw : 0;
+	return errors;
+}
+
+IndirectDraws::Timing IndirectDraws::Measure(UINT drawCount, UINT instances, const Output& out, int iterations, JobSystem& jobs)
+{
+	Timing result;
+	result.Draws = drawCount;
+
+	// Every tenth draw sees nothing, the others a random share of their instances, capped at instances in total
+	std::mt19937 rng(drawCount);
+	const UINT average = std::max(instances / std::max(drawCount - drawCount / 10, 1u), 1u);
+	std::vector<UINT> visibleCounts(drawCount, 0);
+	UINT total = 0;
+	for (UINT i = 0; i < drawCount; ++i)
+	{
+		if (i % 10 == 9)
+			continue;
+		visibleCounts[i] = std::min(1 + (UINT)(rng() % (2 * average)), instances - total);
+		total += visibleCounts[i];
+	}
+	result.Instances = total;
+
+	// Visible instance indices are every other instance of a draw
+	UINT maxVisible = 0;
+	for (UINT n : visibleCounts)
+		maxVisible = std::max(maxVisible, n);
+	std::vector<UINT> visible(maxVisible);
+	for (UINT k = 0; k < maxVisible; ++k)
+		visible[k] = 2 * k;
+
+	std::vector<Source> sources(drawCount);
+	UINT slot = 0;
+	for (UINT i = 0; i < drawCount; ++i)
+	{
+		sources[i].IndexCountPerInstance = 36 + 3 * (i % 100);
+		sources[i].StartIndexLocation = 3 * i;
+		sources[i].BaseVertexLocation = (INT)i;
+		sources[i].FirstSlot = slot;
+		sources[i].Visible = visible.data();
+		sources[i].VisibleCount = visibleCounts[i];
+		slot += 2 * visibleCounts[i];
+	}
+
+	Counts counts;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+		counts = Build(sources.data(), drawCount, out);
+	auto end = std::chrono::high_resolution_clock::now();
+	result.SerialMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+		counts = Build(sources.data(), drawCount, out, &jobs);
+	end = std::chrono::high_resolution_clock::now();
+	result.ParallelMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+
+	result.KeptDraws = counts.Draws;
+	result.Errors = Validate(sources.data(), drawCount, out, counts);
+	return result;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "DXHelper.h"
+
+class JobSystem;
+
+// ExecuteIndirect commands for the visible instances of many draws. Draws without visible instances are dropped,
+// the slots of the others are packed back to back and every kept draw gets one Command. The slot offsets come
+// from a prefix sum over the visible counts, computed per chunk of draws on worker threads.
+namespace IndirectDraws
+{
+	static const UINT ChunkDraws = 256;
+	static const UINT ParallelThreshold = 4096; // draws before the build is split over the job system
+
+	// The vertex shaders fetch their record through gInstanceIndices[SV_InstanceID], and SV_InstanceID starts at
+	// 0 whatever StartInstanceLocation says. So each command points the root SRV of gInstanceIndices at the
+	// draw's first slot, as DrawRenderItems does for direct draws, and draws with StartInstanceLocation 0.
+	struct Command
+	{
+		D3D12_GPU_VIRTUAL_ADDRESS InstanceIndices = 0; // address of the draw's first slot
+		D3D12_DRAW_INDEXED_ARGUMENTS Draw = {};
+	};
+	static_assert(sizeof(Command) == 32, "Command is the ByteStride of the command signature");
+
+	// Command signature for Command: the root SRV at rootParameter of rootSignature, then the indexed draw
+	ComPtr<ID3D12CommandSignature> CreateCommandSignature(ID3D12Device* device, ID3D12RootSignature* rootSignature, UINT rootParameter);
+
+	struct Source
+	{
+		UINT IndexCountPerInstance = 0;
+		UINT StartIndexLocation = 0;
+		INT BaseVertexLocation = 0;
+		UINT FirstSlot = 0;            // instance record slot of instance 0
+		const UINT* Visible = nullptr; // indices of the visible instances
+		UINT VisibleCount = 0;
+	};
+
+	struct Output
+	{
+		Command* Commands = nullptr;               // one per kept draw
+		UINT* Slots = nullptr;                     // one per visible instance
+		D3D12_GPU_VIRTUAL_ADDRESS SlotsAddress = 0; // GPU address of Slots[0], 0 for CPU only builds
+	};
+
+	struct Counts
+	{
+		UINT Draws = 0;
+		UINT Instances = 0;
+	};
+
+	// Counts what Build writes, to size the outputs.
+	Counts Count(const Source* sources, UINT count);
+
+	// Writes the records of sources[0, count) to out in source order. Every output array is written front to
+	// back exactly once, so they can point into mapped upload buffers. Large builds are split over the threads of
+	// jobs when one is given.
+	Counts Build(const Source* sources, UINT count, const Output& out, JobSystem* jobs = nullptr);
+
+	// Reads the commands back like ExecuteIndirect would and checks them against sources, returns the number of
+	// mismatching draws, a missing or extra draw counts as one.
+	UINT Validate(const Source* sources, UINT count, const Output& out, const Counts& counts);
+
+	struct Timing
+	{
+		UINT Draws = 0;
+		UINT Instances = 0;
+		UINT KeptDraws = 0;
+		double SerialMs = 0.0;
+		double ParallelMs = 0.0;
+		UINT Errors = 0; // from Validate of the parallel build
+	};
+
+	// Builds the arguments of drawCount pseudo random draws with about instances visible instances in total,
+	// a tenth of the draws without any, iterations times serial and parallel. out must hold drawCount commands
+	// and instances slots, pass mapped upload buffers to include the write combining cost.
+	Timing Measure(UINT drawCount, UINT instances, const Output& out, int iterations, JobSystem& jobs);
+}
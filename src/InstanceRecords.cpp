@@ -0,0 +1,244 @@
+#include "InstanceRecords.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <numeric>
+
+void InstanceRecords::Reset(std::vector<const InstanceData*> sources, int frameResourceCount)
+{
+	mSources = std::move(sources);
+	mFrameResourceCount = frameResourceCount;
+	mFramesDirty.assign(mSources.size(), 0);
+	mDirty.clear();
+	MarkAllDirty();
+}
+
+void InstanceRecords::MarkDirty(UINT slot)
+{
+	assert(slot < mSources.size());
+	if (mFramesDirty[slot] == 0)
+		mDirty.push_back(slot);
+	mFramesDirty[slot] = mFrameResourceCount;
+}
+
+void InstanceRecords::MarkAllDirty()
+{
+	mFramesDirty.assign(mSources.size(), mFrameResourceCount);
+	mDirty.resize(mSources.size());
+	std::iota(mDirty.begin(), mDirty.end(), 0u);
+}
+
+UINT InstanceRecords::Update(PackedInstance* records, UINT aoType, JobSystem* jobs)
+{
+	if (aoType != mAOType)
+	{
+		mAOType = aoType;
+		MarkAllDirty();
+	}
+
+	// Every slot is in the list once, so the chunks never share a record or a counter
+	const UINT count = (UINT)mDirty.size();
+	auto update = [&](size_t first, size_t last)
+	{
+		for (size_t k = first; k < last; ++k)
+		{
+			const UINT slot = mDirty[k];
+			PackInstance(*mSources[slot], aoType, &records[slot]);
+			--mFramesDirty[slot];
+		}
+	};
+	if (jobs != nullptr && count >= ParallelThreshold)
+		jobs->ParallelFor(count, ChunkRecords, update);
+	else
+		update(0, count);
+
+	mDirty.erase(std::remove_if(mDirty.begin(), mDirty.end(), [this](UINT slot) { return mFramesDirty[slot] == 0; }), mDirty.end());
+	return count;
+}
+
+void PackInstance(const InstanceData& instance, UINT aoType, PackedInstance* record)
+{
+	assert(instance.MaterialIndex <= PackedMaterialIndexMask && aoType < 4);
+	XMMATRIX world = XMMatrixTranspose(XMLoadFloat4x4(&instance.World));
+	XMMATRIX tex = XMLoadFloat4x4(&instance.TexTransform);
+	// (_11, _21, _12, _22), the two columns of the 2x2 part side by side, the translation _41 _42 goes in z
+	XMVECTOR uv = XMVectorMergeXY(tex.r[0], tex.r[1]);
+
+	PackedInstance data;
+	XMStoreFloat4(&data.World[0], world.r[0]);
+	XMStoreFloat4(&data.World[1], world.r[1]);
+	XMStoreFloat4(&data.World[2], world.r[2]);
+	XMStoreFloat3(&data.TexTransform[0], XMVectorPermute<XM_PERMUTE_0X, XM_PERMUTE_0Y, XM_PERMUTE_1X, XM_PERMUTE_1Y>(uv, tex.r[3]));
+	XMStoreFloat3(&data.TexTransform[1], XMVectorPermute<XM_PERMUTE_0Z, XM_PERMUTE_0W, XM_PERMUTE_1Y, XM_PERMUTE_1W>(uv, tex.r[3]));
+	data.MaterialAndFlags = instance.MaterialIndex | (aoType << PackedAOTypeShift);
+	if (XMMatrixIsIdentity(tex))
+		data.MaterialAndFlags |= PackedIdentityTexTransform;
+
+	// One sequential copy, the upload heap is write combined
+	memcpy(record, &data, sizeof(data));
+}
+
+InstanceData UnpackInstance(const PackedInstance& record)
+{
+	XMVECTOR r0 = XMLoadFloat4(&record.World[0]);
+	XMVECTOR r1 = XMLoadFloat4(&record.World[1]);
+	XMVECTOR r2 = XMLoadFloat4(&record.World[2]);
+	XMVECTOR r3 = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+
+	// Same as InstanceNormalMatrix in Common.hlsl
+	XMVECTOR c0 = XMVector3Cross(r1, r2);
+	XMVECTOR c1 = XMVector3Cross(r2, r0);
+	XMVECTOR c2 = XMVector3Cross(r0, r1);
+	XMVECTOR s = XMVectorGetX(XMVector3Dot(r0, c0)) < 0.0f ? XMVectorReplicate(-1.0f) : XMVectorReplicate(1.0f);
+
+	InstanceData instance;
+	XMStoreFloat4x4(&instance.World, XMMatrixTranspose(XMMATRIX(r0, r1, r2, r3)));
+	XMStoreFloat4x4(&instance.InvTpsWorld, XMMatrixTranspose(XMMATRIX(
+		XMVectorSetW(c0 * s, 0.0f), XMVectorSetW(c1 * s, 0.0f), XMVectorSetW(c2 * s, 0.0f), r3)));
+	if ((record.MaterialAndFlags & PackedIdentityTexTransform) == 0)
+	{
+		const XMFLOAT3& u = record.TexTransform[0];
+		const XMFLOAT3& v = record.TexTransform[1];
+		instance.TexTransform = XMFLOAT4X4(
+			u.x, v.x, 0.0f, 0.0f,
+			u.y, v.y, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			u.z, v.z, 0.0f, 1.0f);
+	}
+	instance.MaterialIndex = record.MaterialAndFlags & PackedMaterialIndexMask;
+	instance.AOType = (record.MaterialAndFlags >> PackedAOTypeShift) & 3;
+	return instance;
+}
+
+InstancePackingError VerifyInstancePacking(UINT count)
+{
+	InstancePackingError error;
+	error.Instances = count;
+
+	for (UINT i = 0; i < count; ++i)
+	{
+		// Non uniform scales with a random sign for mirrored instances, every fourth one sheared
+		auto scale = [](float sign) { return sign * MathHelper::RandF(0.2f, 5.0f); };
+		XMMATRIX world = XMMatrixScaling(scale(1.0f), scale(1.0f), scale(MathHelper::RandF() < 0.3f ? -1.0f : 1.0f));
+		if (i % 4 == 0)
+		{
+			XMMATRIX shear = XMMatrixIdentity();
+			shear.r[1] = XMVectorSet(MathHelper::RandF(-1.0f, 1.0f), 1.0f, 0.0f, 0.0f);
+			world = world * shear;
+		}
+		world = world * XMMatrixRotationRollPitchYaw(MathHelper::RandF(0.0f, XM_2PI), MathHelper::RandF(0.0f, XM_2PI), MathHelper::RandF(0.0f, XM_2PI)) *
+			XMMatrixTranslation(MathHelper::RandF(-100.0f, 100.0f), MathHelper::RandF(-100.0f, 100.0f), MathHelper::RandF(-100.0f, 100.0f));
+
+		// Identity, tiling and scrolling, rotated
+		XMMATRIX tex = XMMatrixIdentity();
+		if (i % 3 == 1)
+			tex = XMMatrixScaling(8.0f, 8.0f, 1.0f) * XMMatrixTranslation(MathHelper::RandF(), MathHelper::RandF(), 0.0f);
+		else if (i % 3 == 2)
+			tex = XMMatrixScaling(3.0f, 2.0f, 1.0f) * XMMatrixRotationZ(MathHelper::RandF(0.0f, XM_2PI)) * XMMatrixTranslation(0.5f, 0.25f, 0.0f);
+
+		InstanceData instance;
+		XMStoreFloat4x4(&instance.World, world);
+		XMStoreFloat4x4(&instance.TexTransform, tex);
+		instance.MaterialIndex = (i * 7919) & PackedMaterialIndexMask;
+		const UINT aoType = i % 4;
+
+		PackedInstance record;
+		PackInstance(instance, aoType, &record);
+		InstanceData decoded = UnpackInstance(record);
+		if (decoded.MaterialIndex != instance.MaterialIndex || decoded.AOType != aoType)
+			++error.BadIndices;
+
+		XMMATRIX decodedWorld = XMLoadFloat4x4(&decoded.World);
+		XMMATRIX normalMatrix = MathHelper::AffineInverseTranspose(world);
+		XMMATRIX decodedNormalMatrix = XMLoadFloat4x4(&decoded.InvTpsWorld);
+		XMMATRIX decodedTex = XMLoadFloat4x4(&decoded.TexTransform);
+		for (int k = 0; k < 4; ++k)
+		{
+			XMVECTOR p = XMVectorSet(MathHelper::RandF(-1.0f, 1.0f), MathHelper::RandF(-1.0f, 1.0f), MathHelper::RandF(-1.0f, 1.0f), 0.0f);
+			XMVECTOR moved = XMVector3Transform(p, world) - XMVector3Transform(p, decodedWorld);
+			error.Position = std::max(error.Position, XMVectorGetX(XMVector3Length(moved)));
+
+			XMVECTOR n = XMVector3Normalize(p);
+			XMVECTOR expected = XMVector3Normalize(XMVector3TransformNormal(n, normalMatrix));
+			XMVECTOR actual = XMVector3Normalize(XMVector3TransformNormal(n, decodedNormalMatrix));
+			error.NormalDeg = std::max(error.NormalDeg, XMConvertToDegrees(XMVectorGetX(XMVector3AngleBetweenNormals(expected, actual))));
+
+			XMVECTOR uv = XMVectorSet(MathHelper::RandF(), MathHelper::RandF(), 0.0f, 1.0f);
+			XMVECTOR texC = XMVector4Transform(uv, tex) - XMVector4Transform(uv, decodedTex);
+			error.TexC = std::max(error.TexC, XMVectorGetX(XMVector2Length(texC)));
+		}
+	}
+	return error;
+}
+
+InstanceUploadTiming MeasureInstanceUpload(InstanceData* fullRecords, PackedInstance* records, UINT count, UINT changed, int iterations,
+	JobSystem& jobs)
+{
+	InstanceUploadTiming result;
+	result.Instances = count;
+	result.Changed = changed;
+
+	// Rotated, scaled and translated instances
+	std::vector<InstanceData> instances(count);
+	std::vector<const InstanceData*> sources(count);
+	for (UINT i = 0; i < count; ++i)
+	{
+		XMMATRIX world = XMMatrixScaling(MathHelper::RandF(0.5f, 2.0f), MathHelper::RandF(0.5f, 2.0f), MathHelper::RandF(0.5f, 2.0f)) *
+			XMMatrixRotationRollPitchYaw(MathHelper::RandF(0.0f, XM_2PI), MathHelper::RandF(0.0f, XM_2PI), MathHelper::RandF(0.0f, XM_2PI)) *
+			XMMatrixTranslation(MathHelper::RandF(-100.0f, 100.0f), MathHelper::RandF(-100.0f, 100.0f), MathHelper::RandF(-100.0f, 100.0f));
+		XMStoreFloat4x4(&instances[i].World, world);
+		instances[i].MaterialIndex = i % 16;
+		sources[i] = &instances[i];
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+	{
+		for (UINT i = 0; i < count; ++i)
+		{
+			XMMATRIX world = XMLoadFloat4x4(&instances[i].World);
+			InstanceData data;
+			XMStoreFloat4x4(&data.World, XMMatrixTranspose(world));
+			XMStoreFloat4x4(&data.InvTpsWorld, XMMatrixTranspose(XMMatrixInverse(nullptr, world)));
+			XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&instances[i].TexTransform)));
+			data.MaterialIndex = instances[i].MaterialIndex;
+			data.AOType = 0;
+			memcpy(&fullRecords[i], &data, sizeof(data));
+		}
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	result.FullMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+	{
+		for (UINT i = 0; i < count; ++i)
+			PackInstance(instances[i], 0, &records[i]);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	result.PackedMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+
+	// One frame resource, so every update sees exactly the instances changed since the last one
+	InstanceRecords dirty;
+	dirty.Reset(std::move(sources), 1);
+	dirty.Update(records, 0, &jobs);
+	const UINT stride = std::max(count / std::max(changed, 1u), 1u);
+	double total = 0.0;
+	for (int it = 0; it < iterations; ++it)
+	{
+		for (UINT k = 0; k < changed; ++k)
+			dirty.MarkDirty((k * stride + it) % count);
+		start = std::chrono::high_resolution_clock::now();
+		dirty.Update(records, 0, &jobs);
+		end = std::chrono::high_resolution_clock::now();
+		total += std::chrono::duration<double, std::milli>(end - start).count();
+	}
+	result.DirtyMs = total / iterations;
+
+	result.FullBytes = (UINT64)count * sizeof(InstanceData);
+	result.PackedBytes = (UINT64)count * sizeof(PackedInstance);
+	result.DirtyBytes = (UINT64)changed * sizeof(PackedInstance);
+	return result;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "FrameResource.hpp"
+
+class JobSystem;
+
+// The GPU records of all instances, one fixed slot each in every frame resource's instance buffer.
+// A record is only rebuilt while its instance is dirty: marking one dirty makes the next frameResourceCount
+// updates rewrite it, one per frame resource, like Material::NumFramesDirty. Draws pick their instances
+// through lists of slots, so culling and sorting never move the records themselves.
+class InstanceRecords
+{
+public:
+	static const UINT ParallelThreshold = 4096; // dirty records before the update is split over the job system
+	static const UINT ChunkRecords = 1024;
+
+	// sources[slot] is the CPU side instance of the slot, it must stay at that address. Every slot starts dirty.
+	void Reset(std::vector<const InstanceData*> sources, int frameResourceCount);
+
+	void MarkDirty(UINT slot);
+	void MarkAllDirty();
+
+	// Repacks the dirty records in records (the mapped instance buffer of the current frame resource) and
+	// returns how many, on the threads of jobs when one is given. A new aoType dirties every record, it is
+	// stored in each of them.
+	UINT Update(PackedInstance* records, UINT aoType, JobSystem* jobs = nullptr);
+
+	UINT SlotCount() const { return (UINT)mSources.size(); }
+	UINT DirtyCount() const { return (UINT)mDirty.size(); }
+
+private:
+	std::vector<const InstanceData*> mSources;
+	std::vector<int> mFramesDirty; // per slot
+	std::vector<UINT> mDirty;      // slots with mFramesDirty > 0
+	int mFrameResourceCount = 1;
+	UINT mAOType = 0;
+};
+
+// Packs instance into record with SSE shuffles. Only the affine part of the world (last column 0 0 0 1) and
+// of the texture transform (uv, 0, 1 in, the first two columns out) survive, which is all the scene uses.
+void PackInstance(const InstanceData& instance, UINT aoType, PackedInstance* record);
+
+// What the shaders decode from a record: World and TexTransform as 4x4 row vector matrices, InvTpsWorld the
+// adjugate normal matrix, i.e. the inverse transpose times the determinant's magnitude.
+InstanceData UnpackInstance(const PackedInstance& record);
+
+struct InstancePackingError
+{
+	UINT Instances = 0;
+	float Position = 0.0f;  // largest distance between a point moved by the original and the decoded world
+	float NormalDeg = 0.0f; // largest angle between normals from the inverse transpose and the decoded adjugate
+	float TexC = 0.0f;      // largest texture coordinate difference
+	UINT BadIndices = 0;    // records whose material index or AOType did not come back
+};
+
+// Packs and decodes count random instances, with non uniform, mirrored, identity and rotated texture transforms,
+// and compares transformed points, normals and texture coordinates against the unpacked originals.
+InstancePackingError VerifyInstancePacking(UINT count);
+
+struct InstanceUploadTiming
+{
+	UINT Instances = 0;
+	UINT Changed = 0;
+	double FullMs = 0.0;     // every 208 byte InstanceData record rebuilt with XMMatrixInverse, the old update
+	double PackedMs = 0.0;   // every record packed on one thread
+	double DirtyMs = 0.0;    // InstanceRecords::Update of the changed ones
+	UINT64 FullBytes = 0;    // written per update by each method
+	UINT64 PackedBytes = 0;
+	UINT64 DirtyBytes = 0;
+};
+
+// Updates count random affine instances, with changed of them marked dirty, iterations times per method.
+// fullRecords and records must hold count entries each, pass mapped upload buffers to include the write
+// combining cost. fullRecords receives the old full records, records the packed ones. The dirty update runs on jobs.
+InstanceUploadTiming MeasureInstanceUpload(InstanceData* fullRecords, PackedInstance* records, UINT count, UINT changed, int iterations,
+	JobSystem& jobs);
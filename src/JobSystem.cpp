@@ -0,0 +1,231 @@
+#include "JobSystem.h"
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+	// The system the current thread works for and its deque there, unset on threads that are not workers
+	thread_local const JobSystem* tJobSystem = nullptr;
+	thread_local UINT tQueue = 0;
+}
+
+JobSystem::JobSystem(UINT workerCount)
+{
+	mQueues.resize(workerCount + 1);
+	for (auto& queue : mQueues)
+		queue = std::make_unique<Queue>();
+	mThreads.reserve(workerCount);
+	for (UINT i = 1; i <= workerCount; ++i)
+		mThreads.emplace_back([this, i]() { WorkerLoop(i); });
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mSleepLock);
+		mStop = true;
+	}
+	mWake.notify_all();
+	for (auto& thread : mThreads)
+		thread.join();
+}
+
+UINT JobSystem::DefaultWorkerCount()
+{
+	const UINT cores = std::thread::hardware_concurrency();
+	return cores > 1 ? cores - 1 : 0;
+}
+
+void JobSystem::Run(std::function<void()> fn, JobCounter* counter)
+{
+	if (counter != nullptr)
+		counter->Pending.fetch_add(1);
+
+	// Counted before it is visible, so a thief never takes mQueued below zero. A worker about to sleep has either
+	// counted itself in mSleeping before the load below or sees the job in mQueued.
+	mQueued.fetch_add(1);
+	Queue& queue = *mQueues[ThisThreadQueue()];
+	{
+		std::lock_guard<std::mutex> lock(queue.Lock);
+		queue.Jobs.push_back({ std::move(fn), counter });
+	}
+
+	if (mSleeping.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(mSleepLock);
+		mWake.notify_one();
+	}
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	const UINT queue = ThisThreadQueue();
+	while (counter.Pending.load() > 0)
+	{
+		if (!RunOne(queue))
+			std::this_thread::yield();
+	}
+}
+
+bool JobSystem::RunOne(UINT self)
+{
+	Job job;
+	bool found = false;
+	{
+		Queue& own = *mQueues[self];
+		std::lock_guard<std::mutex> lock(own.Lock);
+		if (!own.Jobs.empty())
+		{
+			job = std::move(own.Jobs.back());
+			own.Jobs.pop_back();
+			found = true;
+		}
+	}
+
+	const UINT count = ThreadCount();
+	for (UINT k = 1; !found && k < count; ++k)
+	{
+		Queue& victim = *mQueues[(self + k) % count];
+		std::lock_guard<std::mutex> lock(victim.Lock);
+		if (!victim.Jobs.empty())
+		{
+			job = std::move(victim.Jobs.front());
+			victim.Jobs.pop_front();
+			found = true;
+			mStolen.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	if (!found)
+		return false;
+
+	mQueued.fetch_sub(1);
+	job.Fn();
+	if (job.Counter != nullptr)
+		job.Counter->Pending.fetch_sub(1);
+	return true;
+}
+
+void JobSystem::WorkerLoop(UINT queue)
+{
+	tJobSystem = this;
+	tQueue = queue;
+	while (!mStop.load())
+	{
+		if (RunOne(queue))
+			continue;
+
+		std::unique_lock<std::mutex> lock(mSleepLock);
+		mSleeping.fetch_add(1);
+		mWake.wait(lock, [this]() { return mStop.load() || mQueued.load() > 0; });
+		mSleeping.fetch_sub(1);
+	}
+}
+
+UINT JobSystem::ThisThreadQueue() const
+{
+	return tJobSystem == this ? tQueue : 0;
+}
+
+UINT JobGraph::Add(const char* name, std::function<void()> fn)
+{
+	Node node;
+	node.Name = name;
+	node.Fn = std::move(fn);
+	mNodes.push_back(std::move(node));
+	return (UINT)mNodes.size() - 1;
+}
+
+void JobGraph::Depend(UINT job, UINT dependency)
+{
+	assert(job < Count() && dependency < Count() && job != dependency);
+	mNodes[dependency].Dependents.push_back(job);
+	mNodes[job].DependencyCount++;
+}
+
+void JobGraph::Execute(UINT job)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	mNodes[job].Fn();
+	auto end = std::chrono::high_resolution_clock::now();
+	mNodes[job].Ms = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void JobGraph::Run(JobSystem& jobs)
+{
+	const UINT count = Count();
+	if (mRemainingCount != count)
+	{
+		mRemaining.reset(new std::atomic<UINT>[count]);
+		mRemainingCount = count;
+	}
+	for (UINT i = 0; i < count; ++i)
+		mRemaining[i] = mNodes[i].DependencyCount;
+
+	// A job queues the dependents it was the last dependency of before it is counted done itself, so the counter
+	// only reaches zero after the last job of the graph
+	JobCounter counter;
+	std::function<void(UINT)> launch = [&](UINT job)
+	{
+		jobs.Run([&, job]()
+		{
+			Execute(job);
+			for (UINT dependent : mNodes[job].Dependents)
+			{
+				if (mRemaining[dependent].fetch_sub(1) == 1)
+					launch(dependent);
+			}
+		}, &counter);
+	};
+	for (UINT i = 0; i < count; ++i)
+	{
+		if (mNodes[i].DependencyCount == 0)
+			launch(i);
+	}
+	jobs.Wait(counter);
+}
+
+void JobGraph::RunSerial()
+{
+	for (UINT i = 0; i < Count(); ++i)
+		Execute(i);
+}
+
+JobThroughput MeasureJobSystem(UINT threads, UINT jobs, UINT items, int iterations)
+{
+	JobThroughput result;
+	result.Threads = threads;
+	result.Jobs = jobs;
+
+	JobSystem system(threads > 0 ? threads - 1 : 0);
+	JobCounter counter;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+	{
+		for (UINT i = 0; i < jobs; ++i)
+			system.Run([]() {}, &counter);
+		system.Wait(counter);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	result.EmptyJobsMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+
+	// A few hundred cycles per item, in pieces of 1024 items
+	std::vector<float> out(items);
+	start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+	{
+		system.ParallelFor(items, 1024, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				float x = (float)i * 0.001f;
+				for (int k = 0; k < 16; ++k)
+					x = sqrtf(x * x + 1.0f) * 0.5f + sinf(x);
+				out[i] = x;
+			}
+		});
+	}
+	end = std::chrono::high_resolution_clock::now();
+	result.ParallelForMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+	result.Stolen = system.StolenJobs();
+	return result;
+}
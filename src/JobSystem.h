@@ -0,0 +1,141 @@
+#pragma once
+#include "DXHelper.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Jobs counted on it until they returned, see JobSystem::Wait
+struct JobCounter
+{
+	std::atomic<UINT> Pending{ 0 };
+};
+
+// Work stealing job system for per frame work. Every thread has its own deque: a thread pushes and pops its own
+// jobs at the back, newest first while their data is still in cache, and idle threads steal the oldest job at the
+// front of another deque, which for split ranges is the biggest piece left. Workers sleep while there is nothing
+// queued. The thread that created the system is not a worker but runs jobs while it waits, on deque 0.
+class JobSystem
+{
+public:
+	// workerCount threads besides the calling one
+	explicit JobSystem(UINT workerCount = DefaultWorkerCount());
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// One worker per hardware thread, less the one of the caller
+	static UINT DefaultWorkerCount();
+	// Workers and the creating thread
+	UINT ThreadCount() const { return (UINT)mQueues.size(); }
+
+	// Queues fn on the calling thread's deque. counter, when given, counts the job until fn returned.
+	void Run(std::function<void()> fn, JobCounter* counter = nullptr);
+	// Runs queued jobs, own ones first, until counter drops to zero. Jobs may Wait on the jobs they queued.
+	void Wait(JobCounter& counter);
+
+	// body(begin, end) over [0, count). The range is halved down to grain items, the upper halves queued and the
+	// lower ones run on, so the first pieces other threads steal are the biggest.
+	template<typename Body>
+	void ParallelFor(size_t count, size_t grain, const Body& body)
+	{
+		if (count == 0)
+			return;
+		grain = std::max<size_t>(grain, 1);
+
+		JobCounter counter;
+		std::function<void(size_t, size_t)> split = [&](size_t begin, size_t end)
+		{
+			while (end - begin > grain)
+			{
+				const size_t mid = begin + (end - begin) / 2;
+				Run([&split, mid, end]() { split(mid, end); }, &counter);
+				end = mid;
+			}
+			body(begin, end);
+		};
+		split(0, count);
+		Wait(counter);
+	}
+
+	UINT64 StolenJobs() const { return mStolen.load(); }
+
+private:
+	struct Job
+	{
+		std::function<void()> Fn;
+		JobCounter* Counter = nullptr;
+	};
+
+	struct Queue
+	{
+		std::mutex Lock;
+		std::deque<Job> Jobs;
+	};
+
+	void WorkerLoop(UINT queue);
+	// Runs one job, its own or a stolen one, returns false when every deque was empty
+	bool RunOne(UINT queue);
+	UINT ThisThreadQueue() const;
+
+	std::vector<std::unique_ptr<Queue>> mQueues; // 0 for the creating thread and other non workers
+	std::vector<std::thread> mThreads;
+	std::atomic<UINT> mQueued{ 0 };
+	std::atomic<UINT> mSleeping{ 0 };
+	std::atomic<bool> mStop{ false };
+	std::atomic<UINT64> mStolen{ 0 };
+	std::mutex mSleepLock;
+	std::condition_variable mWake;
+};
+
+// Jobs with dependencies between them, built once and run every frame. Each job is queued as soon as the last
+// of its dependencies returned, by the thread that ran that dependency.
+class JobGraph
+{
+public:
+	UINT Add(const char* name, std::function<void()> fn);
+	// job does not start before dependency returned
+	void Depend(UINT job, UINT dependency);
+
+	void Run(JobSystem& jobs);
+	// Every job on the calling thread in the order they were added, which has to respect the dependencies
+	void RunSerial();
+
+	UINT Count() const { return (UINT)mNodes.size(); }
+	const char* Name(UINT job) const { return mNodes[job].Name; }
+	// Time job took in the last run
+	double Ms(UINT job) const { return mNodes[job].Ms; }
+
+private:
+	struct Node
+	{
+		const char* Name = "";
+		std::function<void()> Fn;
+		std::vector<UINT> Dependents;
+		UINT DependencyCount = 0;
+		double Ms = 0.0;
+	};
+
+	void Execute(UINT job);
+
+	std::vector<Node> mNodes;
+	std::unique_ptr<std::atomic<UINT>[]> mRemaining; // dependencies still running, per job
+	UINT mRemainingCount = 0;
+};
+
+struct JobThroughput
+{
+	UINT Threads = 0;
+	UINT Jobs = 0;
+	double EmptyJobsMs = 0.0;   // Jobs empty jobs queued by one thread and Wait
+	double ParallelForMs = 0.0; // ParallelFor over a fixed amount of arithmetic
+	UINT64 Stolen = 0;          // jobs run by another thread than the one that queued them, both tests
+
+	double NsPerJob() const { return Jobs > 0 ? EmptyJobsMs * 1e6 / Jobs : 0.0; }
+};
+
+// Runs jobs empty jobs and a ParallelFor over items items of arithmetic on a system of threads threads
+// (threads - 1 workers), iterations times each.
+JobThroughput MeasureJobSystem(UINT threads, UINT jobs, UINT items, int iterations);
@@ -0,0 +1,180 @@
+#include "MaterialTable.h"
+#include <chrono>
+#include <cstring>
+#include <random>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+	UINT LowestSetBit(UINT64 word)
+	{
+#if defined(_MSC_VER)
+		unsigned long bit;
+		_BitScanForward64(&bit, word);
+		return (UINT)bit;
+#else
+		return (UINT)__builtin_ctzll(word);
+#endif
+	}
+}
+
+void MaterialTable::Reset(UINT count, int frameResourceCount)
+{
+	mData.assign(count, MaterialData());
+	mDirty.assign(frameResourceCount, std::vector<UINT64>((count + 63) / 64, 0));
+}
+
+void MaterialTable::Set(const Material& mat)
+{
+	Set((UINT)mat.MatCBIndex, Pack(mat));
+}
+
+void MaterialTable::Set(UINT index, const MaterialData& data)
+{
+	assert(index < Count());
+	mData[index] = data;
+	for (auto& dirty : mDirty)
+		dirty[index / 64] |= 1ull << (index % 64);
+}
+
+void MaterialTable::MarkAllDirty()
+{
+	for (auto& dirty : mDirty)
+	{
+		std::fill(dirty.begin(), dirty.end(), ~0ull);
+		if (Count() % 64 != 0)
+			dirty.back() = (1ull << (Count() % 64)) - 1;
+	}
+}
+
+MaterialTable::UploadStats MaterialTable::Upload(int frameResource, MaterialData* records)
+{
+	UploadStats stats;
+	std::vector<UINT64>& dirty = mDirty[frameResource];
+
+	// Skips whole clean words, every run is then one memcpy
+	UINT i = 0;
+	for (;;)
+	{
+		const UINT first = NextBit(dirty, i, true);
+		if (first == Count())
+			break;
+		const UINT end = NextBit(dirty, first, false);
+		memcpy(records + first, mData.data() + first, sizeof(MaterialData) * (end - first));
+		stats.Records += end - first;
+		stats.Runs++;
+		i = end;
+	}
+	if (stats.Runs > 0)
+		std::fill(dirty.begin(), dirty.end(), 0ull);
+
+	stats.Bytes = (UINT64)stats.Records * sizeof(MaterialData);
+	return stats;
+}
+
+UINT MaterialTable::NextBit(const std::vector<UINT64>& bits, UINT from, bool set) const
+{
+	const UINT words = (UINT)bits.size();
+	UINT w = from / 64;
+	if (w >= words)
+		return Count();
+	UINT64 word = (set ? bits[w] : ~bits[w]) & (~0ull << (from % 64));
+	while (word == 0)
+	{
+		if (++w == words)
+			return Count();
+		word = set ? bits[w] : ~bits[w];
+	}
+	return std::min(w * 64 + LowestSetBit(word), Count());
+}
+
+MaterialData MaterialTable::Pack(const Material& mat)
+{
+	MaterialData data;
+	data.DiffuseAlbedo = mat.DiffuseAlbedo;
+	data.FresnelR0 = mat.FresnelR0;
+	data.Roughness = mat.Roughness;
+	XMStoreFloat4x4(&data.MatTransform, XMMatrixTranspose(XMLoadFloat4x4(&mat.MatTransform)));
+	data.DiffuseMapIndex = mat.DiffuseSrvHeapIndex;
+	data.NormalMapIndex = mat.NormalSrvHeapIndex;
+	data.CubeMapIndex = mat.CubeMapInex;
+	data.Metallic = mat.metallic;
+	return data;
+}
+
+MaterialUploadTiming MeasureMaterialUpload(MaterialData* const* records, int frameResourceCount, UINT count, UINT changed,
+	bool clustered, int frames)
+{
+	MaterialUploadTiming result;
+	result.Materials = count;
+	result.Changed = changed;
+
+	std::mt19937 rng(count);
+	std::unordered_map<std::string, std::unique_ptr<Material>> materials;
+	std::vector<Material*> byIndex(count);
+	MaterialTable table;
+	table.Reset(count, frameResourceCount);
+	for (UINT i = 0; i < count; ++i)
+	{
+		auto mat = std::make_unique<Material>();
+		mat->Name = "material" + std::to_string(i);
+		mat->MatCBIndex = (int)i;
+		mat->Roughness = (float)(rng() % 100) / 100.0f;
+		mat->NumFramesDirty = 0;
+		byIndex[i] = mat.get();
+		table.Set(*mat);
+		materials[mat->Name] = std::move(mat);
+	}
+	for (int f = 0; f < frameResourceCount; ++f)
+		table.Upload(f, records[f]);
+
+	// The materials edited in each frame, a block or pseudo random ones
+	std::vector<std::vector<UINT>> edits(frames);
+	for (auto& frame : edits)
+	{
+		UINT start = (UINT)(rng() % count);
+		for (UINT k = 0; k < changed; ++k)
+			frame.push_back(clustered ? (start + k) % count : (UINT)(rng() % count));
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		for (UINT i : edits[frame])
+		{
+			byIndex[i]->Roughness = 1.0f - byIndex[i]->Roughness;
+			byIndex[i]->NumFramesDirty = frameResourceCount;
+		}
+		MaterialData* frameRecords = records[frame % frameResourceCount];
+		for (auto& e : materials)
+		{
+			Material* mat = e.second.get();
+			if (mat->NumFramesDirty > 0)
+			{
+				MaterialData data = MaterialTable::Pack(*mat);
+				memcpy(frameRecords + mat->MatCBIndex, &data, sizeof(data));
+				mat->NumFramesDirty--;
+			}
+		}
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	result.MapWalkMs = std::chrono::duration<double, std::milli>(end - start).count() / frames;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		for (UINT i : edits[frame])
+		{
+			byIndex[i]->Roughness = 1.0f - byIndex[i]->Roughness;
+			table.Set(*byIndex[i]);
+		}
+		MaterialTable::UploadStats stats = table.Upload(frame % frameResourceCount, records[frame % frameResourceCount]);
+		result.Runs = stats.Runs;
+		result.Bytes = stats.Bytes;
+	}
+	end = std::chrono::high_resolution_clock::now();
+	result.TableMs = std::chrono::duration<double, std::milli>(end - start).count() / frames;
+	return result;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "FrameResource.hpp"
+
+// The GPU records of all materials, dense by MatCBIndex, with one dirty bit per material and frame resource.
+// Changing a material sets its bit for every frame resource, and each Upload writes the records dirty for
+// the frame resource it fills in runs of consecutive records, one memcpy per run.
+class MaterialTable
+{
+public:
+	// count records from MatCBIndex 0, all clean
+	void Reset(UINT count, int frameResourceCount);
+
+	// Packs mat into the record at mat.MatCBIndex and marks it dirty
+	void Set(const Material& mat);
+	void Set(UINT index, const MaterialData& data);
+	void MarkAllDirty();
+
+	struct UploadStats
+	{
+		UINT Records = 0;
+		UINT Runs = 0;
+		UINT64 Bytes = 0;
+	};
+
+	// Copies the records dirty for frameResource to records (the mapped material buffer of that frame resource)
+	// and clears their bits.
+	UploadStats Upload(int frameResource, MaterialData* records);
+
+	UINT Count() const { return (UINT)mData.size(); }
+	const MaterialData& Data(UINT index) const { return mData[index]; }
+
+	static MaterialData Pack(const Material& mat);
+
+private:
+	// First record at or after from whose bit is set (or clear), Count() when there is none
+	UINT NextBit(const std::vector<UINT64>& bits, UINT from, bool set) const;
+
+	std::vector<MaterialData> mData;
+	std::vector<std::vector<UINT64>> mDirty; // per frame resource, bit i of word i / 64 for record i
+};
+
+struct MaterialUploadTiming
+{
+	UINT Materials = 0;
+	UINT Changed = 0;       // materials edited per frame
+	double MapWalkMs = 0.0; // unordered_map<std::string, unique_ptr<Material>> walk with NumFramesDirty, the old update
+	double TableMs = 0.0;   // MaterialTable::Set of the edited ones and Upload
+	UINT Runs = 0;          // memcpy runs of the last table upload
+	UINT64 Bytes = 0;       // written by the last table upload
+};
+
+// count materials, changed of them edited every frame, scattered or in one block of consecutive indices,
+// updated frames times with each method while cycling over frameResourceCount frame resources. records
+// must hold count entries per frame resource, pass mapped upload buffers to include the write combining cost.
+MaterialUploadTiming MeasureMaterialUpload(MaterialData* const* records, int frameResourceCount, UINT count, UINT changed,
+	bool clustered, int frames);
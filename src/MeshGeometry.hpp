@@ -8,6 +8,15 @@ struct SubmeshGeometry {
 	UINT IndexCount = 0;//
 	UINT StartIndexLocation = 0;//׼λ
 	INT BaseVertexLocation = 0;//׼λ
+	UINT VertexCount = 0;//number of vertices owned by the submesh, starting at BaseVertexLocation
+	DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;//index width of this submesh, one MeshGeometry may mix 16 and 32-bit ranges
+
+	//object-space bounds of the submesh vertices
+	DirectX::BoundingBox Bounds;
+
+	//LOD chains are stored as extra DrawArgs sharing the vertices of level 0
+	UINT LodLevel = 0;
+	float LodError = 0.0f;//object-space deviation of this level from level 0
 };
 
 //
@@ -37,6 +46,12 @@ struct MeshGeometry {
 	//ʹøSubmeshļͼΣǾͿsubmeshnameҲе
 	std::unordered_map<std::string, SubmeshGeometry> DrawArgs;
 
+	//the same vertices in the quantized CompactVertex layout, for the passes whose input layout reads it
+	ComPtr<ID3D12Resource> CompactVertexBufferGPU = nullptr;
+	ComPtr<ID3D12Resource> CompactVertexBufferUploader = nullptr;
+	UINT CompactVertexByteStride = 0;
+	UINT CompactVertexBufferByteSize = 0;
+
 	//ȡ㻺ͼ
 	D3D12_VERTEX_BUFFER_VIEW VertexBufferView()const {
 		D3D12_VERTEX_BUFFER_VIEW vbv;
@@ -47,6 +62,16 @@ struct MeshGeometry {
 		return vbv;
 	}
 
+	//vertex buffer view of the compact copy, same vertex order as VertexBufferView
+	D3D12_VERTEX_BUFFER_VIEW CompactVertexBufferView()const {
+		D3D12_VERTEX_BUFFER_VIEW vbv;
+		vbv.BufferLocation = CompactVertexBufferGPU->GetGPUVirtualAddress();
+		vbv.SizeInBytes = CompactVertexBufferByteSize;
+		vbv.StrideInBytes = CompactVertexByteStride;
+
+		return vbv;
+	}
+
 	//ȡͼ
 	D3D12_INDEX_BUFFER_VIEW IndexBufferView()const {
 		D3D12_INDEX_BUFFER_VIEW ibv;
@@ -57,9 +82,19 @@ struct MeshGeometry {
 		return ibv;
 	}
 
+	//index buffer view for submeshes whose width differs from IndexFormat, UNKNOWN falls back to IndexFormat
+	D3D12_INDEX_BUFFER_VIEW IndexBufferView(DXGI_FORMAT format)const {
+		D3D12_INDEX_BUFFER_VIEW ibv = IndexBufferView();
+		if (format != DXGI_FORMAT_UNKNOWN)
+			ibv.Format = format;
+
+		return ibv;
+	}
+
 	//ϴͷŵϴѵڴ
 	void DisposUploaders() {
 		VertexBufferUploader = nullptr;
 		IndexBufferUploader = nullptr;
+		CompactVertexBufferUploader = nullptr;
 	}
 };
\ No newline at end of file
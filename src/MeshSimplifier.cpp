@@ -0,0 +1,444 @@
+#include "MeshSimplifier.h"
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include <string>
+#include <climits>
+
+namespace
+{
+	// Symmetric 4x4 matrix of the plane equations, upper triangle stored row by row.
+	struct Quadric
+	{
+		double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+		double a11 = 0, a12 = 0, a13 = 0;
+		double a22 = 0, a23 = 0;
+		double a33 = 0;
+
+		void AddPlane(double nx, double ny, double nz, double d, double w)
+		{
+			a00 += w * nx * nx; a01 += w * nx * ny; a02 += w * nx * nz; a03 += w * nx * d;
+			a11 += w * ny * ny; a12 += w * ny * nz; a13 += w * ny * d;
+			a22 += w * nz * nz; a23 += w * nz * d;
+			a33 += w * d * d;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+			a11 += q.a11; a12 += q.a12; a13 += q.a13;
+			a22 += q.a22; a23 += q.a23;
+			a33 += q.a33;
+		}
+
+		// Sum of squared distances of p to all planes
+		double Evaluate(const XMFLOAT3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			double r = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x
+				+ a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y
+				+ a22 * z * z + 2.0 * a23 * z
+				+ a33;
+			return r > 0.0 ? r : 0.0;
+		}
+	};
+
+	enum class VertexKind : std::uint8_t
+	{
+		Manifold, // free to collapse onto any neighbour
+		Border,   // collapses along open border edges only
+		Seam,     // two attribute copies, collapses along the seam only
+		Locked,
+	};
+
+	struct Collapse
+	{
+		UINT From; // position groups
+		UINT To;
+		double Cost;
+	};
+
+	const double kBorderWeight = 10.0;
+
+	// Vertices with bitwise equal positions form one position group, only vertices referenced
+	// by the index list count as wedges (attribute copies) of their group.
+	struct PositionGroups
+	{
+		std::vector<UINT> GroupOf;      // vertex -> group
+		std::vector<UINT> FirstWedge;   // group -> offset in Wedges, groupCount + 1
+		std::vector<UINT> Wedges;       // vertices of each group
+		std::vector<XMFLOAT3> Position; // group -> position
+
+		UINT Count() const { return (UINT)Position.size(); }
+	};
+
+	PositionGroups BuildPositionGroups(const Vertex* vertices, size_t vertexCount, const std::vector<std::uint8_t>& used)
+	{
+		PositionGroups groups;
+		groups.GroupOf.resize(vertexCount);
+
+		std::unordered_map<std::string, UINT> lookup;
+		lookup.reserve(vertexCount);
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			std::string key(reinterpret_cast<const char*>(&vertices[v].Pos), sizeof(XMFLOAT3));
+			auto it = lookup.find(key);
+			if (it == lookup.end())
+			{
+				it = lookup.emplace(key, groups.Count()).first;
+				groups.Position.push_back(vertices[v].Pos);
+			}
+			groups.GroupOf[v] = it->second;
+		}
+
+		groups.FirstWedge.assign(groups.Count() + 1, 0);
+		for (size_t v = 0; v < vertexCount; ++v)
+			groups.FirstWedge[groups.GroupOf[v] + 1] += used[v];
+		for (UINT g = 0; g < groups.Count(); ++g)
+			groups.FirstWedge[g + 1] += groups.FirstWedge[g];
+		groups.Wedges.resize(groups.FirstWedge.back());
+		std::vector<UINT> cursor(groups.FirstWedge.begin(), groups.FirstWedge.end() - 1);
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			if (used[v])
+				groups.Wedges[cursor[groups.GroupOf[v]]++] = (UINT)v;
+		}
+		return groups;
+	}
+
+	inline std::uint64_t EdgeKey(UINT a, UINT b)
+	{
+		if (a > b)
+			std::swap(a, b);
+		return ((std::uint64_t)a << 32) | b;
+	}
+
+	XMVECTOR TriangleNormal(const XMFLOAT3& p0, const XMFLOAT3& p1, const XMFLOAT3& p2)
+	{
+		XMVECTOR a = XMLoadFloat3(&p0);
+		return XMVector3Cross(XMLoadFloat3(&p1) - a, XMLoadFloat3(&p2) - a);
+	}
+
+	// Attribute copies of a vertex must keep a comparable shading frame, otherwise the collapse
+	// would smear a hard edge or rotate the tangent space across the surface.
+	bool SimilarFrames(const Vertex& a, const Vertex& b)
+	{
+		const float minCos = 0.7f;
+		if (XMVectorGetX(XMVector3Dot(XMLoadFloat3(&a.Normal), XMLoadFloat3(&b.Normal))) < minCos)
+			return false;
+
+		XMVECTOR ta = XMLoadFloat3(&a.TangentU);
+		XMVECTOR tb = XMLoadFloat3(&b.TangentU);
+		if (XMVectorGetX(XMVector3LengthSq(ta)) > 1e-8f && XMVectorGetX(XMVector3LengthSq(tb)) > 1e-8f)
+		{
+			if (XMVectorGetX(XMVector3Dot(XMVector3Normalize(ta), XMVector3Normalize(tb))) < minCos)
+				return false;
+		}
+		return true;
+	}
+}
+
+std::vector<std::uint32_t> MeshSimplifier::Simplify(const Vertex* vertices, size_t vertexCount,
+	const std::uint32_t* indices, size_t indexCount, size_t targetIndexCount, float* outError)
+{
+	assert(indexCount % 3 == 0);
+
+	std::vector<std::uint32_t> result(indices, indices + indexCount);
+	double maxCost = 0.0;
+
+	std::vector<std::uint8_t> used(vertexCount, 0);
+	for (size_t i = 0; i < indexCount; ++i)
+		used[indices[i]] = 1;
+
+	PositionGroups groups = BuildPositionGroups(vertices, vertexCount, used);
+	const UINT groupCount = groups.Count();
+
+	// Edge use counts on positions find open borders and non-manifold edges.
+	std::unordered_map<std::uint64_t, UINT> edgeUse;
+	edgeUse.reserve(indexCount);
+	for (size_t i = 0; i < indexCount; i += 3)
+	{
+		for (int e = 0; e < 3; ++e)
+		{
+			UINT a = groups.GroupOf[result[i + e]];
+			UINT b = groups.GroupOf[result[i + (e + 1) % 3]];
+			if (a != b)
+				edgeUse[EdgeKey(a, b)]++;
+		}
+	}
+
+	std::vector<VertexKind> kind(groupCount, VertexKind::Manifold);
+	std::vector<Quadric> quadrics(groupCount);
+	for (UINT g = 0; g < groupCount; ++g)
+	{
+		UINT wedges = groups.FirstWedge[g + 1] - groups.FirstWedge[g];
+		if (wedges == 2)
+			kind[g] = VertexKind::Seam;
+		else if (wedges > 2)
+			kind[g] = VertexKind::Locked;
+	}
+
+	for (size_t i = 0; i < indexCount; i += 3)
+	{
+		UINT g[3] = { groups.GroupOf[result[i]], groups.GroupOf[result[i + 1]], groups.GroupOf[result[i + 2]] };
+		XMVECTOR n = TriangleNormal(groups.Position[g[0]], groups.Position[g[1]], groups.Position[g[2]]);
+		if (XMVectorGetX(XMVector3LengthSq(n)) < 1e-20f)
+			continue;
+		n = XMVector3Normalize(n);
+		XMFLOAT3 nf;
+		XMStoreFloat3(&nf, n);
+		double d = -(nf.x * groups.Position[g[0]].x + nf.y * groups.Position[g[0]].y + nf.z * groups.Position[g[0]].z);
+		for (int k = 0; k < 3; ++k)
+			quadrics[g[k]].AddPlane(nf.x, nf.y, nf.z, d, 1.0);
+
+		for (int e = 0; e < 3; ++e)
+		{
+			UINT a = g[e];
+			UINT b = g[(e + 1) % 3];
+			if (a == b)
+				continue;
+			UINT use = edgeUse[EdgeKey(a, b)];
+			if (use == 1)
+			{
+				// Plane through the border edge, perpendicular to the face, keeps the outline in place.
+				XMVECTOR pa = XMLoadFloat3(&groups.Position[a]);
+				XMVECTOR m = XMVector3Cross(XMLoadFloat3(&groups.Position[b]) - pa, n);
+				if (XMVectorGetX(XMVector3LengthSq(m)) < 1e-20f)
+					continue;
+				m = XMVector3Normalize(m);
+				XMFLOAT3 mf;
+				XMStoreFloat3(&mf, m);
+				double md = -(mf.x * groups.Position[a].x + mf.y * groups.Position[a].y + mf.z * groups.Position[a].z);
+				quadrics[a].AddPlane(mf.x, mf.y, mf.z, md, kBorderWeight);
+				quadrics[b].AddPlane(mf.x, mf.y, mf.z, md, kBorderWeight);
+
+				for (UINT v : { a, b })
+				{
+					if (kind[v] == VertexKind::Manifold)
+						kind[v] = VertexKind::Border;
+					else if (kind[v] == VertexKind::Seam)
+						kind[v] = VertexKind::Locked;
+				}
+			}
+			else if (use > 2)
+			{
+				kind[a] = VertexKind::Locked;
+				kind[b] = VertexKind::Locked;
+			}
+		}
+	}
+
+	std::vector<UINT> remap(vertexCount);
+	std::vector<std::uint8_t> touched(groupCount);
+	std::vector<UINT> triOffsets;
+	std::vector<UINT> triList;
+	std::vector<Collapse> collapses;
+
+	while (result.size() > targetIndexCount)
+	{
+		const size_t triangleCount = result.size() / 3;
+
+		// vertex -> triangles of the current index list
+		triOffsets.assign(vertexCount + 1, 0);
+		for (std::uint32_t v : result)
+			triOffsets[v + 1]++;
+		for (size_t v = 0; v < vertexCount; ++v)
+			triOffsets[v + 1] += triOffsets[v];
+		triList.resize(result.size());
+		{
+			std::vector<UINT> cursor(triOffsets.begin(), triOffsets.end() - 1);
+			for (size_t i = 0; i < result.size(); ++i)
+				triList[cursor[result[i]]++] = (UINT)(i / 3);
+		}
+
+		// Candidate collapses in both directions of every edge
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int e = 0; e < 3; ++e)
+			{
+				UINT a = groups.GroupOf[result[i + e]];
+				UINT b = groups.GroupOf[result[i + (e + 1) % 3]];
+				for (int dir = 0; dir < 2; ++dir)
+				{
+					UINT from = dir ? b : a;
+					UINT to = dir ? a : b;
+					if (kind[from] == VertexKind::Locked)
+						continue;
+					if (kind[from] == VertexKind::Border && edgeUse[EdgeKey(from, to)] != 1)
+						continue;
+					if (kind[from] == VertexKind::Seam && kind[to] != VertexKind::Seam)
+						continue;
+
+					Quadric q = quadrics[from];
+					q.Add(quadrics[to]);
+					collapses.push_back({ from, to, q.Evaluate(groups.Position[to]) });
+				}
+			}
+		}
+		if (collapses.empty())
+			break;
+
+		std::sort(collapses.begin(), collapses.end(),
+			[](const Collapse& l, const Collapse& r) { return l.Cost < r.Cost; });
+
+		for (size_t v = 0; v < vertexCount; ++v)
+			remap[v] = (UINT)v;
+		std::fill(touched.begin(), touched.end(), 0);
+
+		// Each collapse removes about two triangles, stop halfway to the goal to keep the
+		// collapses of one pass independent from each other.
+		size_t goal = (triangleCount - targetIndexCount / 3) / 2 + 1;
+		size_t applied = 0;
+
+		for (const Collapse& c : collapses)
+		{
+			if (applied >= goal)
+				break;
+			if (touched[c.From] || touched[c.To])
+				continue;
+
+			// Every copy of the source vertex needs a copy of the target on its side of the seam.
+			UINT pairs[2] = { UINT_MAX, UINT_MAX };
+			bool valid = true;
+			UINT wedgeBegin = groups.FirstWedge[c.From];
+			UINT wedgeEnd = groups.FirstWedge[c.From + 1];
+			for (UINT w = wedgeBegin; w < wedgeEnd && valid; ++w)
+			{
+				UINT u = groups.Wedges[w];
+				UINT pair = UINT_MAX;
+				for (UINT t = triOffsets[u]; t < triOffsets[u + 1] && pair == UINT_MAX; ++t)
+				{
+					const std::uint32_t* tri = &result[triList[t] * 3];
+					for (int k = 0; k < 3; ++k)
+					{
+						if (groups.GroupOf[tri[k]] == c.To)
+						{
+							pair = tri[k];
+							break;
+						}
+					}
+				}
+				if (pair == UINT_MAX || !SimilarFrames(vertices[u], vertices[pair]))
+					valid = false;
+				pairs[w - wedgeBegin] = pair;
+			}
+			if (!valid)
+				continue;
+
+			// Reject collapses that flip or degenerate a remaining triangle.
+			const XMFLOAT3& target = groups.Position[c.To];
+			for (UINT w = wedgeBegin; w < wedgeEnd && valid; ++w)
+			{
+				UINT u = groups.Wedges[w];
+				for (UINT t = triOffsets[u]; t < triOffsets[u + 1]; ++t)
+				{
+					const std::uint32_t* tri = &result[triList[t] * 3];
+					UINT g[3] = { groups.GroupOf[tri[0]], groups.GroupOf[tri[1]], groups.GroupOf[tri[2]] };
+					if (g[0] == c.To || g[1] == c.To || g[2] == c.To)
+						continue; // collapses into a degenerate triangle and is removed
+
+					XMFLOAT3 p[3] = { groups.Position[g[0]], groups.Position[g[1]], groups.Position[g[2]] };
+					XMVECTOR before = TriangleNormal(p[0], p[1], p[2]);
+					for (int k = 0; k < 3; ++k)
+					{
+						if (g[k] == c.From)
+							p[k] = target;
+					}
+					XMVECTOR after = TriangleNormal(p[0], p[1], p[2]);
+
+					float lenBefore = XMVectorGetX(XMVector3Length(before));
+					float lenAfter = XMVectorGetX(XMVector3Length(after));
+					if (lenAfter < 1e-12f || XMVectorGetX(XMVector3Dot(before, after)) < 0.25f * lenBefore * lenAfter)
+					{
+						valid = false;
+						break;
+					}
+				}
+			}
+			if (!valid)
+				continue;
+
+			// The flip test above used the current positions of the whole one-ring, so none of it may move again in this pass.
+			for (UINT w = wedgeBegin; w < wedgeEnd; ++w)
+			{
+				UINT u = groups.Wedges[w];
+				remap[u] = pairs[w - wedgeBegin];
+				for (UINT t = triOffsets[u]; t < triOffsets[u + 1]; ++t)
+				{
+					const std::uint32_t* tri = &result[triList[t] * 3];
+					for (int k = 0; k < 3; ++k)
+						touched[groups.GroupOf[tri[k]]] = 1;
+				}
+			}
+			quadrics[c.To].Add(quadrics[c.From]);
+			maxCost = MathHelper::Max(maxCost, c.Cost);
+			++applied;
+		}
+
+		if (applied == 0)
+			break;
+
+		// Apply the collapses and drop the triangles that became degenerate.
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			std::uint32_t a = remap[result[i]];
+			std::uint32_t b = remap[result[i + 1]];
+			std::uint32_t c = remap[result[i + 2]];
+			UINT ga = groups.GroupOf[a], gb = groups.GroupOf[b], gc = groups.GroupOf[c];
+			if (ga == gb || gb == gc || ga == gc)
+				continue;
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	if (outError)
+		*outError = (float)sqrt(maxCost);
+	return result;
+}
+
+std::vector<MeshLod> MeshSimplifier::BuildLodChain(const Vertex* vertices, size_t vertexCount,
+	const std::uint32_t* indices, size_t indexCount, UINT maxLods, float reduction)
+{
+	std::vector<MeshLod> chain;
+
+	const std::uint32_t* source = indices;
+	size_t sourceCount = indexCount;
+	float error = 0.0f;
+	for (UINT level = 0; level < maxLods; ++level)
+	{
+		size_t target = (size_t)(sourceCount / 3 * reduction) * 3;
+		if (target < 3)
+			break;
+
+		MeshLod lod;
+		float levelError = 0.0f;
+		lod.Indices = Simplify(vertices, vertexCount, source, sourceCount, target, &levelError);
+
+		// Stop once a level removes less than a tenth of the triangles of the previous one.
+		if (lod.Indices.empty() || lod.Indices.size() > sourceCount * 9 / 10)
+			break;
+
+		// Errors of successive levels add up since each level is built from the previous one.
+		error += levelError;
+		lod.Error = error;
+		chain.push_back(std::move(lod));
+
+		source = chain.back().Indices.data();
+		sourceCount = chain.back().Indices.size();
+	}
+
+	return chain;
+}
+
+float MeshSimplifier::ProjectedError(float error, float distance, float fovY, float viewportHeight)
+{
+	distance = MathHelper::Max(distance, 1e-4f);
+	return error / (2.0f * distance * tanf(0.5f * fovY)) * viewportHeight;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "FrameResource.hpp"
+
+// One level of a LOD chain, indexing the same vertex buffer as the source mesh.
+struct MeshLod
+{
+	std::vector<std::uint32_t> Indices;
+	float Error = 0.0f; // object space deviation from the source mesh
+};
+
+namespace MeshSimplifier
+{
+	// Quadric error metric simplification by half-edge collapse. Vertices are never moved or created,
+	// the result indexes the input vertices so that every LOD can share one vertex buffer and the
+	// original normals, tangents and uvs stay untouched.
+	// Open borders only collapse along themselves, vertices split by uv or normal seams collapse with
+	// all their copies along the seam, seam junctions and non-manifold vertices are locked.
+	std::vector<std::uint32_t> Simplify(const Vertex* vertices, size_t vertexCount,
+		const std::uint32_t* indices, size_t indexCount, size_t targetIndexCount, float* outError = nullptr);
+
+	// Up to maxLods progressively coarser levels (level 0, the source, is not included).
+	// Each level keeps about reduction of the triangles of the previous one, the chain stops early
+	// once the mesh no longer simplifies.
+	std::vector<MeshLod> BuildLodChain(const Vertex* vertices, size_t vertexCount,
+		const std::uint32_t* indices, size_t indexCount, UINT maxLods, float reduction = 0.5f);
+
+	// Size in pixels of an object of world space size error at distance from a perspective camera.
+	float ProjectedError(float error, float distance, float fovY, float viewportHeight);
+}
@@ -0,0 +1,294 @@
+#include "Meshlet.h"
+#include <cassert>
+#include <cfloat>
+
+namespace
+{
+	struct MeshletAdjacency
+	{
+		std::vector<UINT> Offsets;   // vertexCount + 1
+		std::vector<UINT> Triangles; // triangles touching each vertex
+	};
+
+	MeshletAdjacency BuildAdjacency(const std::uint32_t* indices, size_t indexCount, size_t vertexCount)
+	{
+		MeshletAdjacency adj;
+		adj.Offsets.assign(vertexCount + 1, 0);
+		for (size_t i = 0; i < indexCount; ++i)
+			adj.Offsets[indices[i] + 1]++;
+		for (size_t v = 0; v < vertexCount; ++v)
+			adj.Offsets[v + 1] += adj.Offsets[v];
+
+		adj.Triangles.resize(indexCount);
+		std::vector<UINT> cursor(adj.Offsets.begin(), adj.Offsets.end() - 1);
+		for (size_t i = 0; i < indexCount; ++i)
+			adj.Triangles[cursor[indices[i]]++] = (UINT)(i / 3);
+		return adj;
+	}
+
+	void FinishMeshlet(MeshletMesh& mesh, Meshlet& m, const Vertex* vertices)
+	{
+		// Bounding sphere
+		std::vector<XMFLOAT3> points(m.VertexCount);
+		for (UINT i = 0; i < m.VertexCount; ++i)
+			points[i] = vertices[mesh.Vertices[m.VertexOffset + i]].Pos;
+		BoundingSphere::CreateFromPoints(m.Bounds, points.size(), points.data(), sizeof(XMFLOAT3));
+
+		// Normal cone from the geometric triangle normals
+		std::vector<XMVECTOR> normals;
+		normals.reserve(m.TriangleCount);
+		XMVECTOR axis = XMVectorZero();
+		for (UINT t = 0; t < m.TriangleCount; ++t)
+		{
+			const std::uint32_t* tri = &mesh.Indices[(m.TriangleOffset + t) * 3];
+			XMVECTOR p0 = XMLoadFloat3(&vertices[tri[0]].Pos);
+			XMVECTOR p1 = XMLoadFloat3(&vertices[tri[1]].Pos);
+			XMVECTOR p2 = XMLoadFloat3(&vertices[tri[2]].Pos);
+			XMVECTOR n = XMVector3Cross(p1 - p0, p2 - p0);
+			if (XMVectorGetX(XMVector3LengthSq(n)) < 1e-20f)
+				continue; // degenerate triangles can not be backfacing
+			n = XMVector3Normalize(n);
+			normals.push_back(n);
+			axis += n;
+		}
+
+		m.ConeCutoff = 2.0f;
+		if (normals.empty() || XMVectorGetX(XMVector3LengthSq(axis)) < 1e-12f)
+			return;
+
+		axis = XMVector3Normalize(axis);
+		float minDot = 1.0f;
+		for (const XMVECTOR& n : normals)
+			minDot = MathHelper::Min(minDot, XMVectorGetX(XMVector3Dot(axis, n)));
+
+		// A spread of more than ~84 degrees almost never culls, keep those clusters out of the test.
+		if (minDot <= 0.1f)
+			return;
+
+		XMStoreFloat3(&m.ConeAxis, axis);
+		m.ConeCutoff = sqrtf(1.0f - minDot * minDot);
+	}
+}
+
+void MeshletCullStats::Merge(const MeshletCullStats& rhs)
+{
+	Meshlets += rhs.Meshlets;
+	VisibleMeshlets += rhs.VisibleMeshlets;
+	FrustumCulled += rhs.FrustumCulled;
+	ConeCulled += rhs.ConeCulled;
+	Triangles += rhs.Triangles;
+	VisibleTriangles += rhs.VisibleTriangles;
+	CullMs += rhs.CullMs;
+}
+
+MeshletMesh Meshlets::Build(const Vertex* vertices, size_t vertexCount, const std::uint32_t* indices, size_t indexCount)
+{
+	assert(indexCount % 3 == 0);
+
+	MeshletMesh mesh;
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return mesh;
+
+	mesh.Indices.reserve(indexCount);
+	mesh.Primitives.reserve(indexCount);
+	mesh.Vertices.reserve(vertexCount + vertexCount / 4);
+
+	MeshletAdjacency adj = BuildAdjacency(indices, indexCount, vertexCount);
+
+	std::vector<std::uint8_t> emitted(triangleCount, 0);
+	std::vector<int> localIndex(vertexCount, -1);
+	std::vector<UINT> candidates;
+	size_t scanCursor = 0;
+
+	Meshlet current;
+	XMVECTOR positionSum = XMVectorZero();
+	auto flush = [&]()
+	{
+		if (current.TriangleCount == 0)
+			return;
+		FinishMeshlet(mesh, current, vertices);
+		for (UINT i = 0; i < current.VertexCount; ++i)
+			localIndex[mesh.Vertices[current.VertexOffset + i]] = -1;
+		mesh.Meshlets.push_back(current);
+
+		current = Meshlet();
+		positionSum = XMVectorZero();
+		current.VertexOffset = (UINT)mesh.Vertices.size();
+		current.TriangleOffset = (UINT)(mesh.Indices.size() / 3);
+	};
+
+	auto newVertexCount = [&](UINT tri)
+	{
+		UINT count = 0;
+		for (int k = 0; k < 3; ++k)
+			count += localIndex[indices[tri * 3 + k]] < 0 ? 1 : 0;
+		return count;
+	};
+
+	auto distanceToCenter = [&](UINT tri)
+	{
+		XMVECTOR center = positionSum / (float)MathHelper::Max(current.VertexCount, 1u);
+		XMVECTOR triCenter =
+			(XMLoadFloat3(&vertices[indices[tri * 3 + 0]].Pos) +
+			XMLoadFloat3(&vertices[indices[tri * 3 + 1]].Pos) +
+			XMLoadFloat3(&vertices[indices[tri * 3 + 2]].Pos)) / 3.0f;
+		return XMVectorGetX(XMVector3LengthSq(triCenter - center));
+	};
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+	{
+		// Pick the neighbouring triangle that adds the fewest vertices, ties go to the one
+		// closest to the meshlet center so clusters grow round instead of along index order.
+		UINT best = UINT_MAX;
+		UINT bestCost = 4;
+		float bestDistance = FLT_MAX;
+		for (size_t c = 0; c < candidates.size();)
+		{
+			UINT tri = candidates[c];
+			if (emitted[tri])
+			{
+				candidates[c] = candidates.back();
+				candidates.pop_back();
+				continue;
+			}
+			UINT cost = newVertexCount(tri);
+			if (cost <= bestCost)
+			{
+				float distance = distanceToCenter(tri);
+				if (cost < bestCost || distance < bestDistance)
+				{
+					best = tri;
+					bestCost = cost;
+					bestDistance = distance;
+				}
+			}
+			++c;
+		}
+
+		// No neighbour left, continue with the next triangle in index order.
+		if (best == UINT_MAX)
+		{
+			while (emitted[scanCursor])
+				++scanCursor;
+			best = (UINT)scanCursor;
+			bestCost = newVertexCount(best);
+		}
+
+		if (current.VertexCount + bestCost > Meshlet::MaxVertices || current.TriangleCount + 1 > Meshlet::MaxTriangles)
+		{
+			flush();
+			candidates.clear();
+			bestCost = 3;
+		}
+
+		for (int k = 0; k < 3; ++k)
+		{
+			std::uint32_t v = indices[best * 3 + k];
+			if (localIndex[v] < 0)
+			{
+				localIndex[v] = (int)current.VertexCount++;
+				mesh.Vertices.push_back(v);
+				positionSum += XMLoadFloat3(&vertices[v].Pos);
+				for (UINT a = adj.Offsets[v]; a < adj.Offsets[v + 1]; ++a)
+				{
+					if (!emitted[adj.Triangles[a]])
+						candidates.push_back(adj.Triangles[a]);
+				}
+			}
+			mesh.Primitives.push_back((std::uint8_t)localIndex[v]);
+			mesh.Indices.push_back(v);
+		}
+
+		emitted[best] = 1;
+		current.TriangleCount++;
+	}
+	flush();
+
+	return mesh;
+}
+
+MeshletMesh Meshlets::BuildSubmesh(const MeshGeometry& geo, const SubmeshGeometry& submesh)
+{
+	assert(geo.VertexBufferCPU != nullptr && geo.IndexBufferCPU != nullptr);
+	assert(geo.VertexByteStride == sizeof(Vertex));
+	assert(submesh.VertexCount > 0);
+
+	const Vertex* vertices = reinterpret_cast<const Vertex*>(geo.VertexBufferCPU->GetBufferPointer()) + submesh.BaseVertexLocation;
+
+	std::vector<std::uint32_t> indices(submesh.IndexCount);
+	if (submesh.IndexFormat == DXGI_FORMAT_R16_UINT)
+	{
+		const std::uint16_t* src = reinterpret_cast<const std::uint16_t*>(geo.IndexBufferCPU->GetBufferPointer()) + submesh.StartIndexLocation;
+		for (UINT i = 0; i < submesh.IndexCount; ++i)
+			indices[i] = src[i];
+	}
+	else
+	{
+		const std::uint32_t* src = reinterpret_cast<const std::uint32_t*>(geo.IndexBufferCPU->GetBufferPointer()) + submesh.StartIndexLocation;
+		memcpy(indices.data(), src, submesh.IndexCount * sizeof(std::uint32_t));
+	}
+
+	return Build(vertices, submesh.VertexCount, indices.data(), indices.size());
+}
+
+void Meshlets::Cull(const MeshletMesh& mesh, const BoundingFrustum& localFrustum, const XMFLOAT3& localEyePos,
+	std::vector<std::uint8_t>& visible, MeshletCullStats& stats)
+{
+	visible.resize(mesh.Meshlets.size(), 0);
+	XMVECTOR eye = XMLoadFloat3(&localEyePos);
+
+	for (size_t i = 0; i < mesh.Meshlets.size(); ++i)
+	{
+		const Meshlet& m = mesh.Meshlets[i];
+		stats.Meshlets++;
+
+		if (localFrustum.Contains(m.Bounds) == DISJOINT)
+		{
+			stats.FrustumCulled++;
+			continue;
+		}
+
+		// Backfacing for every point of the sphere and every normal of the cone:
+		// dot(axis, d) >= sin(spread) * (|d| + r) + r, with d from the eye to the sphere center.
+		if (m.ConeCutoff <= 1.0f)
+		{
+			XMVECTOR d = XMLoadFloat3(&m.Bounds.Center) - eye;
+			float dist = XMVectorGetX(XMVector3Length(d));
+			float proj = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&m.ConeAxis), d));
+			if (proj >= m.ConeCutoff * (dist + m.Bounds.Radius) + m.Bounds.Radius)
+			{
+				stats.ConeCulled++;
+				continue;
+			}
+		}
+
+		stats.VisibleMeshlets++;
+		visible[i] = 1;
+	}
+}
+
+UINT Meshlets::Compact(const MeshletMesh& mesh, const std::vector<std::uint8_t>& visible, std::vector<std::uint32_t>& out)
+{
+	const size_t start = out.size();
+	size_t i = 0;
+	while (i < mesh.Meshlets.size())
+	{
+		if (!visible[i])
+		{
+			++i;
+			continue;
+		}
+
+		// Meshlets are stored back to back, so a run of visible ones is one contiguous index range.
+		size_t first = mesh.Meshlets[i].TriangleOffset * 3;
+		size_t last = first;
+		while (i < mesh.Meshlets.size() && visible[i])
+		{
+			last = (size_t)(mesh.Meshlets[i].TriangleOffset + mesh.Meshlets[i].TriangleCount) * 3;
+			++i;
+		}
+		out.insert(out.end(), mesh.Indices.begin() + first, mesh.Indices.begin() + last);
+	}
+	return (UINT)(out.size() - start);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "FrameResource.hpp"
+#include "MeshGeometry.hpp"
+
+// A cluster of at most MaxVertices vertices and MaxTriangles triangles of one submesh.
+struct Meshlet
+{
+	static const UINT MaxVertices = 64;
+	static const UINT MaxTriangles = 124;
+
+	UINT VertexOffset = 0;   // into MeshletMesh::Vertices
+	UINT VertexCount = 0;
+	UINT TriangleOffset = 0; // into MeshletMesh::Primitives (x3) and MeshletMesh::Indices (x3)
+	UINT TriangleCount = 0;
+
+	// Object-space bounds of the cluster
+	BoundingSphere Bounds;
+
+	// Backface cone: every triangle normal lies within the cone around ConeAxis.
+	// ConeCutoff is the sine of the cone half angle, values > 1 mean the cluster can not be cone culled.
+	XMFLOAT3 ConeAxis = { 0.0f, 0.0f, 1.0f };
+	float ConeCutoff = 2.0f;
+};
+
+// Meshlet decomposition of one submesh. Vertex indices are relative to the submesh BaseVertexLocation.
+struct MeshletMesh
+{
+	std::vector<Meshlet> Meshlets;
+	std::vector<std::uint32_t> Vertices;  // unique vertices per meshlet
+	std::vector<std::uint8_t> Primitives; // meshlet local triangle list
+	std::vector<std::uint32_t> Indices;   // the same triangles expanded to vertex indices, in meshlet order
+
+	UINT TriangleCount() const { return (UINT)Indices.size() / 3; }
+};
+
+struct MeshletCullStats
+{
+	UINT Meshlets = 0;
+	UINT VisibleMeshlets = 0;
+	UINT FrustumCulled = 0;
+	UINT ConeCulled = 0;
+	UINT64 Triangles = 0;
+	UINT64 VisibleTriangles = 0;
+	double CullMs = 0.0;
+
+	float CulledFraction() const { return Triangles ? 1.0f - (float)VisibleTriangles / (float)Triangles : 0.0f; }
+	void Merge(const MeshletCullStats& rhs);
+};
+
+namespace Meshlets
+{
+	// Splits a triangle list into meshlets. Triangles are grown greedily over shared vertices,
+	// preferring the candidate that adds the fewest new vertices, so clusters stay spatially compact.
+	MeshletMesh Build(const Vertex* vertices, size_t vertexCount, const std::uint32_t* indices, size_t indexCount);
+
+	// Builds the meshlets of the submesh from the CPU copies of geo's vertex and index buffers.
+	MeshletMesh BuildSubmesh(const MeshGeometry& geo, const SubmeshGeometry& submesh);
+
+	// Frustum and backface cone test of every meshlet against one instance, both given in object space.
+	// visible[i] is set for surviving meshlets and left untouched otherwise, so several instances can be or-ed.
+	// Only the per meshlet counters of stats are updated, triangle counts are up to the caller.
+	void Cull(const MeshletMesh& mesh, const BoundingFrustum& localFrustum, const XMFLOAT3& localEyePos,
+		std::vector<std::uint8_t>& visible, MeshletCullStats& stats);
+
+	// Appends the index ranges of all visible meshlets to out, merging adjacent ranges. Returns the appended index count.
+	UINT Compact(const MeshletMesh& mesh, const std::vector<std::uint8_t>& visible, std::vector<std::uint32_t>& out);
+}
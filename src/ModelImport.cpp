@@ -0,0 +1,128 @@
+﻿#include "ModelImport.h"
+#include <assimp/postprocess.h>
+
+#pragma comment(lib, "assimp-vc143-mtd.lib")
+
+namespace
+{
+	// 关键：预烘焙节点变换 + 生成法线/切线 + 其它实时友好优化
+	const unsigned int ModelImportFlags =
+		aiProcess_Triangulate |
+		aiProcess_ConvertToLeftHanded |
+		aiProcess_PreTransformVertices |      // ★ 将所有 aiNode 的变换应用到顶点
+		aiProcess_GenSmoothNormals |          // ★ 若模型无法线则生成平滑法线
+		aiProcess_CalcTangentSpace |          // ★ 生成切线/副切线（法线贴图/各向异性用）
+		aiProcess_ImproveCacheLocality |
+		aiProcess_JoinIdenticalVertices |
+		aiProcess_SortByPType;
+
+	// 顶点属性（已被 PreTransformVertices 应用节点矩阵）
+	void ConvertVertex(const aiMesh* mesh, unsigned int i, Vertex& out)
+	{
+		// 位置
+		const aiVector3D& p = mesh->mVertices[i];
+		out.Pos = XMFLOAT3(p.x, p.y, p.z);
+
+		// 法线（若原模型没有，已由 GenSmoothNormals 生成；Assimp 会保证存在）
+		const aiVector3D& n = mesh->mNormals[i];
+		out.Normal = XMFLOAT3(n.x, n.y, n.z);
+
+		// 切线（没有也无所谓，置 0）
+		if (mesh->HasTangentsAndBitangents())
+		{
+			const aiVector3D& t = mesh->mTangents[i];
+			out.TangentU = XMFLOAT3(t.x, t.y, t.z);
+		}
+		else
+		{
+			out.TangentU = XMFLOAT3(0, 0, 0);
+		}
+
+		// UV（若不存在就置零）
+		if (mesh->HasTextureCoords(0))
+		{
+			const aiVector3D& uv = mesh->mTextureCoords[0][i];
+			out.TexC = XMFLOAT2(uv.x, uv.y);
+		}
+		else
+		{
+			out.TexC = XMFLOAT2(0, 0);
+		}
+	}
+}
+
+void LoadModels(const char* modelFilename, std::vector<Mesh>& meshes)
+{
+	assert(modelFilename != nullptr);
+	const std::string filePath(modelFilename);
+
+	Assimp::Importer importer;
+
+	const aiScene* scene = importer.ReadFile(filePath.c_str(), ModelImportFlags);
+	assert(scene && scene->HasMeshes());
+
+	for (unsigned int mi = 0; mi < scene->mNumMeshes; ++mi)
+	{
+		const aiMesh* mesh = scene->mMeshes[mi];
+		assert(mesh);
+
+		Mesh out;
+		out.vertices.resize(mesh->mNumVertices);
+		for (unsigned int i = 0; i < mesh->mNumVertices; ++i)
+			ConvertVertex(mesh, i, out.vertices[i]);
+
+		// 索引（三角面）
+		out.indices.reserve(mesh->mNumFaces * 3);
+		for (unsigned int f = 0; f < mesh->mNumFaces; ++f)
+		{
+			const aiFace& face = mesh->mFaces[f];
+			assert(face.mNumIndices == 3);
+			out.indices.push_back(face.mIndices[0]);
+			out.indices.push_back(face.mIndices[1]);
+			out.indices.push_back(face.mIndices[2]);
+		}
+
+		meshes.push_back(std::move(out));
+	}
+}
+
+ModelImport ImportModel(const char* modelFilename)
+{
+	assert(modelFilename != nullptr);
+
+	ModelImport model;
+	model.Importer = std::make_unique<Assimp::Importer>();
+	model.Scene = model.Importer->ReadFile(modelFilename, ModelImportFlags);
+	assert(model.Scene && model.Scene->HasMeshes());
+
+	for (unsigned int mi = 0; mi < model.Scene->mNumMeshes; ++mi)
+	{
+		model.VertexCount += model.Scene->mMeshes[mi]->mNumVertices;
+		model.IndexCount += model.Scene->mMeshes[mi]->mNumFaces * 3;
+	}
+	return model;
+}
+
+void WriteModel(const ModelImport& model, ArenaSubmesh& dst)
+{
+	assert(dst.VertexCount == model.VertexCount && dst.IndexCount == model.IndexCount);
+
+	UINT baseVertex = 0;
+	UINT index = 0;
+	for (unsigned int mi = 0; mi < model.Scene->mNumMeshes; ++mi)
+	{
+		const aiMesh* mesh = model.Scene->mMeshes[mi];
+		for (unsigned int i = 0; i < mesh->mNumVertices; ++i)
+			ConvertVertex(mesh, i, dst.Vertices[baseVertex + i]);
+
+		for (unsigned int f = 0; f < mesh->mNumFaces; ++f)
+		{
+			const aiFace& face = mesh->mFaces[f];
+			assert(face.mNumIndices == 3);
+			dst.SetIndex(index++, face.mIndices[0] + baseVertex);
+			dst.SetIndex(index++, face.mIndices[1] + baseVertex);
+			dst.SetIndex(index++, face.mIndices[2] + baseVertex);
+		}
+		baseVertex += mesh->mNumVertices;
+	}
+}
@@ -0,0 +1,30 @@
+﻿#pragma once
+#include "FrameResource.hpp"
+#include "GeometryArena.h"
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <memory>
+#include <vector>
+
+struct Mesh
+{
+	std::vector<Vertex> vertices;
+	std::vector<std::uint32_t> indices;
+};
+
+// An opened model whose sizes are known before anything is converted.
+struct ModelImport
+{
+	std::unique_ptr<Assimp::Importer> Importer; // owns Scene
+	const aiScene* Scene = nullptr;
+	UINT VertexCount = 0;
+	UINT IndexCount = 0;
+};
+
+// Per mesh copies merged afterwards by MergeMeshesRange. Only kept to measure GeometryArena against.
+void LoadModels(const char* modelFilename, std::vector<Mesh>& meshes);
+
+ModelImport ImportModel(const char* modelFilename);
+
+// Converts every mesh of the scene straight into dst, merged into one submesh.
+void WriteModel(const ModelImport& model, ArenaSubmesh& dst);
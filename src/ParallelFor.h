@@ -0,0 +1,44 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Runs body(begin, end) over [0, count) in chunks of grain items on short lived worker threads.
+// Meant for bulk load time work such as texture decompression, the calling thread takes part.
+template<typename Body>
+void ParallelFor(size_t count, size_t grain, Body&& body)
+{
+	if (count == 0)
+		return;
+	grain = std::max<size_t>(grain, 1);
+
+	const size_t chunks = (count + grain - 1) / grain;
+	const size_t workers = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), chunks);
+	if (workers <= 1)
+	{
+		body(size_t(0), count);
+		return;
+	}
+
+	std::atomic<size_t> next{ 0 };
+	auto run = [&]()
+	{
+		for (;;)
+		{
+			size_t begin = next.fetch_add(grain);
+			if (begin >= count)
+				break;
+			body(begin, std::min(begin + grain, count));
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(workers - 1);
+	for (size_t i = 0; i + 1 < workers; ++i)
+		threads.emplace_back(run);
+	run();
+	for (auto& t : threads)
+		t.join();
+}
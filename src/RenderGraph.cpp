@@ -0,0 +1,649 @@
+#include "RenderGraph.h"
+#include <chrono>
+#include <queue>
+
+namespace
+{
+	UINT BytesPerPixel(DXGI_FORMAT format)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_R32G32B32A32_FLOAT:
+			return 16;
+		case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		case DXGI_FORMAT_R16G16B16A16_UNORM:
+		case DXGI_FORMAT_R32G32_FLOAT:
+			return 8;
+		case DXGI_FORMAT_R16_UNORM:
+		case DXGI_FORMAT_R16_FLOAT:
+		case DXGI_FORMAT_R16_TYPELESS:
+		case DXGI_FORMAT_D16_UNORM:
+			return 2;
+		case DXGI_FORMAT_R8_UNORM:
+			return 1;
+		default:
+			return 4; // RGBA8, R32, depth 24/8 and 32, R11G11B10, R10G10B10A2
+		}
+	}
+
+	UINT64 AlignUp(UINT64 value, UINT64 alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	UINT64 EstimatedAlignment(const RGTextureDesc& desc)
+	{
+		return desc.SampleCount > 1 ? D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT : D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	}
+
+	UINT FullMipChain(UINT width, UINT height)
+	{
+		UINT levels = 1;
+		for (UINT size = std::max(width, height); size > 1; size /= 2)
+			++levels;
+		return levels;
+	}
+}
+
+void RenderGraph::Reset()
+{
+	mTextures.clear();
+	mPasses.clear();
+	mOrder.clear();
+	mStats = Stats();
+}
+
+UINT RenderGraph::CreateTexture(const char* name, const RGTextureDesc& desc)
+{
+	Texture texture;
+	texture.Name = name;
+	texture.Desc = desc;
+	mTextures.push_back(texture);
+	return (UINT)mTextures.size() - 1;
+}
+
+UINT RenderGraph::CreateExternalTexture(const char* name, const RGTextureDesc& desc)
+{
+	UINT texture = CreateTexture(name, desc);
+	mTextures[texture].External = true;
+	return texture;
+}
+
+UINT RenderGraph::ImportTexture(const char* name, const RGTextureDesc& desc)
+{
+	UINT texture = CreateTexture(name, desc);
+	mTextures[texture].Imported = true;
+	return texture;
+}
+
+UINT RenderGraph::AddPass(const char* name, ExecuteFn execute)
+{
+	Pass pass;
+	pass.Name = name;
+	pass.Execute = std::move(execute);
+	mPasses.push_back(std::move(pass));
+	return (UINT)mPasses.size() - 1;
+}
+
+void RenderGraph::Read(UINT pass, UINT texture)
+{
+	assert(pass < PassCount() && texture < TextureCount());
+	mPasses[pass].Reads.push_back(texture);
+	mTextures[texture].Readers.push_back(pass);
+}
+
+void RenderGraph::Write(UINT pass, UINT texture)
+{
+	assert(pass < PassCount() && texture < TextureCount());
+	mPasses[pass].Writes.push_back(texture);
+	mTextures[texture].Writers.push_back(pass);
+}
+
+void RenderGraph::SetSideEffect(UINT pass)
+{
+	mPasses[pass].SideEffect = true;
+}
+
+void RenderGraph::SetAllocation(UINT texture, UINT64 size, UINT64 alignment)
+{
+	assert(texture < TextureCount() && alignment > 0);
+	mTextures[texture].AllocationSize = size;
+	mTextures[texture].AllocationAlignment = alignment;
+}
+
+void RenderGraph::SetResource(UINT texture, ID3D12Resource* resource)
+{
+	assert(mTextures[texture].Offset != Invalid);
+	mTextures[texture].Resource = resource;
+}
+
+void RenderGraph::Compile()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	Cull();
+	Sort();
+	ComputeLifetimes();
+	Alias();
+	auto end = std::chrono::high_resolution_clock::now();
+	mStats.CompileMs = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void RenderGraph::Execute(ID3D12GraphicsCommandList* cmdList) const
+{
+	std::vector<D3D12_RESOURCE_BARRIER> barriers;
+	for (UINT i = 0; i < (UINT)mOrder.size(); ++i)
+	{
+		// The bytes of a texture starting here were last written through another resource, maybe in the last frame
+		barriers.clear();
+		for (const Texture& texture : mTextures)
+		{
+			if (texture.Aliased && texture.Resource != nullptr && texture.Life.First == i)
+				barriers.push_back(CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, texture.Resource));
+		}
+		if (!barriers.empty())
+			cmdList->ResourceBarrier((UINT)barriers.size(), barriers.data());
+
+		const Pass& pass = mPasses[mOrder[i]];
+		if (pass.Execute)
+			pass.Execute(cmdList);
+	}
+}
+
+void RenderGraph::Cull()
+{
+	// Reference counts: a pass counts the textures it writes, a transient texture the other passes reading it.
+	// Dropping a texture nobody reads releases its writers, a writer left without references is culled and
+	// releases what it read.
+	std::vector<UINT> passRefs(PassCount());
+	std::vector<UINT> textureRefs(TextureCount());
+	std::vector<bool> required(PassCount());
+	for (UINT p = 0; p < PassCount(); ++p)
+	{
+		Pass& pass = mPasses[p];
+		pass.Culled = false;
+		passRefs[p] = (UINT)pass.Writes.size();
+		required[p] = pass.SideEffect;
+		for (UINT t : pass.Writes)
+			required[p] = required[p] || mTextures[t].Imported;
+	}
+	for (UINT t = 0; t < TextureCount(); ++t)
+	{
+		for (UINT reader : mTextures[t].Readers)
+		{
+			const std::vector<UINT>& writes = mPasses[reader].Writes;
+			if (std::find(writes.begin(), writes.end(), t) == writes.end())
+				textureRefs[t]++;
+		}
+	}
+
+	std::vector<UINT> unread;
+	auto cull = [&](UINT p)
+	{
+		mPasses[p].Culled = true;
+		for (UINT t : mPasses[p].Reads)
+		{
+			const std::vector<UINT>& writes = mPasses[p].Writes;
+			if (std::find(writes.begin(), writes.end(), t) != writes.end())
+				continue;
+			if (--textureRefs[t] == 0 && !mTextures[t].Imported)
+				unread.push_back(t);
+		}
+	};
+	for (UINT p = 0; p < PassCount(); ++p)
+	{
+		if (passRefs[p] == 0 && !required[p])
+			cull(p);
+	}
+	for (UINT t = 0; t < TextureCount(); ++t)
+	{
+		if (textureRefs[t] == 0 && !mTextures[t].Imported)
+			unread.push_back(t);
+	}
+	while (!unread.empty())
+	{
+		const UINT t = unread.back();
+		unread.pop_back();
+		for (UINT writer : mTextures[t].Writers)
+		{
+			if (!required[writer] && !mPasses[writer].Culled && --passRefs[writer] == 0)
+				cull(writer);
+		}
+	}
+}
+
+void RenderGraph::Sort()
+{
+	// Edges from every kept writer of a texture to its kept readers and from each kept writer to the next one
+	std::vector<std::vector<UINT>> successors(PassCount());
+	std::vector<UINT> predecessors(PassCount());
+	auto edge = [&](UINT from, UINT to)
+	{
+		if (from == to)
+			return;
+		successors[from].push_back(to);
+		predecessors[to]++;
+	};
+	for (const Texture& texture : mTextures)
+	{
+		UINT previous = Invalid;
+		for (UINT writer : texture.Writers)
+		{
+			if (mPasses[writer].Culled)
+				continue;
+			if (previous != Invalid)
+				edge(previous, writer);
+			previous = writer;
+			for (UINT reader : texture.Readers)
+			{
+				if (!mPasses[reader].Culled)
+					edge(writer, reader);
+			}
+		}
+	}
+
+	std::priority_queue<UINT, std::vector<UINT>, std::greater<UINT>> ready;
+	UINT kept = 0;
+	for (UINT p = 0; p < PassCount(); ++p)
+	{
+		if (mPasses[p].Culled)
+			continue;
+		++kept;
+		if (predecessors[p] == 0)
+			ready.push(p);
+	}
+	mOrder.clear();
+	while (!ready.empty())
+	{
+		const UINT p = ready.top();
+		ready.pop();
+		mOrder.push_back(p);
+		for (UINT next : successors[p])
+		{
+			if (--predecessors[next] == 0)
+				ready.push(next);
+		}
+	}
+	// Short when passes wait on each other in a cycle
+	assert(mOrder.size() == kept);
+
+	mStats.Passes = PassCount();
+	mStats.CulledPasses = PassCount() - kept;
+}
+
+void RenderGraph::ComputeLifetimes()
+{
+	for (Texture& texture : mTextures)
+	{
+		texture.Life = Lifetime();
+		texture.Size = texture.AllocationSize > 0 ? texture.AllocationSize : TextureBytes(texture.Desc);
+		texture.Offset = Invalid;
+		texture.Aliased = false;
+		texture.Resource = nullptr;
+	}
+	for (UINT i = 0; i < (UINT)mOrder.size(); ++i)
+	{
+		const Pass& pass = mPasses[mOrder[i]];
+		for (const std::vector<UINT>* uses : { &pass.Reads, &pass.Writes })
+		{
+			for (UINT t : *uses)
+			{
+				Lifetime& life = mTextures[t].Life;
+				life.First = std::min(life.First, i);
+				life.Last = life.Last == Invalid ? i : std::max(life.Last, i);
+			}
+		}
+	}
+}
+
+void RenderGraph::Alias()
+{
+	std::vector<UINT> transients;
+	for (UINT t = 0; t < TextureCount(); ++t)
+	{
+		if (!mTextures[t].Imported && !mTextures[t].External && mTextures[t].Life.First != Invalid)
+			transients.push_back(t);
+	}
+
+	// Biggest first, each at the lowest offset clear of the textures already placed that live at the same time
+	std::stable_sort(transients.begin(), transients.end(),
+		[&](UINT a, UINT b) { return mTextures[a].Size > mTextures[b].Size; });
+	std::vector<UINT> placed;
+	mStats.Transients = (UINT)transients.size();
+	mStats.TransientBytes = 0;
+	mStats.AliasedBytes = 0;
+	for (UINT t : transients)
+	{
+		Texture& texture = mTextures[t];
+		const UINT64 alignment = texture.AllocationAlignment > 0 ? texture.AllocationAlignment : EstimatedAlignment(texture.Desc);
+		std::vector<UINT> live;
+		std::vector<UINT64> candidates = { 0 };
+		for (UINT other : placed)
+		{
+			const Texture& o = mTextures[other];
+			if (o.Life.First <= texture.Life.Last && texture.Life.First <= o.Life.Last)
+			{
+				live.push_back(other);
+				candidates.push_back(AlignUp(o.Offset + o.Size, alignment));
+			}
+		}
+		std::sort(candidates.begin(), candidates.end());
+		for (UINT64 offset : candidates)
+		{
+			bool clear = true;
+			for (UINT other : live)
+			{
+				const Texture& o = mTextures[other];
+				if (offset < o.Offset + o.Size && o.Offset < offset + texture.Size)
+				{
+					clear = false;
+					break;
+				}
+			}
+			if (clear)
+			{
+				texture.Offset = offset;
+				break;
+			}
+		}
+		for (UINT other : placed)
+		{
+			Texture& o = mTextures[other];
+			if (texture.Offset < o.Offset + o.Size && o.Offset < texture.Offset + texture.Size)
+				texture.Aliased = o.Aliased = true;
+		}
+		placed.push_back(t);
+		mStats.TransientBytes += texture.Size;
+		mStats.AliasedBytes = std::max(mStats.AliasedBytes, texture.Offset + texture.Size);
+	}
+
+	mStats.PeakLiveBytes = 0;
+	for (UINT i = 0; i < (UINT)mOrder.size(); ++i)
+	{
+		UINT64 live = 0;
+		for (UINT t : transients)
+		{
+			if (mTextures[t].Life.First <= i && i <= mTextures[t].Life.Last)
+				live += mTextures[t].Size;
+		}
+		mStats.PeakLiveBytes = std::max(mStats.PeakLiveBytes, live);
+	}
+}
+
+UINT64 RenderGraph::TextureBytes(const RGTextureDesc& desc)
+{
+	UINT64 bytes = 0;
+	UINT width = desc.Width;
+	UINT height = desc.Height;
+	for (UINT mip = 0; mip < std::max(desc.MipLevels, 1u); ++mip)
+	{
+		bytes += (UINT64)width * height * BytesPerPixel(desc.Format);
+		width = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+	}
+	return AlignUp(bytes * std::max(desc.SampleCount, 1u), EstimatedAlignment(desc));
+}
+
+DeferredFrameTextures DeclareDeferredFrame(RenderGraph& graph, UINT width, UINT height, bool ssr, const DeferredFramePasses& passes)
+{
+	auto desc = [](UINT w, UINT h, DXGI_FORMAT format, UINT mips = 1)
+	{
+		RGTextureDesc d;
+		d.Width = w;
+		d.Height = h;
+		d.Format = format;
+		d.MipLevels = mips;
+		return d;
+	};
+
+	// ShadowMap, the depth buffer, HiZBuffer and Ssao create their own resources
+	DeferredFrameTextures textures;
+	const UINT backBuffer = textures.BackBuffer = graph.ImportTexture("Back Buffer", desc(width, height, DXGI_FORMAT_R8G8B8A8_UNORM));
+	const UINT shadowMap = textures.ShadowMap = graph.CreateExternalTexture("Shadow Map", desc(2048, 2048, DXGI_FORMAT_R24G8_TYPELESS));
+	const UINT depth = textures.Depth = graph.CreateExternalTexture("Depth", desc(width, height, DXGI_FORMAT_D24_UNORM_S8_UINT));
+	const UINT albedo = textures.Albedo = graph.CreateTexture("GBuffer Albedo", desc(width, height, DXGI_FORMAT_R8G8B8A8_UNORM));
+	const UINT normal = textures.Normal = graph.CreateTexture("GBuffer Normal", desc(width, height, DXGI_FORMAT_R16G16B16A16_FLOAT));
+	const UINT position = textures.Position = graph.CreateTexture("GBuffer Position", desc(width, height, DXGI_FORMAT_R16G16B16A16_FLOAT));
+	const UINT hiZ = textures.HiZ = graph.CreateExternalTexture("HiZ", desc(width, height, DXGI_FORMAT_R32_FLOAT, FullMipChain(width, height)));
+	const UINT ambient = textures.Ambient = graph.CreateExternalTexture("SSAO Ambient", desc(width / 2, height / 2, DXGI_FORMAT_R16_UNORM));
+	const UINT ambientBlurred = textures.AmbientBlurred =
+		graph.CreateExternalTexture("SSAO Ambient Blurred", desc(width / 2, height / 2, DXGI_FORMAT_R16_UNORM));
+	const UINT sceneColor = textures.SceneColor = graph.CreateTexture("Scene Color", desc(width, height, DXGI_FORMAT_R8G8B8A8_UNORM));
+
+	UINT pass = graph.AddPass("Shadow", passes.Shadow);
+	graph.Write(pass, shadowMap);
+
+	pass = graph.AddPass("GBuffer", passes.GBuffer);
+	for (UINT target : { albedo, normal, position, depth })
+		graph.Write(pass, target);
+
+	pass = graph.AddPass("HiZ", passes.HiZ);
+	graph.Read(pass, depth);
+	graph.Write(pass, hiZ);
+
+	pass = graph.AddPass("SSAO", passes.Ssao);
+	graph.Read(pass, normal);
+	graph.Read(pass, depth);
+	graph.Write(pass, ambient);
+
+	pass = graph.AddPass("SSAO Blur", passes.SsaoBlur);
+	graph.Read(pass, ambient);
+	graph.Read(pass, normal);
+	graph.Read(pass, depth);
+	graph.Write(pass, ambientBlurred);
+
+	pass = graph.AddPass("Lighting", passes.Lighting);
+	for (UINT input : { albedo, normal, position, shadowMap })
+		graph.Read(pass, input);
+	graph.Write(pass, sceneColor);
+
+	if (ssr)
+	{
+		const UINT reflections = textures.Reflections = graph.CreateTexture("SSR", desc(width, height, DXGI_FORMAT_R16G16B16A16_FLOAT));
+		pass = graph.AddPass("SSR", passes.Ssr);
+		for (UINT input : { albedo, normal, position, depth, hiZ, sceneColor })
+			graph.Read(pass, input);
+		graph.Write(pass, reflections);
+
+		// The albedo alpha masks out the sky
+		pass = graph.AddPass("SSR Composite", passes.SsrComposite);
+		graph.Read(pass, sceneColor);
+		graph.Read(pass, reflections);
+		graph.Read(pass, albedo);
+		graph.Write(pass, backBuffer);
+	}
+	else
+	{
+		pass = graph.AddPass("Composite", passes.Composite);
+		graph.Read(pass, sceneColor);
+		graph.Write(pass, backBuffer);
+	}
+
+	pass = graph.AddPass("Sky", passes.Sky);
+	graph.Read(pass, depth);
+	graph.Write(pass, backBuffer);
+
+	pass = graph.AddPass("ImGui", passes.Overlay);
+	graph.Write(pass, backBuffer);
+	return textures;
+}
+
+std::vector<RenderGraphMemory> MeasureDeferredFrameMemory()
+{
+	std::vector<RenderGraphMemory> results;
+	const UINT sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+	for (const auto& size : sizes)
+	{
+		for (bool ssr : { true, false })
+		{
+			RenderGraph graph;
+			DeclareDeferredFrame(graph, size[0], size[1], ssr, DeferredFramePasses());
+			graph.Compile();
+
+			RenderGraphMemory result;
+			result.Width = size[0];
+			result.Height = size[1];
+			result.Ssr = ssr;
+			result.Stats = graph.GetStats();
+			results.push_back(result);
+		}
+	}
+	return results;
+}
+
+namespace
+{
+	// Transient textures alive at the same pass never share bytes
+	bool PlacementIsSound(const RenderGraph& graph)
+	{
+		for (UINT a = 0; a < graph.TextureCount(); ++a)
+		{
+			for (UINT b = a + 1; b < graph.TextureCount(); ++b)
+			{
+				if (graph.Offset(a) == RenderGraph::Invalid || graph.Offset(b) == RenderGraph::Invalid)
+					continue;
+				const RenderGraph::Lifetime la = graph.LifetimeOf(a);
+				const RenderGraph::Lifetime lb = graph.LifetimeOf(b);
+				const bool together = la.First <= lb.Last && lb.First <= la.Last;
+				const bool shared = graph.Offset(a) < graph.Offset(b) + graph.Size(b) && graph.Offset(b) < graph.Offset(a) + graph.Size(a);
+				if (together && shared)
+					return false;
+			}
+		}
+		return true;
+	}
+}
+
+UINT VerifyRenderGraph(std::string* failure)
+{
+	UINT failures = 0;
+	auto check = [&](bool condition, const char* what)
+	{
+		if (condition)
+			return;
+		if (failures++ == 0 && failure != nullptr)
+			*failure = what;
+	};
+
+	RGTextureDesc target;
+	target.Width = 1024;
+	target.Height = 1024;
+	const UINT64 targetBytes = RenderGraph::TextureBytes(target);
+
+	// A chain into an imported texture, a chain nobody reads and a side effect pass
+	{
+		RenderGraph graph;
+		const UINT out = graph.ImportTexture("out", target);
+		const UINT t0 = graph.CreateTexture("t0", target);
+		const UINT t1 = graph.CreateTexture("t1", target);
+		const UINT t2 = graph.CreateTexture("t2", target);
+		const UINT t3 = graph.CreateTexture("t3", target);
+		const UINT t4 = graph.CreateTexture("t4", target);
+		const UINT a = graph.AddPass("a");
+		graph.Write(a, t0);
+		const UINT b = graph.AddPass("b");
+		graph.Read(b, t0);
+		graph.Write(b, t1);
+		const UINT c = graph.AddPass("c");
+		graph.Read(c, t1);
+		graph.Write(c, out);
+		const UINT d = graph.AddPass("d");
+		graph.Write(d, t2);
+		const UINT e = graph.AddPass("e");
+		graph.Read(e, t2);
+		graph.Write(e, t3);
+		const UINT f = graph.AddPass("f");
+		graph.Write(f, t4);
+		const UINT g = graph.AddPass("g");
+		graph.Read(g, t4);
+		graph.SetSideEffect(g);
+		graph.Compile();
+
+		check(!graph.IsCulled(a) && !graph.IsCulled(b) && !graph.IsCulled(c), "culled a pass writing into an output");
+		check(graph.IsCulled(d) && graph.IsCulled(e), "kept a chain nobody reads");
+		check(!graph.IsCulled(f) && !graph.IsCulled(g), "culled a side effect pass or its input");
+		check(graph.Order() == std::vector<UINT>({ a, b, c, f, g }), "wrong order of a chain");
+		check(graph.Offset(t2) == RenderGraph::Invalid, "allocated a texture of culled passes");
+	}
+
+	// Passes added consumers first still run producers first
+	{
+		RenderGraph graph;
+		const UINT out = graph.ImportTexture("out", target);
+		const UINT t0 = graph.CreateTexture("t0", target);
+		const UINT t1 = graph.CreateTexture("t1", target);
+		const UINT c = graph.AddPass("c");
+		graph.Read(c, t1);
+		graph.Write(c, out);
+		const UINT b = graph.AddPass("b");
+		graph.Read(b, t0);
+		graph.Write(b, t1);
+		const UINT a = graph.AddPass("a");
+		graph.Write(a, t0);
+		graph.Compile();
+		check(graph.Order() == std::vector<UINT>({ a, b, c }), "passes added out of order were not sorted");
+	}
+
+	// Four passes in a chain: t0 and t2 never live together and share their memory
+	{
+		RenderGraph graph;
+		const UINT out = graph.ImportTexture("out", target);
+		UINT t[3];
+		for (UINT i = 0; i < 3; ++i)
+			t[i] = graph.CreateTexture("t", target);
+		UINT pass = graph.AddPass("p0");
+		graph.Write(pass, t[0]);
+		for (UINT i = 1; i < 3; ++i)
+		{
+			pass = graph.AddPass("p");
+			graph.Read(pass, t[i - 1]);
+			graph.Write(pass, t[i]);
+		}
+		pass = graph.AddPass("p3");
+		graph.Read(pass, t[2]);
+		graph.Write(pass, out);
+		graph.Compile();
+
+		const RenderGraph::Lifetime life = graph.LifetimeOf(t[1]);
+		check(life.First == 1 && life.Last == 2, "wrong lifetime");
+		check(graph.Offset(t[0]) == graph.Offset(t[2]), "disjoint lifetimes did not share memory");
+		check(graph.IsAliased(t[0]) && graph.IsAliased(t[2]) && !graph.IsAliased(t[1]), "wrong textures need aliasing barriers");
+		check(graph.GetStats().TransientBytes == 3 * targetBytes, "wrong transient bytes");
+		check(graph.GetStats().AliasedBytes == 2 * targetBytes, "wrong aliased heap size");
+		check(graph.GetStats().PeakLiveBytes == 2 * targetBytes, "wrong peak live bytes");
+		check(PlacementIsSound(graph), "overlapping lifetimes share memory");
+	}
+
+	// An external texture orders its passes but takes no heap space, allocation sizes replace the estimates
+	{
+		RenderGraph graph;
+		const UINT out = graph.ImportTexture("out", target);
+		const UINT external = graph.CreateExternalTexture("external", target);
+		const UINT t0 = graph.CreateTexture("t0", target);
+		graph.SetAllocation(t0, targetBytes + 1, 1 << 16);
+		UINT pass = graph.AddPass("p0");
+		graph.Write(pass, external);
+		pass = graph.AddPass("p1");
+		graph.Read(pass, external);
+		graph.Write(pass, t0);
+		pass = graph.AddPass("p2");
+		graph.Read(pass, t0);
+		graph.Write(pass, out);
+		graph.Compile();
+		check(graph.GetStats().CulledPasses == 0, "culled the writer of an external texture that is read");
+		check(graph.Offset(external) == RenderGraph::Invalid, "placed an external texture");
+		check(graph.Size(t0) == targetBytes + 1 && graph.GetStats().AliasedBytes == targetBytes + 1, "ignored the allocation size");
+	}
+
+	for (bool ssr : { true, false })
+	{
+		RenderGraph graph;
+		const DeferredFrameTextures textures = DeclareDeferredFrame(graph, 1920, 1080, ssr, DeferredFramePasses());
+		graph.Compile();
+		check(PlacementIsSound(graph), "overlapping lifetimes share memory in the deferred frame");
+		check(graph.GetStats().Transients == (ssr ? 5u : 4u) && graph.Offset(textures.Depth) == RenderGraph::Invalid,
+			"deferred frame placed textures it does not own");
+		check(graph.GetStats().CulledPasses == (ssr ? 2u : 3u), "deferred frame culled the wrong passes");
+		check(graph.GetStats().AliasedBytes <= graph.GetStats().TransientBytes, "aliasing grew the deferred frame");
+	}
+	return failures;
+}
@@ -0,0 +1,185 @@
+#pragma once
+#include "D3D12Shim.h"
+#include <functional>
+
+struct RGTextureDesc
+{
+	UINT Width = 0;
+	UINT Height = 0;
+	DXGI_FORMAT Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	UINT MipLevels = 1;
+	UINT SampleCount = 1;
+};
+
+// Passes of one frame declare the textures they read and write, Compile then works out which passes matter, their
+// order and how long each transient texture lives, and packs the transient ones into one heap where textures
+// whose lifetimes do not overlap share memory. Compiling touches no device, the graph only records what the
+// passes do through their Execute functions. The owner creates the placed resources at the computed offsets and
+// hands them back through SetResource, Execute then issues their aliasing barriers.
+//
+// Order: a pass reading a texture runs after every pass writing it, passes writing the same texture run in the
+// order they were added. Among passes free to run the earliest added goes first.
+// Culling: a pass is kept when it has side effects, writes an imported texture or writes a texture a kept pass
+// reads.
+class RenderGraph
+{
+public:
+	typedef std::function<void(ID3D12GraphicsCommandList*)> ExecuteFn;
+	static const UINT Invalid = UINT_MAX;
+
+	struct Lifetime
+	{
+		UINT First = Invalid; // position in Order of the first and last kept pass using the texture
+		UINT Last = Invalid;
+	};
+
+	struct Stats
+	{
+		UINT Passes = 0;
+		UINT CulledPasses = 0;
+		UINT Transients = 0;         // placed transient textures used by kept passes
+		UINT64 TransientBytes = 0;   // every transient texture in memory of its own
+		UINT64 AliasedBytes = 0;     // size of the heap they share
+		UINT64 PeakLiveBytes = 0;    // most bytes alive at one pass, no packing does better
+		double CompileMs = 0.0;
+	};
+
+	void Reset();
+
+	// Lives within the frame, memory may be shared with other transient textures
+	UINT CreateTexture(const char* name, const RGTextureDesc& desc);
+	// Lives within the frame in a resource created outside the graph: culled and ordered like the other transient
+	// textures but given no place in the heap
+	UINT CreateExternalTexture(const char* name, const RGTextureDesc& desc);
+	// Lives beyond the frame (back buffer, history), never shares memory and its writers are never culled
+	UINT ImportTexture(const char* name, const RGTextureDesc& desc);
+
+	UINT AddPass(const char* name, ExecuteFn execute = nullptr);
+	void Read(UINT pass, UINT texture);
+	void Write(UINT pass, UINT texture);
+	// The pass has effects outside of the textures it writes, it is never culled
+	void SetSideEffect(UINT pass);
+	// Size and alignment GetResourceAllocationInfo gives for a transient texture, Compile estimates them with
+	// TextureBytes otherwise
+	void SetAllocation(UINT texture, UINT64 size, UINT64 alignment);
+
+	void Compile();
+	// The resource placed at Offset(texture), set after Compile
+	void SetResource(UINT texture, ID3D12Resource* resource);
+	// Runs the kept passes in Order. Before the first pass of a placed texture sharing memory with others it issues
+	// an aliasing barrier, that pass must then write the whole texture first (clear, discard or copy).
+	void Execute(ID3D12GraphicsCommandList* cmdList) const;
+
+	// Kept passes in execution order
+	const std::vector<UINT>& Order() const { return mOrder; }
+	bool IsCulled(UINT pass) const { return mPasses[pass].Culled; }
+	UINT PassCount() const { return (UINT)mPasses.size(); }
+	const char* PassName(UINT pass) const { return mPasses[pass].Name; }
+
+	UINT TextureCount() const { return (UINT)mTextures.size(); }
+	const char* TextureName(UINT texture) const { return mTextures[texture].Name; }
+	bool IsImported(UINT texture) const { return mTextures[texture].Imported; }
+	Lifetime LifetimeOf(UINT texture) const { return mTextures[texture].Life; }
+	// Heap offset of a transient texture used by kept passes, Invalid for the others
+	UINT64 Offset(UINT texture) const { return mTextures[texture].Offset; }
+	UINT64 Size(UINT texture) const { return mTextures[texture].Size; }
+	// Placed and sharing bytes with another placed texture
+	bool IsAliased(UINT texture) const { return mTextures[texture].Aliased; }
+
+	const Stats& GetStats() const { return mStats; }
+
+	// Bytes a placed texture takes: all mips at bytes per pixel of the format, rounded to the 64KB placement
+	// alignment (4MB with MSAA). An estimate of what GetResourceAllocationInfo returns, which adds tiling padding.
+	static UINT64 TextureBytes(const RGTextureDesc& desc);
+
+private:
+	struct Texture
+	{
+		const char* Name = "";
+		RGTextureDesc Desc;
+		bool Imported = false;
+		bool External = false;
+		std::vector<UINT> Writers; // in the order they were added
+		std::vector<UINT> Readers;
+		Lifetime Life;
+		UINT64 AllocationSize = 0; // from SetAllocation, 0 to estimate
+		UINT64 AllocationAlignment = 0;
+		UINT64 Size = 0;
+		UINT64 Offset = Invalid;
+		bool Aliased = false;
+		ID3D12Resource* Resource = nullptr;
+	};
+
+	struct Pass
+	{
+		const char* Name = "";
+		ExecuteFn Execute;
+		std::vector<UINT> Reads;
+		std::vector<UINT> Writes;
+		bool SideEffect = false;
+		bool Culled = false;
+	};
+
+	void Cull();
+	void Sort();
+	void ComputeLifetimes();
+	void Alias();
+
+	std::vector<Texture> mTextures;
+	std::vector<Pass> mPasses;
+	std::vector<UINT> mOrder;
+	Stats mStats;
+};
+
+// The work of each pass of the deferred frame, empty ones for a graph that is only compiled
+struct DeferredFramePasses
+{
+	RenderGraph::ExecuteFn Shadow;
+	RenderGraph::ExecuteFn GBuffer;
+	RenderGraph::ExecuteFn HiZ;
+	RenderGraph::ExecuteFn Ssao;
+	RenderGraph::ExecuteFn SsaoBlur;
+	RenderGraph::ExecuteFn Lighting;
+	RenderGraph::ExecuteFn Ssr;
+	RenderGraph::ExecuteFn SsrComposite;
+	RenderGraph::ExecuteFn Composite;
+	RenderGraph::ExecuteFn Sky;
+	RenderGraph::ExecuteFn Overlay;
+};
+
+// Textures of the deferred frame, Reflections is Invalid without SSR
+struct DeferredFrameTextures
+{
+	UINT BackBuffer = RenderGraph::Invalid;
+	UINT ShadowMap = RenderGraph::Invalid;
+	UINT Depth = RenderGraph::Invalid;
+	UINT Albedo = RenderGraph::Invalid;
+	UINT Normal = RenderGraph::Invalid;
+	UINT Position = RenderGraph::Invalid;
+	UINT HiZ = RenderGraph::Invalid;
+	UINT Ambient = RenderGraph::Invalid;
+	UINT AmbientBlurred = RenderGraph::Invalid;
+	UINT SceneColor = RenderGraph::Invalid;
+	UINT Reflections = RenderGraph::Invalid;
+};
+
+// The frame Draw records at width x height with the formats of GBuffers, SceneColorRT, SSR, HiZBuffer, Ssao and
+// ShadowMap: shadow map, G-buffer, HiZ, lighting into the scene color, SSR and its composite or a plain composite
+// into the back buffer, sky and ImGui. The SSAO passes are declared too, nothing reads the ambient map yet.
+// The G-buffer, scene color and SSR targets are placed by the graph, the others keep the resources of their owners.
+DeferredFrameTextures DeclareDeferredFrame(RenderGraph& graph, UINT width, UINT height, bool ssr, const DeferredFramePasses& passes);
+
+struct RenderGraphMemory
+{
+	UINT Width = 0;
+	UINT Height = 0;
+	bool Ssr = false;
+	RenderGraph::Stats Stats;
+};
+
+// DeclareDeferredFrame compiled at 1920x1080 and 3840x2160, with and without SSR
+std::vector<RenderGraphMemory> MeasureDeferredFrameMemory();
+
+// Compiles small graphs with known results: culling, ordering of passes added out of order, lifetimes and heap
+// offsets. Returns the number of failed checks, the first one described in failure.
+UINT VerifyRenderGraph(std::string* failure = nullptr);
@@ -0,0 +1,226 @@
+#include "RenderQueue.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <random>
+
+UINT SortKey::QuantizeDepth(float viewZ, float nearZ, float farZ)
+{
+	const UINT maxDepth = (1u << DepthBits) - 1;
+	float t = (viewZ - nearZ) / (farZ - nearZ);
+	t = std::min(std::max(t, 0.0f), 1.0f);
+	return (UINT)(t * (float)maxDepth);
+}
+
+UINT64 SortKey::Opaque(UINT layer, UINT pso, UINT geometry, UINT material, UINT depth)
+{
+	assert(layer < (1u << LayerBits) && pso < (1u << PsoBits) && geometry < (1u << GeometryBits) &&
+		material < (1u << MaterialBits) && depth < (1u << DepthBits));
+	UINT64 key = layer;
+	key = (key << PsoBits) | pso;
+	key = (key << GeometryBits) | geometry;
+	key = (key << MaterialBits) | material;
+	key = (key << DepthBits) | depth;
+	return key;
+}
+
+UINT64 SortKey::Transparent(UINT layer, UINT pso, UINT geometry, UINT material, UINT depth)
+{
+	assert(layer < (1u << LayerBits) && pso < (1u << PsoBits) && geometry < (1u << GeometryBits) &&
+		material < (1u << MaterialBits) && depth < (1u << DepthBits));
+	UINT64 key = layer;
+	key = (key << DepthBits) | ((1u << DepthBits) - 1 - depth);
+	key = (key << PsoBits) | pso;
+	key = (key << GeometryBits) | geometry;
+	key = (key << MaterialBits) | material;
+	return key;
+}
+
+UINT SortKey::Layer(UINT64 key)
+{
+	return (UINT)(key >> (64 - LayerBits));
+}
+
+void RadixSort(std::vector<UINT64>& keys, std::vector<UINT>& values, std::vector<UINT64>& scratchKeys, std::vector<UINT>& scratchValues)
+{
+	assert(keys.size() == values.size());
+	const size_t count = keys.size();
+	if (count < 2)
+		return;
+
+	UINT histograms[8][256] = {};
+	for (size_t i = 0; i < count; ++i)
+	{
+		UINT64 key = keys[i];
+		for (int digit = 0; digit < 8; ++digit)
+			histograms[digit][(key >> (digit * 8)) & 0xff]++;
+	}
+
+	scratchKeys.resize(count);
+	scratchValues.resize(count);
+	for (int digit = 0; digit < 8; ++digit)
+	{
+		UINT* histogram = histograms[digit];
+		// Every key has the same digit, the pass would not move anything
+		if (histogram[(keys[0] >> (digit * 8)) & 0xff] == count)
+			continue;
+
+		UINT offset = 0;
+		for (int b = 0; b < 256; ++b)
+		{
+			UINT n = histogram[b];
+			histogram[b] = offset;
+			offset += n;
+		}
+
+		const int shift = digit * 8;
+		for (size_t i = 0; i < count; ++i)
+		{
+			UINT dst = histogram[(keys[i] >> shift) & 0xff]++;
+			scratchKeys[dst] = keys[i];
+			scratchValues[dst] = values[i];
+		}
+		keys.swap(scratchKeys);
+		values.swap(scratchValues);
+	}
+}
+
+void RenderQueue::Clear()
+{
+	mKeys.clear();
+	mItems.clear();
+}
+
+void RenderQueue::Push(UINT64 key, UINT item)
+{
+	mKeys.push_back(key);
+	mItems.push_back(item);
+}
+
+void RenderQueue::Sort()
+{
+	RadixSort(mKeys, mItems, mScratchKeys, mScratchItems);
+}
+
+void DrawStateChanges::Merge(const DrawStateChanges& rhs)
+{
+	Draws += rhs.Draws;
+	Pso += rhs.Pso;
+	VertexBuffers += rhs.VertexBuffers;
+	IndexBuffers += rhs.IndexBuffers;
+	Topologies += rhs.Topologies;
+}
+
+namespace
+{
+	struct SyntheticItem
+	{
+		UINT Layer;
+		UINT Pso;
+		UINT Geometry;
+		UINT Material;
+		float ViewZ;
+	};
+
+	const UINT SyntheticTransparentLayer = 2;
+
+	UINT64 SyntheticKey(const SyntheticItem& item)
+	{
+		UINT depth = SortKey::QuantizeDepth(item.ViewZ, 0.1f, 1000.0f);
+		return item.Layer == SyntheticTransparentLayer ?
+			SortKey::Transparent(item.Layer, item.Pso, item.Geometry, item.Material, depth) :
+			SortKey::Opaque(item.Layer, item.Pso, item.Geometry, item.Material, depth);
+	}
+
+	// Every geometry has its own vertex and index buffer, one in eight is drawn as a line list
+	DrawStateChanges WalkItems(const std::vector<SyntheticItem>& items, const std::vector<UINT>& order)
+	{
+		DrawStateChanges changes;
+		UINT pso = UINT_MAX;
+		UINT geometry = UINT_MAX;
+		UINT topology = UINT_MAX;
+		for (UINT i : order)
+		{
+			const SyntheticItem& item = items[i];
+			if (item.Pso != pso)
+			{
+				pso = item.Pso;
+				++changes.Pso;
+			}
+			if (item.Geometry != geometry)
+			{
+				geometry = item.Geometry;
+				++changes.VertexBuffers;
+				++changes.IndexBuffers;
+			}
+			UINT itemTopology = item.Geometry % 8 == 0 ? 1 : 0;
+			if (itemTopology != topology)
+			{
+				topology = itemTopology;
+				++changes.Topologies;
+			}
+			++changes.Draws;
+		}
+		return changes;
+	}
+}
+
+RenderQueueTiming MeasureRenderQueue(UINT count, int iterations)
+{
+	RenderQueueTiming result;
+	result.Items = count;
+
+	std::mt19937 rng(count);
+	std::uniform_real_distribution<float> viewZ(0.1f, 1000.0f);
+	std::vector<SyntheticItem> items(count);
+	for (SyntheticItem& item : items)
+	{
+		item.Layer = rng() % 3;
+		item.Pso = item.Layer * 4 + rng() % 4;
+		item.Geometry = rng() % 256;
+		item.Material = rng() % 1024;
+		item.ViewZ = viewZ(rng);
+	}
+
+	std::vector<UINT64> keys, scratchKeys;
+	std::vector<UINT> values, scratchValues;
+	auto buildKeys = [&]()
+	{
+		keys.resize(count);
+		values.resize(count);
+		for (UINT i = 0; i < count; ++i)
+		{
+			keys[i] = SyntheticKey(items[i]);
+			values[i] = i;
+		}
+	};
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+	{
+		buildKeys();
+		RadixSort(keys, values, scratchKeys, scratchValues);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	result.RadixMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+	const std::vector<UINT> radixOrder = values;
+
+	std::vector<std::pair<UINT64, UINT>> pairs(count);
+	start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+	{
+		for (UINT i = 0; i < count; ++i)
+			pairs[i] = { SyntheticKey(items[i]), i };
+		std::sort(pairs.begin(), pairs.end());
+	}
+	end = std::chrono::high_resolution_clock::now();
+	result.StdSortMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+
+	std::vector<UINT> submissionOrder(count);
+	for (UINT i = 0; i < count; ++i)
+		submissionOrder[i] = i;
+	result.Unsorted = WalkItems(items, submissionOrder);
+	result.Sorted = WalkItems(items, radixOrder);
+	return result;
+}
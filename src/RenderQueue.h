@@ -0,0 +1,72 @@
+#pragma once
+#include "DXHelper.h"
+
+// Draws ordered by 64 bit sort keys. Opaque keys group by layer, PSO, geometry and material and go front to
+// back within a group, transparent ones put the depth right below the layer so they draw back to front:
+//   opaque       layer 4 | pso 8 | geometry 12 | material 16 | depth 24
+//   transparent  layer 4 | far to near depth 24 | pso 8 | geometry 12 | material 16
+namespace SortKey
+{
+	const UINT LayerBits = 4;
+	const UINT PsoBits = 8;
+	const UINT GeometryBits = 12;
+	const UINT MaterialBits = 16;
+	const UINT DepthBits = 24;
+
+	// viewZ between nearZ and farZ mapped to [0, 2^DepthBits), clamped outside
+	UINT QuantizeDepth(float viewZ, float nearZ, float farZ);
+
+	UINT64 Opaque(UINT layer, UINT pso, UINT geometry, UINT material, UINT depth);
+	UINT64 Transparent(UINT layer, UINT pso, UINT geometry, UINT material, UINT depth);
+
+	UINT Layer(UINT64 key);
+}
+
+// Sorts keys ascending and moves values along, stable. Least significant digit first with 8 bit digits, all
+// histograms are counted in one pass and digits every key shares are skipped. The scratch vectors are resized
+// as needed and may come back swapped with keys and values.
+void RadixSort(std::vector<UINT64>& keys, std::vector<UINT>& values, std::vector<UINT64>& scratchKeys, std::vector<UINT>& scratchValues);
+
+class RenderQueue
+{
+public:
+	void Clear();
+	void Push(UINT64 key, UINT item);
+	void Sort();
+
+	UINT Size() const { return (UINT)mKeys.size(); }
+	UINT64 Key(UINT i) const { return mKeys[i]; }
+	UINT Item(UINT i) const { return mItems[i]; }
+
+private:
+	std::vector<UINT64> mKeys;
+	std::vector<UINT> mItems;
+	std::vector<UINT64> mScratchKeys;
+	std::vector<UINT> mScratchItems;
+};
+
+// State set on the command list while drawing, with the sets a draw loop skipped because the state was bound.
+struct DrawStateChanges
+{
+	UINT Draws = 0;
+	UINT Pso = 0;
+	UINT VertexBuffers = 0;
+	UINT IndexBuffers = 0;
+	UINT Topologies = 0;
+
+	UINT Total() const { return Pso + VertexBuffers + IndexBuffers + Topologies; }
+	void Merge(const DrawStateChanges& rhs);
+};
+
+struct RenderQueueTiming
+{
+	UINT Items = 0;
+	double RadixMs = 0.0;        // key build and RadixSort
+	double StdSortMs = 0.0;      // key build and std::sort of the same pairs
+	DrawStateChanges Unsorted;   // walking the items in submission order, binding only what changed
+	DrawStateChanges Sorted;     // the same in key order
+};
+
+// Builds keys for count pseudo random items (3 layers, one of them transparent, 16 PSOs, 256 geometries,
+// 1024 materials) and sorts them iterations times with each method.
+RenderQueueTiming MeasureRenderQueue(UINT count, int iterations);
@@ -0,0 +1,64 @@
+#include "ResourceRegistry.h"
+#include <chrono>
+#include <random>
+
+namespace
+{
+	struct BenchmarkTag;
+}
+
+RegistryLookupTiming MeasureRegistryLookups(UINT names, UINT lookupsPerFrame, int frames)
+{
+	RegistryLookupTiming result;
+	result.Names = names;
+	result.LookupsPerFrame = lookupsPerFrame;
+
+	// Names between 4 and 27 characters, like "sky" or "DefferedShadingPass1"
+	std::mt19937 rng(names);
+	std::vector<std::string> nameStrings(names);
+	std::unordered_map<std::string, UINT> map;
+	Registry<UINT, BenchmarkTag> registry;
+	std::vector<TypedHandle<BenchmarkTag>> handles(names);
+	for (UINT i = 0; i < names; ++i)
+	{
+		nameStrings[i] = "res" + std::to_string(i) + std::string(rng() % 24, 'x');
+		map[nameStrings[i]] = i;
+		handles[i] = registry.Add(nameStrings[i], i);
+	}
+
+	// The draw code passes literals, the string map path gets the same const char*
+	std::vector<const char*> frameNames(lookupsPerFrame);
+	std::vector<TypedHandle<BenchmarkTag>> frameHandles(lookupsPerFrame);
+	const size_t smallString = std::string().capacity();
+	for (UINT k = 0; k < lookupsPerFrame; ++k)
+	{
+		UINT i = (UINT)(rng() % names);
+		frameNames[k] = nameStrings[i].c_str();
+		frameHandles[k] = handles[i];
+		result.StringAllocations += nameStrings[i].size() > smallString ? 1 : 0;
+	}
+
+	volatile UINT sink = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		UINT sum = 0;
+		for (const char* name : frameNames)
+			sum += map[name];
+		sink = sink + sum;
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	result.StringMapUs = std::chrono::duration<double, std::micro>(end - start).count() / frames;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		UINT sum = 0;
+		for (TypedHandle<BenchmarkTag> handle : frameHandles)
+			sum += registry[handle];
+		sink = sink + sum;
+	}
+	end = std::chrono::high_resolution_clock::now();
+	result.HandleUs = std::chrono::duration<double, std::micro>(end - start).count() / frames;
+	return result;
+}
@@ -0,0 +1,176 @@
+#pragma once
+#include "DXHelper.h"
+#include <cassert>
+#include <string>
+#include <unordered_map>
+
+// 32 bit name of a registry entry: 24 bit slot index and 8 bit generation. The tag keeps the handles of different
+// registries apart, a material handle does not convert to a PSO handle.
+template<typename Tag>
+struct TypedHandle
+{
+	static const UINT IndexBits = 24;
+	static const UINT IndexMask = (1u << IndexBits) - 1;
+	static const UINT MaxGeneration = 0xfe; // 0xff with index IndexMask would be the null value
+
+	UINT Value = UINT_MAX;
+
+	TypedHandle() = default;
+	TypedHandle(UINT index, UINT generation) : Value((generation << IndexBits) | index) {}
+
+	UINT Index() const { return Value & IndexMask; }
+	UINT Generation() const { return Value >> IndexBits; }
+	bool IsNull() const { return Value == UINT_MAX; }
+
+	bool operator==(TypedHandle rhs) const { return Value == rhs.Value; }
+	bool operator!=(TypedHandle rhs) const { return Value != rhs.Value; }
+};
+
+struct GeometryTag;
+struct SubmeshTag;
+struct MaterialTag;
+struct TextureTag;
+struct PsoTag;
+using GeometryHandle = TypedHandle<GeometryTag>;
+using SubmeshHandle = TypedHandle<SubmeshTag>;
+using MaterialHandle = TypedHandle<MaterialTag>;
+using TextureHandle = TypedHandle<TextureTag>;
+using PsoHandle = TypedHandle<PsoTag>;
+
+// Values in a dense array behind typed handles. Names are interned once when entries are added at build time,
+// Find resolves them to handles there and the frame code only indexes with the handles it kept. Removed slots
+// are reused with the next generation, so a stale handle fails IsValid instead of reaching the new entry.
+// The handle to name table is only kept in debug builds, for DebugName.
+template<typename T, typename Tag>
+class Registry
+{
+public:
+	using Handle = TypedHandle<Tag>;
+
+	// Adds a value under a name not in the registry yet
+	Handle Add(const std::string& name, T value)
+	{
+		assert(mIndices.find(name) == mIndices.end());
+		UINT index;
+		if (!mFreeSlots.empty())
+		{
+			index = mFreeSlots.back();
+			mFreeSlots.pop_back();
+			mValues[index] = std::move(value);
+		}
+		else
+		{
+			index = (UINT)mValues.size();
+			assert(index < Handle::IndexMask);
+			mValues.push_back(std::move(value));
+			mGenerations.push_back(0);
+			mLive.push_back(false);
+#ifndef NDEBUG
+			mNames.emplace_back();
+#endif
+		}
+		mLive[index] = true;
+		mIndices.emplace(name, index);
+#ifndef NDEBUG
+		mNames[index] = name;
+#endif
+		return Handle(index, mGenerations[index]);
+	}
+
+	// Build time lookup, hashes the name. A null handle when there is no such entry.
+	Handle Find(const std::string& name) const
+	{
+		auto it = mIndices.find(name);
+		return it == mIndices.end() ? Handle() : Handle(it->second, mGenerations[it->second]);
+	}
+
+	void Remove(Handle handle)
+	{
+		assert(IsValid(handle));
+		const UINT index = handle.Index();
+		for (auto it = mIndices.begin(); it != mIndices.end(); ++it)
+		{
+			if (it->second == index)
+			{
+				mIndices.erase(it);
+				break;
+			}
+		}
+		mValues[index] = T();
+		mLive[index] = false;
+		mGenerations[index] = mGenerations[index] == Handle::MaxGeneration ? 0 : mGenerations[index] + 1;
+		mFreeSlots.push_back(index);
+	}
+
+	bool IsValid(Handle handle) const
+	{
+		return handle.Index() < mValues.size() && mLive[handle.Index()] && mGenerations[handle.Index()] == handle.Generation();
+	}
+
+	T& operator[](Handle handle)
+	{
+		assert(IsValid(handle));
+		return mValues[handle.Index()];
+	}
+
+	const T& operator[](Handle handle) const
+	{
+		assert(IsValid(handle));
+		return mValues[handle.Index()];
+	}
+
+	// Live entries
+	UINT Count() const { return (UINT)mIndices.size(); }
+	// Slots, live or free; handle indices are below it
+	UINT SlotCount() const { return (UINT)mValues.size(); }
+
+	// Calls f(handle, value) for every live entry in slot order
+	template<typename F>
+	void ForEach(F f)
+	{
+		for (UINT i = 0; i < (UINT)mValues.size(); ++i)
+		{
+			if (mLive[i])
+				f(Handle(i, mGenerations[i]), mValues[i]);
+		}
+	}
+
+	const char* DebugName(Handle handle) const
+	{
+#ifndef NDEBUG
+		return IsValid(handle) ? mNames[handle.Index()].c_str() : "<invalid>";
+#else
+		(void)handle;
+		return "";
+#endif
+	}
+
+	void Clear()
+	{
+		*this = Registry();
+	}
+
+private:
+	std::vector<T> mValues;
+	std::vector<std::uint8_t> mGenerations;
+	std::vector<bool> mLive;
+	std::vector<UINT> mFreeSlots;
+	std::unordered_map<std::string, UINT> mIndices;
+#ifndef NDEBUG
+	std::vector<std::string> mNames;
+#endif
+};
+
+struct RegistryLookupTiming
+{
+	UINT Names = 0;
+	UINT LookupsPerFrame = 0;
+	double StringMapUs = 0.0;    // unordered_map<std::string, T>[const char*] per frame, the way the draw code looked PSOs up
+	double HandleUs = 0.0;       // Registry[handle] per frame
+	UINT StringAllocations = 0;  // per frame, key strings too long for the small string buffer
+	UINT HandleAllocations = 0;  // per frame, always 0
+};
+
+// Looks lookupsPerFrame names picked from names pseudo random registry entries up through both paths,
+// frames times, and reports the cost of one frame.
+RegistryLookupTiming MeasureRegistryLookups(UINT names, UINT lookupsPerFrame, int frames);
@@ -0,0 +1,470 @@
+#include "ResourceStateTracker.h"
+
+namespace
+{
+	const UINT NotUsed = UINT_MAX;
+
+	const D3D12_RESOURCE_STATES ReadStates = D3D12_RESOURCE_STATE_GENERIC_READ | D3D12_RESOURCE_STATE_DEPTH_READ;
+
+	bool Covers(D3D12_RESOURCE_STATES current, D3D12_RESOURCE_STATES needed)
+	{
+		return current == needed ||
+			(ResourceStateTracker::IsRead(current) && ResourceStateTracker::IsRead(needed) && (current & needed) == needed);
+	}
+
+	D3D12_RESOURCE_BARRIER Transition(ID3D12Resource* resource, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after,
+		UINT subresource, D3D12_RESOURCE_BARRIER_FLAGS flags)
+	{
+		return CD3DX12_RESOURCE_BARRIER::Transition(resource, before, after, subresource, flags);
+	}
+}
+
+UINT ResourceStateTracker::Register(const char* name, ID3D12Resource* resource, UINT subresources, D3D12_RESOURCE_STATES state)
+{
+	Resource r;
+	r.Name = name;
+	r.Ptr = resource;
+	r.States.assign(std::max(subresources, 1u), state);
+	mResources.push_back(r);
+	return (UINT)mResources.size() - 1;
+}
+
+void ResourceStateTracker::Reset(UINT id, ID3D12Resource* resource, D3D12_RESOURCE_STATES state)
+{
+	mResources[id].Ptr = resource;
+	std::fill(mResources[id].States.begin(), mResources[id].States.end(), state);
+}
+
+void ResourceStateTracker::BeginFrame()
+{
+	mPasses.clear();
+}
+
+UINT ResourceStateTracker::AddPass(const char* name)
+{
+	Pass pass;
+	pass.Name = name;
+	mPasses.push_back(pass);
+	return (UINT)mPasses.size() - 1;
+}
+
+void ResourceStateTracker::Use(UINT pass, UINT resource, D3D12_RESOURCE_STATES state, UINT subresource)
+{
+	assert(pass < PassCount() && resource < mResources.size());
+	const UINT count = (UINT)mResources[resource].States.size();
+	const UINT first = subresource == AllSubresources ? 0 : subresource;
+	const UINT end = subresource == AllSubresources ? count : subresource + 1;
+	assert(end <= count);
+
+	std::vector<PassUse>& uses = mPasses[pass].Uses;
+	for (UINT s = first; s < end; ++s)
+	{
+		auto it = std::find_if(uses.begin(), uses.end(),
+			[&](const PassUse& use) { return use.Resource == resource && use.Subresource == s; });
+		if (it == uses.end())
+		{
+			uses.push_back({ resource, s, state });
+			continue;
+		}
+		// Reads combine, a write has to be the only use
+		assert(it->State == state || (IsRead(it->State) && IsRead(state)));
+		it->State |= state;
+	}
+}
+
+void ResourceStateTracker::Plan(bool splitBarriers)
+{
+	mStats = Stats();
+	mStats.Passes = PassCount();
+
+	// The passes using each subresource with the states they need, for the look ahead over following reads
+	std::vector<std::vector<std::vector<std::pair<UINT, D3D12_RESOURCE_STATES>>>> timeline(mResources.size());
+	std::vector<std::vector<UINT>> cursor(mResources.size());
+	std::vector<std::vector<UINT>> lastUse(mResources.size());
+	for (UINT r = 0; r < (UINT)mResources.size(); ++r)
+	{
+		timeline[r].resize(mResources[r].States.size());
+		cursor[r].assign(mResources[r].States.size(), 0);
+		lastUse[r].assign(mResources[r].States.size(), NotUsed);
+	}
+	for (UINT p = 0; p < PassCount(); ++p)
+	{
+		Pass& pass = mPasses[p];
+		pass.Barriers.clear();
+		std::sort(pass.Uses.begin(), pass.Uses.end(), [](const PassUse& a, const PassUse& b)
+		{
+			return a.Resource != b.Resource ? a.Resource < b.Resource : a.Subresource < b.Subresource;
+		});
+		for (const PassUse& use : pass.Uses)
+			timeline[use.Resource][use.Subresource].push_back({ p, use.State });
+	}
+
+	struct Change
+	{
+		UINT Subresource;
+		D3D12_RESOURCE_STATES Before;
+		D3D12_RESOURCE_STATES After;
+		UINT LastUse;
+	};
+
+	for (UINT p = 0; p < PassCount(); ++p)
+	{
+		const std::vector<PassUse>& uses = mPasses[p].Uses;
+		for (size_t i = 0; i < uses.size();)
+		{
+			const UINT r = uses[i].Resource;
+			Resource& resource = mResources[r];
+			std::vector<Change> changes;
+			bool uav = false;
+			for (; i < uses.size() && uses[i].Resource == r; ++i)
+			{
+				const UINT s = uses[i].Subresource;
+				const D3D12_RESOURCE_STATES needed = uses[i].State;
+				const D3D12_RESOURCE_STATES current = resource.States[s];
+				const UINT k = cursor[r][s]++;
+				if (Covers(current, needed))
+				{
+					// Writes through a UAV in an earlier pass have to finish first
+					if (needed == D3D12_RESOURCE_STATE_UNORDERED_ACCESS && lastUse[r][s] != NotUsed)
+						uav = true;
+					++mStats.CoveredUses;
+				}
+				else
+				{
+					D3D12_RESOURCE_STATES after = needed;
+					const auto& accesses = timeline[r][s];
+					for (size_t j = k + 1; IsRead(after) && j < accesses.size() && IsRead(accesses[j].second); ++j)
+						after |= accesses[j].second;
+					changes.push_back({ s, current, after, lastUse[r][s] });
+					resource.States[s] = after;
+				}
+				lastUse[r][s] = p;
+			}
+
+			// One barrier for the whole resource when every subresource makes the same change
+			const UINT count = (UINT)resource.States.size();
+			bool whole = count > 1 && changes.size() == count;
+			for (const Change& c : changes)
+				whole = whole && c.Before == changes[0].Before && c.After == changes[0].After;
+			if (whole)
+			{
+				Change merged = changes[0];
+				merged.Subresource = AllSubresources;
+				// A subresource not used yet this frame puts no bound on the begin, the latest one used does
+				merged.LastUse = NotUsed;
+				for (const Change& c : changes)
+					if (c.LastUse != NotUsed)
+						merged.LastUse = merged.LastUse == NotUsed ? c.LastUse : std::max(merged.LastUse, c.LastUse);
+				changes.assign(1, merged);
+			}
+
+			for (const Change& c : changes)
+			{
+				// Begins right after the previous use, which is before this frame when there is none
+				const UINT begin = c.LastUse == NotUsed ? 0 : c.LastUse + 1;
+				if (splitBarriers && begin < p)
+				{
+					mPasses[begin].Barriers.push_back(Transition(resource.Ptr, c.Before, c.After, c.Subresource,
+						D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY));
+					mPasses[p].Barriers.push_back(Transition(resource.Ptr, c.Before, c.After, c.Subresource,
+						D3D12_RESOURCE_BARRIER_FLAG_END_ONLY));
+					mStats.Barriers += 2;
+					++mStats.Split;
+				}
+				else
+				{
+					mPasses[p].Barriers.push_back(Transition(resource.Ptr, c.Before, c.After, c.Subresource,
+						D3D12_RESOURCE_BARRIER_FLAG_NONE));
+					++mStats.Barriers;
+				}
+				++mStats.Transitions;
+			}
+			if (uav)
+			{
+				mPasses[p].Barriers.push_back(CD3DX12_RESOURCE_BARRIER::UAV(resource.Ptr));
+				++mStats.Barriers;
+				++mStats.UavBarriers;
+			}
+		}
+	}
+
+	for (const Pass& pass : mPasses)
+	{
+		if (!pass.Barriers.empty())
+			++mStats.Calls;
+	}
+}
+
+void ResourceStateTracker::Record(ID3D12GraphicsCommandList* cmdList, UINT pass) const
+{
+	const std::vector<D3D12_RESOURCE_BARRIER>& barriers = mPasses[pass].Barriers;
+	if (!barriers.empty())
+		cmdList->ResourceBarrier((UINT)barriers.size(), barriers.data());
+}
+
+bool ResourceStateTracker::IsRead(D3D12_RESOURCE_STATES state)
+{
+	return state != D3D12_RESOURCE_STATE_COMMON && (state & ~ReadStates) == 0;
+}
+
+namespace
+{
+	struct DeferredFrameResources
+	{
+		UINT ShadowMap, Depth, Albedo, Normal, Position, Feedback, HiZ, SceneColor, Ssr, BackBuffer;
+	};
+
+	// In the states the hand written barriers leave them in at the end of a frame
+	DeferredFrameResources RegisterDeferredFrame(ResourceStateTracker& tracker, UINT hiZMips)
+	{
+		DeferredFrameResources r;
+		r.ShadowMap = tracker.Register("Shadow Map", nullptr, 1, D3D12_RESOURCE_STATE_GENERIC_READ);
+		r.Depth = tracker.Register("Depth", nullptr, 1, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+		r.Albedo = tracker.Register("GBuffer Albedo", nullptr, 1, D3D12_RESOURCE_STATE_GENERIC_READ);
+		r.Normal = tracker.Register("GBuffer Normal", nullptr, 1, D3D12_RESOURCE_STATE_GENERIC_READ);
+		r.Position = tracker.Register("GBuffer Position", nullptr, 1, D3D12_RESOURCE_STATE_GENERIC_READ);
+		r.Feedback = tracker.Register("Streaming Feedback", nullptr, 1, D3D12_RESOURCE_STATE_COPY_DEST);
+		r.HiZ = tracker.Register("HiZ", nullptr, hiZMips, D3D12_RESOURCE_STATE_GENERIC_READ);
+		r.SceneColor = tracker.Register("Scene Color", nullptr, 1, D3D12_RESOURCE_STATE_PRESENT);
+		r.Ssr = tracker.Register("SSR", nullptr, 1, D3D12_RESOURCE_STATE_GENERIC_READ);
+		r.BackBuffer = tracker.Register("Back Buffer", nullptr, 1, D3D12_RESOURCE_STATE_PRESENT);
+		return r;
+	}
+
+	void DeclareDeferredFrame(ResourceStateTracker& tracker, const DeferredFrameResources& r, UINT hiZMips)
+	{
+		const D3D12_RESOURCE_STATES rt = D3D12_RESOURCE_STATE_RENDER_TARGET;
+		const D3D12_RESOURCE_STATES ps = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+		const D3D12_RESOURCE_STATES cs = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+		tracker.BeginFrame();
+
+		UINT pass = tracker.AddPass("Shadow");
+		tracker.Use(pass, r.ShadowMap, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+		pass = tracker.AddPass("Feedback Clear");
+		tracker.Use(pass, r.Feedback, D3D12_RESOURCE_STATE_COPY_DEST);
+
+		pass = tracker.AddPass("GBuffer");
+		for (UINT target : { r.Albedo, r.Normal, r.Position })
+			tracker.Use(pass, target, rt);
+		tracker.Use(pass, r.Depth, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+		tracker.Use(pass, r.Feedback, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+		pass = tracker.AddPass("Feedback Copy");
+		tracker.Use(pass, r.Feedback, D3D12_RESOURCE_STATE_COPY_SOURCE);
+
+		// Each mip is written as a UAV from the one above it read as an SRV
+		pass = tracker.AddPass("HiZ Mip 0");
+		tracker.Use(pass, r.Depth, cs);
+		tracker.Use(pass, r.HiZ, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, 0);
+		for (UINT mip = 1; mip < hiZMips; ++mip)
+		{
+			pass = tracker.AddPass("HiZ Mip");
+			tracker.Use(pass, r.HiZ, cs, mip - 1);
+			tracker.Use(pass, r.HiZ, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, mip);
+		}
+
+		pass = tracker.AddPass("Lighting");
+		for (UINT input : { r.Albedo, r.Normal, r.Position, r.ShadowMap })
+			tracker.Use(pass, input, ps);
+		tracker.Use(pass, r.SceneColor, rt);
+
+		pass = tracker.AddPass("SSR");
+		for (UINT input : { r.Normal, r.Position, r.Depth, r.HiZ, r.SceneColor })
+			tracker.Use(pass, input, ps);
+		tracker.Use(pass, r.Ssr, rt);
+
+		pass = tracker.AddPass("SSR Composite");
+		tracker.Use(pass, r.SceneColor, ps);
+		tracker.Use(pass, r.Ssr, ps);
+		tracker.Use(pass, r.BackBuffer, rt);
+
+		pass = tracker.AddPass("Sky");
+		tracker.Use(pass, r.Depth, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+		tracker.Use(pass, r.BackBuffer, rt);
+
+		pass = tracker.AddPass("ImGui");
+		tracker.Use(pass, r.BackBuffer, rt);
+
+		pass = tracker.AddPass("Present");
+		tracker.Use(pass, r.BackBuffer, D3D12_RESOURCE_STATE_PRESENT);
+	}
+
+	UINT FullMipChain(UINT width, UINT height)
+	{
+		UINT levels = 1;
+		for (UINT size = std::max(width, height); size > 1; size /= 2)
+			++levels;
+		return levels;
+	}
+}
+
+BarrierReport MeasureDeferredFrameBarriers(UINT width, UINT height)
+{
+	BarrierReport report;
+	report.HiZMips = FullMipChain(width, height);
+
+	// Shadow map 2, G-buffer targets 6, feedback buffer 3, depth around the HiZ 2, HiZ in and out of UAV 2 and a
+	// UAV barrier after every mip, scene color 2, SSR target 2, back buffer 2
+	report.HandCalls = 21 + report.HiZMips;
+
+	for (bool split : { false, true })
+	{
+		ResourceStateTracker tracker;
+		const DeferredFrameResources resources = RegisterDeferredFrame(tracker, report.HiZMips);
+		for (int frame = 0; frame < 2; ++frame)
+		{
+			DeclareDeferredFrame(tracker, resources, report.HiZMips);
+			tracker.Plan(split);
+		}
+		(split ? report.TrackedSplit : report.Tracked) = tracker.GetStats();
+	}
+	return report;
+}
+
+UINT VerifyResourceStateTracker(std::string* failure)
+{
+	UINT failures = 0;
+	auto check = [&](bool condition, const char* what)
+	{
+		if (condition)
+			return;
+		if (failures++ == 0 && failure != nullptr)
+			*failure = what;
+	};
+	const D3D12_RESOURCE_STATES rt = D3D12_RESOURCE_STATE_RENDER_TARGET;
+	const D3D12_RESOURCE_STATES ps = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+	const D3D12_RESOURCE_STATES cs = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+	const D3D12_RESOURCE_STATES uav = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+
+	// Render target, read twice, written again: the second read rides on the first transition
+	{
+		ResourceStateTracker tracker;
+		const UINT t = tracker.Register("t", nullptr, 1, rt);
+		tracker.BeginFrame();
+		const UINT write = tracker.AddPass("write");
+		tracker.Use(write, t, rt);
+		const UINT pixelRead = tracker.AddPass("pixel read");
+		tracker.Use(pixelRead, t, ps);
+		const UINT computeRead = tracker.AddPass("compute read");
+		tracker.Use(computeRead, t, cs);
+		const UINT rewrite = tracker.AddPass("rewrite");
+		tracker.Use(rewrite, t, rt);
+		tracker.Plan(false);
+
+		check(tracker.Barriers(write).empty(), "barrier for a state the resource is in");
+		check(tracker.Barriers(pixelRead).size() == 1 && tracker.Barriers(pixelRead)[0].Transition.StateAfter == (ps | cs),
+			"a read transition did not take on the following read");
+		check(tracker.Barriers(computeRead).empty(), "barrier for a read the state already covers");
+		check(tracker.Barriers(rewrite).size() == 1 && tracker.Barriers(rewrite)[0].Transition.StateBefore == (ps | cs),
+			"wrong state before the rewrite");
+		check(tracker.GetStats().Calls == 2 && tracker.GetStats().CoveredUses == 2, "wrong stats");
+		check(tracker.State(t) == rt, "wrong state at the end of the frame");
+	}
+
+	// Three targets of one pass share a call, all mips of a texture share a barrier, one mip gets its own
+	{
+		ResourceStateTracker tracker;
+		UINT targets[3];
+		for (UINT& target : targets)
+			target = tracker.Register("target", nullptr, 1, ps);
+		const UINT mips = tracker.Register("mips", nullptr, 4, ps);
+		tracker.BeginFrame();
+		const UINT pass = tracker.AddPass("pass");
+		for (UINT target : targets)
+			tracker.Use(pass, target, rt);
+		tracker.Use(pass, mips, uav);
+		const UINT single = tracker.AddPass("single");
+		tracker.Use(single, mips, ps, 2);
+		tracker.Plan(false);
+
+		const auto& barriers = tracker.Barriers(pass);
+		check(barriers.size() == 4 && tracker.GetStats().Calls == 2, "transitions of a pass were not batched");
+		check(barriers.size() == 4 && barriers[3].Transition.Subresource == ResourceStateTracker::AllSubresources,
+			"transition of every subresource was not merged");
+		check(tracker.Barriers(single).size() == 1 && tracker.Barriers(single)[0].Transition.Subresource == 2,
+			"wrong subresource");
+		check(tracker.State(mips, 2) == ps && tracker.State(mips, 3) == uav, "subresource states mixed up");
+	}
+
+	// A gap between two uses splits the transition, adjacent uses do not
+	{
+		ResourceStateTracker tracker;
+		const UINT a = tracker.Register("a", nullptr, 1, ps);
+		const UINT b = tracker.Register("b", nullptr, 1, ps);
+		tracker.BeginFrame();
+		const UINT writeA = tracker.AddPass("write a");
+		tracker.Use(writeA, a, rt);
+		const UINT writeB = tracker.AddPass("write b");
+		tracker.Use(writeB, b, rt);
+		tracker.Use(writeB, a, rt);
+		const UINT other = tracker.AddPass("other");
+		tracker.Use(other, b, ps);
+		const UINT readA = tracker.AddPass("read a");
+		tracker.Use(readA, a, ps);
+		tracker.Plan(true);
+
+		check(tracker.Barriers(other).size() == 2 &&
+			tracker.Barriers(other)[0].Flags == D3D12_RESOURCE_BARRIER_FLAG_NONE &&
+			tracker.Barriers(other)[1].Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY,
+			"wrong barriers before the pass after the last write of a");
+		check(tracker.Barriers(readA).size() == 1 && tracker.Barriers(readA)[0].Flags == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY,
+			"split transition did not end before its pass");
+		check(tracker.GetStats().Split == 2 && tracker.GetStats().Transitions == 4, "wrong split count");
+	}
+
+	// A merged transition begins after the last use of any of its subresources, unused ones do not pull it earlier
+	{
+		ResourceStateTracker tracker;
+		const UINT mips = tracker.Register("mips", nullptr, 3, uav);
+		const UINT other = tracker.Register("other", nullptr, 1, rt);
+		tracker.BeginFrame();
+		const UINT first = tracker.AddPass("first");
+		tracker.Use(first, other, rt);
+		const UINT write = tracker.AddPass("write mip 0");
+		tracker.Use(write, mips, uav, 0);
+		const UINT gap = tracker.AddPass("gap");
+		tracker.Use(gap, other, rt);
+		const UINT read = tracker.AddPass("read");
+		tracker.Use(read, mips, ps);
+		tracker.Plan(true);
+
+		check(tracker.Barriers(first).empty(), "merged transition began before a subresource was last used");
+		check(tracker.Barriers(gap).size() == 1 && tracker.Barriers(gap)[0].Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY &&
+			tracker.Barriers(gap)[0].Transition.Subresource == ResourceStateTracker::AllSubresources,
+			"merged transition did not begin after the last use");
+		check(tracker.Barriers(read).size() == 1 && tracker.Barriers(read)[0].Flags == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY,
+			"merged transition did not end before its pass");
+	}
+
+	// UAV to UAV in consecutive passes needs a UAV barrier, not a transition
+	{
+		ResourceStateTracker tracker;
+		const UINT u = tracker.Register("u", nullptr, 1, uav);
+		tracker.BeginFrame();
+		const UINT first = tracker.AddPass("first");
+		tracker.Use(first, u, uav);
+		const UINT second = tracker.AddPass("second");
+		tracker.Use(second, u, uav);
+		tracker.Plan(true);
+		check(tracker.Barriers(first).empty(), "UAV barrier without an earlier writer");
+		check(tracker.Barriers(second).size() == 1 && tracker.Barriers(second)[0].Type == D3D12_RESOURCE_BARRIER_TYPE_UAV,
+			"missing UAV barrier");
+	}
+
+	// The deferred frame leaves every resource where the next frame starts, so a second frame plans the same
+	{
+		ResourceStateTracker tracker;
+		const DeferredFrameResources resources = RegisterDeferredFrame(tracker, 11);
+		ResourceStateTracker::Stats stats[3];
+		for (auto& s : stats)
+		{
+			DeclareDeferredFrame(tracker, resources, 11);
+			tracker.Plan(true);
+			s = tracker.GetStats();
+		}
+		check(stats[1].Barriers == stats[2].Barriers && stats[1].Calls == stats[2].Calls, "deferred frame does not settle");
+		check(tracker.State(resources.BackBuffer) == D3D12_RESOURCE_STATE_PRESENT, "back buffer not presentable");
+	}
+	return failures;
+}
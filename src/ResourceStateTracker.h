@@ -0,0 +1,95 @@
+#pragma once
+#include "D3D12Shim.h"
+
+// Tracks the state of every subresource of the registered resources across frames and works out the barriers
+// of a frame from the states its passes declare they need. Per pass all barriers go into one ResourceBarrier
+// call and a transition covering every subresource becomes a single ALL_SUBRESOURCES barrier. Uses whose state
+// the subresource is already in, or read states contained in the read state it is in, need no barrier, and a
+// transition into a read state also takes on the read states of the following reads, up to the next write,
+// so those need none either. With split barriers a transition begins right after the subresource's previous
+// use and ends before the pass needing it, giving the GPU the passes in between to finish it.
+// Planning never touches a device, resources may be null.
+class ResourceStateTracker
+{
+public:
+	static const UINT AllSubresources = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+
+	struct Stats
+	{
+		UINT Passes = 0;
+		UINT Calls = 0;          // passes with barriers, one ResourceBarrier call each
+		UINT Barriers = 0;       // barrier records, both halves of a split transition
+		UINT Transitions = 0;    // state changes, a whole resource counts once
+		UINT Split = 0;          // transitions split into a begin and an end
+		UINT UavBarriers = 0;
+		UINT CoveredUses = 0;    // subresource uses that were already in a suitable state
+	};
+
+	// Every subresource starts in state
+	UINT Register(const char* name, ID3D12Resource* resource, UINT subresources, D3D12_RESOURCE_STATES state);
+	// The resource was recreated, in state
+	void Reset(UINT id, ID3D12Resource* resource, D3D12_RESOURCE_STATES state);
+
+	// Starts declaring the passes of a frame
+	void BeginFrame();
+	UINT AddPass(const char* name);
+	// pass needs subresource (or all of them) of resource in state. Read states of one pass combine, a write
+	// state has to be the only use of the subresource in the pass.
+	void Use(UINT pass, UINT resource, D3D12_RESOURCE_STATES state, UINT subresource = AllSubresources);
+
+	// Computes the barriers of the declared passes and moves the tracked states to where the frame leaves them
+	void Plan(bool splitBarriers = true);
+	// The barriers to record before pass, begin halves of later transitions included
+	const std::vector<D3D12_RESOURCE_BARRIER>& Barriers(UINT pass) const { return mPasses[pass].Barriers; }
+	void Record(ID3D12GraphicsCommandList* cmdList, UINT pass) const;
+
+	D3D12_RESOURCE_STATES State(UINT resource, UINT subresource = 0) const { return mResources[resource].States[subresource]; }
+	UINT PassCount() const { return (UINT)mPasses.size(); }
+	const char* PassName(UINT pass) const { return mPasses[pass].Name; }
+	const Stats& GetStats() const { return mStats; }
+
+	// Read only states, several of them can be combined into one
+	static bool IsRead(D3D12_RESOURCE_STATES state);
+
+private:
+	struct Resource
+	{
+		const char* Name = "";
+		ID3D12Resource* Ptr = nullptr;
+		std::vector<D3D12_RESOURCE_STATES> States;
+	};
+
+	struct PassUse
+	{
+		UINT Resource = 0;
+		UINT Subresource = 0;
+		D3D12_RESOURCE_STATES State = D3D12_RESOURCE_STATE_COMMON;
+	};
+
+	struct Pass
+	{
+		const char* Name = "";
+		std::vector<PassUse> Uses; // one per subresource
+		std::vector<D3D12_RESOURCE_BARRIER> Barriers;
+	};
+
+	std::vector<Resource> mResources;
+	std::vector<Pass> mPasses;
+	Stats mStats;
+};
+
+struct BarrierReport
+{
+	UINT HiZMips = 0;
+	UINT HandCalls = 0;    // barriers written by hand for every pass, one per call, as before the tracker
+	ResourceStateTracker::Stats Tracked;      // the same passes planned without split barriers
+	ResourceStateTracker::Stats TrackedSplit; // and with them
+};
+
+// Declares the passes Draw records at width x height with SSR on (shadow map, G-buffer with the streaming
+// feedback buffer, every HiZ mip, lighting, SSR, composite, sky, ImGui and present) and plans a frame after
+// one warm up frame, so the states are the ones the previous frame left.
+BarrierReport MeasureDeferredFrameBarriers(UINT width, UINT height);
+
+// Plans small frames with known barriers. Returns the number of failed checks, the first one described in failure.
+UINT VerifyResourceStateTracker(std::string* failure = nullptr);
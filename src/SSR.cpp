@@ -11,8 +11,7 @@ SSR::SSR(ID3D12Device* device, UINT width, UINT height)
 
 void SSR::BuildResources()
 {
-	CD3DX12_RESOURCE_DESC texDesc = CD3DX12_RESOURCE_DESC::Tex2D(
-		mFormat, mWidth, mHeight, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+	CD3DX12_RESOURCE_DESC texDesc(ResourceDesc());
 
 	float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
 	CD3DX12_CLEAR_VALUE optClear(mFormat, clearColor);
@@ -27,6 +26,38 @@ void SSR::BuildResources()
 	));
 }
 
+void SSR::PlaceResource(ID3D12Heap* heap, UINT64 offset)
+{
+	const D3D12_RESOURCE_DESC texDesc = ResourceDesc();
+
+	float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	CD3DX12_CLEAR_VALUE optClear(mFormat, clearColor);
+
+	mSSRMap.Reset();
+	ThrowIfFailed(md3dDevice->CreatePlacedResource(
+		heap,
+		offset,
+		&texDesc,
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		&optClear,
+		IID_PPV_ARGS(&mSSRMap)
+	));
+	mPlaced = true;
+
+	BuildDescriptors();
+}
+
+void SSR::ReleasePlacedResource()
+{
+	if (!mPlaced)
+		return;
+
+	mSSRMap.Reset();
+	mPlaced = false;
+	BuildResources();
+	BuildDescriptors();
+}
+
 void SSR::BuildDescriptors(
 	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
 	CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
@@ -67,7 +98,10 @@ void SSR::OnResize(UINT width, UINT height)
 		mViewport = { 0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f };
 		mScissorRect = { 0, 0, (int)width, (int)height };
 
-		BuildResources();
-		BuildDescriptors();
+		if (!mPlaced)
+		{
+			BuildResources();
+			BuildDescriptors();
+		}
 	}
 }
\ No newline at end of file
@@ -26,10 +26,20 @@ public:
 		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuRtv
 	);
 
+	// Once the map is placed OnResize leaves building a new one to the owner of the heap
 	void OnResize(UINT width, UINT height);
 
 	void BuildDescriptors();
 
+	D3D12_RESOURCE_DESC ResourceDesc() const
+	{
+		return CD3DX12_RESOURCE_DESC::Tex2D(mFormat, mWidth, mHeight, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+	}
+	// Replaces the map with one placed at offset in heap and rebuilds its views
+	void PlaceResource(ID3D12Heap* heap, UINT64 offset);
+	// Replaces a placed map with a committed one again, before the heap it was placed in is released
+	void ReleasePlacedResource();
+
 	struct ssrParams
 	{
 		float maxDistance = 50.0f;
@@ -55,6 +65,7 @@ private:
 	UINT mHeight = 0;
 
 	ComPtr<ID3D12Resource> mSSRMap = nullptr;
+	bool mPlaced = false;
 
 	CD3DX12_CPU_DESCRIPTOR_HANDLE mCpuSrv;
 	CD3DX12_GPU_DESCRIPTOR_HANDLE mGpuSrv;
@@ -0,0 +1,484 @@
+#include "SceneBVH.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+namespace
+{
+	struct Bin
+	{
+		XMVECTOR Min;
+		XMVECTOR Max;
+		UINT Count;
+	};
+
+	// Half the surface area, the SAH only compares ratios
+	float HalfArea(FXMVECTOR boxMin, FXMVECTOR boxMax)
+	{
+		XMFLOAT3 d;
+		XMStoreFloat3(&d, XMVectorMax(XMVectorSubtract(boxMax, boxMin), XMVectorZero()));
+		return d.x * d.y + d.y * d.z + d.z * d.x;
+	}
+
+	float Component(const XMFLOAT3& v, UINT axis)
+	{
+		return (&v.x)[axis];
+	}
+}
+
+void SceneBVH::Build(const BoundingBox* boxes, UINT count)
+{
+	mPrimMin.resize(count);
+	mPrimMax.resize(count);
+	mCentroids.resize(count);
+	mOrder.resize(count);
+	mPrimLeaf.assign(count, 0);
+	for (UINT i = 0; i < count; ++i)
+	{
+		XMVECTOR center = XMLoadFloat3(&boxes[i].Center);
+		XMVECTOR extents = XMLoadFloat3(&boxes[i].Extents);
+		XMStoreFloat3(&mPrimMin[i], XMVectorSubtract(center, extents));
+		XMStoreFloat3(&mPrimMax[i], XMVectorAdd(center, extents));
+		mCentroids[i] = boxes[i].Center;
+		mOrder[i] = i;
+	}
+
+	// A binary tree with one primitive per leaf at worst, so the node array never grows past its reservation.
+	mNodes.clear();
+	mNodes.reserve(count > 0 ? 2 * (size_t)count - 1 : 1);
+	mNodes.emplace_back();
+	mNodes[0].Count = count;
+	mDirtyLeaves.clear();
+	mDepth = 0;
+
+	if (count == 0)
+	{
+		mNodes[0].Min = mNodes[0].Max = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		mLeafDirty.assign(1, 0);
+		return;
+	}
+
+	std::vector<std::pair<UINT, UINT>> stack; // node, depth
+	stack.emplace_back(0, 0);
+	while (!stack.empty())
+	{
+		const UINT node = stack.back().first;
+		const UINT depth = stack.back().second;
+		stack.pop_back();
+		mDepth = std::max(mDepth, depth);
+
+		if (Split(node, depth))
+		{
+			const UINT left = mNodes[node].Left;
+			stack.emplace_back(left + 1, depth + 1);
+			stack.emplace_back(left, depth + 1);
+		}
+		else
+		{
+			const Node& leaf = mNodes[node];
+			for (UINT k = leaf.First; k < leaf.First + leaf.Count; ++k)
+				mPrimLeaf[mOrder[k]] = node;
+		}
+	}
+
+	mLeafDirty.assign(mNodes.size(), 0);
+}
+
+bool SceneBVH::Split(UINT nodeIndex, UINT depth)
+{
+	const UINT first = mNodes[nodeIndex].First;
+	const UINT count = mNodes[nodeIndex].Count;
+
+	XMVECTOR nodeMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR nodeMax = XMVectorReplicate(-FLT_MAX);
+	XMVECTOR centroidMin = nodeMin;
+	XMVECTOR centroidMax = nodeMax;
+	for (UINT k = first; k < first + count; ++k)
+	{
+		const UINT p = mOrder[k];
+		XMVECTOR centroid = XMLoadFloat3(&mCentroids[p]);
+		nodeMin = XMVectorMin(nodeMin, XMLoadFloat3(&mPrimMin[p]));
+		nodeMax = XMVectorMax(nodeMax, XMLoadFloat3(&mPrimMax[p]));
+		centroidMin = XMVectorMin(centroidMin, centroid);
+		centroidMax = XMVectorMax(centroidMax, centroid);
+	}
+	XMStoreFloat3(&mNodes[nodeIndex].Min, nodeMin);
+	XMStoreFloat3(&mNodes[nodeIndex].Max, nodeMax);
+
+	if (count <= MinLeafPrimitives || depth + 1 >= MaxDepth)
+		return false;
+
+	XMFLOAT3 binOrigin;
+	XMFLOAT3 centroidExtent;
+	XMStoreFloat3(&binOrigin, centroidMin);
+	XMStoreFloat3(&centroidExtent, XMVectorSubtract(centroidMax, centroidMin));
+
+	float binScale[3];
+	for (UINT axis = 0; axis < 3; ++axis)
+	{
+		float extent = Component(centroidExtent, axis);
+		binScale[axis] = extent > 0.0f ? BinCount / extent : 0.0f;
+	}
+
+	auto binOf = [&](UINT p, UINT axis)
+	{
+		float offset = Component(mCentroids[p], axis) - Component(binOrigin, axis);
+		return std::min((UINT)(offset * binScale[axis]), BinCount - 1);
+	};
+
+	// Bin the primitives along all three axes in one pass
+	Bin bins[3][BinCount];
+	for (UINT axis = 0; axis < 3; ++axis)
+	{
+		for (UINT b = 0; b < BinCount; ++b)
+		{
+			bins[axis][b].Min = XMVectorReplicate(FLT_MAX);
+			bins[axis][b].Max = XMVectorReplicate(-FLT_MAX);
+			bins[axis][b].Count = 0;
+		}
+	}
+	for (UINT k = first; k < first + count; ++k)
+	{
+		const UINT p = mOrder[k];
+		XMVECTOR primMin = XMLoadFloat3(&mPrimMin[p]);
+		XMVECTOR primMax = XMLoadFloat3(&mPrimMax[p]);
+		for (UINT axis = 0; axis < 3; ++axis)
+		{
+			if (binScale[axis] == 0.0f)
+				continue;
+			Bin& bin = bins[axis][binOf(p, axis)];
+			bin.Min = XMVectorMin(bin.Min, primMin);
+			bin.Max = XMVectorMax(bin.Max, primMax);
+			bin.Count++;
+		}
+	}
+
+	// Cost of splitting after bin b: area times primitive count of both sides
+	float bestCost = FLT_MAX;
+	UINT bestAxis = 0;
+	UINT bestBin = 0;
+	for (UINT axis = 0; axis < 3; ++axis)
+	{
+		if (binScale[axis] == 0.0f)
+			continue;
+
+		float rightArea[BinCount];
+		UINT rightCount[BinCount];
+		XMVECTOR accMin = XMVectorReplicate(FLT_MAX);
+		XMVECTOR accMax = XMVectorReplicate(-FLT_MAX);
+		UINT accCount = 0;
+		for (UINT b = BinCount - 1; b > 0; --b)
+		{
+			accMin = XMVectorMin(accMin, bins[axis][b].Min);
+			accMax = XMVectorMax(accMax, bins[axis][b].Max);
+			accCount += bins[axis][b].Count;
+			rightArea[b - 1] = HalfArea(accMin, accMax);
+			rightCount[b - 1] = accCount;
+		}
+
+		accMin = XMVectorReplicate(FLT_MAX);
+		accMax = XMVectorReplicate(-FLT_MAX);
+		accCount = 0;
+		for (UINT b = 0; b + 1 < BinCount; ++b)
+		{
+			accMin = XMVectorMin(accMin, bins[axis][b].Min);
+			accMax = XMVectorMax(accMax, bins[axis][b].Max);
+			accCount += bins[axis][b].Count;
+			if (accCount == 0 || rightCount[b] == 0)
+				continue;
+
+			float cost = HalfArea(accMin, accMax) * accCount + rightArea[b] * rightCount[b];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+			}
+		}
+	}
+
+	UINT mid = 0;
+	if (bestCost == FLT_MAX)
+	{
+		// Every centroid in the same spot, no plane separates them
+		if (count <= MaxLeafPrimitives)
+			return false;
+		mid = first + count / 2;
+	}
+	else
+	{
+		// One traversal step costs about as much as testing one primitive
+		const float area = HalfArea(nodeMin, nodeMax);
+		if (count <= MaxLeafPrimitives && area + bestCost >= area * count)
+			return false;
+
+		auto begin = mOrder.begin() + first;
+		mid = (UINT)(std::partition(begin, begin + count, [&](UINT p) { return binOf(p, bestAxis) <= bestBin; }) - mOrder.begin());
+	}
+
+	const UINT left = (UINT)mNodes.size();
+	mNodes.emplace_back();
+	mNodes.emplace_back();
+	mNodes[left].First = first;
+	mNodes[left].Count = mid - first;
+	mNodes[left].Parent = nodeIndex;
+	mNodes[left + 1].First = mid;
+	mNodes[left + 1].Count = first + count - mid;
+	mNodes[left + 1].Parent = nodeIndex;
+	mNodes[nodeIndex].Left = left;
+	return true;
+}
+
+void SceneBVH::SetBounds(UINT primitive, const BoundingBox& box)
+{
+	assert(primitive < PrimitiveCount());
+
+	XMVECTOR center = XMLoadFloat3(&box.Center);
+	XMVECTOR extents = XMLoadFloat3(&box.Extents);
+	XMStoreFloat3(&mPrimMin[primitive], XMVectorSubtract(center, extents));
+	XMStoreFloat3(&mPrimMax[primitive], XMVectorAdd(center, extents));
+
+	const UINT leaf = mPrimLeaf[primitive];
+	if (!mLeafDirty[leaf])
+	{
+		mLeafDirty[leaf] = 1;
+		mDirtyLeaves.push_back(leaf);
+	}
+}
+
+bool SceneBVH::UpdateLeafBounds(UINT nodeIndex)
+{
+	Node& node = mNodes[nodeIndex];
+	XMVECTOR nodeMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR nodeMax = XMVectorReplicate(-FLT_MAX);
+	for (UINT k = node.First; k < node.First + node.Count; ++k)
+	{
+		nodeMin = XMVectorMin(nodeMin, XMLoadFloat3(&mPrimMin[mOrder[k]]));
+		nodeMax = XMVectorMax(nodeMax, XMLoadFloat3(&mPrimMax[mOrder[k]]));
+	}
+
+	if (XMVector3Equal(nodeMin, XMLoadFloat3(&node.Min)) && XMVector3Equal(nodeMax, XMLoadFloat3(&node.Max)))
+		return false;
+	XMStoreFloat3(&node.Min, nodeMin);
+	XMStoreFloat3(&node.Max, nodeMax);
+	return true;
+}
+
+bool SceneBVH::UpdateInnerBounds(UINT nodeIndex)
+{
+	Node& node = mNodes[nodeIndex];
+	const Node& left = mNodes[node.Left];
+	const Node& right = mNodes[node.Left + 1];
+	XMVECTOR nodeMin = XMVectorMin(XMLoadFloat3(&left.Min), XMLoadFloat3(&right.Min));
+	XMVECTOR nodeMax = XMVectorMax(XMLoadFloat3(&left.Max), XMLoadFloat3(&right.Max));
+
+	if (XMVector3Equal(nodeMin, XMLoadFloat3(&node.Min)) && XMVector3Equal(nodeMax, XMLoadFloat3(&node.Max)))
+		return false;
+	XMStoreFloat3(&node.Min, nodeMin);
+	XMStoreFloat3(&node.Max, nodeMax);
+	return true;
+}
+
+UINT SceneBVH::Refit()
+{
+	// Several dirty leaves may share ancestors. Each walk stops as soon as a node keeps its bounds,
+	// the ones above it were computed from the same children already.
+	UINT touched = 0;
+	for (UINT leaf : mDirtyLeaves)
+	{
+		mLeafDirty[leaf] = 0;
+		++touched;
+		bool changed = UpdateLeafBounds(leaf);
+		for (UINT node = leaf; changed && node != 0; ++touched)
+		{
+			node = mNodes[node].Parent;
+			changed = UpdateInnerBounds(node);
+		}
+	}
+	mDirtyLeaves.clear();
+	return touched;
+}
+
+void SceneBVH::Query(const BoundingFrustum& frustum, FXMVECTOR sweep, std::vector<UINT>& out) const
+{
+	if (mNodes.empty() || mNodes[0].Count == 0)
+		return;
+
+	// The plane normals point out of the frustum
+	XMVECTOR planes[6];
+	frustum.GetPlanes(&planes[0], &planes[1], &planes[2], &planes[3], &planes[4], &planes[5]);
+	XMVECTOR absNormals[6];
+	for (int i = 0; i < 6; ++i)
+		absNormals[i] = XMVectorAbs(planes[i]);
+
+	const XMVECTOR halfSweep = XMVectorScale(sweep, 0.5f);
+	const XMVECTOR sweepExtent = XMVectorAbs(halfSweep);
+
+	auto classify = [&](const XMFLOAT3& boxMin, const XMFLOAT3& boxMax) -> ContainmentType
+	{
+		XMVECTOR vMin = XMLoadFloat3(&boxMin);
+		XMVECTOR vMax = XMLoadFloat3(&boxMax);
+		XMVECTOR center = XMVectorAdd(XMVectorScale(XMVectorAdd(vMin, vMax), 0.5f), halfSweep);
+		XMVECTOR extent = XMVectorAdd(XMVectorScale(XMVectorSubtract(vMax, vMin), 0.5f), sweepExtent);
+
+		ContainmentType result = CONTAINS;
+		for (int i = 0; i < 6; ++i)
+		{
+			XMVECTOR distance = XMPlaneDotCoord(planes[i], center);
+			XMVECTOR radius = XMVector3Dot(extent, absNormals[i]);
+			if (XMVector4Greater(distance, radius))
+				return DISJOINT;
+			if (XMVector4Greater(distance, XMVectorNegate(radius)))
+				result = INTERSECTS;
+		}
+		return result;
+	};
+
+	UINT stack[MaxDepth + 1];
+	UINT top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const Node& node = mNodes[stack[--top]];
+		ContainmentType containment = classify(node.Min, node.Max);
+		if (containment == DISJOINT)
+			continue;
+
+		if (containment == CONTAINS)
+		{
+			out.insert(out.end(), mOrder.begin() + node.First, mOrder.begin() + node.First + node.Count);
+			continue;
+		}
+
+		if (node.IsLeaf())
+		{
+			for (UINT k = node.First; k < node.First + node.Count; ++k)
+			{
+				const UINT p = mOrder[k];
+				if (classify(mPrimMin[p], mPrimMax[p]) != DISJOINT)
+					out.push_back(p);
+			}
+			continue;
+		}
+
+		assert(top + 2 <= MaxDepth + 1);
+		stack[top++] = node.Left + 1;
+		stack[top++] = node.Left;
+	}
+}
+
+void SceneBVH::QueryViews(const Culling::FrustumPlanes* views, UINT viewCount, std::uint8_t* masks) const
+{
+	assert(viewCount <= Culling::MaxViews);
+	memset(masks, 0, PrimitiveCount());
+	if (mNodes.empty() || mNodes[0].Count == 0 || viewCount == 0)
+		return;
+
+	// The plane normals point into the frustum
+	XMVECTOR planes[Culling::MaxViews][6];
+	XMVECTOR absNormals[Culling::MaxViews][6];
+	for (UINT v = 0; v < viewCount; ++v)
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			planes[v][i] = XMLoadFloat4(&views[v].Planes[i]);
+			absNormals[v][i] = XMVectorAbs(planes[v][i]);
+		}
+	}
+
+	auto classify = [&](UINT v, FXMVECTOR center, FXMVECTOR extent) -> ContainmentType
+	{
+		ContainmentType result = CONTAINS;
+		for (int i = 0; i < 6; ++i)
+		{
+			XMVECTOR distance = XMPlaneDotCoord(planes[v][i], center);
+			XMVECTOR radius = XMVector3Dot(extent, absNormals[v][i]);
+			if (XMVector4Greater(XMVectorNegate(distance), radius))
+				return DISJOINT;
+			if (XMVector4Greater(radius, distance))
+				result = INTERSECTS;
+		}
+		return result;
+	};
+
+	// Views still to test in the subtree and views already known to see all of it
+	struct Entry
+	{
+		UINT Node;
+		UINT Open;
+		UINT Inside;
+	};
+	Entry stack[MaxDepth + 1];
+	UINT top = 0;
+	stack[top++] = { 0, (1u << viewCount) - 1u, 0 };
+	while (top > 0)
+	{
+		const Entry entry = stack[--top];
+		const Node& node = mNodes[entry.Node];
+		XMVECTOR vMin = XMLoadFloat3(&node.Min);
+		XMVECTOR vMax = XMLoadFloat3(&node.Max);
+		XMVECTOR center = XMVectorScale(XMVectorAdd(vMin, vMax), 0.5f);
+		XMVECTOR extent = XMVectorScale(XMVectorSubtract(vMax, vMin), 0.5f);
+
+		UINT open = entry.Open;
+		UINT inside = entry.Inside;
+		for (UINT v = 0; v < viewCount; ++v)
+		{
+			if ((open & (1u << v)) == 0)
+				continue;
+			ContainmentType containment = classify(v, center, extent);
+			if (containment == INTERSECTS)
+				continue;
+			open &= ~(1u << v);
+			if (containment == CONTAINS)
+				inside |= 1u << v;
+		}
+
+		if (open == 0)
+		{
+			if (inside != 0)
+			{
+				for (UINT k = node.First; k < node.First + node.Count; ++k)
+					masks[mOrder[k]] = (std::uint8_t)inside;
+			}
+			continue;
+		}
+
+		if (node.IsLeaf())
+		{
+			for (UINT k = node.First; k < node.First + node.Count; ++k)
+			{
+				const UINT p = mOrder[k];
+				XMVECTOR pMin = XMLoadFloat3(&mPrimMin[p]);
+				XMVECTOR pMax = XMLoadFloat3(&mPrimMax[p]);
+				XMVECTOR pCenter = XMVectorScale(XMVectorAdd(pMin, pMax), 0.5f);
+				XMVECTOR pExtent = XMVectorScale(XMVectorSubtract(pMax, pMin), 0.5f);
+
+				UINT mask = inside;
+				for (UINT v = 0; v < viewCount; ++v)
+				{
+					if ((open & (1u << v)) != 0 && classify(v, pCenter, pExtent) != DISJOINT)
+						mask |= 1u << v;
+				}
+				masks[p] = (std::uint8_t)mask;
+			}
+			continue;
+		}
+
+		assert(top + 2 <= MaxDepth + 1);
+		stack[top++] = { node.Left + 1, open, inside };
+		stack[top++] = { node.Left, open, inside };
+	}
+}
+
+BoundingBox SceneBVH::Bounds() const
+{
+	BoundingBox box;
+	if (mNodes.empty())
+	{
+		box.Center = box.Extents = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		return box;
+	}
+	BoundingBox::CreateFromPoints(box, XMLoadFloat3(&mNodes[0].Min), XMLoadFloat3(&mNodes[0].Max));
+	return box;
+}
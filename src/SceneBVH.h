@@ -0,0 +1,69 @@
+#pragma once
+#include "DXHelper.h"
+#include "FrustumCulling.h"
+
+// Bounding volume hierarchy over world space boxes, one primitive per scene instance.
+// Built top down with a binned surface area heuristic. Moving primitives only refits the nodes above
+// them, so the tree keeps its topology and slowly loses quality under motion: Build again after large changes.
+class SceneBVH
+{
+public:
+	static const UINT BinCount = 16;
+	static const UINT MinLeafPrimitives = 4; // never split further, testing a few boxes is cheaper than visiting nodes
+	static const UINT MaxLeafPrimitives = 8; // always split when a plane separates the centroids
+	static const UINT MaxDepth = 64; // nodes this deep become leaves whatever their size, bounds the query stack
+
+	struct Node
+	{
+		XMFLOAT3 Min;
+		UINT Left = 0;   // right child is Left + 1, 0 for leaves (the root is never a child)
+		XMFLOAT3 Max;
+		UINT First = 0;  // primitives [First, First + Count) of the build order, inner nodes included
+		UINT Count = 0;
+		UINT Parent = 0;
+
+		bool IsLeaf() const { return Left == 0; }
+	};
+
+	void Build(const BoundingBox* boxes, UINT count);
+
+	// Moves one primitive, the nodes above it are fixed up by the next Refit.
+	void SetBounds(UINT primitive, const BoundingBox& box);
+	// Refits the nodes above every primitive moved since the last call, returns how many nodes it touched.
+	UINT Refit();
+
+	// Appends the primitives whose box overlaps the frustum to out, in no particular order.
+	// Every box is first swept along sweep, i.e. the box and its copy moved by sweep both count:
+	// with the light direction times the scene size this also keeps the shadow casters of everything in view.
+	void Query(const BoundingFrustum& frustum, FXMVECTOR sweep, std::vector<UINT>& out) const;
+
+	// Tests all viewCount <= Culling::MaxViews views in one traversal and writes one byte per primitive to masks,
+	// bit v set when the primitive overlaps views[v]. A node carries the views still undecided for it down the tree,
+	// views that see it whole or not at all drop out. masks must hold PrimitiveCount() bytes.
+	void QueryViews(const Culling::FrustumPlanes* views, UINT viewCount, std::uint8_t* masks) const;
+
+	UINT PrimitiveCount() const { return (UINT)mPrimMin.size(); }
+	UINT NodeCount() const { return (UINT)mNodes.size(); }
+	UINT Depth() const { return mDepth; }
+	const std::vector<Node>& Nodes() const { return mNodes; }
+
+	// Bounds of the whole tree, empty at the origin when there are no primitives.
+	BoundingBox Bounds() const;
+
+private:
+	// Node bounds from the primitives or the children, returns false when they did not change.
+	bool UpdateLeafBounds(UINT node);
+	bool UpdateInnerBounds(UINT node);
+	// Splits node in two with the cheapest binned SAH plane, returns false when it stays a leaf.
+	bool Split(UINT node, UINT depth);
+
+	std::vector<Node> mNodes;
+	std::vector<XMFLOAT3> mPrimMin;
+	std::vector<XMFLOAT3> mPrimMax;
+	std::vector<XMFLOAT3> mCentroids; // at build time, refits do not move primitives between leaves
+	std::vector<UINT> mOrder;         // primitives grouped by leaf
+	std::vector<UINT> mPrimLeaf;
+	std::vector<UINT> mDirtyLeaves;
+	std::vector<std::uint8_t> mLeafDirty; // per node
+	UINT mDepth = 0;
+};
@@ -35,6 +35,25 @@ void SceneColorRT::BuildResource()
         IID_PPV_ARGS(&mSceneColor)));
 }
 
+void SceneColorRT::PlaceResource(ID3D12Heap* heap, UINT64 offset)
+{
+    const D3D12_RESOURCE_DESC texDesc = ResourceDesc();
+    CD3DX12_CLEAR_VALUE optClear(mFormat, mClearColor);
+
+    // The lighting pass moves it from PRESENT to RENDER_TARGET and back
+    mSceneColor.Reset();
+    ThrowIfFailed(md3dDevice->CreatePlacedResource(
+        heap,
+        offset,
+        &texDesc,
+        D3D12_RESOURCE_STATE_PRESENT,
+        &optClear,
+        IID_PPV_ARGS(&mSceneColor)));
+    mPlaced = true;
+
+    BuildDescriptors();
+}
+
 void SceneColorRT::BuildDescriptors(
     CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
     CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
@@ -78,7 +97,10 @@ void SceneColorRT::OnResize(UINT newWidth, UINT newHeight)
         mViewport = { 0.0f, 0.0f, (float)newWidth, (float)newHeight, 0.0f, 1.0f };
         mScissorRect = { 0, 0, (int)newWidth, (int)newHeight };
 
-        BuildResource();
-		BuildDescriptors();
+        if (!mPlaced)
+        {
+            BuildResource();
+            BuildDescriptors();
+        }
     }
 }
\ No newline at end of file
@@ -27,8 +27,16 @@ public:
         CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
         CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuRtv);
 
+    // Once the target is placed OnResize leaves building a new one to the owner of the heap
     void OnResize(UINT newWidth, UINT newHeight);
 
+    D3D12_RESOURCE_DESC ResourceDesc() const
+    {
+        return CD3DX12_RESOURCE_DESC::Tex2D(mFormat, mWidth, mHeight, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+    }
+    // Replaces the target with one placed at offset in heap and rebuilds its views
+    void PlaceResource(ID3D12Heap* heap, UINT64 offset);
+
 private:
     void BuildResource();
     void BuildDescriptors();
@@ -51,4 +59,5 @@ private:
     CD3DX12_CPU_DESCRIPTOR_HANDLE mCpuRtv;
 
     ComPtr<ID3D12Resource> mSceneColor = nullptr;
+    bool mPlaced = false;
 };
\ No newline at end of file
@@ -0,0 +1,365 @@
+#include "SceneStore.h"
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+
+SceneHandle SceneStore::Create(const InstanceDesc& desc)
+{
+	const UINT index = Count();
+	UINT slot;
+	if (!mFreeSlots.empty())
+	{
+		slot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+	}
+	else
+	{
+		slot = (UINT)mSlotToDense.size();
+		mSlotToDense.push_back(UINT_MAX);
+		mGenerations.push_back(0);
+	}
+	mSlotToDense[slot] = index;
+	mDenseToSlot.push_back(slot);
+
+	mWorlds.push_back(desc.World);
+	mLocalBounds.push_back(desc.LocalBounds);
+	mMaterialIndices.push_back(desc.MaterialIndex);
+	mFlags.push_back(desc.Flags & ~MovedFlag);
+	mLayerMasks.push_back(desc.LayerMask);
+	mOwners.push_back({ desc.Item, desc.ItemInstance });
+	mCold.push_back({ desc.Name, desc.Geo });
+
+	mWorldBounds.Resize(index + 1);
+	mWorldBounds.Set(index, TransformBounds(index));
+	return { slot, mGenerations[slot] };
+}
+
+void SceneStore::Destroy(SceneHandle handle)
+{
+	const UINT index = IndexOf(handle);
+	assert(index != UINT_MAX);
+	if (index == UINT_MAX)
+		return;
+
+	// The last instance takes the place of the destroyed one
+	const UINT last = Count() - 1;
+	if (index != last)
+	{
+		mWorlds[index] = mWorlds[last];
+		mLocalBounds[index] = mLocalBounds[last];
+		mMaterialIndices[index] = mMaterialIndices[last];
+		mFlags[index] = mFlags[last];
+		mLayerMasks[index] = mLayerMasks[last];
+		mOwners[index] = mOwners[last];
+		mCold[index] = std::move(mCold[last]);
+		mWorldBounds.Set(index, WorldBox(last));
+
+		mDenseToSlot[index] = mDenseToSlot[last];
+		mSlotToDense[mDenseToSlot[index]] = index;
+	}
+	for (size_t m = 0; m < mMoved.size();)
+	{
+		if (mMoved[m] == index)
+		{
+			mMoved[m] = mMoved.back();
+			mMoved.pop_back();
+			continue;
+		}
+		if (mMoved[m] == last)
+			mMoved[m] = index;
+		++m;
+	}
+
+	mWorlds.pop_back();
+	mLocalBounds.pop_back();
+	mMaterialIndices.pop_back();
+	mFlags.pop_back();
+	mLayerMasks.pop_back();
+	mOwners.pop_back();
+	mCold.pop_back();
+	mDenseToSlot.pop_back();
+	mWorldBounds.Resize(last);
+
+	mSlotToDense[handle.Index] = UINT_MAX;
+	mGenerations[handle.Index]++;
+	mFreeSlots.push_back(handle.Index);
+}
+
+void SceneStore::Clear()
+{
+	// Outstanding handles stay invalid, their slots come back with a new generation
+	for (UINT slot : mDenseToSlot)
+	{
+		mSlotToDense[slot] = UINT_MAX;
+		mGenerations[slot]++;
+		mFreeSlots.push_back(slot);
+	}
+	mDenseToSlot.clear();
+
+	mWorlds.clear();
+	mLocalBounds.clear();
+	mMaterialIndices.clear();
+	mFlags.clear();
+	mLayerMasks.clear();
+	mOwners.clear();
+	mCold.clear();
+	mWorldBounds.Resize(0);
+	mMoved.clear();
+}
+
+void SceneStore::Reserve(UINT count)
+{
+	mWorlds.reserve(count);
+	mLocalBounds.reserve(count);
+	mMaterialIndices.reserve(count);
+	mFlags.reserve(count);
+	mLayerMasks.reserve(count);
+	mOwners.reserve(count);
+	mCold.reserve(count);
+	mDenseToSlot.reserve(count);
+	const size_t padded = (count + 7) & ~7u;
+	for (auto* stream : { &mWorldBounds.CenterX, &mWorldBounds.CenterY, &mWorldBounds.CenterZ,
+		&mWorldBounds.ExtentX, &mWorldBounds.ExtentY, &mWorldBounds.ExtentZ })
+		stream->reserve(padded);
+}
+
+bool SceneStore::IsValid(SceneHandle handle) const
+{
+	return handle.Index < mSlotToDense.size() && mSlotToDense[handle.Index] != UINT_MAX &&
+		mGenerations[handle.Index] == handle.Generation;
+}
+
+UINT SceneStore::IndexOf(SceneHandle handle) const
+{
+	return IsValid(handle) ? mSlotToDense[handle.Index] : UINT_MAX;
+}
+
+void SceneStore::SetWorld(UINT index, const XMFLOAT4X4& world)
+{
+	mWorlds[index] = world;
+	mWorldBounds.Set(index, TransformBounds(index));
+	if ((mFlags[index] & MovedFlag) == 0)
+	{
+		mFlags[index] |= MovedFlag;
+		mMoved.push_back(index);
+	}
+}
+
+void SceneStore::ClearMoved()
+{
+	for (UINT index : mMoved)
+		mFlags[index] &= ~MovedFlag;
+	mMoved.clear();
+}
+
+void SceneStore::Select(UINT layerMask, std::vector<UINT>& out) const
+{
+	out.clear();
+	for (UINT i = 0; i < Count(); ++i)
+	{
+		if (mLayerMasks[i] & layerMask)
+			out.push_back(i);
+	}
+}
+
+void SceneStore::KeepLayers(UINT layerMask, std::uint8_t* masks) const
+{
+	for (UINT i = 0; i < Count(); ++i)
+		masks[i] = (mLayerMasks[i] & layerMask) ? masks[i] : 0;
+}
+
+BoundingBox SceneStore::WorldBox(UINT index) const
+{
+	return BoundingBox(
+		XMFLOAT3(mWorldBounds.CenterX[index], mWorldBounds.CenterY[index], mWorldBounds.CenterZ[index]),
+		XMFLOAT3(mWorldBounds.ExtentX[index], mWorldBounds.ExtentY[index], mWorldBounds.ExtentZ[index]));
+}
+
+BoundingBox SceneStore::TransformBounds(UINT index) const
+{
+	BoundingBox box;
+	mLocalBounds[index].Transform(box, XMLoadFloat4x4(&mWorlds[index]));
+	return box;
+}
+
+namespace
+{
+	// What the loops read of a RenderItem, with the members around them so the instances sit as far apart as
+	// they do in the real items
+	struct ItemInstance
+	{
+		XMFLOAT4X4 World;
+		XMFLOAT4X4 TexTransform;
+		XMFLOAT4X4 InvTpsWorld;
+		UINT MaterialIndex = 0;
+		UINT AOType = 0;
+		BoundingBox WorldBox;
+	};
+
+	struct SyntheticItem
+	{
+		XMFLOAT4X4 World;
+		XMFLOAT4X4 TexTransform;
+		int NumFrameDirty = 0;
+		std::string Name;
+		std::vector<ItemInstance> Instances;
+		BoundingBox Bounds;
+		UINT Layer = 0;
+		std::vector<UINT> VisibleInstances;
+	};
+
+	const UINT SyntheticLayers = 3;
+	const UINT SyntheticCulledLayers = 0x3; // layer 2 is drawn whole, like the sky
+
+	bool BoxInPlanes(const Culling::FrustumPlanes& planes, float cx, float cy, float cz, float ex, float ey, float ez)
+	{
+		for (int k = 0; k < 6; ++k)
+		{
+			const XMFLOAT4& p = planes.Planes[k];
+			float d = p.x * cx + p.y * cy + p.z * cz + p.w;
+			float r = fabsf(p.x) * ex + fabsf(p.y) * ey + fabsf(p.z) * ez;
+			if (d < -r)
+				return false;
+		}
+		return true;
+	}
+}
+
+SceneStoreTiming MeasureSceneStore(UINT count, int iterations)
+{
+	SceneStoreTiming result;
+	result.Instances = count;
+
+	std::mt19937 rng(count);
+	const float side = 4.0f * cbrtf((float)count);
+	std::uniform_real_distribution<float> position(-0.5f * side, 0.5f * side);
+	std::uniform_real_distribution<float> size(0.2f, 1.5f);
+
+	// Items are allocated one after the other with their names and instance lists in between, the way the
+	// app builds its render items
+	std::vector<std::unique_ptr<SyntheticItem>> items;
+	std::vector<SyntheticItem*> layers[SyntheticLayers];
+	SceneStore store;
+	store.Reserve(count);
+	for (UINT instance = 0; instance < count;)
+	{
+		auto item = std::make_unique<SyntheticItem>();
+		item->Name = "item" + std::to_string(items.size()) + std::string(rng() % 24, '_');
+		item->Bounds = BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(size(rng), size(rng), size(rng)));
+		item->Layer = (UINT)(rng() % SyntheticLayers);
+		item->Instances.resize(std::min(1 + (UINT)(rng() % 4), count - instance));
+		for (UINT i = 0; i < (UINT)item->Instances.size(); ++i, ++instance)
+		{
+			ItemInstance& data = item->Instances[i];
+			XMStoreFloat4x4(&data.World, XMMatrixTranslation(position(rng), position(rng), position(rng)));
+			data.MaterialIndex = (UINT)(rng() % 64);
+			item->Bounds.Transform(data.WorldBox, XMLoadFloat4x4(&data.World));
+
+			SceneStore::InstanceDesc desc;
+			desc.World = data.World;
+			desc.LocalBounds = item->Bounds;
+			desc.MaterialIndex = data.MaterialIndex;
+			desc.LayerMask = 1u << item->Layer;
+			desc.Item = (UINT)items.size();
+			desc.ItemInstance = i;
+			desc.Name = item->Name;
+			store.Create(desc);
+		}
+		layers[item->Layer].push_back(item.get());
+		items.push_back(std::move(item));
+	}
+	result.Items = (UINT)items.size();
+
+	XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0.0f, 0.2f * side, -0.6f * side, 1.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f * XM_PI, 16.0f / 9.0f, 0.1f, 1000.0f);
+	const Culling::FrustumPlanes planes = Culling::ExtractPlanes(XMMatrixMultiply(view, proj));
+
+	// Update: every instance drifts a little, its world box follows
+	const XMMATRIX step = XMMatrixTranslation(0.001f, 0.0f, -0.001f);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+	{
+		for (auto& item : items)
+		{
+			for (ItemInstance& data : item->Instances)
+			{
+				XMMATRIX world = XMMatrixMultiply(XMLoadFloat4x4(&data.World), step);
+				XMStoreFloat4x4(&data.World, world);
+				item->Bounds.Transform(data.WorldBox, world);
+			}
+		}
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	result.ItemUpdateMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+	{
+		for (UINT i = 0; i < store.Count(); ++i)
+		{
+			XMFLOAT4X4 world;
+			XMStoreFloat4x4(&world, XMMatrixMultiply(XMLoadFloat4x4(&store.Worlds()[i]), step));
+			store.SetWorld(i, world);
+		}
+		store.ClearMoved();
+	}
+	end = std::chrono::high_resolution_clock::now();
+	result.StoreUpdateMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+
+	// Culling: the items of the culled layers through their pointer lists, the store by layer bits
+	start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+	{
+		UINT visible = 0;
+		for (UINT layer = 0; layer < SyntheticLayers; ++layer)
+		{
+			if ((SyntheticCulledLayers & (1u << layer)) == 0)
+				continue;
+			for (SyntheticItem* item : layers[layer])
+			{
+				item->VisibleInstances.clear();
+				for (UINT i = 0; i < (UINT)item->Instances.size(); ++i)
+				{
+					const BoundingBox& box = item->Instances[i].WorldBox;
+					if (BoxInPlanes(planes, box.Center.x, box.Center.y, box.Center.z, box.Extents.x, box.Extents.y, box.Extents.z))
+						item->VisibleInstances.push_back(i);
+				}
+				visible += (UINT)item->VisibleInstances.size();
+			}
+		}
+		result.ItemVisible = visible;
+	}
+	end = std::chrono::high_resolution_clock::now();
+	result.ItemCullMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+
+	const Culling::InstanceBoxes& boxes = store.WorldBounds();
+	const UINT* layerMasks = store.LayerMasks();
+	std::vector<UINT> visibleIndices(boxes.PaddedCount());
+	start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+	{
+		UINT visible = 0;
+		for (UINT i = 0; i < store.Count(); ++i)
+		{
+			if ((layerMasks[i] & SyntheticCulledLayers) &&
+				BoxInPlanes(planes, boxes.CenterX[i], boxes.CenterY[i], boxes.CenterZ[i], boxes.ExtentX[i], boxes.ExtentY[i], boxes.ExtentZ[i]))
+				visibleIndices[visible++] = i;
+		}
+		result.StoreVisible = visible;
+	}
+	end = std::chrono::high_resolution_clock::now();
+	result.StoreCullMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+
+	std::vector<std::uint8_t> masks(boxes.PaddedCount());
+	start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+	{
+		Culling::CullViews(boxes, &planes, 1, masks.data());
+		store.KeepLayers(SyntheticCulledLayers, masks.data());
+	}
+	end = std::chrono::high_resolution_clock::now();
+	result.StoreSimdMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+	return result;
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include "DXHelper.h"
+#include "FrustumCulling.h"
+#include <string>
+
+struct MeshGeometry;
+
+// Stable name of a scene instance. Index picks a slot of the handle table, Generation is bumped every time the
+// slot is freed so a handle of a destroyed instance never resolves to the instance that reuses the slot.
+struct SceneHandle
+{
+	UINT Index = UINT_MAX;
+	UINT Generation = 0;
+};
+
+// Scene instances as structure of arrays. What the per frame loops touch lives in dense parallel streams
+// indexed 0..Count()-1: world matrix, object and world space bounds, material index, flags, a bitmask of the
+// layers the instance is drawn in and the render item it belongs to. The world bounds are culling box streams,
+// the culling kernels run on them directly. Names and geometry are only looked up by tools and sit in a cold array.
+// Destroy moves the last instance into the freed place, so dense indices stay packed but are only stable as long
+// as nothing is destroyed; keep handles for anything longer lived.
+class SceneStore
+{
+public:
+	static const UINT MaxLayers = 32;
+	static const UINT MovedFlag = 1u << 31; // set by SetWorld until ClearMoved, the other flag bits are the caller's
+
+	struct InstanceDesc
+	{
+		XMFLOAT4X4 World = XMFLOAT4X4(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+		BoundingBox LocalBounds;
+		UINT MaterialIndex = 0;
+		UINT Flags = 0;
+		UINT LayerMask = 0;
+		UINT Item = 0;         // owner of the instance, e.g. an index into the render items
+		UINT ItemInstance = 0; // which of the owner's instances it is
+		std::string Name;
+		MeshGeometry* Geo = nullptr;
+	};
+
+	struct Owner
+	{
+		UINT Item = 0;
+		UINT ItemInstance = 0;
+	};
+
+	struct Cold
+	{
+		std::string Name;
+		MeshGeometry* Geo = nullptr;
+	};
+
+	SceneHandle Create(const InstanceDesc& desc);
+	void Destroy(SceneHandle handle);
+	void Clear();
+	void Reserve(UINT count);
+
+	bool IsValid(SceneHandle handle) const;
+	UINT IndexOf(SceneHandle handle) const; // dense index, UINT_MAX for invalid handles
+	SceneHandle HandleOf(UINT index) const { return { mDenseToSlot[index], mGenerations[mDenseToSlot[index]] }; }
+	UINT Count() const { return (UINT)mWorlds.size(); }
+
+	// Replaces the world matrix, recomputes the world bounds and marks the instance moved
+	void SetWorld(UINT index, const XMFLOAT4X4& world);
+	void SetMaterialIndex(UINT index, UINT materialIndex) { mMaterialIndices[index] = materialIndex; }
+	void SetLayerMask(UINT index, UINT layerMask) { mLayerMasks[index] = layerMask; }
+
+	// Instances moved since the last ClearMoved, in the order they moved
+	const std::vector<UINT>& Moved() const { return mMoved; }
+	void ClearMoved();
+
+	// Dense indices of the instances in any of the layers of layerMask
+	void Select(UINT layerMask, std::vector<UINT>& out) const;
+	// Zeroes masks[i] of every instance in none of the layers of layerMask, e.g. the cull masks of hidden layers
+	void KeepLayers(UINT layerMask, std::uint8_t* masks) const;
+
+	const XMFLOAT4X4* Worlds() const { return mWorlds.data(); }
+	const BoundingBox* LocalBounds() const { return mLocalBounds.data(); }
+	const Culling::InstanceBoxes& WorldBounds() const { return mWorldBounds; }
+	const UINT* MaterialIndices() const { return mMaterialIndices.data(); }
+	const UINT* Flags() const { return mFlags.data(); }
+	const UINT* LayerMasks() const { return mLayerMasks.data(); }
+	const Owner* Owners() const { return mOwners.data(); }
+	BoundingBox WorldBox(UINT index) const; // from the streams
+	const Cold& ColdData(UINT index) const { return mCold[index]; }
+
+private:
+	BoundingBox TransformBounds(UINT index) const;
+
+	// Hot, one entry per instance
+	std::vector<XMFLOAT4X4> mWorlds;
+	std::vector<BoundingBox> mLocalBounds;
+	Culling::InstanceBoxes mWorldBounds;
+	std::vector<UINT> mMaterialIndices;
+	std::vector<UINT> mFlags;
+	std::vector<UINT> mLayerMasks;
+	std::vector<Owner> mOwners;
+	// Cold, one entry per instance
+	std::vector<Cold> mCold;
+
+	// Handle table: slot -> dense index and generation, dense index -> slot, free slots
+	std::vector<UINT> mSlotToDense;
+	std::vector<UINT> mGenerations;
+	std::vector<UINT> mDenseToSlot;
+	std::vector<UINT> mFreeSlots;
+
+	std::vector<UINT> mMoved;
+};
+
+struct SceneStoreTiming
+{
+	UINT Instances = 0;
+	UINT Items = 0;
+	double ItemUpdateMs = 0.0;  // move every instance and transform its bounds, walking the items and their instances
+	double StoreUpdateMs = 0.0; // the same over the store streams
+	double ItemCullMs = 0.0;    // plane test of the world boxes of the culled layers, walking the layer pointer lists
+	double StoreCullMs = 0.0;   // the same plane test over the store streams, layers picked by bitmask
+	double StoreSimdMs = 0.0;   // Culling::CullViews over the store streams plus KeepLayers
+	UINT ItemVisible = 0;
+	UINT StoreVisible = 0;
+};
+
+// Builds count instances spread over render item like objects (one to four instances each, three layers, two of
+// them culled) once as heap allocated items with per layer pointer lists and once as a SceneStore, then runs the
+// update and culling loops over both iterations times on the calling thread.
+SceneStoreTiming MeasureSceneStore(UINT count, int iterations);
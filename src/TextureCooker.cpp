@@ -0,0 +1,1010 @@
+#include "TextureCooker.h"
+#include "BCDecoder.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+	using TextureCooker::CookSettings;
+	using TextureCooker::Image;
+	using TextureCooker::TextureKind;
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	double MsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	template<typename T>
+	T Clamp(T v, T lo, T hi)
+	{
+		return std::min(std::max(v, lo), hi);
+	}
+
+	// ---- color space ----
+
+	float SrgbToLinear(float v)
+	{
+		return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+	}
+
+	float LinearToSrgb(float v)
+	{
+		return v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+	}
+
+	std::uint8_t ToUnorm8(float v)
+	{
+		return (std::uint8_t)(Clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+
+	void NormalizeXYZ(float* t)
+	{
+		float len = std::sqrt(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+		if (len < 1e-6f)
+		{
+			t[0] = t[1] = 0.0f;
+			t[2] = 1.0f;
+			return;
+		}
+		t[0] /= len;
+		t[1] /= len;
+		t[2] /= len;
+	}
+
+	// ---- Kaiser windowed sinc ----
+
+	double BesselI0(double x)
+	{
+		double sum = 1.0, term = 1.0, half = x * 0.5;
+		for (int k = 1; k < 32; ++k)
+		{
+			term *= (half / k) * (half / k);
+			sum += term;
+			if (term < sum * 1e-12)
+				break;
+		}
+		return sum;
+	}
+
+	double KaiserSinc(double x, double width, double alpha)
+	{
+		if (std::fabs(x) >= width)
+			return 0.0;
+		const double pi = 3.14159265358979323846;
+		double sinc = x == 0.0 ? 1.0 : std::sin(pi * x) / (pi * x);
+		double r = x / width;
+		return sinc * BesselI0(alpha * std::sqrt(1.0 - r * r)) / BesselI0(alpha);
+	}
+
+	// Taps of one axis of a src -> dst resample, TapCount weights per destination texel.
+	struct AxisFilter
+	{
+		std::uint32_t TapCount = 0;
+		std::vector<int> First;
+		std::vector<float> Weights;
+	};
+
+	AxisFilter BuildAxisFilter(std::uint32_t src, std::uint32_t dst, const CookSettings& settings)
+	{
+		const double scale = (double)src / dst;
+		const double radius = settings.KaiserWidth * scale;
+
+		AxisFilter filter;
+		filter.TapCount = (std::uint32_t)std::ceil(2.0 * radius) + 1;
+		filter.First.resize(dst);
+		filter.Weights.assign((size_t)dst * filter.TapCount, 0.0f);
+		for (std::uint32_t o = 0; o < dst; ++o)
+		{
+			// texel centers are at j + 0.5
+			const double center = (o + 0.5) * scale;
+			const int first = (int)std::ceil(center - radius - 0.5);
+			filter.First[o] = first;
+
+			float* weights = &filter.Weights[(size_t)o * filter.TapCount];
+			double sum = 0.0;
+			for (std::uint32_t t = 0; t < filter.TapCount; ++t)
+			{
+				double x = (first + (int)t + 0.5 - center) / scale;
+				double w = KaiserSinc(x, settings.KaiserWidth, settings.KaiserAlpha);
+				weights[t] = (float)w;
+				sum += w;
+			}
+			for (std::uint32_t t = 0; t < filter.TapCount && sum != 0.0; ++t)
+				weights[t] = (float)(weights[t] / sum);
+		}
+		return filter;
+	}
+
+	inline int Address(int i, int size, bool wrap)
+	{
+		if (wrap)
+			return ((i % size) + size) % size;
+		return Clamp(i, 0, size - 1);
+	}
+
+	template<typename Body>
+	void RunRows(std::uint32_t rows, bool parallel, Body&& body)
+	{
+		if (parallel)
+			ParallelFor(rows, 8, body);
+		else
+			body(size_t(0), size_t(rows));
+	}
+
+	Image Downsample(const Image& src, const CookSettings& settings)
+	{
+		Image dst;
+		dst.Width = std::max(src.Width / 2, 1u);
+		dst.Height = std::max(src.Height / 2, 1u);
+		dst.Texels.assign((size_t)dst.Width * dst.Height * 4, 0.0f);
+
+		const AxisFilter fx = BuildAxisFilter(src.Width, dst.Width, settings);
+		const AxisFilter fy = BuildAxisFilter(src.Height, dst.Height, settings);
+		const bool wrap = settings.WrapAddressing;
+
+		// Horizontal pass into dst.Width x src.Height
+		std::vector<float> tmp((size_t)dst.Width * src.Height * 4, 0.0f);
+		RunRows(src.Height, settings.Parallel, [&](size_t begin, size_t end)
+		{
+			for (size_t y = begin; y < end; ++y)
+			{
+				const float* srcRow = &src.Texels[y * src.Width * 4];
+				float* tmpRow = &tmp[y * dst.Width * 4];
+				for (std::uint32_t x = 0; x < dst.Width; ++x)
+				{
+					const float* weights = &fx.Weights[(size_t)x * fx.TapCount];
+					float acc[4] = {};
+					for (std::uint32_t t = 0; t < fx.TapCount; ++t)
+					{
+						const float* s = srcRow + Address(fx.First[x] + (int)t, (int)src.Width, wrap) * 4;
+						for (int c = 0; c < 4; ++c)
+							acc[c] += weights[t] * s[c];
+					}
+					memcpy(tmpRow + x * 4, acc, sizeof(acc));
+				}
+			}
+		});
+
+		// Vertical pass, whole rows at a time
+		const size_t rowFloats = (size_t)dst.Width * 4;
+		RunRows(dst.Height, settings.Parallel, [&](size_t begin, size_t end)
+		{
+			for (size_t y = begin; y < end; ++y)
+			{
+				float* dstRow = &dst.Texels[y * rowFloats];
+				const float* weights = &fy.Weights[y * fy.TapCount];
+				for (std::uint32_t t = 0; t < fy.TapCount; ++t)
+				{
+					if (weights[t] == 0.0f)
+						continue;
+					const float* tmpRow = &tmp[Address(fy.First[y] + (int)t, (int)src.Height, wrap) * rowFloats];
+					for (size_t i = 0; i < rowFloats; ++i)
+						dstRow[i] += weights[t] * tmpRow[i];
+				}
+
+				// The negative lobes can ring past the valid range
+				for (std::uint32_t x = 0; x < dst.Width; ++x)
+				{
+					float* t = dstRow + x * 4;
+					if (settings.Kind == TextureKind::NormalMap)
+						NormalizeXYZ(t);
+					else
+					{
+						for (int c = 0; c < 3; ++c)
+							t[c] = Clamp(t[c], 0.0f, 1.0f);
+					}
+					t[3] = Clamp(t[3], 0.0f, 1.0f);
+				}
+			}
+		});
+		return dst;
+	}
+
+	// ---- BC1 ----
+
+	struct BC1Endpoints
+	{
+		std::uint16_t C0 = 0;
+		std::uint16_t C1 = 0;
+	};
+
+	std::uint16_t Pack565(const float* c)
+	{
+		int r = (int)(Clamp(c[0], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+		int g = (int)(Clamp(c[1], 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+		int b = (int)(Clamp(c[2], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+		return (std::uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	void Unpack565(std::uint16_t c, int* rgb)
+	{
+		int r5 = (c >> 11) & 31, g6 = (c >> 5) & 63, b5 = c & 31;
+		rgb[0] = (r5 << 3) | (r5 >> 2);
+		rgb[1] = (g6 << 2) | (g6 >> 4);
+		rgb[2] = (b5 << 3) | (b5 >> 2);
+	}
+
+	// Index weights of endpoint 0 in the palette the decoder builds, <0 marks the transparent entry.
+	const float BC1FourColorWeights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	const float BC1ThreeColorWeights[4] = { 1.0f, 0.0f, 0.5f, -1.0f };
+
+	// Orders the endpoints for the wanted mode, picks indices against the decoder's palette and
+	// returns the squared error.
+	float BC1Evaluate(const float colors[16][3], const bool transparent[16], bool punchThrough, bool forceFourColors,
+		BC1Endpoints& ep, std::uint8_t indices[16])
+	{
+		if (punchThrough ? ep.C0 > ep.C1 : ep.C0 < ep.C1)
+			std::swap(ep.C0, ep.C1);
+		const bool fourColors = ep.C0 > ep.C1 || forceFourColors;
+
+		int a[3], b[3];
+		Unpack565(ep.C0, a);
+		Unpack565(ep.C1, b);
+		int palette[4][3];
+		for (int c = 0; c < 3; ++c)
+		{
+			palette[0][c] = a[c];
+			palette[1][c] = b[c];
+			palette[2][c] = fourColors ? (2 * a[c] + b[c]) / 3 : (a[c] + b[c]) / 2;
+			palette[3][c] = fourColors ? (a[c] + 2 * b[c]) / 3 : 0;
+		}
+		const int candidates = fourColors ? 4 : 3;
+
+		float error = 0.0f;
+		for (int i = 0; i < 16; ++i)
+		{
+			if (transparent[i])
+			{
+				indices[i] = 3;
+				continue;
+			}
+			float best = 1e30f;
+			for (int k = 0; k < candidates; ++k)
+			{
+				float d = 0.0f;
+				for (int c = 0; c < 3; ++c)
+				{
+					float e = colors[i][c] - palette[k][c];
+					d += e * e;
+				}
+				if (d < best)
+				{
+					best = d;
+					indices[i] = (std::uint8_t)k;
+				}
+			}
+			error += best;
+		}
+		return error;
+	}
+
+	// Least squares endpoints for fixed indices, false when the system is singular.
+	bool BC1SolveEndpoints(const float colors[16][3], const bool transparent[16], const std::uint8_t indices[16],
+		bool fourColors, float e0[3], float e1[3])
+	{
+		const float* weights = fourColors ? BC1FourColorWeights : BC1ThreeColorWeights;
+		float aa = 0, ab = 0, bb = 0, ax[3] = {}, bx[3] = {};
+		for (int i = 0; i < 16; ++i)
+		{
+			if (transparent[i])
+				continue;
+			float a = weights[indices[i]], b = 1.0f - a;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < 3; ++c)
+			{
+				ax[c] += a * colors[i][c];
+				bx[c] += b * colors[i][c];
+			}
+		}
+		float det = aa * bb - ab * ab;
+		if (std::fabs(det) < 1e-6f)
+			return false;
+		for (int c = 0; c < 3; ++c)
+		{
+			e0[c] = (ax[c] * bb - bx[c] * ab) / det;
+			e1[c] = (bx[c] * aa - ax[c] * ab) / det;
+		}
+		return true;
+	}
+
+	// Principal axis of n points by power iteration, zero when they are all the same.
+	template<int N>
+	void PrincipalAxis(const float (*points)[N], const bool* skip, int count, float mean[N], float axis[N])
+	{
+		int used = 0;
+		for (int c = 0; c < N; ++c)
+			mean[c] = 0.0f;
+		for (int i = 0; i < count; ++i)
+		{
+			if (skip && skip[i])
+				continue;
+			for (int c = 0; c < N; ++c)
+				mean[c] += points[i][c];
+			++used;
+		}
+		for (int c = 0; c < N; ++c)
+			mean[c] /= std::max(used, 1);
+
+		float cov[N][N] = {};
+		for (int i = 0; i < count; ++i)
+		{
+			if (skip && skip[i])
+				continue;
+			float d[N];
+			for (int c = 0; c < N; ++c)
+				d[c] = points[i][c] - mean[c];
+			for (int r = 0; r < N; ++r)
+				for (int c = 0; c < N; ++c)
+					cov[r][c] += d[r] * d[c];
+		}
+
+		// Start from the row of the largest variance, it is never orthogonal to the main axis
+		int start = 0;
+		for (int c = 1; c < N; ++c)
+			if (cov[c][c] > cov[start][start])
+				start = c;
+		for (int c = 0; c < N; ++c)
+			axis[c] = cov[start][c];
+
+		for (int iter = 0; iter < 8; ++iter)
+		{
+			float next[N] = {};
+			for (int r = 0; r < N; ++r)
+				for (int c = 0; c < N; ++c)
+					next[r] += cov[r][c] * axis[c];
+			float len = 0.0f;
+			for (int c = 0; c < N; ++c)
+				len += next[c] * next[c];
+			len = std::sqrt(len);
+			if (len < 1e-6f)
+			{
+				for (int c = 0; c < N; ++c)
+					axis[c] = 0.0f;
+				return;
+			}
+			for (int c = 0; c < N; ++c)
+				axis[c] = next[c] / len;
+		}
+	}
+
+	void EncodeBC1Color(const std::uint8_t* rgba, std::uint8_t* block, bool forceFourColors)
+	{
+		float colors[16][3];
+		bool transparent[16];
+		bool punchThrough = false;
+		int opaque = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			for (int c = 0; c < 3; ++c)
+				colors[i][c] = rgba[i * 4 + c];
+			transparent[i] = !forceFourColors && rgba[i * 4 + 3] < 128;
+			punchThrough |= transparent[i];
+			opaque += transparent[i] ? 0 : 1;
+		}
+
+		BC1Endpoints best;
+		std::uint8_t bestIndices[16] = {};
+		if (opaque == 0)
+		{
+			memset(bestIndices, 3, sizeof(bestIndices));
+		}
+		else
+		{
+			float mean[3], axis[3];
+			PrincipalAxis<3>(colors, transparent, 16, mean, axis);
+			float tMin = 0.0f, tMax = 0.0f;
+			for (int i = 0; i < 16; ++i)
+			{
+				if (transparent[i])
+					continue;
+				float t = 0.0f;
+				for (int c = 0; c < 3; ++c)
+					t += (colors[i][c] - mean[c]) * axis[c];
+				tMin = std::min(tMin, t);
+				tMax = std::max(tMax, t);
+			}
+			float e0[3], e1[3];
+			for (int c = 0; c < 3; ++c)
+			{
+				e0[c] = mean[c] + axis[c] * tMax;
+				e1[c] = mean[c] + axis[c] * tMin;
+			}
+
+			best.C0 = Pack565(e0);
+			best.C1 = Pack565(e1);
+			float bestError = BC1Evaluate(colors, transparent, punchThrough, forceFourColors, best, bestIndices);
+
+			// Refit the endpoints to the chosen indices while that keeps improving
+			for (int iter = 0; iter < 2 && bestError > 0.0f; ++iter)
+			{
+				const bool fourColors = best.C0 > best.C1 || forceFourColors;
+				if (!BC1SolveEndpoints(colors, transparent, bestIndices, fourColors, e0, e1))
+					break;
+				BC1Endpoints ep;
+				ep.C0 = Pack565(e0);
+				ep.C1 = Pack565(e1);
+				std::uint8_t indices[16];
+				float error = BC1Evaluate(colors, transparent, punchThrough, forceFourColors, ep, indices);
+				if (error >= bestError)
+					break;
+				bestError = error;
+				best = ep;
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+		}
+
+		std::uint32_t bits = 0;
+		for (int i = 0; i < 16; ++i)
+			bits |= (std::uint32_t)bestIndices[i] << (2 * i);
+		memcpy(block, &best.C0, 2);
+		memcpy(block + 2, &best.C1, 2);
+		memcpy(block + 4, &bits, 4);
+	}
+
+	// ---- BC4 ----
+
+	void BC4Palette(int r0, int r1, int palette[8])
+	{
+		palette[0] = r0;
+		palette[1] = r1;
+		if (r0 > r1)
+		{
+			for (int i = 1; i <= 6; ++i)
+				palette[i + 1] = ((7 - i) * r0 + i * r1 + 3) / 7;
+		}
+		else
+		{
+			for (int i = 1; i <= 4; ++i)
+				palette[i + 1] = ((5 - i) * r0 + i * r1 + 2) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	int BC4Evaluate(const std::uint8_t values[16], int r0, int r1, std::uint8_t indices[16])
+	{
+		int palette[8];
+		BC4Palette(r0, r1, palette);
+		int error = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			int best = INT32_MAX;
+			for (int k = 0; k < 8; ++k)
+			{
+				int d = (values[i] - palette[k]) * (values[i] - palette[k]);
+				if (d < best)
+				{
+					best = d;
+					indices[i] = (std::uint8_t)k;
+				}
+			}
+			error += best;
+		}
+		return error;
+	}
+
+	void EncodeBC4(const std::uint8_t values[16], std::uint8_t* block)
+	{
+		int lo = 255, hi = 0, innerLo = 255, innerHi = 0;
+		bool hasExtremes = false;
+		for (int i = 0; i < 16; ++i)
+		{
+			lo = std::min<int>(lo, values[i]);
+			hi = std::max<int>(hi, values[i]);
+			if (values[i] == 0 || values[i] == 255)
+			{
+				hasExtremes = true;
+				continue;
+			}
+			innerLo = std::min<int>(innerLo, values[i]);
+			innerHi = std::max<int>(innerHi, values[i]);
+		}
+
+		// Eight interpolated values over the full range
+		int r0 = hi, r1 = lo;
+		std::uint8_t indices[16];
+		int error = BC4Evaluate(values, r0, r1, indices);
+
+		// Six values over the inner range, 0 and 255 come for free
+		if (hasExtremes && error > 0)
+		{
+			if (innerLo > innerHi)
+				innerLo = innerHi = lo;
+			std::uint8_t alt[16];
+			int altError = BC4Evaluate(values, innerLo, innerHi, alt);
+			if (altError < error)
+			{
+				r0 = innerLo;
+				r1 = innerHi;
+				memcpy(indices, alt, sizeof(alt));
+			}
+		}
+
+		std::uint64_t bits = 0;
+		for (int i = 0; i < 16; ++i)
+			bits |= (std::uint64_t)indices[i] << (3 * i);
+		bits = (bits << 16) | ((std::uint64_t)r1 << 8) | (std::uint64_t)r0;
+		memcpy(block, &bits, 8);
+	}
+
+	void EncodeBC4Channel(const std::uint8_t* rgba, int channel, std::uint8_t* block)
+	{
+		std::uint8_t values[16];
+		for (int i = 0; i < 16; ++i)
+			values[i] = rgba[i * 4 + channel];
+		EncodeBC4(values, block);
+	}
+
+	// ---- BC7, mode 6 ----
+
+	const int BC7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	struct BC7Endpoint
+	{
+		int Q[4]; // 7 bit
+		int P;    // shared low bit
+		int Value(int c) const { return (Q[c] << 1) | P; }
+	};
+
+	BC7Endpoint BC7Quantize(const float* e)
+	{
+		BC7Endpoint best = {};
+		float bestError = 1e30f;
+		for (int p = 0; p < 2; ++p)
+		{
+			BC7Endpoint ep;
+			ep.P = p;
+			float error = 0.0f;
+			for (int c = 0; c < 4; ++c)
+			{
+				ep.Q[c] = Clamp((int)std::floor((e[c] - p) * 0.5f + 0.5f), 0, 127);
+				float d = e[c] - ep.Value(c);
+				error += d * d;
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				best = ep;
+			}
+		}
+		return best;
+	}
+
+	int BC7Evaluate(const float texels[16][4], const BC7Endpoint& e0, const BC7Endpoint& e1, std::uint8_t indices[16])
+	{
+		int palette[16][4];
+		for (int k = 0; k < 16; ++k)
+		{
+			for (int c = 0; c < 4; ++c)
+				palette[k][c] = ((64 - BC7Weights4[k]) * e0.Value(c) + BC7Weights4[k] * e1.Value(c) + 32) >> 6;
+		}
+
+		int error = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			int best = INT32_MAX;
+			for (int k = 0; k < 16; ++k)
+			{
+				int d = 0;
+				for (int c = 0; c < 4; ++c)
+				{
+					int e = (int)texels[i][c] - palette[k][c];
+					d += e * e;
+				}
+				if (d < best)
+				{
+					best = d;
+					indices[i] = (std::uint8_t)k;
+				}
+			}
+			error += best;
+		}
+		return error;
+	}
+
+	struct BitWriter
+	{
+		std::uint64_t Lo = 0, Hi = 0;
+		int Pos = 0;
+
+		void Write(std::uint32_t value, int count)
+		{
+			for (int i = 0; i < count; ++i, ++Pos)
+			{
+				std::uint64_t bit = (value >> i) & 1;
+				if (Pos < 64)
+					Lo |= bit << Pos;
+				else
+					Hi |= bit << (Pos - 64);
+			}
+		}
+	};
+
+	void EncodeBC7(const std::uint8_t* rgba, std::uint8_t* block)
+	{
+		float texels[16][4];
+		for (int i = 0; i < 16; ++i)
+			for (int c = 0; c < 4; ++c)
+				texels[i][c] = rgba[i * 4 + c];
+
+		float mean[4], axis[4];
+		PrincipalAxis<4>(texels, nullptr, 16, mean, axis);
+		float tMin = 0.0f, tMax = 0.0f;
+		for (int i = 0; i < 16; ++i)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < 4; ++c)
+				t += (texels[i][c] - mean[c]) * axis[c];
+			tMin = std::min(tMin, t);
+			tMax = std::max(tMax, t);
+		}
+		float e0[4], e1[4];
+		for (int c = 0; c < 4; ++c)
+		{
+			e0[c] = Clamp(mean[c] + axis[c] * tMin, 0.0f, 255.0f);
+			e1[c] = Clamp(mean[c] + axis[c] * tMax, 0.0f, 255.0f);
+		}
+
+		BC7Endpoint best0 = BC7Quantize(e0), best1 = BC7Quantize(e1);
+		std::uint8_t bestIndices[16];
+		int bestError = BC7Evaluate(texels, best0, best1, bestIndices);
+
+		for (int iter = 0; iter < 2 && bestError > 0; ++iter)
+		{
+			float aa = 0, ab = 0, bb = 0, ax[4] = {}, bx[4] = {};
+			for (int i = 0; i < 16; ++i)
+			{
+				float b = BC7Weights4[bestIndices[i]] / 64.0f, a = 1.0f - b;
+				aa += a * a;
+				ab += a * b;
+				bb += b * b;
+				for (int c = 0; c < 4; ++c)
+				{
+					ax[c] += a * texels[i][c];
+					bx[c] += b * texels[i][c];
+				}
+			}
+			float det = aa * bb - ab * ab;
+			if (std::fabs(det) < 1e-6f)
+				break;
+			for (int c = 0; c < 4; ++c)
+			{
+				e0[c] = Clamp((ax[c] * bb - bx[c] * ab) / det, 0.0f, 255.0f);
+				e1[c] = Clamp((bx[c] * aa - ax[c] * ab) / det, 0.0f, 255.0f);
+			}
+			BC7Endpoint q0 = BC7Quantize(e0), q1 = BC7Quantize(e1);
+			std::uint8_t indices[16];
+			int error = BC7Evaluate(texels, q0, q1, indices);
+			if (error >= bestError)
+				break;
+			bestError = error;
+			best0 = q0;
+			best1 = q1;
+			memcpy(bestIndices, indices, sizeof(indices));
+		}
+
+		// The anchor index is stored without its top bit, the weights are symmetric so a swap is exact
+		if (bestIndices[0] & 8)
+		{
+			std::swap(best0, best1);
+			for (auto& index : bestIndices)
+				index = (std::uint8_t)(15 - index);
+		}
+
+		BitWriter bits;
+		bits.Write(1 << 6, 7);
+		for (int c = 0; c < 4; ++c)
+		{
+			bits.Write(best0.Q[c], 7);
+			bits.Write(best1.Q[c], 7);
+		}
+		bits.Write(best0.P, 1);
+		bits.Write(best1.P, 1);
+		for (int i = 0; i < 16; ++i)
+			bits.Write(bestIndices[i], i == 0 ? 3 : 4);
+		assert(bits.Pos == 128);
+		memcpy(block, &bits.Lo, 8);
+		memcpy(block + 8, &bits.Hi, 8);
+	}
+
+	enum class EncodeKind
+	{
+		BC1,
+		BC3,
+		BC5,
+		BC7,
+		Unsupported,
+	};
+
+	EncodeKind EncodeKindOf(DXGI_FORMAT format)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_BC1_TYPELESS:
+		case DXGI_FORMAT_BC1_UNORM:
+		case DXGI_FORMAT_BC1_UNORM_SRGB:
+			return EncodeKind::BC1;
+		case DXGI_FORMAT_BC3_TYPELESS:
+		case DXGI_FORMAT_BC3_UNORM:
+		case DXGI_FORMAT_BC3_UNORM_SRGB:
+			return EncodeKind::BC3;
+		case DXGI_FORMAT_BC5_TYPELESS:
+		case DXGI_FORMAT_BC5_UNORM:
+			return EncodeKind::BC5;
+		case DXGI_FORMAT_BC7_TYPELESS:
+		case DXGI_FORMAT_BC7_UNORM:
+		case DXGI_FORMAT_BC7_UNORM_SRGB:
+			return EncodeKind::BC7;
+		default:
+			return EncodeKind::Unsupported;
+		}
+	}
+
+	// Squared error over the channels the format stores, BC1 skips the punched through texels
+	double SquaredError(DXGI_FORMAT format, const std::vector<std::uint8_t>& source, const std::vector<std::uint8_t>& decoded,
+		std::uint64_t& samples)
+	{
+		const bool bc1 = EncodeKindOf(format) == EncodeKind::BC1;
+		int channels = 4;
+		if (bc1)
+			channels = 3;
+		else if (EncodeKindOf(format) == EncodeKind::BC5)
+			channels = 2;
+
+		double sum = 0.0;
+		for (size_t i = 0; i < source.size(); i += 4)
+		{
+			if (bc1 && source[i + 3] < 128)
+				continue;
+			for (int c = 0; c < channels; ++c)
+			{
+				double d = (double)source[i + c] - decoded[i + c];
+				sum += d * d;
+			}
+			samples += channels;
+		}
+		return sum;
+	}
+}
+
+bool TextureCooker::IsSupportedFormat(DXGI_FORMAT format)
+{
+	return EncodeKindOf(format) != EncodeKind::Unsupported;
+}
+
+DDS::Result TextureCooker::LoadSource(const char* fileName, TextureKind kind, Image& image)
+{
+	DDS::Reader reader;
+	DDS::Result result = reader.Open(fileName);
+	if (result != DDS::Result::Ok)
+		return result;
+
+	const DDS::TextureDesc& desc = reader.Desc();
+	if (desc.Dimension != DDS::TextureDimension::Texture2D || desc.IsCubeMap)
+		return DDS::Result::UnsupportedFormat;
+
+	const DDS::Subresource& top = reader.GetSubresource(0, 0);
+	std::vector<std::uint8_t> rgba((size_t)top.Width * top.Height * 4);
+	bool rebuildZ = false;
+	switch (desc.Format)
+	{
+	case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		DDS::CopySubresource(top, rgba.data(), (size_t)top.Width * 4, rgba.size());
+		break;
+	case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+	case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+	{
+		DDS::CopySubresource(top, rgba.data(), (size_t)top.Width * 4, rgba.size());
+		const bool opaque = desc.Format == DXGI_FORMAT_B8G8R8X8_TYPELESS || desc.Format == DXGI_FORMAT_B8G8R8X8_UNORM ||
+			desc.Format == DXGI_FORMAT_B8G8R8X8_UNORM_SRGB;
+		for (size_t i = 0; i < rgba.size(); i += 4)
+		{
+			std::swap(rgba[i], rgba[i + 2]);
+			if (opaque)
+				rgba[i + 3] = 255;
+		}
+		break;
+	}
+	case DXGI_FORMAT_BC4_SNORM:
+	case DXGI_FORMAT_BC5_SNORM:
+		return DDS::Result::UnsupportedFormat;
+	default:
+		if (!BC::IsSupported(desc.Format))
+			return DDS::Result::UnsupportedFormat;
+		rgba = BC::DecodeSubresource(desc.Format, top);
+		rebuildZ = desc.Format == DXGI_FORMAT_BC5_TYPELESS || desc.Format == DXGI_FORMAT_BC5_UNORM;
+		break;
+	}
+
+	float srgbTable[256];
+	for (int i = 0; i < 256; ++i)
+		srgbTable[i] = SrgbToLinear(i / 255.0f);
+
+	image.Width = top.Width;
+	image.Height = top.Height;
+	image.Texels.resize(rgba.size());
+	for (size_t i = 0; i < rgba.size(); i += 4)
+	{
+		float* t = &image.Texels[i];
+		for (int c = 0; c < 3; ++c)
+		{
+			if (kind == TextureKind::Color)
+				t[c] = srgbTable[rgba[i + c]];
+			else if (kind == TextureKind::NormalMap)
+				t[c] = rgba[i + c] / 255.0f * 2.0f - 1.0f;
+			else
+				t[c] = rgba[i + c] / 255.0f;
+		}
+		t[3] = rgba[i + 3] / 255.0f;
+
+		if (kind == TextureKind::NormalMap)
+		{
+			if (rebuildZ)
+				t[2] = std::sqrt(std::max(0.0f, 1.0f - t[0] * t[0] - t[1] * t[1]));
+			NormalizeXYZ(t);
+		}
+	}
+	return DDS::Result::Ok;
+}
+
+std::vector<Image> TextureCooker::GenerateMips(const Image& top, const CookSettings& settings)
+{
+	std::vector<Image> mips;
+	mips.push_back(top);
+	if (!settings.GenerateMips)
+		return mips;
+
+	// Each level from the previous one, the filter spans 2 * KaiserWidth source texels each way
+	while (mips.back().Width > 1 || mips.back().Height > 1)
+		mips.push_back(Downsample(mips.back(), settings));
+	return mips;
+}
+
+std::vector<std::uint8_t> TextureCooker::ToRGBA8(const Image& image, TextureKind kind)
+{
+	std::vector<std::uint8_t> rgba(image.Texels.size());
+	RunRows(image.Height, true, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin * image.Width * 4; i < end * image.Width * 4; i += 4)
+		{
+			const float* t = &image.Texels[i];
+			for (int c = 0; c < 3; ++c)
+			{
+				if (kind == TextureKind::Color)
+					rgba[i + c] = ToUnorm8(LinearToSrgb(Clamp(t[c], 0.0f, 1.0f)));
+				else if (kind == TextureKind::NormalMap)
+					rgba[i + c] = ToUnorm8(t[c] * 0.5f + 0.5f);
+				else
+					rgba[i + c] = ToUnorm8(t[c]);
+			}
+			rgba[i + 3] = ToUnorm8(t[3]);
+		}
+	});
+	return rgba;
+}
+
+void TextureCooker::EncodeBlock(DXGI_FORMAT format, const std::uint8_t rgba[64], std::uint8_t* block)
+{
+	switch (EncodeKindOf(format))
+	{
+	case EncodeKind::BC1:
+		EncodeBC1Color(rgba, block, false);
+		break;
+	case EncodeKind::BC3:
+		EncodeBC4Channel(rgba, 3, block);
+		EncodeBC1Color(rgba, block + 8, true);
+		break;
+	case EncodeKind::BC5:
+		EncodeBC4Channel(rgba, 0, block);
+		EncodeBC4Channel(rgba, 1, block + 8);
+		break;
+	case EncodeKind::BC7:
+		EncodeBC7(rgba, block);
+		break;
+	default:
+		assert(false && "unsupported encode format");
+		break;
+	}
+}
+
+std::vector<std::uint8_t> TextureCooker::EncodeSurface(DXGI_FORMAT format, const std::uint8_t* rgba,
+	std::uint32_t width, std::uint32_t height, bool parallel)
+{
+	assert(IsSupportedFormat(format));
+	const size_t blockBytes = BC::BlockBytes(format);
+	const std::uint32_t blocksWide = (width + 3) / 4;
+	const std::uint32_t blocksHigh = (height + 3) / 4;
+	std::vector<std::uint8_t> blocks((size_t)blocksWide * blocksHigh * blockBytes);
+
+	auto encodeRows = [&](size_t begin, size_t end)
+	{
+		std::uint8_t texels[64];
+		for (size_t by = begin; by < end; ++by)
+		{
+			for (std::uint32_t bx = 0; bx < blocksWide; ++bx)
+			{
+				for (std::uint32_t r = 0; r < 4; ++r)
+				{
+					const std::uint32_t y = std::min<std::uint32_t>((std::uint32_t)by * 4 + r, height - 1);
+					for (std::uint32_t c = 0; c < 4; ++c)
+					{
+						const std::uint32_t x = std::min(bx * 4 + c, width - 1);
+						memcpy(texels + (r * 4 + c) * 4, rgba + ((size_t)y * width + x) * 4, 4);
+					}
+				}
+				EncodeBlock(format, texels, &blocks[(by * blocksWide + bx) * blockBytes]);
+			}
+		}
+	};
+
+	if (parallel)
+		ParallelFor(blocksHigh, 4, encodeRows);
+	else
+		encodeRows(0, blocksHigh);
+	return blocks;
+}
+
+TextureCooker::CookReport TextureCooker::CookFile(const char* sourceFile, const char* destFile, const CookSettings& settings)
+{
+	CookReport report;
+	report.Source = sourceFile;
+	report.Format = settings.Format;
+	if (!IsSupportedFormat(settings.Format))
+	{
+		report.Status = DDS::Result::UnsupportedFormat;
+		return report;
+	}
+
+	auto start = Clock::now();
+	Image top;
+	report.Status = LoadSource(sourceFile, settings.Kind, top);
+	if (report.Status != DDS::Result::Ok)
+		return report;
+
+	auto mipStart = Clock::now();
+	std::vector<Image> mips = GenerateMips(top, settings);
+	report.MipMs = MsSince(mipStart);
+
+	std::vector<std::vector<std::uint8_t>> levels;
+	double squaredError = 0.0;
+	std::uint64_t samples = 0;
+	for (const Image& mip : mips)
+	{
+		std::vector<std::uint8_t> rgba = ToRGBA8(mip, settings.Kind);
+
+		auto encodeStart = Clock::now();
+		levels.push_back(EncodeSurface(settings.Format, rgba.data(), mip.Width, mip.Height, settings.Parallel));
+		report.EncodeMs += MsSince(encodeStart);
+
+		std::vector<std::uint8_t> decoded(rgba.size());
+		BC::DecodeSurface(settings.Format, levels.back().data(), ((mip.Width + 3) / 4) * BC::BlockBytes(settings.Format),
+			mip.Width, mip.Height, decoded.data(), (size_t)mip.Width * 4, settings.Parallel);
+		squaredError += SquaredError(settings.Format, rgba, decoded, samples);
+		report.Pixels += (std::uint64_t)mip.Width * mip.Height;
+	}
+
+	report.Status = DDS::WriteTexture2D(destFile, settings.Format, top.Width, top.Height, levels);
+	report.TotalMs = MsSince(start);
+	report.Width = top.Width;
+	report.Height = top.Height;
+	report.MipLevels = (std::uint32_t)mips.size();
+
+	const double mse = samples > 0 ? squaredError / samples : 0.0;
+	report.Psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+	return report;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "../utils/DDSReader.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Offline texture cooking: builds a full mip chain with a Kaiser windowed sinc filter and encodes
+// every level to BC1/BC3/BC5/BC7 in a DDS file that CreateDDSTextureFromFile12 loads.
+// Filter rows and BC blocks are spread over worker threads.
+namespace TextureCooker
+{
+	enum class TextureKind
+	{
+		Color,     // sRGB encoded, filtered in linear space
+		Linear,    // roughness, metallic, AO ... filtered as stored
+		NormalMap, // tangent space normals, renormalized on every level
+	};
+
+	struct CookSettings
+	{
+		TextureKind Kind = TextureKind::Color;
+		DXGI_FORMAT Format = DXGI_FORMAT_BC7_UNORM; // any BC1, BC3, BC5 or BC7 variant
+		bool GenerateMips = true;   // otherwise only mip 0 of the source is kept
+		bool WrapAddressing = true; // tiling textures filter across the opposite edge
+		float KaiserAlpha = 4.0f;
+		float KaiserWidth = 3.0f;   // filter radius in destination texels
+		bool Parallel = true;
+	};
+
+	// Float RGBA texels: linear light for colors, [-1, 1] xyz for normal maps.
+	struct Image
+	{
+		std::uint32_t Width = 0;
+		std::uint32_t Height = 0;
+		std::vector<float> Texels;
+	};
+
+	struct CookReport
+	{
+		std::string Source;
+		DDS::Result Status = DDS::Result::Ok;
+		DXGI_FORMAT Format = DXGI_FORMAT_UNKNOWN;
+		std::uint32_t Width = 0;
+		std::uint32_t Height = 0;
+		std::uint32_t MipLevels = 0;
+		std::uint64_t Pixels = 0; // over all mip levels
+		double MipMs = 0.0;
+		double EncodeMs = 0.0;
+		double TotalMs = 0.0;     // load, mips, encode and write
+		double Psnr = 0.0;        // dB of the encoded levels against the filtered RGBA8 levels
+
+		double MPixelsPerSecond() const { return TotalMs > 0.0 ? Pixels / (TotalMs * 1000.0) : 0.0; }
+	};
+
+	bool IsSupportedFormat(DXGI_FORMAT format);
+
+	// Mip 0 of a DDS file. RGBA8/BGRA8 and the BC formats BC::DecodeSurface handles are accepted,
+	// BC5 normal maps get their z rebuilt.
+	DDS::Result LoadSource(const char* fileName, TextureKind kind, Image& image);
+
+	// Level 0 is the input, every further level halves each side down to 1x1.
+	std::vector<Image> GenerateMips(const Image& top, const CookSettings& settings);
+
+	// RGBA8 as the GPU reads it: sRGB for colors, biased to [0, 255] for normals.
+	std::vector<std::uint8_t> ToRGBA8(const Image& image, TextureKind kind);
+
+	// One 4x4 block of RGBA8 texels (row after row) into 8 or 16 bytes.
+	void EncodeBlock(DXGI_FORMAT format, const std::uint8_t rgba[64], std::uint8_t* block);
+
+	// A whole surface, edge blocks are padded by repeating the last row and column.
+	std::vector<std::uint8_t> EncodeSurface(DXGI_FORMAT format, const std::uint8_t* rgba,
+		std::uint32_t width, std::uint32_t height, bool parallel = true);
+
+	CookReport CookFile(const char* sourceFile, const char* destFile, const CookSettings& settings);
+}
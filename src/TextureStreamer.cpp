@@ -0,0 +1,537 @@
+#include "TextureStreamer.h"
+
+namespace
+{
+	HRESULT ToHResult(DDS::Result result)
+	{
+		switch (result)
+		{
+		case DDS::Result::Ok: return S_OK;
+		case DDS::Result::FileNotFound: return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+		case DDS::Result::UnsupportedFormat: return E_NOTIMPL;
+		default: return E_FAIL;
+		}
+	}
+
+	const UINT NoRequest = UINT_MAX;
+}
+
+TextureStreamer::TextureStreamer(ID3D12Device* device, UINT frameCount, UINT maxMaterials, UINT64 budgetBytes)
+	: md3dDevice(device)
+{
+	mStats.BudgetBytes = budgetBytes;
+	mMaterialTextures.resize(maxMaterials);
+
+	const UINT64 feedbackBytes = (UINT64)maxMaterials * sizeof(UINT);
+	mFeedback.resize(frameCount);
+	mFeedbackReadback.resize(frameCount);
+	mFeedbackWritten.assign(frameCount, false);
+	for (UINT i = 0; i < frameCount; ++i)
+	{
+		ThrowIfFailed(md3dDevice->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(feedbackBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(&mFeedback[i])));
+
+		ThrowIfFailed(md3dDevice->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(feedbackBytes),
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(&mFeedbackReadback[i])));
+	}
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(feedbackBytes),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&mFeedbackClear)));
+	void* clear = nullptr;
+	ThrowIfFailed(mFeedbackClear->Map(0, nullptr, &clear));
+	memset(clear, 0xff, (size_t)feedbackBytes);
+	mFeedbackClear->Unmap(0, nullptr);
+
+	mLoader = std::thread(&TextureStreamer::LoaderMain, this);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+	mLoader.join();
+}
+
+UINT TextureStreamer::AddTexture(const std::string& name, const std::wstring& fileName,
+	ID3D12GraphicsCommandList* cmdList, UINT64 fenceValue, UINT tailSize)
+{
+	auto tex = std::make_unique<StreamedTexture>();
+	tex->Name = name;
+	ThrowIfFailed(ToHResult(tex->File.Open(fileName.c_str())));
+	tex->Desc = tex->File.Desc();
+	if (tex->Desc.Dimension != DDS::TextureDimension::Texture2D)
+		ThrowIfFailed(E_NOTIMPL);
+
+	// Coarsest valid mip no larger than tailSize, always resident
+	UINT tail = 0;
+	while (tail + 1 < tex->Desc.MipLevels &&
+		std::max(tex->Desc.Width >> tail, tex->Desc.Height >> tail) > tailSize)
+		++tail;
+	tex->TailMip = ClampToValid(*tex, tail);
+	tex->ResidentMip = tex->Desc.MipLevels;
+	tex->RequestedMip = tex->TailMip;
+
+	const UINT id = (UINT)mTextures.size();
+	mStats.FullBytes += ResidentSize(*tex, 0);
+	mTextures.push_back(std::move(tex));
+
+	LoadRequest request;
+	request.Texture = id;
+	request.Source = mTextures[id].get();
+	request.FirstMip = mTextures[id]->TailMip;
+	request.EndMip = mTextures[id]->Desc.MipLevels;
+	LoadResult tailLoad = Load(request);
+	Resize(cmdList, id, request.FirstMip, &tailLoad, fenceValue);
+	return id;
+}
+
+void TextureStreamer::SetDescriptor(UINT texture, D3D12_CPU_DESCRIPTOR_HANDLE srv)
+{
+	StreamedTexture& tex = *mTextures[texture];
+	tex.Srv = srv;
+	tex.HasSrv = true;
+	WriteSrv(tex);
+}
+
+StreamedTextureInfo TextureStreamer::Info(UINT texture) const
+{
+	const StreamedTexture& tex = *mTextures[texture];
+	StreamedTextureInfo info;
+	info.Name = tex.Name;
+	info.Width = tex.Desc.Width;
+	info.Height = tex.Desc.Height;
+	info.MipLevels = tex.Desc.MipLevels;
+	info.ResidentMip = tex.ResidentMip;
+	info.RequestedMip = tex.RequestedMip;
+	info.ResidentBytes = tex.ResidentBytes;
+	return info;
+}
+
+void TextureStreamer::MapMaterial(UINT material, UINT texture)
+{
+	assert(material < mMaterialTextures.size());
+	auto& textures = mMaterialTextures[material];
+	if (std::find(textures.begin(), textures.end(), texture) == textures.end())
+		textures.push_back(texture);
+}
+
+void TextureStreamer::BeginFeedback(ID3D12GraphicsCommandList* cmdList, UINT frameIndex)
+{
+	ID3D12Resource* feedback = mFeedback[frameIndex].Get();
+	cmdList->CopyBufferRegion(feedback, 0, mFeedbackClear.Get(), 0, feedback->GetDesc().Width);
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(feedback,
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+}
+
+void TextureStreamer::EndFeedback(ID3D12GraphicsCommandList* cmdList, UINT frameIndex)
+{
+	ID3D12Resource* feedback = mFeedback[frameIndex].Get();
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(feedback,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE));
+	cmdList->CopyBufferRegion(mFeedbackReadback[frameIndex].Get(), 0, feedback, 0, feedback->GetDesc().Width);
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(feedback,
+		D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_COPY_DEST));
+	mFeedbackWritten[frameIndex] = true;
+}
+
+void TextureStreamer::ReadFeedback(UINT frameIndex)
+{
+	++mFrame;
+	if (!mFeedbackWritten[frameIndex])
+		return;
+
+	const UINT count = (UINT)mMaterialTextures.size();
+	D3D12_RANGE readRange = { 0, count * sizeof(UINT) };
+	UINT* values = nullptr;
+	ThrowIfFailed(mFeedbackReadback[frameIndex]->Map(0, &readRange, reinterpret_cast<void**>(&values)));
+	for (UINT m = 0; m < count; ++m)
+	{
+		if (values[m] == NoFeedback)
+			continue;
+
+		// 8.8 fixed point log2 of the uv footprint, biased by 64 (see RecordMipFeedback in the shader)
+		const float uvLod = values[m] / 256.0f - 64.0f;
+		for (UINT t : mMaterialTextures[m])
+		{
+			const StreamedTexture& tex = *mTextures[t];
+			float mip = uvLod + log2f((float)std::max(tex.Desc.Width, tex.Desc.Height));
+			RequestMip(t, mip <= 0.0f ? 0 : (UINT)mip);
+		}
+	}
+	D3D12_RANGE writeRange = { 0, 0 };
+	mFeedbackReadback[frameIndex]->Unmap(0, &writeRange);
+}
+
+void TextureStreamer::RequestMip(UINT texture, UINT mip)
+{
+	StreamedTexture& tex = *mTextures[texture];
+	tex.FrameRequest = std::min(tex.FrameRequest, mip);
+	tex.LastUsedFrame = mFrame;
+}
+
+void TextureStreamer::Update(ID3D12GraphicsCommandList* cmdList, UINT64 completedFence, UINT64 frameFence)
+{
+	mRetired.erase(std::remove_if(mRetired.begin(), mRetired.end(),
+		[&](const std::pair<UINT64, ComPtr<ID3D12Resource>>& r) { return r.first <= completedFence; }),
+		mRetired.end());
+
+	// This frame's requests; untouched textures only need their tail
+	const Clock::time_point now = Clock::now();
+	for (auto& texPtr : mTextures)
+	{
+		StreamedTexture& tex = *texPtr;
+		const UINT requested = tex.FrameRequest == NoRequest ? tex.TailMip : std::min(tex.FrameRequest, tex.TailMip);
+		tex.RequestedMip = ClampToValid(tex, requested);
+		tex.FrameRequest = NoRequest;
+
+		if (tex.RequestedMip < tex.ResidentMip && !tex.Waiting)
+		{
+			tex.Waiting = true;
+			tex.RequestTime = now;
+		}
+		else if (tex.RequestedMip >= tex.ResidentMip)
+		{
+			tex.Waiting = false;
+		}
+	}
+
+	if (!mPrepared)
+		PrepareUpdate();
+	mPrepared = false;
+	std::vector<LoadResult> done;
+	done.swap(mFinished);
+	for (LoadResult& result : done)
+	{
+		StreamedTexture& tex = *mTextures[result.Request.Texture];
+		tex.Loading = false;
+		--mStats.PendingLoads;
+		mReservedBytes -= result.Request.Bytes;
+		if (result.Request.EndMip != tex.ResidentMip)
+		{
+			mRetired.emplace_back(frameFence, result.Upload);
+			continue;
+		}
+
+		Resize(cmdList, result.Request.Texture, result.Request.FirstMip, &result, frameFence);
+		++mStats.CompletedLoads;
+		if (tex.Waiting)
+		{
+			double ms = std::chrono::duration<double, std::milli>(now - tex.RequestTime).count();
+			mStats.LastLatencyMs = ms;
+			mStats.MaxLatencyMs = std::max(mStats.MaxLatencyMs, ms);
+			mLatencySumMs += ms;
+			mStats.AverageLatencyMs = mLatencySumMs / ++mLatencySamples;
+			tex.Waiting = tex.RequestedMip < tex.ResidentMip;
+			tex.RequestTime = now;
+		}
+	}
+
+	// The budget may have been lowered
+	MakeRoom(cmdList, 0, UINT_MAX, frameFence);
+	IssueLoads(cmdList, frameFence);
+}
+
+D3D12_RESOURCE_DESC TextureStreamer::TextureDesc(const StreamedTexture& tex, UINT firstMip) const
+{
+	return CD3DX12_RESOURCE_DESC::Tex2D(tex.Desc.Format,
+		std::max(tex.Desc.Width >> firstMip, 1u),
+		std::max(tex.Desc.Height >> firstMip, 1u),
+		(UINT16)tex.Desc.ArraySize,
+		(UINT16)(tex.Desc.MipLevels - firstMip));
+}
+
+UINT64 TextureStreamer::ResidentSize(const StreamedTexture& tex, UINT firstMip) const
+{
+	if (firstMip >= tex.Desc.MipLevels)
+		return 0;
+	D3D12_RESOURCE_DESC desc = TextureDesc(tex, firstMip);
+	return md3dDevice->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+}
+
+bool TextureStreamer::IsValidFirstMip(const StreamedTexture& tex, UINT mip) const
+{
+	// Block compressed resources need a top level that is a whole number of blocks
+	if (mip == 0 || !DDS::IsBlockCompressed(tex.Desc.Format))
+		return true;
+	return (tex.Desc.Width >> mip) % 4 == 0 && (tex.Desc.Height >> mip) % 4 == 0 &&
+		(tex.Desc.Width >> mip) > 0 && (tex.Desc.Height >> mip) > 0;
+}
+
+UINT TextureStreamer::ClampToValid(const StreamedTexture& tex, UINT mip) const
+{
+	while (mip > 0 && !IsValidFirstMip(tex, mip))
+		--mip;
+	return mip;
+}
+
+TextureStreamer::LoadResult TextureStreamer::Load(const LoadRequest& request)
+{
+	// Only the DDS mapping and the immutable description are read here, both safe off the main thread
+	const StreamedTexture& tex = *request.Source;
+	const D3D12_RESOURCE_DESC desc = TextureDesc(tex, request.FirstMip);
+	const UINT newCount = tex.Desc.MipLevels - request.FirstMip;
+	const UINT loadCount = request.EndMip - request.FirstMip;
+
+	LoadResult result;
+	result.Request = request;
+	result.Footprints.resize((size_t)loadCount * tex.Desc.ArraySize);
+	std::vector<UINT> numRows(result.Footprints.size());
+	std::vector<UINT64> rowBytes(result.Footprints.size());
+	UINT64 uploadBytes = 0;
+	for (UINT slice = 0; slice < tex.Desc.ArraySize; ++slice)
+	{
+		UINT64 sliceBytes = 0;
+		const size_t first = (size_t)slice * loadCount;
+		md3dDevice->GetCopyableFootprints(&desc, slice * newCount, loadCount, uploadBytes,
+			&result.Footprints[first], &numRows[first], &rowBytes[first], &sliceBytes);
+		const UINT64 alignment = D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT;
+		uploadBytes = (uploadBytes + sliceBytes + alignment - 1) & ~(alignment - 1);
+	}
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(uploadBytes),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&result.Upload)));
+
+	BYTE* mapped = nullptr;
+	ThrowIfFailed(result.Upload->Map(0, nullptr, reinterpret_cast<void**>(&mapped)));
+	for (UINT slice = 0; slice < tex.Desc.ArraySize; ++slice)
+	{
+		for (UINT k = 0; k < loadCount; ++k)
+		{
+			const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& fp = result.Footprints[(size_t)slice * loadCount + k];
+			DDS::CopySubresource(tex.File.GetSubresource(request.FirstMip + k, slice), mapped + fp.Offset,
+				fp.Footprint.RowPitch, (size_t)fp.Footprint.RowPitch * numRows[(size_t)slice * loadCount + k]);
+		}
+	}
+	result.Upload->Unmap(0, nullptr);
+	return result;
+}
+
+void TextureStreamer::LoaderMain()
+{
+	for (;;)
+	{
+		LoadRequest request;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, [this]() { return mQuit || !mQueue.empty(); });
+			if (mQuit)
+				return;
+			request = mQueue.front();
+			mQueue.pop_front();
+		}
+
+		LoadResult result = Load(request);
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		mDone.push_back(std::move(result));
+	}
+}
+
+bool TextureStreamer::PrepareUpdate()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (LoadResult& result : mDone)
+			mFinished.push_back(std::move(result));
+		mDone.clear();
+	}
+	mPrepared = true;
+	if (!mFinished.empty())
+		return true;
+
+	// Update and IssueLoads only evict to make room
+	const UINT64 used = mStats.ResidentBytes + mReservedBytes;
+	if (used > mStats.BudgetBytes)
+		return true;
+	for (const auto& texPtr : mTextures)
+	{
+		const StreamedTexture& tex = *texPtr;
+		if (tex.Loading || tex.FrameRequest == NoRequest)
+			continue;
+		const UINT requested = ClampToValid(tex, std::min(tex.FrameRequest, tex.TailMip));
+		if (requested < tex.ResidentMip && used + ResidentSize(tex, requested) - tex.ResidentBytes > mStats.BudgetBytes)
+			return true;
+	}
+	return false;
+}
+
+void TextureStreamer::IssueLoads(ID3D12GraphicsCommandList* cmdList, UINT64 frameFence)
+{
+	bool issued = false;
+	for (UINT t = 0; t < (UINT)mTextures.size(); ++t)
+	{
+		StreamedTexture& tex = *mTextures[t];
+		if (tex.Loading || tex.RequestedMip >= tex.ResidentMip)
+			continue;
+
+		// Everything that was asked for if it fits, else the finest level that does
+		UINT target = tex.RequestedMip;
+		UINT64 bytes = 0;
+		for (; target < tex.ResidentMip; ++target)
+		{
+			if (!IsValidFirstMip(tex, target))
+				continue;
+			bytes = ResidentSize(tex, target) - tex.ResidentBytes;
+			if (MakeRoom(cmdList, bytes, t, frameFence))
+				break;
+		}
+		if (target >= tex.ResidentMip)
+			continue;
+
+		LoadRequest request;
+		request.Texture = t;
+		request.Source = &tex;
+		request.FirstMip = target;
+		request.EndMip = tex.ResidentMip;
+		request.Bytes = bytes;
+
+		tex.Loading = true;
+		mReservedBytes += bytes;
+		++mStats.PendingLoads;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mQueue.push_back(request);
+		}
+		issued = true;
+	}
+	if (issued)
+		mWake.notify_one();
+}
+
+bool TextureStreamer::MakeRoom(ID3D12GraphicsCommandList* cmdList, UINT64 bytes, UINT exclude, UINT64 frameFence)
+{
+	while (mStats.ResidentBytes + mReservedBytes + bytes > mStats.BudgetBytes)
+	{
+		// Least recently used texture holding mips finer than it currently needs
+		UINT victim = UINT_MAX;
+		for (UINT t = 0; t < (UINT)mTextures.size(); ++t)
+		{
+			const StreamedTexture& tex = *mTextures[t];
+			if (t == exclude || tex.Loading || tex.ResidentMip >= tex.RequestedMip)
+				continue;
+			if (victim == UINT_MAX || tex.LastUsedFrame < mTextures[victim]->LastUsedFrame)
+				victim = t;
+		}
+		if (victim == UINT_MAX)
+			return false;
+
+		Resize(cmdList, victim, mTextures[victim]->RequestedMip, nullptr, frameFence);
+		++mStats.Evictions;
+	}
+	return true;
+}
+
+void TextureStreamer::Resize(ID3D12GraphicsCommandList* cmdList, UINT texture, UINT firstMip,
+	const LoadResult* load, UINT64 frameFence)
+{
+	StreamedTexture& tex = *mTextures[texture];
+	const UINT mipLevels = tex.Desc.MipLevels;
+	const UINT slices = tex.Desc.ArraySize;
+	const UINT newCount = mipLevels - firstMip;
+	const UINT oldCount = mipLevels - tex.ResidentMip;
+	assert(!load || (load->Request.FirstMip == firstMip && load->Request.EndMip == tex.ResidentMip));
+
+	const D3D12_RESOURCE_DESC desc = TextureDesc(tex, firstMip);
+	ComPtr<ID3D12Resource> resource;
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&desc,
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&resource)));
+
+	// Mips both resources share move over on the GPU
+	if (tex.Resource)
+	{
+		cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(tex.Resource.Get(),
+			D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_SOURCE));
+		for (UINT slice = 0; slice < slices; ++slice)
+		{
+			for (UINT mip = std::max(firstMip, tex.ResidentMip); mip < mipLevels; ++mip)
+			{
+				CD3DX12_TEXTURE_COPY_LOCATION dst(resource.Get(), (mip - firstMip) + slice * newCount);
+				CD3DX12_TEXTURE_COPY_LOCATION src(tex.Resource.Get(), (mip - tex.ResidentMip) + slice * oldCount);
+				cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+			}
+		}
+		mRetired.emplace_back(frameFence, tex.Resource);
+	}
+
+	// Freshly loaded mips come from the upload buffer
+	if (load)
+	{
+		const UINT loadCount = load->Request.EndMip - load->Request.FirstMip;
+		for (UINT slice = 0; slice < slices; ++slice)
+		{
+			for (UINT k = 0; k < loadCount; ++k)
+			{
+				CD3DX12_TEXTURE_COPY_LOCATION dst(resource.Get(), k + slice * newCount);
+				CD3DX12_TEXTURE_COPY_LOCATION src(load->Upload.Get(), load->Footprints[(size_t)slice * loadCount + k]);
+				cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+			}
+		}
+		mRetired.emplace_back(frameFence, load->Upload);
+	}
+
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(resource.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+
+	mStats.ResidentBytes -= tex.ResidentBytes;
+	tex.ResidentBytes = ResidentSize(tex, firstMip);
+	mStats.ResidentBytes += tex.ResidentBytes;
+	tex.Resource = resource;
+	tex.ResidentMip = firstMip;
+	WriteSrv(tex);
+}
+
+void TextureStreamer::WriteSrv(StreamedTexture& tex)
+{
+	if (!tex.HasSrv)
+		return;
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = tex.Desc.Format;
+	const UINT mipLevels = tex.Desc.MipLevels - tex.ResidentMip;
+	if (tex.Desc.IsCubeMap)
+	{
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
+		srvDesc.TextureCube.MipLevels = mipLevels;
+	}
+	else if (tex.Desc.ArraySize > 1)
+	{
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+		srvDesc.Texture2DArray.MipLevels = mipLevels;
+		srvDesc.Texture2DArray.ArraySize = tex.Desc.ArraySize;
+	}
+	else
+	{
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MipLevels = mipLevels;
+	}
+	md3dDevice->CreateShaderResourceView(tex.Resource.Get(), &srvDesc, tex.Srv);
+}
@@ -0,0 +1,172 @@
+#pragma once
+#include "DXHelper.h"
+#include "../utils/DDSReader.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+using Microsoft::WRL::ComPtr;
+
+// Mip streaming for the DDS textures of the scene.
+// Every texture keeps a committed resource holding only its resident mips [ResidentMip, MipLevels).
+// Finer mips are read from the mapped DDS file on a loader thread straight into an upload buffer;
+// the main thread then builds a bigger resource, copies the old mips over on the GPU and swaps the SRV.
+// Under budget pressure the least recently used textures are shrunk back towards what they need.
+// The swap rewrites the SRV in place, in the shader visible heap every frame binds, so it is only safe while
+// no earlier frame is still executing. The streamer does not version descriptors: with several frames in flight
+// the app drains the queue (FlushCmdQueue) before every Update that PrepareUpdate says may rewrite one.
+//
+// Requests come from G-buffer feedback: every material records the finest uv footprint it was sampled
+// with (log2 uv units per pixel), turned into a mip per texture from the texture's size.
+struct TextureStreamingStats
+{
+	UINT64 BudgetBytes = 0;
+	UINT64 ResidentBytes = 0;
+	UINT64 FullBytes = 0;       // all mips of all textures
+	UINT PendingLoads = 0;
+	UINT64 CompletedLoads = 0;
+	UINT64 Evictions = 0;
+	double LastLatencyMs = 0.0; // from the first frame asking for a mip to the frame it is sampled
+	double AverageLatencyMs = 0.0;
+	double MaxLatencyMs = 0.0;
+};
+
+struct StreamedTextureInfo
+{
+	std::string Name;
+	UINT Width = 0;
+	UINT Height = 0;
+	UINT MipLevels = 0;
+	UINT ResidentMip = 0;
+	UINT RequestedMip = 0;
+	UINT64 ResidentBytes = 0;
+};
+
+class TextureStreamer
+{
+public:
+	static const UINT NoFeedback = 0xffffffff;
+
+	TextureStreamer(ID3D12Device* device, UINT frameCount, UINT maxMaterials, UINT64 budgetBytes);
+	TextureStreamer(const TextureStreamer& rhs) = delete;
+	TextureStreamer& operator=(const TextureStreamer& rhs) = delete;
+	~TextureStreamer();
+
+	// Maps the DDS file and uploads its mip tail (mips no larger than tailSize) on cmdList.
+	// The upload buffer is released once fenceValue has completed.
+	UINT AddTexture(const std::string& name, const std::wstring& fileName,
+		ID3D12GraphicsCommandList* cmdList, UINT64 fenceValue, UINT tailSize = 128);
+
+	// The SRV is written now and rewritten after every residency change.
+	void SetDescriptor(UINT texture, D3D12_CPU_DESCRIPTOR_HANDLE srv);
+	ID3D12Resource* Resource(UINT texture) const { return mTextures[texture]->Resource.Get(); }
+	UINT TextureCount() const { return (UINT)mTextures.size(); }
+	StreamedTextureInfo Info(UINT texture) const;
+
+	// Material feedback slot -> textures sampled through it.
+	void MapMaterial(UINT material, UINT texture);
+
+	// Bound as a root UAV during the G-buffer pass, one uint per material.
+	D3D12_GPU_VIRTUAL_ADDRESS FeedbackAddress(UINT frameIndex) const { return mFeedback[frameIndex]->GetGPUVirtualAddress(); }
+	void BeginFeedback(ID3D12GraphicsCommandList* cmdList, UINT frameIndex);
+	void EndFeedback(ID3D12GraphicsCommandList* cmdList, UINT frameIndex);
+
+	// Reads the feedback of frameIndex, whose fence must have completed, and queues loads.
+	void ReadFeedback(UINT frameIndex);
+
+	// CPU side request for textures outside the G-buffer pass (sky), valid for the current frame.
+	void RequestMip(UINT texture, UINT mip);
+
+	// Swaps in finished loads and applies evictions. Descriptors are rewritten here, so no command list
+	// still in flight may reference them: call it while the GPU is idle, or after PrepareUpdate returned false.
+	void Update(ID3D12GraphicsCommandList* cmdList, UINT64 completedFence, UINT64 frameFence);
+	// Takes the loads finished so far for the next Update, later ones wait for the one after. Returns whether
+	// that Update may rewrite descriptors: something to swap in, residency over budget or a request that only
+	// fits after an eviction.
+	bool PrepareUpdate();
+
+	void SetBudget(UINT64 bytes) { mStats.BudgetBytes = bytes; }
+	const TextureStreamingStats& Stats() const { return mStats; }
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	struct StreamedTexture
+	{
+		std::string Name;
+		DDS::Reader File;
+		DDS::TextureDesc Desc;
+		ComPtr<ID3D12Resource> Resource;
+		D3D12_CPU_DESCRIPTOR_HANDLE Srv = {};
+		bool HasSrv = false;
+
+		UINT TailMip = 0;      // coarsest resident mip we ever keep
+		UINT ResidentMip = 0;
+		UINT RequestedMip = 0;
+		UINT64 ResidentBytes = 0;
+		UINT64 LastUsedFrame = 0;
+		bool Loading = false;
+		UINT FrameRequest = UINT_MAX; // finest mip asked for since the last Update
+		bool Waiting = false;         // RequestedMip is finer than ResidentMip since RequestTime
+		Clock::time_point RequestTime;
+	};
+
+	struct LoadRequest
+	{
+		UINT Texture = 0;
+		UINT FirstMip = 0; // new resident mip
+		UINT EndMip = 0;   // resident mip when the load was issued
+		UINT64 Bytes = 0;  // budget reserved until the load is applied
+		const StreamedTexture* Source = nullptr;
+	};
+
+	struct LoadResult
+	{
+		LoadRequest Request;
+		ComPtr<ID3D12Resource> Upload;
+		std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> Footprints; // EndMip - FirstMip per array slice
+	};
+
+	D3D12_RESOURCE_DESC TextureDesc(const StreamedTexture& tex, UINT firstMip) const;
+	UINT64 ResidentSize(const StreamedTexture& tex, UINT firstMip) const;
+	bool IsValidFirstMip(const StreamedTexture& tex, UINT mip) const;
+	UINT ClampToValid(const StreamedTexture& tex, UINT mip) const;
+
+	// Loader thread side: copies mips [FirstMip, EndMip) of every slice into a new upload buffer.
+	LoadResult Load(const LoadRequest& request);
+	void LoaderMain();
+
+	void IssueLoads(ID3D12GraphicsCommandList* cmdList, UINT64 frameFence);
+	// Shrinks least recently used textures until bytes more fit the budget, never touching exclude.
+	bool MakeRoom(ID3D12GraphicsCommandList* cmdList, UINT64 bytes, UINT exclude, UINT64 frameFence);
+	void Resize(ID3D12GraphicsCommandList* cmdList, UINT texture, UINT firstMip, const LoadResult* load, UINT64 frameFence);
+	void WriteSrv(StreamedTexture& tex);
+
+	ID3D12Device* md3dDevice = nullptr;
+	std::vector<std::unique_ptr<StreamedTexture>> mTextures;
+	std::vector<std::vector<UINT>> mMaterialTextures;
+	UINT64 mFrame = 0;
+
+	std::vector<ComPtr<ID3D12Resource>> mFeedback;
+	std::vector<ComPtr<ID3D12Resource>> mFeedbackReadback;
+	std::vector<bool> mFeedbackWritten;
+	ComPtr<ID3D12Resource> mFeedbackClear; // NoFeedback in every slot
+
+	std::vector<std::pair<UINT64, ComPtr<ID3D12Resource>>> mRetired;
+	UINT64 mReservedBytes = 0;
+
+	std::thread mLoader;
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::deque<LoadRequest> mQueue;
+	std::vector<LoadResult> mDone;
+	std::vector<LoadResult> mFinished; // taken from mDone by PrepareUpdate, for the next Update
+	bool mPrepared = false;
+	bool mQuit = false;
+
+	TextureStreamingStats mStats;
+	double mLatencySumMs = 0.0;
+	UINT64 mLatencySamples = 0;
+};
@@ -40,6 +40,20 @@ public:
 		memcpy(&mappedData[elementIndex * elementByteSize], &Data, sizeof(T));
 	}
 
+	//copies count consecutive elements starting at firstElement in one memcpy, structured buffers only
+	void CopyRange(int firstElement, const T* data, UINT count)
+	{
+		assert(!mIsConstantBuffer);
+		memcpy(&mappedData[firstElement * elementByteSize], data, sizeof(T) * count);
+	}
+
+	//the mapped elements for writers that fill them in place, structured buffers only
+	T* MappedData()
+	{
+		assert(!mIsConstantBuffer);
+		return reinterpret_cast<T*>(mappedData);
+	}
+
 	//شϴѵָ
 	Microsoft::WRL::ComPtr<ID3D12Resource> Resource()const
 	{
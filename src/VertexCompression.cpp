@@ -0,0 +1,334 @@
+#include "VertexCompression.h"
+#include <emmintrin.h>
+#include <cstddef>
+#include <cmath>
+#include <chrono>
+#include <cassert>
+
+using namespace DirectX::PackedVector;
+
+namespace
+{
+	const float kUnorm16Max = 65535.0f;
+	const float kSnorm16Max = 32767.0f;
+
+	inline float SignNotZero(float v)
+	{
+		return v >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	inline std::uint16_t QuantizeUnorm16(float v)
+	{
+		v = MathHelper::Clamp(v, 0.0f, kUnorm16Max);
+		return static_cast<std::uint16_t>(v + 0.5f);
+	}
+
+	inline std::int16_t QuantizeSnorm16(float v)
+	{
+		v = MathHelper::Clamp(v, -1.0f, 1.0f) * kSnorm16Max;
+		return static_cast<std::int16_t>(v >= 0.0f ? v + 0.5f : v - 0.5f);
+	}
+
+	void EncodeVertexScalar(const Vertex& v, const VertexQuantization& q, CompactVertex& out)
+	{
+		out.Pos[0] = QuantizeUnorm16((v.Pos.x - q.Offset.x) / q.Scale.x);
+		out.Pos[1] = QuantizeUnorm16((v.Pos.y - q.Offset.y) / q.Scale.y);
+		out.Pos[2] = QuantizeUnorm16((v.Pos.z - q.Offset.z) / q.Scale.z);
+		out.Pos[3] = 0;
+
+		XMFLOAT2 n = VertexCompression::OctEncode(v.Normal);
+		out.Normal[0] = QuantizeSnorm16(n.x);
+		out.Normal[1] = QuantizeSnorm16(n.y);
+
+		XMFLOAT2 t = VertexCompression::OctEncode(v.TangentU);
+		out.TangentU[0] = QuantizeSnorm16(t.x);
+		out.TangentU[1] = QuantizeSnorm16(t.y);
+
+		out.TexC[0] = XMConvertFloatToHalf(v.TexC.x);
+		out.TexC[1] = XMConvertFloatToHalf(v.TexC.y);
+	}
+
+	// Loads the 3 floats at member offset of 4 consecutive vertices and transposes them to x/y/z rows.
+	// Each load reads one float past the member, the caller guarantees a vertex follows the block.
+	inline void LoadTransposed(const Vertex* v, size_t memberOffset, __m128& x, __m128& y, __m128& z)
+	{
+		const char* base = reinterpret_cast<const char*>(v) + memberOffset;
+		__m128 r0 = _mm_loadu_ps(reinterpret_cast<const float*>(base + 0 * sizeof(Vertex)));
+		__m128 r1 = _mm_loadu_ps(reinterpret_cast<const float*>(base + 1 * sizeof(Vertex)));
+		__m128 r2 = _mm_loadu_ps(reinterpret_cast<const float*>(base + 2 * sizeof(Vertex)));
+		__m128 r3 = _mm_loadu_ps(reinterpret_cast<const float*>(base + 3 * sizeof(Vertex)));
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		x = r0;
+		y = r1;
+		z = r2;
+	}
+
+	// Octahedral encoding of 4 unit vectors at once, result quantized to snorm16.
+	inline void OctEncode4(__m128 x, __m128 y, __m128 z, __m128i& outX, __m128i& outY)
+	{
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 zero = _mm_setzero_ps();
+
+		__m128 l1 = _mm_add_ps(_mm_add_ps(_mm_andnot_ps(signMask, x), _mm_andnot_ps(signMask, y)), _mm_andnot_ps(signMask, z));
+		__m128 inv = _mm_div_ps(one, _mm_max_ps(l1, _mm_set1_ps(1e-20f)));
+		x = _mm_mul_ps(x, inv);
+		y = _mm_mul_ps(y, inv);
+
+		// Fold the lower hemisphere over the diagonals.
+		__m128 signX = _mm_or_ps(_mm_and_ps(x, signMask), one);
+		__m128 signY = _mm_or_ps(_mm_and_ps(y, signMask), one);
+		__m128 foldX = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(signMask, y)), signX);
+		__m128 foldY = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(signMask, x)), signY);
+		__m128 lower = _mm_cmplt_ps(z, zero);
+		x = _mm_or_ps(_mm_and_ps(lower, foldX), _mm_andnot_ps(lower, x));
+		y = _mm_or_ps(_mm_and_ps(lower, foldY), _mm_andnot_ps(lower, y));
+
+		const __m128 scale = _mm_set1_ps(kSnorm16Max);
+		outX = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(x, _mm_sub_ps(zero, one)), one), scale));
+		outY = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(y, _mm_sub_ps(zero, one)), one), scale));
+	}
+}
+
+VertexQuantization VertexQuantization::FromBounds(const BoundingBox& bounds)
+{
+	VertexQuantization q;
+	q.Offset = XMFLOAT3(
+		bounds.Center.x - bounds.Extents.x,
+		bounds.Center.y - bounds.Extents.y,
+		bounds.Center.z - bounds.Extents.z);
+
+	// Flat submeshes have a zero extent on one axis, keep the scale invertible.
+	const float minSize = 1e-6f;
+	q.Scale = XMFLOAT3(
+		MathHelper::Max(2.0f * bounds.Extents.x, minSize) / kUnorm16Max,
+		MathHelper::Max(2.0f * bounds.Extents.y, minSize) / kUnorm16Max,
+		MathHelper::Max(2.0f * bounds.Extents.z, minSize) / kUnorm16Max);
+	return q;
+}
+
+VertexQuantizationConstants VertexQuantizationConstants::From(const VertexQuantization& q)
+{
+	VertexQuantizationConstants c;
+	c.Offset = XMFLOAT4(q.Offset.x, q.Offset.y, q.Offset.z, 0.0f);
+	c.Extent = XMFLOAT4(q.Scale.x * kUnorm16Max, q.Scale.y * kUnorm16Max, q.Scale.z * kUnorm16Max, 0.0f);
+	return c;
+}
+
+void VertexCompressionReport::Merge(const VertexCompressionReport& rhs)
+{
+	VertexCount += rhs.VertexCount;
+	SourceBytes += rhs.SourceBytes;
+	CompactBytes += rhs.CompactBytes;
+	MaxPositionError = MathHelper::Max(MaxPositionError, rhs.MaxPositionError);
+	MaxNormalErrorDeg = MathHelper::Max(MaxNormalErrorDeg, rhs.MaxNormalErrorDeg);
+	MaxTangentErrorDeg = MathHelper::Max(MaxTangentErrorDeg, rhs.MaxTangentErrorDeg);
+	MaxTexCError = MathHelper::Max(MaxTexCError, rhs.MaxTexCError);
+	EncodeMs += rhs.EncodeMs;
+}
+
+BoundingBox VertexCompression::ComputeBounds(const Vertex* vertices, size_t count)
+{
+	BoundingBox bounds(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f));
+	if (count == 0)
+		return bounds;
+
+	XMVECTOR vMin = XMLoadFloat3(&vertices[0].Pos);
+	XMVECTOR vMax = vMin;
+	for (size_t i = 1; i < count; ++i)
+	{
+		XMVECTOR p = XMLoadFloat3(&vertices[i].Pos);
+		vMin = XMVectorMin(vMin, p);
+		vMax = XMVectorMax(vMax, p);
+	}
+
+	BoundingBox::CreateFromPoints(bounds, vMin, vMax);
+	return bounds;
+}
+
+XMFLOAT2 VertexCompression::OctEncode(const XMFLOAT3& n)
+{
+	float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if (l1 <= 0.0f)
+		return XMFLOAT2(0.0f, 0.0f);
+
+	float x = n.x / l1;
+	float y = n.y / l1;
+	if (n.z < 0.0f)
+	{
+		float fx = (1.0f - fabsf(y)) * SignNotZero(x);
+		float fy = (1.0f - fabsf(x)) * SignNotZero(y);
+		x = fx;
+		y = fy;
+	}
+	return XMFLOAT2(x, y);
+}
+
+XMFLOAT3 VertexCompression::OctDecode(const XMFLOAT2& e)
+{
+	XMFLOAT3 n(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+	if (n.z < 0.0f)
+	{
+		n.x = (1.0f - fabsf(e.y)) * SignNotZero(e.x);
+		n.y = (1.0f - fabsf(e.x)) * SignNotZero(e.y);
+	}
+
+	XMFLOAT3 result;
+	XMStoreFloat3(&result, XMVector3Normalize(XMLoadFloat3(&n)));
+	return result;
+}
+
+void VertexCompression::EncodeVertices(const Vertex* src, size_t count, const VertexQuantization& q, CompactVertex* dst)
+{
+	const __m128 offX = _mm_set1_ps(q.Offset.x);
+	const __m128 offY = _mm_set1_ps(q.Offset.y);
+	const __m128 offZ = _mm_set1_ps(q.Offset.z);
+	const __m128 invScaleX = _mm_set1_ps(1.0f / q.Scale.x);
+	const __m128 invScaleY = _mm_set1_ps(1.0f / q.Scale.y);
+	const __m128 invScaleZ = _mm_set1_ps(1.0f / q.Scale.z);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 unormMax = _mm_set1_ps(kUnorm16Max);
+
+	alignas(16) std::int32_t px[4], py[4], pz[4];
+	alignas(16) std::int32_t nx[4], ny[4], tx[4], ty[4];
+
+	// "i + 4 < count" keeps the one-float overread of LoadTransposed inside the array.
+	size_t i = 0;
+	for (; i + 4 < count; i += 4)
+	{
+		__m128 x, y, z;
+		LoadTransposed(src + i, offsetof(Vertex, Pos), x, y, z);
+		x = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(x, offX), invScaleX), zero), unormMax);
+		y = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(y, offY), invScaleY), zero), unormMax);
+		z = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(z, offZ), invScaleZ), zero), unormMax);
+		_mm_store_si128(reinterpret_cast<__m128i*>(px), _mm_cvtps_epi32(x));
+		_mm_store_si128(reinterpret_cast<__m128i*>(py), _mm_cvtps_epi32(y));
+		_mm_store_si128(reinterpret_cast<__m128i*>(pz), _mm_cvtps_epi32(z));
+
+		__m128i ex, ey;
+		LoadTransposed(src + i, offsetof(Vertex, Normal), x, y, z);
+		OctEncode4(x, y, z, ex, ey);
+		_mm_store_si128(reinterpret_cast<__m128i*>(nx), ex);
+		_mm_store_si128(reinterpret_cast<__m128i*>(ny), ey);
+
+		LoadTransposed(src + i, offsetof(Vertex, TangentU), x, y, z);
+		OctEncode4(x, y, z, ex, ey);
+		_mm_store_si128(reinterpret_cast<__m128i*>(tx), ex);
+		_mm_store_si128(reinterpret_cast<__m128i*>(ty), ey);
+
+		for (int k = 0; k < 4; ++k)
+		{
+			CompactVertex& out = dst[i + k];
+			out.Pos[0] = static_cast<std::uint16_t>(px[k]);
+			out.Pos[1] = static_cast<std::uint16_t>(py[k]);
+			out.Pos[2] = static_cast<std::uint16_t>(pz[k]);
+			out.Pos[3] = 0;
+			out.Normal[0] = static_cast<std::int16_t>(nx[k]);
+			out.Normal[1] = static_cast<std::int16_t>(ny[k]);
+			out.TangentU[0] = static_cast<std::int16_t>(tx[k]);
+			out.TangentU[1] = static_cast<std::int16_t>(ty[k]);
+		}
+	}
+
+	// Half conversion of the whole uv stream goes through the strided F16C path of DirectXMath.
+	if (i > 0)
+	{
+		XMConvertFloatToHalfStream(&dst[0].TexC[0], sizeof(CompactVertex), &src[0].TexC.x, sizeof(Vertex), i);
+		XMConvertFloatToHalfStream(&dst[0].TexC[1], sizeof(CompactVertex), &src[0].TexC.y, sizeof(Vertex), i);
+	}
+
+	for (; i < count; ++i)
+		EncodeVertexScalar(src[i], q, dst[i]);
+}
+
+void VertexCompression::DecodeVertices(const CompactVertex* src, size_t count, const VertexQuantization& q, Vertex* dst)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		const CompactVertex& v = src[i];
+		Vertex& out = dst[i];
+
+		out.Pos.x = q.Offset.x + v.Pos[0] * q.Scale.x;
+		out.Pos.y = q.Offset.y + v.Pos[1] * q.Scale.y;
+		out.Pos.z = q.Offset.z + v.Pos[2] * q.Scale.z;
+
+		out.Normal = OctDecode(XMFLOAT2(v.Normal[0] / kSnorm16Max, v.Normal[1] / kSnorm16Max));
+		out.TangentU = OctDecode(XMFLOAT2(v.TangentU[0] / kSnorm16Max, v.TangentU[1] / kSnorm16Max));
+
+		out.TexC.x = XMConvertHalfToFloat(v.TexC[0]);
+		out.TexC.y = XMConvertHalfToFloat(v.TexC[1]);
+	}
+}
+
+VertexCompressionReport VertexCompression::Measure(const Vertex* src, const CompactVertex* enc, size_t count, const VertexQuantization& q)
+{
+	VertexCompressionReport report;
+	report.VertexCount = (UINT)count;
+	report.SourceBytes = count * sizeof(Vertex);
+	report.CompactBytes = count * sizeof(CompactVertex);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		Vertex decoded;
+		DecodeVertices(&enc[i], 1, q, &decoded);
+
+		XMVECTOR posError = XMVector3Length(XMLoadFloat3(&src[i].Pos) - XMLoadFloat3(&decoded.Pos));
+		report.MaxPositionError = MathHelper::Max(report.MaxPositionError, XMVectorGetX(posError));
+
+		// Zero tangents come from meshes without uvs, there is no direction to compare.
+		XMVECTOR n = XMLoadFloat3(&src[i].Normal);
+		if (XMVectorGetX(XMVector3LengthSq(n)) > 1e-8f)
+		{
+			float angle = XMVectorGetX(XMVector3AngleBetweenNormals(XMVector3Normalize(n), XMLoadFloat3(&decoded.Normal)));
+			report.MaxNormalErrorDeg = MathHelper::Max(report.MaxNormalErrorDeg, XMConvertToDegrees(angle));
+		}
+
+		XMVECTOR t = XMLoadFloat3(&src[i].TangentU);
+		if (XMVectorGetX(XMVector3LengthSq(t)) > 1e-8f)
+		{
+			float angle = XMVectorGetX(XMVector3AngleBetweenNormals(XMVector3Normalize(t), XMLoadFloat3(&decoded.TangentU)));
+			report.MaxTangentErrorDeg = MathHelper::Max(report.MaxTangentErrorDeg, XMConvertToDegrees(angle));
+		}
+
+		float uvError = MathHelper::Max(fabsf(src[i].TexC.x - decoded.TexC.x), fabsf(src[i].TexC.y - decoded.TexC.y));
+		report.MaxTexCError = MathHelper::Max(report.MaxTexCError, uvError);
+	}
+
+	return report;
+}
+
+VertexCompressionReport VertexCompression::EncodeGeometry(const MeshGeometry& geo, CompactMesh& out)
+{
+	assert(geo.VertexBufferCPU != nullptr && geo.VertexByteStride == sizeof(Vertex));
+	const Vertex* vertices = reinterpret_cast<const Vertex*>(geo.VertexBufferCPU->GetBufferPointer());
+	const size_t vertexCount = geo.VertexBufferByteSize / sizeof(Vertex);
+
+	VertexCompressionReport report;
+	out.Vertices.resize(vertexCount);
+	out.Quantization.clear();
+
+	for (const auto& arg : geo.DrawArgs)
+	{
+		const SubmeshGeometry& submesh = arg.second;
+		if (submesh.LodLevel > 0)
+			continue; // shares the vertices of level 0
+		assert(submesh.BaseVertexLocation >= 0);
+		assert((size_t)submesh.BaseVertexLocation + submesh.VertexCount <= vertexCount);
+
+		const Vertex* src = vertices + (size_t)submesh.BaseVertexLocation;
+		CompactVertex* dst = out.Vertices.data() + (size_t)submesh.BaseVertexLocation;
+
+		VertexQuantization q = VertexQuantization::FromBounds(ComputeBounds(src, submesh.VertexCount));
+		out.Quantization[arg.first] = q;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		EncodeVertices(src, submesh.VertexCount, q, dst);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		VertexCompressionReport submeshReport = Measure(src, dst, submesh.VertexCount, q);
+		submeshReport.EncodeMs = std::chrono::duration<double, std::milli>(end - start).count();
+		report.Merge(submeshReport);
+	}
+
+	return report;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "FrameResource.hpp"
+#include "MeshGeometry.hpp"
+#include <DirectXPackedVector.h>
+
+// Compact 20 byte vertex layout, the quantized counterpart of Vertex (44 bytes).
+//   Pos      : unorm16 xyz normalized to the owning submesh bounds (w is padding)
+//   Normal   : octahedral encoded unit vector, 2 x snorm16
+//   TangentU : octahedral encoded unit vector, 2 x snorm16
+//   TexC     : 2 x half float
+struct CompactVertex
+{
+	std::uint16_t Pos[4];
+	std::int16_t Normal[2];
+	std::int16_t TangentU[2];
+	DirectX::PackedVector::HALF TexC[2];
+};
+
+static_assert(sizeof(CompactVertex) == 20, "CompactVertex must stay 20 bytes");
+
+// Dequantization constants of one submesh: Pos = Offset + unorm * Scale.
+struct VertexQuantization
+{
+	XMFLOAT3 Offset = { 0.0f, 0.0f, 0.0f };
+	XMFLOAT3 Scale = { 1.0f, 1.0f, 1.0f };
+
+	static VertexQuantization FromBounds(const BoundingBox& bounds);
+};
+
+// The same grid as the root constants of the compact vertex shaders (cbVertexQuantization):
+// Pos = Offset + unorm * Extent, with unorm the [0, 1] value the R16G16B16A16_UNORM input delivers.
+struct VertexQuantizationConstants
+{
+	XMFLOAT4 Offset = { 0.0f, 0.0f, 0.0f, 0.0f };
+	XMFLOAT4 Extent = { 1.0f, 1.0f, 1.0f, 0.0f };
+
+	static VertexQuantizationConstants From(const VertexQuantization& q);
+};
+
+// Worst case error of a compact encoding against the source vertices.
+struct VertexCompressionReport
+{
+	UINT VertexCount = 0;
+	UINT64 SourceBytes = 0;
+	UINT64 CompactBytes = 0;
+
+	float MaxPositionError = 0.0f;   // world units
+	float MaxNormalErrorDeg = 0.0f;  // degrees
+	float MaxTangentErrorDeg = 0.0f; // degrees
+	float MaxTexCError = 0.0f;       // uv units
+
+	double EncodeMs = 0.0;
+
+	UINT64 SavedBytes() const { return SourceBytes - CompactBytes; }
+	void Merge(const VertexCompressionReport& rhs);
+};
+
+// Compact copy of a MeshGeometry vertex buffer, quantized per submesh.
+struct CompactMesh
+{
+	std::vector<CompactVertex> Vertices;
+	std::unordered_map<std::string, VertexQuantization> Quantization;
+};
+
+namespace VertexCompression
+{
+	// Bounds of count vertices, used to derive the position quantization grid.
+	BoundingBox ComputeBounds(const Vertex* vertices, size_t count);
+
+	// SSE bulk encoder, 4 vertices per iteration with a scalar tail.
+	void EncodeVertices(const Vertex* src, size_t count, const VertexQuantization& q, CompactVertex* dst);
+
+	// Scalar decoder for CPU consumers of compact buffers.
+	void DecodeVertices(const CompactVertex* src, size_t count, const VertexQuantization& q, Vertex* dst);
+
+	// Decodes enc and compares it with src attribute by attribute.
+	VertexCompressionReport Measure(const Vertex* src, const CompactVertex* enc, size_t count, const VertexQuantization& q);
+
+	// Encodes the submeshes of geo from its CPU vertex blob into out, each on a grid fitted to its own vertices.
+	// Submeshes must have VertexCount set, the returned report covers the whole geometry.
+	VertexCompressionReport EncodeGeometry(const MeshGeometry& geo, CompactMesh& out);
+
+	// Octahedral mapping of a unit vector to [-1,1]^2 and back.
+	XMFLOAT2 OctEncode(const XMFLOAT3& n);
+	XMFLOAT3 OctDecode(const XMFLOAT2& e);
+}
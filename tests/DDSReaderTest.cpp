@@ -0,0 +1,203 @@
+#include "Test.h"
+#include "../utils/DDSReader.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+namespace
+{
+	std::string ModelPath(const char* file)
+	{
+		return std::string(MSR_MODELS_DIR) + "/" + file;
+	}
+
+	std::vector<uint8_t> ReadFile(const std::string& fileName)
+	{
+		std::ifstream file(fileName, std::ios::binary);
+		return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	// Every subresource follows the previous one in D3D12 order with the pitches of GetSurfaceInfo, the last
+	// one ends with the image
+	void CheckLayout(const DDS::Reader& reader, const uint8_t* imageEnd)
+	{
+		const DDS::TextureDesc& desc = reader.Desc();
+		CHECK(reader.Subresources().size() == (size_t)desc.MipLevels * desc.ArraySize);
+		if (reader.Subresources().empty())
+			return;
+
+		const uint8_t* next = reader.Subresources()[0].Data;
+		for (uint32_t slice = 0; slice < desc.ArraySize; ++slice)
+		{
+			for (uint32_t mip = 0; mip < desc.MipLevels; ++mip)
+			{
+				const DDS::Subresource& sub = reader.GetSubresource(mip, slice);
+				CHECK(sub.MipLevel == mip && sub.ArraySlice == slice);
+				CHECK(sub.Width == std::max(desc.Width >> mip, 1u));
+				CHECK(sub.Height == std::max(desc.Height >> mip, 1u));
+				CHECK(sub.Data == next);
+
+				size_t numBytes = 0, rowBytes = 0, numRows = 0;
+				DDS::GetSurfaceInfo(sub.Width, sub.Height, desc.Format, &numBytes, &rowBytes, &numRows);
+				CHECK(sub.SlicePitch == numBytes && sub.RowPitch == rowBytes && sub.NumRows == numRows);
+				next = sub.Data + sub.SlicePitch * sub.Depth;
+			}
+		}
+		CHECK(next == imageEnd);
+	}
+
+	struct ModelTexture
+	{
+		const char* File;
+		DXGI_FORMAT Format; // UNKNOWN: any format the reader knows
+		uint32_t Width;
+		uint32_t MipLevels;
+		bool IsCubeMap;
+	};
+
+	// The DDS files the app loads
+	const ModelTexture gModelTextures[] =
+	{
+		{ "Cyborg_Weapon/ibl_brdf_lut.dds", DXGI_FORMAT_R16G16B16A16_FLOAT, 128, 1, false },
+		{ "Cyborg_Weapon/diffuse_cube.dds", DXGI_FORMAT_UNKNOWN, 16, 1, true },
+		{ "Cyborg_Weapon/specular_cube.dds", DXGI_FORMAT_UNKNOWN, 256, 6, true },
+		{ "cave/cave_albedo.dds", DXGI_FORMAT_BC1_UNORM, 2048, 12, false },
+		{ "cave/cave_normal.dds", DXGI_FORMAT_BC1_UNORM, 2048, 12, false },
+	};
+}
+
+TEST_CASE(DDSReader_OpensModelTextures)
+{
+	for (const ModelTexture& expected : gModelTextures)
+	{
+		std::printf("  %s\n", expected.File);
+		const std::string fileName = ModelPath(expected.File);
+		DDS::Reader reader;
+		CHECK(reader.Open(fileName.c_str()) == DDS::Result::Ok);
+		if (!reader.IsOpen())
+			continue;
+
+		const DDS::TextureDesc& desc = reader.Desc();
+		CHECK(desc.Format == expected.Format || (expected.Format == DXGI_FORMAT_UNKNOWN && DDS::BitsPerPixel(desc.Format) > 0));
+		CHECK(desc.Dimension == DDS::TextureDimension::Texture2D);
+		CHECK(desc.Width == expected.Width && desc.Height == expected.Width && desc.Depth == 1);
+		CHECK(desc.MipLevels == expected.MipLevels);
+		CHECK(desc.IsCubeMap == expected.IsCubeMap);
+		CHECK(desc.ArraySize == (expected.IsCubeMap ? 6u : 1u));
+
+		// The mapping and a copy in memory parse the same, the texels come right after the header
+		const std::vector<uint8_t> bytes = ReadFile(fileName);
+		CHECK(bytes.size() == reader.FileSize());
+		DDS::Reader memory;
+		CHECK(memory.OpenMemory(bytes.data(), bytes.size()) == DDS::Result::Ok);
+		if (!memory.IsOpen())
+			continue;
+		CHECK(memory.Desc().Format == desc.Format && memory.Desc().MipLevels == desc.MipLevels);
+		CheckLayout(memory, bytes.data() + bytes.size());
+		const DDS::Subresource& first = memory.Subresources()[0];
+		CHECK(memcmp(first.Data, reader.Subresources()[0].Data, first.SlicePitch) == 0);
+	}
+}
+
+TEST_CASE(DDSReader_RejectsTruncatedFiles)
+{
+	const std::vector<uint8_t> bytes = ReadFile(ModelPath("cave/cave_albedo.dds"));
+	CHECK(bytes.size() > 128);
+	if (bytes.size() <= 128)
+		return;
+
+	DDS::Reader reader;
+	// Cut in the last mip, in the first one, right after the header and inside it
+	const size_t sizes[] = { bytes.size() - 1, 128 + 1024, 128, 64, 3, 0 };
+	for (size_t size : sizes)
+	{
+		CHECK(reader.OpenMemory(bytes.data(), size) == DDS::Result::Truncated);
+		CHECK(!reader.IsOpen() && reader.Subresources().empty());
+	}
+	CHECK(reader.OpenMemory(nullptr, 0) == DDS::Result::Truncated);
+
+	// The same through a mapping of a cut file, and of an empty one
+	const char* cut = "DDSReaderTest_truncated.dds";
+	for (size_t size : { bytes.size() / 2, (size_t)0 })
+	{
+		{
+			std::ofstream file(cut, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(bytes.data()), size);
+		}
+		CHECK(reader.Open(cut) == DDS::Result::Truncated);
+		CHECK(!reader.IsOpen());
+	}
+	std::remove(cut);
+}
+
+TEST_CASE(DDSReader_RejectsInvalidFiles)
+{
+	std::vector<uint8_t> bytes = ReadFile(ModelPath("cave/cave_albedo.dds"));
+	CHECK(bytes.size() > 128);
+	if (bytes.size() <= 128)
+		return;
+
+	DDS::Reader reader;
+	CHECK(reader.Open(ModelPath("missing.dds").c_str()) == DDS::Result::FileNotFound);
+
+	std::vector<uint8_t> badMagic = bytes;
+	badMagic[0] = 'X';
+	CHECK(reader.OpenMemory(badMagic.data(), badMagic.size()) == DDS::Result::InvalidHeader);
+
+	// dwSize of the header
+	std::vector<uint8_t> badHeader = bytes;
+	badHeader[4] = 100;
+	CHECK(reader.OpenMemory(badHeader.data(), badHeader.size()) == DDS::Result::InvalidHeader);
+	CHECK(!reader.IsOpen());
+}
+
+TEST_CASE(DDSReader_WritesAndReadsBack)
+{
+	// 8x4 RGBA8 with its 4x2, 2x1 and 1x1 mips
+	std::vector<std::vector<uint8_t>> mips;
+	for (uint32_t w = 8, h = 4; ; w = std::max(w / 2, 1u), h = std::max(h / 2, 1u))
+	{
+		std::vector<uint8_t> mip(w * h * 4);
+		for (size_t i = 0; i < mip.size(); ++i)
+			mip[i] = (uint8_t)(i * 7 + mips.size() * 31);
+		mips.push_back(mip);
+		if (w == 1 && h == 1)
+			break;
+	}
+
+	const char* fileName = "DDSReaderTest_written.dds";
+	CHECK(DDS::WriteTexture2D(fileName, DXGI_FORMAT_R8G8B8A8_UNORM, 8, 4, mips) == DDS::Result::Ok);
+	{
+		DDS::Reader reader;
+		CHECK(reader.Open(fileName) == DDS::Result::Ok);
+		CHECK(reader.Desc().Format == DXGI_FORMAT_R8G8B8A8_UNORM);
+		CHECK(reader.Desc().Width == 8 && reader.Desc().Height == 4);
+		CHECK(reader.Desc().MipLevels == mips.size() && reader.Desc().ArraySize == 1);
+		if (reader.Subresources().size() == mips.size())
+		{
+			for (size_t i = 0; i < mips.size(); ++i)
+			{
+				const DDS::Subresource& sub = reader.Subresources()[i];
+				CHECK(sub.SlicePitch == mips[i].size());
+				CHECK(memcmp(sub.Data, mips[i].data(), mips[i].size()) == 0);
+			}
+		}
+
+		// Copies into a wider pitch keep the rows
+		const DDS::Subresource& top = reader.Subresources()[0];
+		std::vector<uint8_t> padded(256 * top.NumRows, 0xcd);
+		DDS::CopySubresource(top, padded.data(), 256, padded.size());
+		for (size_t row = 0; row < top.NumRows; ++row)
+		{
+			CHECK(memcmp(&padded[row * 256], top.Data + row * top.RowPitch, top.RowPitch) == 0);
+			CHECK(padded[row * 256 + top.RowPitch] == 0xcd);
+		}
+	}
+	std::remove(fileName);
+
+	// A mip of the wrong size is refused
+	mips[1].pop_back();
+	CHECK(DDS::WriteTexture2D(fileName, DXGI_FORMAT_R8G8B8A8_UNORM, 8, 4, mips) == DDS::Result::Truncated);
+}
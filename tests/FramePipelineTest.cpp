@@ -0,0 +1,149 @@
+#include "Test.h"
+#include "../src/FramePipeline.h"
+#include <thread>
+
+namespace
+{
+	struct TestPacket
+	{
+		std::uint64_t Frame = 0;
+		std::vector<std::uint64_t> Payload; // every entry is Frame, a packet written while read shows up torn
+		std::atomic<int> Users{ 0 };        // threads inside the packet at once
+	};
+}
+
+TEST_CASE(FramePipeline_QueueIsFifoAndBounded)
+{
+	SpscQueue<int, 4> queue;
+	CHECK(queue.Size() == 0);
+	for (int i = 0; i < 4; ++i)
+		CHECK(queue.TryPush(i));
+	CHECK(!queue.TryPush(4));
+	CHECK(queue.Size() == 4);
+
+	int value = -1;
+	for (int i = 0; i < 4; ++i)
+	{
+		CHECK(queue.TryPop(value));
+		CHECK(value == i);
+	}
+	CHECK(!queue.TryPop(value));
+
+	// The indices wrap around the slots
+	for (int i = 0; i < 10; ++i)
+	{
+		CHECK(queue.TryPush(i));
+		CHECK(queue.TryPop(value));
+		CHECK(value == i);
+	}
+}
+
+TEST_CASE(FramePipeline_SameThreadHandsPacketsOutInOrder)
+{
+	FramePipeline<TestPacket> pipeline(3);
+	std::vector<TestPacket*> order;
+	for (std::uint64_t frame = 0; frame < 9; ++frame)
+	{
+		TestPacket* packet = pipeline.BeginFrame();
+		packet->Frame = frame;
+		pipeline.Submit(packet);
+
+		TestPacket* rendered = pipeline.Acquire();
+		CHECK(rendered == packet);
+		CHECK(rendered->Frame == frame);
+		pipeline.Release(rendered);
+		order.push_back(packet);
+	}
+	// Round robin over the packets, like the frame resources they stand for
+	for (size_t i = 3; i < order.size(); ++i)
+		CHECK(order[i] == order[i - 3]);
+
+	pipeline.Drain();
+	pipeline.Stop();
+	CHECK(pipeline.Acquire() == nullptr);
+}
+
+TEST_CASE(FramePipeline_ThreadsNeverShareAPacket)
+{
+	const std::uint32_t packetCount = 3;
+	const std::uint64_t frames = 20000;
+	FramePipeline<TestPacket> pipeline(packetCount);
+
+	std::atomic<std::uint64_t> released{ 0 };
+	std::uint64_t rendered = 0;
+	bool inOrder = true;
+	bool intact = true;
+	bool exclusive = true;
+	std::thread render([&]()
+	{
+		while (TestPacket* packet = pipeline.Acquire())
+		{
+			exclusive &= packet->Users.fetch_add(1) == 0;
+			inOrder &= packet->Frame == rendered;
+			for (std::uint64_t value : packet->Payload)
+				intact &= value == packet->Frame;
+			++rendered;
+			packet->Users.fetch_sub(1);
+			released.fetch_add(1);
+			pipeline.Release(packet);
+		}
+	});
+
+	bool bounded = true;
+	for (std::uint64_t frame = 0; frame < frames; ++frame)
+	{
+		TestPacket* packet = pipeline.BeginFrame();
+		exclusive &= packet->Users.fetch_add(1) == 0;
+		// Every other packet may still be submitted or rendered, never more
+		bounded &= frame - released.load() <= packetCount;
+		packet->Frame = frame;
+		packet->Payload.assign(1 + frame % 64, frame);
+		packet->Users.fetch_sub(1);
+		pipeline.Submit(packet);
+
+		if (frame % 1000 == 999)
+		{
+			pipeline.Drain();
+			bounded &= released.load() == frame + 1;
+		}
+	}
+	pipeline.Drain();
+	pipeline.Stop();
+	render.join();
+
+	std::printf("  %llu frames, simulation waits %llu, render waits %llu\n", (unsigned long long)rendered,
+		(unsigned long long)pipeline.SimulationWaits(), (unsigned long long)pipeline.RenderWaits());
+	CHECK(rendered == frames);
+	CHECK(inOrder);
+	CHECK(intact);
+	CHECK(exclusive);
+	CHECK(bounded);
+}
+
+TEST_CASE(FramePipeline_StopTakesTheSubmittedPacketsFirst)
+{
+	FramePipeline<TestPacket> pipeline(2);
+	TestPacket* first = pipeline.BeginFrame();
+	first->Frame = 1;
+	pipeline.Submit(first);
+	TestPacket* second = pipeline.BeginFrame();
+	second->Frame = 2;
+	pipeline.Submit(second);
+	pipeline.Stop();
+
+	TestPacket* packet = pipeline.Acquire();
+	CHECK(packet != nullptr && packet->Frame == 1);
+	pipeline.Release(packet);
+	packet = pipeline.Acquire();
+	CHECK(packet != nullptr && packet->Frame == 2);
+	pipeline.Release(packet);
+	CHECK(pipeline.Acquire() == nullptr);
+
+	// A restarted pipeline hands the packets out again
+	pipeline.Restart();
+	packet = pipeline.BeginFrame();
+	pipeline.Submit(packet);
+	CHECK(pipeline.Acquire() == packet);
+	pipeline.Release(packet);
+	pipeline.Drain();
+}
@@ -0,0 +1,115 @@
+#include "Test.h"
+#include "../src/InstanceRecords.h"
+#include "../src/JobSystem.h"
+
+namespace
+{
+	// The shaders sample with these errors at most, far below what a wrong row, sign or column would give
+	const float MaxPositionError = 1e-4f;  // world units, translations up to 100
+	const float MaxNormalErrorDeg = 0.1f;  // near the float acos noise floor
+	const float MaxTexCError = 1e-4f;      // uv units, tiling up to 8
+
+	InstanceData MakeInstance(FXMMATRIX world, CXMMATRIX tex, UINT materialIndex)
+	{
+		InstanceData instance;
+		XMStoreFloat4x4(&instance.World, world);
+		XMStoreFloat4x4(&instance.TexTransform, tex);
+		instance.MaterialIndex = materialIndex;
+		return instance;
+	}
+}
+
+TEST_CASE(InstanceRecords_DecodesWithinBounds)
+{
+	const InstancePackingError error = VerifyInstancePacking(10000);
+	std::printf("  position %g, normal %g deg, texc %g, bad indices %u\n", error.Position, error.NormalDeg, error.TexC, error.BadIndices);
+	CHECK(error.Instances == 10000);
+	CHECK(error.Position <= MaxPositionError);
+	CHECK(error.NormalDeg <= MaxNormalErrorDeg);
+	CHECK(error.TexC <= MaxTexCError);
+	CHECK(error.BadIndices == 0);
+}
+
+TEST_CASE(InstanceRecords_RoundTripsIndicesAndFlags)
+{
+	const UINT materialIndices[] = { 0, 1, 255, 65536, PackedMaterialIndexMask };
+	for (UINT materialIndex : materialIndices)
+	{
+		for (UINT aoType = 0; aoType < 4; ++aoType)
+		{
+			PackedInstance record;
+			PackInstance(MakeInstance(XMMatrixTranslation(1.0f, 2.0f, 3.0f), XMMatrixIdentity(), materialIndex), aoType, &record);
+			CHECK((record.MaterialAndFlags & PackedIdentityTexTransform) != 0);
+
+			const InstanceData decoded = UnpackInstance(record);
+			CHECK(decoded.MaterialIndex == materialIndex);
+			CHECK(decoded.AOType == aoType);
+		}
+	}
+
+	// A texture transform that is not the identity is kept and flagged so
+	PackedInstance record;
+	PackInstance(MakeInstance(XMMatrixIdentity(), XMMatrixScaling(2.0f, 3.0f, 1.0f) * XMMatrixTranslation(0.5f, 0.25f, 0.0f), 7), 1, &record);
+	CHECK((record.MaterialAndFlags & PackedIdentityTexTransform) == 0);
+	const InstanceData decoded = UnpackInstance(record);
+	CHECK(decoded.TexTransform._11 == 2.0f && decoded.TexTransform._22 == 3.0f);
+	CHECK(decoded.TexTransform._41 == 0.5f && decoded.TexTransform._42 == 0.25f);
+}
+
+TEST_CASE(InstanceRecords_MirroredNormalsPointOutwards)
+{
+	// Mirrored in x: the adjugate flips with the determinant, the decoded normal matrix must not
+	const XMMATRIX world = XMMatrixScaling(-2.0f, 1.0f, 0.5f) * XMMatrixTranslation(10.0f, 0.0f, 0.0f);
+	PackedInstance record;
+	PackInstance(MakeInstance(world, XMMatrixIdentity(), 0), 0, &record);
+	const InstanceData decoded = UnpackInstance(record);
+
+	const XMMATRIX expected = MathHelper::AffineInverseTranspose(world);
+	const XMMATRIX actual = XMLoadFloat4x4(&decoded.InvTpsWorld);
+	const XMVECTOR normals[] = { XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f) };
+	for (XMVECTOR n : normals)
+	{
+		const XMVECTOR a = XMVector3Normalize(XMVector3TransformNormal(n, expected));
+		const XMVECTOR b = XMVector3Normalize(XMVector3TransformNormal(n, actual));
+		CHECK(XMVectorGetX(XMVector3Dot(a, b)) > 0.9999f);
+	}
+}
+
+TEST_CASE(InstanceRecords_UpdatesDirtySlotsOncePerFrameResource)
+{
+	const int frameResources = 3;
+	const UINT count = InstanceRecords::ParallelThreshold + 100; // the first updates take the parallel path
+	std::vector<InstanceData> instances(count);
+	std::vector<const InstanceData*> sources(count);
+	for (UINT i = 0; i < count; ++i)
+	{
+		instances[i] = MakeInstance(XMMatrixTranslation((float)i, 0.0f, 0.0f), XMMatrixIdentity(), i % 16);
+		sources[i] = &instances[i];
+	}
+
+	JobSystem jobs(3);
+	InstanceRecords records;
+	records.Reset(sources, frameResources);
+	std::vector<PackedInstance> buffer(count);
+	for (int frame = 0; frame < frameResources; ++frame)
+		CHECK(records.Update(buffer.data(), 0, &jobs) == count);
+	CHECK(records.DirtyCount() == 0);
+	CHECK(records.Update(buffer.data(), 0) == 0);
+	CHECK(buffer[count - 1].World[0].w == (float)(count - 1));
+
+	// One changed instance is rewritten in each frame resource, then left alone
+	instances[5].MaterialIndex = 99;
+	records.MarkDirty(5);
+	records.MarkDirty(5);
+	for (int frame = 0; frame < frameResources; ++frame)
+	{
+		buffer[5].MaterialAndFlags = 0;
+		CHECK(records.Update(buffer.data(), 0) == 1);
+		CHECK(UnpackInstance(buffer[5]).MaterialIndex == 99);
+	}
+	CHECK(records.Update(buffer.data(), 0) == 0);
+
+	// A new AO type is stored in every record
+	CHECK(records.Update(buffer.data(), 2, &jobs) == count);
+	CHECK(UnpackInstance(buffer[count / 2]).AOType == 2);
+}
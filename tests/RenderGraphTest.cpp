@@ -0,0 +1,134 @@
+#include "Test.h"
+#include "../src/RenderGraph.h"
+
+TEST_CASE(RenderGraph_CompilesKnownGraphs)
+{
+	std::string failure;
+	const UINT failures = VerifyRenderGraph(&failure);
+	if (failures != 0)
+		std::printf("  %u failed, first: %s\n", failures, failure.c_str());
+	CHECK(failures == 0);
+}
+
+TEST_CASE(RenderGraph_ChainSharesMemoryBetweenDisjointLifetimes)
+{
+	RGTextureDesc target;
+	target.Width = 512;
+	target.Height = 512;
+	const UINT64 targetBytes = RenderGraph::TextureBytes(target);
+
+	// p0 -> t0 -> p1 -> t1 -> p2 -> t2 -> p3 -> out, and a pass nobody reads
+	RenderGraph graph;
+	const UINT out = graph.ImportTexture("out", target);
+	const UINT unused = graph.CreateTexture("unused", target);
+	UINT t[3];
+	for (UINT i = 0; i < 3; ++i)
+		t[i] = graph.CreateTexture("t", target);
+	const UINT p0 = graph.AddPass("p0");
+	graph.Write(p0, t[0]);
+	const UINT dead = graph.AddPass("dead");
+	graph.Write(dead, unused);
+	const UINT p1 = graph.AddPass("p1");
+	graph.Read(p1, t[0]);
+	graph.Write(p1, t[1]);
+	const UINT p2 = graph.AddPass("p2");
+	graph.Read(p2, t[1]);
+	graph.Write(p2, t[2]);
+	const UINT p3 = graph.AddPass("p3");
+	graph.Read(p3, t[2]);
+	graph.Write(p3, out);
+	graph.Compile();
+
+	CHECK(graph.IsCulled(dead));
+	CHECK(graph.Order() == std::vector<UINT>({ p0, p1, p2, p3 }));
+	CHECK(graph.Offset(unused) == RenderGraph::Invalid);
+	CHECK(graph.Offset(out) == RenderGraph::Invalid);
+	for (UINT i = 0; i < 3; ++i)
+	{
+		CHECK(graph.LifetimeOf(t[i]).First == i);
+		CHECK(graph.LifetimeOf(t[i]).Last == i + 1);
+		CHECK(graph.Offset(t[i]) % D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT == 0);
+	}
+	CHECK(graph.Offset(t[0]) == graph.Offset(t[2]));
+	CHECK(graph.Offset(t[1]) != graph.Offset(t[0]));
+	CHECK(graph.GetStats().AliasedBytes == 2 * targetBytes);
+	CHECK(graph.GetStats().TransientBytes == 3 * targetBytes);
+}
+
+namespace
+{
+	// Records what Execute issues
+	struct RecordingCommandList : ID3D12GraphicsCommandList
+	{
+		std::vector<D3D12_RESOURCE_BARRIER> Barriers;
+		void ResourceBarrier(UINT count, const D3D12_RESOURCE_BARRIER* barriers) override
+		{
+			Barriers.insert(Barriers.end(), barriers, barriers + count);
+		}
+	};
+}
+
+TEST_CASE(RenderGraph_ExecuteAliasesBeforeTheFirstUse)
+{
+	RGTextureDesc target;
+	target.Width = 256;
+	target.Height = 256;
+
+	RenderGraph graph;
+	const UINT out = graph.ImportTexture("out", target);
+	const UINT t0 = graph.CreateTexture("t0", target);
+	const UINT t1 = graph.CreateTexture("t1", target);
+	const UINT t2 = graph.CreateTexture("t2", target);
+	std::vector<UINT> ran;
+	UINT pass = graph.AddPass("p0", [&](ID3D12GraphicsCommandList*) { ran.push_back(0); });
+	graph.Write(pass, t0);
+	pass = graph.AddPass("p1", [&](ID3D12GraphicsCommandList*) { ran.push_back(1); });
+	graph.Read(pass, t0);
+	graph.Write(pass, t1);
+	pass = graph.AddPass("p2", [&](ID3D12GraphicsCommandList*) { ran.push_back(2); });
+	graph.Read(pass, t1);
+	graph.Write(pass, t2);
+	pass = graph.AddPass("p3", [&](ID3D12GraphicsCommandList*) { ran.push_back(3); });
+	graph.Read(pass, t2);
+	graph.Write(pass, out);
+	graph.Compile();
+
+	// Stand-ins for the placed resources, the graph only passes them on
+	ID3D12Resource* const resources[] = { reinterpret_cast<ID3D12Resource*>(0x10), reinterpret_cast<ID3D12Resource*>(0x20),
+		reinterpret_cast<ID3D12Resource*>(0x30) };
+	graph.SetResource(t0, resources[0]);
+	graph.SetResource(t1, resources[1]);
+	graph.SetResource(t2, resources[2]);
+
+	RecordingCommandList cmdList;
+	graph.Execute(&cmdList);
+	CHECK(ran == std::vector<UINT>({ 0, 1, 2, 3 }));
+	// t0 and t2 share memory, t1 has its own
+	CHECK(cmdList.Barriers.size() == 2);
+	for (const D3D12_RESOURCE_BARRIER& barrier : cmdList.Barriers)
+		CHECK(barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_ALIASING);
+	if (cmdList.Barriers.size() == 2)
+	{
+		CHECK(cmdList.Barriers[0].Aliasing.pResourceAfter == resources[0]);
+		CHECK(cmdList.Barriers[1].Aliasing.pResourceAfter == resources[2]);
+	}
+}
+
+TEST_CASE(RenderGraph_DeferredFrameTransientsOverlap)
+{
+	for (bool ssr : { true, false })
+	{
+		RenderGraph graph;
+		const DeferredFrameTextures textures = DeclareDeferredFrame(graph, 1920, 1080, ssr, DeferredFramePasses());
+		graph.Compile();
+		const RenderGraph::Stats& stats = graph.GetStats();
+		std::printf("  %s SSR: %u transients, %llu bytes, heap %llu bytes\n", ssr ? "with" : "without", stats.Transients,
+			(unsigned long long)stats.TransientBytes, (unsigned long long)stats.AliasedBytes);
+		// Every placed target of the frame is alive while the lighting pass runs, so none share memory
+		CHECK(stats.AliasedBytes == stats.TransientBytes);
+		CHECK(stats.PeakLiveBytes == stats.TransientBytes);
+		CHECK(!graph.IsAliased(textures.SceneColor));
+		// The SSAO maps keep the resources of their owner
+		CHECK(graph.Offset(textures.Ambient) == RenderGraph::Invalid);
+	}
+}
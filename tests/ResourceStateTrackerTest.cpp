@@ -0,0 +1,250 @@
+#include "Test.h"
+#include "../src/ResourceStateTracker.h"
+#include <cstdint>
+
+TEST_CASE(ResourceStateTracker_PlansKnownFrames)
+{
+	std::string failure;
+	const UINT failures = VerifyResourceStateTracker(&failure);
+	if (failures != 0)
+		std::printf("  %u failed, first: %s\n", failures, failure.c_str());
+	CHECK(failures == 0);
+}
+
+TEST_CASE(ResourceStateTracker_BatchesTheDeferredFrame)
+{
+	const BarrierReport report = MeasureDeferredFrameBarriers(1920, 1080);
+	std::printf("  %u HiZ mips: hand written %u calls, tracked %u calls, split %u transitions\n",
+		report.HiZMips, report.HandCalls, report.Tracked.Calls, report.TrackedSplit.Split);
+	CHECK(report.HiZMips == 11);
+	CHECK(report.Tracked.Calls < report.HandCalls);
+	CHECK(report.TrackedSplit.Split > 0);
+	CHECK(report.TrackedSplit.Transitions == report.Tracked.Transitions);
+}
+
+namespace
+{
+	const D3D12_RESOURCE_STATES RenderTarget = D3D12_RESOURCE_STATE_RENDER_TARGET;
+	const D3D12_RESOURCE_STATES PixelRead = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+	const D3D12_RESOURCE_STATES ComputeRead = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+	const D3D12_RESOURCE_STATES Uav = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+
+	// Stand-ins for the resources, the tracker only passes them on
+	ID3D12Resource* FakeResource(std::uintptr_t id) { return reinterpret_cast<ID3D12Resource*>(id * 16); }
+
+	bool IsTransition(const D3D12_RESOURCE_BARRIER& barrier, ID3D12Resource* resource, D3D12_RESOURCE_STATES before,
+		D3D12_RESOURCE_STATES after, UINT subresource, D3D12_RESOURCE_BARRIER_FLAGS flags)
+	{
+		return barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION && barrier.Flags == flags &&
+			barrier.Transition.pResource == resource && barrier.Transition.StateBefore == before &&
+			barrier.Transition.StateAfter == after && barrier.Transition.Subresource == subresource;
+	}
+
+	// Records every ResourceBarrier call
+	struct RecordingCommandList : ID3D12GraphicsCommandList
+	{
+		std::vector<std::vector<D3D12_RESOURCE_BARRIER>> Calls;
+		void ResourceBarrier(UINT count, const D3D12_RESOURCE_BARRIER* barriers) override
+		{
+			Calls.emplace_back(barriers, barriers + count);
+		}
+	};
+
+	// write: the target is rendered, other: a pass not touching it, read: the target is sampled
+	struct WriteThenRead
+	{
+		ResourceStateTracker Tracker;
+		UINT Target = 0;
+		UINT Write = 0, Other = 0, Read = 0;
+
+		explicit WriteThenRead(bool split)
+		{
+			Target = Tracker.Register("target", FakeResource(1), 1, PixelRead);
+			const UINT other = Tracker.Register("other", FakeResource(2), 1, RenderTarget);
+			Tracker.BeginFrame();
+			Write = Tracker.AddPass("write");
+			Tracker.Use(Write, Target, RenderTarget);
+			Other = Tracker.AddPass("other");
+			Tracker.Use(Other, other, RenderTarget);
+			Read = Tracker.AddPass("read");
+			Tracker.Use(Read, Target, PixelRead);
+			Tracker.Plan(split);
+		}
+	};
+}
+
+TEST_CASE(ResourceStateTracker_TransitionsOnlyWhereTheStateChanges)
+{
+	WriteThenRead frame(false);
+	const ResourceStateTracker& tracker = frame.Tracker;
+	CHECK(tracker.Barriers(frame.Write).size() == 1);
+	if (tracker.Barriers(frame.Write).size() == 1)
+		CHECK(IsTransition(tracker.Barriers(frame.Write)[0], FakeResource(1), PixelRead, RenderTarget,
+			0, D3D12_RESOURCE_BARRIER_FLAG_NONE));
+	// A resource of one subresource transitions subresource 0
+	CHECK(tracker.Barriers(frame.Other).empty());
+	CHECK(tracker.Barriers(frame.Read).size() == 1);
+	if (tracker.Barriers(frame.Read).size() == 1)
+		CHECK(IsTransition(tracker.Barriers(frame.Read)[0], FakeResource(1), RenderTarget, PixelRead,
+			0, D3D12_RESOURCE_BARRIER_FLAG_NONE));
+	CHECK(tracker.GetStats().Transitions == 2);
+	CHECK(tracker.GetStats().Split == 0);
+	CHECK(tracker.GetStats().Calls == 2);
+	CHECK(tracker.GetStats().CoveredUses == 1);
+	// The next frame starts where this one left the target
+	CHECK(tracker.State(frame.Target) == PixelRead);
+
+	// One ResourceBarrier call per pass with barriers, none for the others
+	RecordingCommandList cmdList;
+	for (UINT pass = 0; pass < tracker.PassCount(); ++pass)
+		tracker.Record(&cmdList, pass);
+	CHECK(cmdList.Calls.size() == 2);
+}
+
+TEST_CASE(ResourceStateTracker_SplitsAcrossPassesInBetween)
+{
+	WriteThenRead frame(true);
+	const ResourceStateTracker& tracker = frame.Tracker;
+
+	// The write needs the target at once, there is no pass before it to begin in
+	CHECK(tracker.Barriers(frame.Write).size() == 1);
+	if (tracker.Barriers(frame.Write).size() == 1)
+		CHECK(tracker.Barriers(frame.Write)[0].Flags == D3D12_RESOURCE_BARRIER_FLAG_NONE);
+
+	// RENDER_TARGET -> PIXEL_SHADER_RESOURCE begins right after the write and ends before the read
+	CHECK(tracker.Barriers(frame.Other).size() == 1);
+	if (tracker.Barriers(frame.Other).size() == 1)
+		CHECK(IsTransition(tracker.Barriers(frame.Other)[0], FakeResource(1), RenderTarget, PixelRead,
+			0, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY));
+	CHECK(tracker.Barriers(frame.Read).size() == 1);
+	if (tracker.Barriers(frame.Read).size() == 1)
+		CHECK(IsTransition(tracker.Barriers(frame.Read)[0], FakeResource(1), RenderTarget, PixelRead,
+			0, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY));
+	CHECK(tracker.GetStats().Split == 1);
+	CHECK(tracker.GetStats().Transitions == 2);
+	CHECK(tracker.GetStats().Barriers == 3);
+
+	// Recorded in pass order the begin comes first
+	RecordingCommandList cmdList;
+	for (UINT pass = 0; pass < tracker.PassCount(); ++pass)
+		tracker.Record(&cmdList, pass);
+	CHECK(cmdList.Calls.size() == 3);
+	if (cmdList.Calls.size() == 3)
+	{
+		CHECK(cmdList.Calls[1][0].Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY);
+		CHECK(cmdList.Calls[2][0].Flags == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY);
+	}
+}
+
+TEST_CASE(ResourceStateTracker_FoldsFollowingReadsIntoOneTransition)
+{
+	ResourceStateTracker tracker;
+	const UINT target = tracker.Register("target", FakeResource(1), 1, RenderTarget);
+	tracker.BeginFrame();
+	const UINT pixel = tracker.AddPass("pixel");
+	tracker.Use(pixel, target, PixelRead);
+	const UINT compute = tracker.AddPass("compute");
+	tracker.Use(compute, target, ComputeRead);
+	const UINT write = tracker.AddPass("write");
+	tracker.Use(write, target, RenderTarget);
+	tracker.Plan(false);
+
+	// Both reads come out of the one transition, the write ends them
+	CHECK(tracker.Barriers(pixel).size() == 1);
+	if (tracker.Barriers(pixel).size() == 1)
+		CHECK(IsTransition(tracker.Barriers(pixel)[0], FakeResource(1), RenderTarget, PixelRead | ComputeRead,
+			0, D3D12_RESOURCE_BARRIER_FLAG_NONE));
+	CHECK(tracker.Barriers(compute).empty());
+	CHECK(tracker.Barriers(write).size() == 1);
+	if (tracker.Barriers(write).size() == 1)
+		CHECK(IsTransition(tracker.Barriers(write)[0], FakeResource(1), PixelRead | ComputeRead, RenderTarget,
+			0, D3D12_RESOURCE_BARRIER_FLAG_NONE));
+}
+
+TEST_CASE(ResourceStateTracker_MipChainPerSubresource)
+{
+	// The HiZ pattern: each mip written as a UAV from the one above it, then the whole chain sampled
+	const UINT mips = 4;
+	ResourceStateTracker tracker;
+	const UINT hiZ = tracker.Register("HiZ", FakeResource(3), mips, PixelRead);
+	tracker.BeginFrame();
+	std::vector<UINT> passes;
+	passes.push_back(tracker.AddPass("mip 0"));
+	tracker.Use(passes[0], hiZ, Uav, 0);
+	for (UINT mip = 1; mip < mips; ++mip)
+	{
+		passes.push_back(tracker.AddPass("mip"));
+		tracker.Use(passes[mip], hiZ, ComputeRead, mip - 1);
+		tracker.Use(passes[mip], hiZ, Uav, mip);
+	}
+	const UINT sample = tracker.AddPass("sample");
+	tracker.Use(sample, hiZ, PixelRead);
+	tracker.Plan(true);
+
+	// Every mip but the first begins its move to UAV in pass 0, ahead of the pass writing it
+	CHECK(tracker.Barriers(passes[0]).size() == mips);
+	UINT begins = 0;
+	for (const D3D12_RESOURCE_BARRIER& barrier : tracker.Barriers(passes[0]))
+		begins += barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY ? 1 : 0;
+	CHECK(begins == mips - 1);
+	for (UINT mip = 1; mip < mips; ++mip)
+	{
+		// The source mip goes UAV -> SRV at once, taking on the sampling that follows, the written one ends its
+		// move to UAV
+		bool source = false;
+		bool ended = false;
+		for (const D3D12_RESOURCE_BARRIER& barrier : tracker.Barriers(passes[mip]))
+		{
+			source |= IsTransition(barrier, FakeResource(3), Uav, ComputeRead | PixelRead, mip - 1, D3D12_RESOURCE_BARRIER_FLAG_NONE);
+			ended |= IsTransition(barrier, FakeResource(3), PixelRead, Uav, mip, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY);
+		}
+		CHECK(source);
+		CHECK(ended);
+	}
+	// Only the last mip still needs a transition for the sampling, the others are in a read state covering it
+	CHECK(tracker.Barriers(sample).size() == 1);
+	if (tracker.Barriers(sample).size() == 1)
+		CHECK(IsTransition(tracker.Barriers(sample)[0], FakeResource(3), Uav, PixelRead, mips - 1, D3D12_RESOURCE_BARRIER_FLAG_NONE));
+	for (UINT mip = 0; mip + 1 < mips; ++mip)
+		CHECK(tracker.State(hiZ, mip) == (ComputeRead | PixelRead));
+	CHECK(tracker.State(hiZ, mips - 1) == PixelRead);
+}
+
+TEST_CASE(ResourceStateTracker_UavWritesInARowGetAUavBarrier)
+{
+	ResourceStateTracker tracker;
+	const UINT buffer = tracker.Register("buffer", FakeResource(4), 1, Uav);
+	tracker.BeginFrame();
+	const UINT first = tracker.AddPass("first");
+	tracker.Use(first, buffer, Uav);
+	const UINT second = tracker.AddPass("second");
+	tracker.Use(second, buffer, Uav);
+	tracker.Plan(true);
+
+	// The state never changes, the second pass only waits for the writes of the first
+	CHECK(tracker.Barriers(first).empty());
+	CHECK(tracker.Barriers(second).size() == 1);
+	if (tracker.Barriers(second).size() == 1)
+	{
+		CHECK(tracker.Barriers(second)[0].Type == D3D12_RESOURCE_BARRIER_TYPE_UAV);
+		CHECK(tracker.Barriers(second)[0].UAV.pResource == FakeResource(4));
+	}
+	CHECK(tracker.GetStats().UavBarriers == 1);
+	CHECK(tracker.GetStats().Transitions == 0);
+}
+
+TEST_CASE(ResourceStateTracker_MergesAWholeResourceChange)
+{
+	ResourceStateTracker tracker;
+	const UINT target = tracker.Register("target", FakeResource(5), 3, PixelRead);
+	tracker.BeginFrame();
+	const UINT write = tracker.AddPass("write");
+	tracker.Use(write, target, RenderTarget);
+	tracker.Plan(false);
+
+	CHECK(tracker.Barriers(write).size() == 1);
+	if (tracker.Barriers(write).size() == 1)
+		CHECK(IsTransition(tracker.Barriers(write)[0], FakeResource(5), PixelRead, RenderTarget,
+			D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_BARRIER_FLAG_NONE));
+	CHECK(tracker.GetStats().Transitions == 1);
+}
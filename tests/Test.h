@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdio>
+#include <vector>
+
+// Minimal registry for the tests of the CPU side modules. Every TEST_CASE registers itself, TestMain runs the
+// ones whose name starts with the prefix given on the command line, a failed CHECK reports and moves on.
+namespace Test
+{
+	typedef void (*Function)();
+
+	struct Case
+	{
+		const char* Name;
+		Function Run;
+	};
+
+	std::vector<Case>& Cases();
+	void Fail(const char* file, int line, const char* expression);
+
+	struct Registrar
+	{
+		Registrar(const char* name, Function run) { Cases().push_back({ name, run }); }
+	};
+}
+
+#define TEST_CASE(name) \
+	static void name(); \
+	static Test::Registrar name##Registrar(#name, name); \
+	static void name()
+
+#define CHECK(expression) \
+	do { if (!(expression)) Test::Fail(__FILE__, __LINE__, #expression); } while (0)
@@ -0,0 +1,40 @@
+#include "Test.h"
+#include <cstring>
+
+namespace
+{
+	int gFailures = 0;
+}
+
+std::vector<Test::Case>& Test::Cases()
+{
+	static std::vector<Case> cases;
+	return cases;
+}
+
+void Test::Fail(const char* file, int line, const char* expression)
+{
+	std::printf("  %s(%d): CHECK(%s) failed\n", file, line, expression);
+	++gFailures;
+}
+
+// MySoftRasterizerTests [prefix]: runs every test case whose name starts with prefix, all of them without one
+int main(int argc, char** argv)
+{
+	const char* prefix = argc > 1 ? argv[1] : "";
+	int ran = 0;
+	int failedCases = 0;
+	for (const Test::Case& test : Test::Cases())
+	{
+		if (strncmp(test.Name, prefix, strlen(prefix)) != 0)
+			continue;
+		const int failuresBefore = gFailures;
+		std::printf("%s\n", test.Name);
+		test.Run();
+		++ran;
+		if (gFailures != failuresBefore)
+			++failedCases;
+	}
+	std::printf("%d test cases, %d failed\n", ran, failedCases);
+	return ran == 0 || failedCases != 0 ? 1 : 0;
+}
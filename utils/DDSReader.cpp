@@ -0,0 +1,745 @@
+#include "DDSReader.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	constexpr uint32_t MakeFourCC(char c0, char c1, char c2, char c3)
+	{
+		return (uint32_t)(uint8_t)c0 | ((uint32_t)(uint8_t)c1 << 8) |
+			((uint32_t)(uint8_t)c2 << 16) | ((uint32_t)(uint8_t)c3 << 24);
+	}
+
+	// File layout, see DDS_HEADER in DDSTextureLoader.cpp
+#pragma pack(push, 1)
+	struct PixelFormat
+	{
+		uint32_t Size;
+		uint32_t Flags;
+		uint32_t FourCC;
+		uint32_t RGBBitCount;
+		uint32_t RBitMask;
+		uint32_t GBitMask;
+		uint32_t BBitMask;
+		uint32_t ABitMask;
+	};
+
+	struct Header
+	{
+		uint32_t Size;
+		uint32_t Flags;
+		uint32_t Height;
+		uint32_t Width;
+		uint32_t PitchOrLinearSize;
+		uint32_t Depth;
+		uint32_t MipMapCount;
+		uint32_t Reserved1[11];
+		PixelFormat Ddspf;
+		uint32_t Caps;
+		uint32_t Caps2;
+		uint32_t Caps3;
+		uint32_t Caps4;
+		uint32_t Reserved2;
+	};
+
+	struct HeaderDXT10
+	{
+		uint32_t DxgiFormat;
+		uint32_t ResourceDimension;
+		uint32_t MiscFlag;
+		uint32_t ArraySize;
+		uint32_t MiscFlags2;
+	};
+#pragma pack(pop)
+
+	static_assert(sizeof(PixelFormat) == 32, "DDS pixel format size mismatch");
+	static_assert(sizeof(Header) == 124, "DDS header size mismatch");
+	static_assert(sizeof(HeaderDXT10) == 20, "DDS DX10 header size mismatch");
+
+	const uint32_t Magic = 0x20534444; // "DDS "
+
+	const uint32_t PixelFourCC = 0x00000004;
+	const uint32_t PixelRGB = 0x00000040;
+	const uint32_t PixelLuminance = 0x00020000;
+	const uint32_t PixelAlpha = 0x00000002;
+
+	const uint32_t HeaderFlagsCaps = 0x00000001;
+	const uint32_t HeaderFlagsHeight = 0x00000002;
+	const uint32_t HeaderFlagsWidth = 0x00000004;
+	const uint32_t HeaderFlagsPixelFormat = 0x00001000;
+	const uint32_t HeaderFlagsMipMapCount = 0x00020000;
+	const uint32_t HeaderFlagsLinearSize = 0x00080000;
+	const uint32_t HeaderFlagsVolume = 0x00800000;
+
+	const uint32_t CapsComplex = 0x00000008;
+	const uint32_t CapsTexture = 0x00001000;
+	const uint32_t CapsMipMap = 0x00400000;
+	const uint32_t Caps2CubeMap = 0x00000200;
+	const uint32_t Caps2CubeMapAllFaces = 0x0000fc00;
+
+	// D3D11_RESOURCE_DIMENSION and D3D11_RESOURCE_MISC_TEXTURECUBE
+	const uint32_t ResourceDimensionTexture1D = 2;
+	const uint32_t ResourceDimensionTexture2D = 3;
+	const uint32_t ResourceDimensionTexture3D = 4;
+	const uint32_t MiscTextureCube = 0x4;
+
+	// D3D12 resource limits
+	const uint32_t MaxTextureDimension1D = 16384;
+	const uint32_t MaxTextureDimension2D = 16384;
+	const uint32_t MaxTextureDimension3D = 2048;
+	const uint32_t MaxTextureArraySize = 2048;
+	const uint32_t MaxMipLevels = 15;
+
+	bool IsBitMask(const PixelFormat& ddpf, uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+	{
+		return ddpf.RBitMask == r && ddpf.GBitMask == g && ddpf.BBitMask == b && ddpf.ABitMask == a;
+	}
+
+	DXGI_FORMAT GetMaskFormat(const PixelFormat& ddpf)
+	{
+		if (ddpf.Flags & PixelRGB)
+		{
+			switch (ddpf.RGBBitCount)
+			{
+			case 32:
+				if (IsBitMask(ddpf, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000))
+					return DXGI_FORMAT_R8G8B8A8_UNORM;
+				if (IsBitMask(ddpf, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000))
+					return DXGI_FORMAT_B8G8R8A8_UNORM;
+				if (IsBitMask(ddpf, 0x00ff0000, 0x0000ff00, 0x000000ff, 0x00000000))
+					return DXGI_FORMAT_B8G8R8X8_UNORM;
+				// D3DX writes 10:10:10:2 with the red and blue masks swapped
+				if (IsBitMask(ddpf, 0x3ff00000, 0x000ffc00, 0x000003ff, 0xc0000000))
+					return DXGI_FORMAT_R10G10B10A2_UNORM;
+				if (IsBitMask(ddpf, 0x0000ffff, 0xffff0000, 0x00000000, 0x00000000))
+					return DXGI_FORMAT_R16G16_UNORM;
+				if (IsBitMask(ddpf, 0xffffffff, 0x00000000, 0x00000000, 0x00000000))
+					return DXGI_FORMAT_R32_FLOAT;
+				break;
+
+			case 16:
+				if (IsBitMask(ddpf, 0x7c00, 0x03e0, 0x001f, 0x8000))
+					return DXGI_FORMAT_B5G5R5A1_UNORM;
+				if (IsBitMask(ddpf, 0xf800, 0x07e0, 0x001f, 0x0000))
+					return DXGI_FORMAT_B5G6R5_UNORM;
+				if (IsBitMask(ddpf, 0x0f00, 0x00f0, 0x000f, 0xf000))
+					return DXGI_FORMAT_B4G4R4A4_UNORM;
+				break;
+			}
+		}
+		else if (ddpf.Flags & PixelLuminance)
+		{
+			if (ddpf.RGBBitCount == 8 && IsBitMask(ddpf, 0x000000ff, 0x00000000, 0x00000000, 0x00000000))
+				return DXGI_FORMAT_R8_UNORM;
+			if (ddpf.RGBBitCount == 16)
+			{
+				if (IsBitMask(ddpf, 0x0000ffff, 0x00000000, 0x00000000, 0x00000000))
+					return DXGI_FORMAT_R16_UNORM;
+				if (IsBitMask(ddpf, 0x000000ff, 0x00000000, 0x00000000, 0x0000ff00))
+					return DXGI_FORMAT_R8G8_UNORM;
+			}
+		}
+		else if (ddpf.Flags & PixelAlpha)
+		{
+			if (ddpf.RGBBitCount == 8)
+				return DXGI_FORMAT_A8_UNORM;
+		}
+		return DXGI_FORMAT_UNKNOWN;
+	}
+
+	DXGI_FORMAT GetFourCCFormat(uint32_t fourCC)
+	{
+		switch (fourCC)
+		{
+		case MakeFourCC('D', 'X', 'T', '1'): return DXGI_FORMAT_BC1_UNORM;
+		case MakeFourCC('D', 'X', 'T', '2'):
+		case MakeFourCC('D', 'X', 'T', '3'): return DXGI_FORMAT_BC2_UNORM;
+		case MakeFourCC('D', 'X', 'T', '4'):
+		case MakeFourCC('D', 'X', 'T', '5'): return DXGI_FORMAT_BC3_UNORM;
+		case MakeFourCC('A', 'T', 'I', '1'):
+		case MakeFourCC('B', 'C', '4', 'U'): return DXGI_FORMAT_BC4_UNORM;
+		case MakeFourCC('B', 'C', '4', 'S'): return DXGI_FORMAT_BC4_SNORM;
+		case MakeFourCC('A', 'T', 'I', '2'):
+		case MakeFourCC('B', 'C', '5', 'U'): return DXGI_FORMAT_BC5_UNORM;
+		case MakeFourCC('B', 'C', '5', 'S'): return DXGI_FORMAT_BC5_SNORM;
+
+		// D3DFORMAT values stored as FourCC
+		case 36:  return DXGI_FORMAT_R16G16B16A16_UNORM;
+		case 110: return DXGI_FORMAT_R16G16B16A16_SNORM;
+		case 111: return DXGI_FORMAT_R16_FLOAT;
+		case 112: return DXGI_FORMAT_R16G16_FLOAT;
+		case 113: return DXGI_FORMAT_R16G16B16A16_FLOAT;
+		case 114: return DXGI_FORMAT_R32_FLOAT;
+		case 115: return DXGI_FORMAT_R32G32_FLOAT;
+		case 116: return DXGI_FORMAT_R32G32B32A32_FLOAT;
+		}
+		return DXGI_FORMAT_UNKNOWN;
+	}
+
+	// Legacy header to DXGI format, the same mapping as GetDXGIFormat in DDSTextureLoader.cpp
+	DXGI_FORMAT GetDXGIFormat(const PixelFormat& ddpf)
+	{
+		if (ddpf.Flags & PixelFourCC)
+			return GetFourCCFormat(ddpf.FourCC);
+
+		// Some exporters (ibl_brdf_lut.dds) set DDPF_RGB with meaningless masks next to a valid FourCC.
+		DXGI_FORMAT format = GetMaskFormat(ddpf);
+		if (format == DXGI_FORMAT_UNKNOWN && ddpf.FourCC != 0)
+			format = GetFourCCFormat(ddpf.FourCC);
+		return format;
+	}
+}
+
+size_t DDS::BitsPerPixel(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+	case DXGI_FORMAT_R32G32B32A32_UINT:
+	case DXGI_FORMAT_R32G32B32A32_SINT:
+		return 128;
+
+	case DXGI_FORMAT_R32G32B32_TYPELESS:
+	case DXGI_FORMAT_R32G32B32_FLOAT:
+	case DXGI_FORMAT_R32G32B32_UINT:
+	case DXGI_FORMAT_R32G32B32_SINT:
+		return 96;
+
+	case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+	case DXGI_FORMAT_R16G16B16A16_UNORM:
+	case DXGI_FORMAT_R16G16B16A16_UINT:
+	case DXGI_FORMAT_R16G16B16A16_SNORM:
+	case DXGI_FORMAT_R16G16B16A16_SINT:
+	case DXGI_FORMAT_R32G32_TYPELESS:
+	case DXGI_FORMAT_R32G32_FLOAT:
+	case DXGI_FORMAT_R32G32_UINT:
+	case DXGI_FORMAT_R32G32_SINT:
+		return 64;
+
+	case DXGI_FORMAT_R10G10B10A2_TYPELESS:
+	case DXGI_FORMAT_R10G10B10A2_UNORM:
+	case DXGI_FORMAT_R10G10B10A2_UINT:
+	case DXGI_FORMAT_R11G11B10_FLOAT:
+	case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_R8G8B8A8_UINT:
+	case DXGI_FORMAT_R8G8B8A8_SNORM:
+	case DXGI_FORMAT_R8G8B8A8_SINT:
+	case DXGI_FORMAT_R16G16_TYPELESS:
+	case DXGI_FORMAT_R16G16_FLOAT:
+	case DXGI_FORMAT_R16G16_UNORM:
+	case DXGI_FORMAT_R16G16_UINT:
+	case DXGI_FORMAT_R16G16_SNORM:
+	case DXGI_FORMAT_R16G16_SINT:
+	case DXGI_FORMAT_R32_TYPELESS:
+	case DXGI_FORMAT_D32_FLOAT:
+	case DXGI_FORMAT_R32_FLOAT:
+	case DXGI_FORMAT_R32_UINT:
+	case DXGI_FORMAT_R32_SINT:
+	case DXGI_FORMAT_R9G9B9E5_SHAREDEXP:
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+	case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+		return 32;
+
+	case DXGI_FORMAT_R8G8_TYPELESS:
+	case DXGI_FORMAT_R8G8_UNORM:
+	case DXGI_FORMAT_R8G8_UINT:
+	case DXGI_FORMAT_R8G8_SNORM:
+	case DXGI_FORMAT_R8G8_SINT:
+	case DXGI_FORMAT_R16_TYPELESS:
+	case DXGI_FORMAT_R16_FLOAT:
+	case DXGI_FORMAT_D16_UNORM:
+	case DXGI_FORMAT_R16_UNORM:
+	case DXGI_FORMAT_R16_UINT:
+	case DXGI_FORMAT_R16_SNORM:
+	case DXGI_FORMAT_R16_SINT:
+	case DXGI_FORMAT_B5G6R5_UNORM:
+	case DXGI_FORMAT_B5G5R5A1_UNORM:
+	case DXGI_FORMAT_B4G4R4A4_UNORM:
+		return 16;
+
+	case DXGI_FORMAT_R8_TYPELESS:
+	case DXGI_FORMAT_R8_UNORM:
+	case DXGI_FORMAT_R8_UINT:
+	case DXGI_FORMAT_R8_SNORM:
+	case DXGI_FORMAT_R8_SINT:
+	case DXGI_FORMAT_A8_UNORM:
+		return 8;
+
+	case DXGI_FORMAT_BC1_TYPELESS:
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_TYPELESS:
+	case DXGI_FORMAT_BC4_UNORM:
+	case DXGI_FORMAT_BC4_SNORM:
+		return 4;
+
+	case DXGI_FORMAT_BC2_TYPELESS:
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_TYPELESS:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_TYPELESS:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC5_SNORM:
+	case DXGI_FORMAT_BC6H_TYPELESS:
+	case DXGI_FORMAT_BC6H_UF16:
+	case DXGI_FORMAT_BC6H_SF16:
+	case DXGI_FORMAT_BC7_TYPELESS:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return 8;
+
+	default:
+		return 0;
+	}
+}
+
+bool DDS::IsBlockCompressed(DXGI_FORMAT format)
+{
+	return (format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM) ||
+		(format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+}
+
+void DDS::GetSurfaceInfo(size_t width, size_t height, DXGI_FORMAT format,
+	size_t* outNumBytes, size_t* outRowBytes, size_t* outNumRows)
+{
+	size_t rowBytes = 0;
+	size_t numRows = 0;
+
+	if (IsBlockCompressed(format))
+	{
+		// 8 bytes per 4x4 block for BC1/BC4, 16 for the others
+		const size_t bytesPerBlock = BitsPerPixel(format) * 2;
+		const size_t blocksWide = width > 0 ? std::max<size_t>(1, (width + 3) / 4) : 0;
+		const size_t blocksHigh = height > 0 ? std::max<size_t>(1, (height + 3) / 4) : 0;
+		rowBytes = blocksWide * bytesPerBlock;
+		numRows = blocksHigh;
+	}
+	else
+	{
+		rowBytes = (width * BitsPerPixel(format) + 7) / 8; // round up to nearest byte
+		numRows = height;
+	}
+
+	if (outNumBytes)
+		*outNumBytes = rowBytes * numRows;
+	if (outRowBytes)
+		*outRowBytes = rowBytes;
+	if (outNumRows)
+		*outNumRows = numRows;
+}
+
+void DDS::CopySubresource(const Subresource& src, void* dst, size_t dstRowPitch, size_t dstSlicePitch)
+{
+	assert(dstRowPitch >= src.RowPitch && dstSlicePitch >= dstRowPitch * src.NumRows);
+
+	uint8_t* dstBytes = static_cast<uint8_t*>(dst);
+	if (dstRowPitch == src.RowPitch && dstSlicePitch == src.SlicePitch)
+	{
+		memcpy(dstBytes, src.Data, src.SlicePitch * src.Depth);
+		return;
+	}
+
+	for (uint32_t z = 0; z < src.Depth; ++z)
+	{
+		const uint8_t* srcSlice = src.Data + src.SlicePitch * z;
+		uint8_t* dstSlice = dstBytes + dstSlicePitch * z;
+		for (size_t row = 0; row < src.NumRows; ++row)
+			memcpy(dstSlice + dstRowPitch * row, srcSlice + src.RowPitch * row, src.RowPitch);
+	}
+}
+
+const char* DDS::ResultString(Result result)
+{
+	switch (result)
+	{
+	case Result::Ok: return "Ok";
+	case Result::FileNotFound: return "FileNotFound";
+	case Result::MapFailed: return "MapFailed";
+	case Result::InvalidHeader: return "InvalidHeader";
+	case Result::UnsupportedFormat: return "UnsupportedFormat";
+	case Result::Truncated: return "Truncated";
+	case Result::WriteFailed: return "WriteFailed";
+	}
+	return "Unknown";
+}
+
+DDS::Result DDS::WriteTexture2D(const char* fileName, DXGI_FORMAT format, uint32_t width, uint32_t height,
+	const std::vector<std::vector<uint8_t>>& mips)
+{
+	if (mips.empty() || mips.size() > MaxMipLevels || BitsPerPixel(format) == 0)
+		return Result::UnsupportedFormat;
+
+	for (size_t i = 0; i < mips.size(); ++i)
+	{
+		size_t numBytes, rowBytes, numRows;
+		GetSurfaceInfo(std::max(width >> i, 1u), std::max(height >> i, 1u), format, &numBytes, &rowBytes, &numRows);
+		if (mips[i].size() != numBytes)
+			return Result::Truncated;
+	}
+
+	Header header = {};
+	header.Size = sizeof(Header);
+	header.Flags = HeaderFlagsCaps | HeaderFlagsHeight | HeaderFlagsWidth | HeaderFlagsPixelFormat |
+		HeaderFlagsMipMapCount | HeaderFlagsLinearSize;
+	header.Height = height;
+	header.Width = width;
+	header.PitchOrLinearSize = (uint32_t)mips[0].size();
+	header.MipMapCount = (uint32_t)mips.size();
+	header.Ddspf.Size = sizeof(PixelFormat);
+	header.Ddspf.Flags = PixelFourCC;
+	header.Ddspf.FourCC = MakeFourCC('D', 'X', '1', '0');
+	header.Caps = CapsTexture | (mips.size() > 1 ? CapsComplex | CapsMipMap : 0);
+
+	HeaderDXT10 dx10 = {};
+	dx10.DxgiFormat = (uint32_t)format;
+	dx10.ResourceDimension = ResourceDimensionTexture2D;
+	dx10.ArraySize = 1;
+
+	std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return Result::WriteFailed;
+	file.write(reinterpret_cast<const char*>(&Magic), sizeof(Magic));
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(&dx10), sizeof(dx10));
+	for (const auto& mip : mips)
+		file.write(reinterpret_cast<const char*>(mip.data()), mip.size());
+	return file ? Result::Ok : Result::WriteFailed;
+}
+
+DDS::Reader::Reader(Reader&& rhs) noexcept
+{
+	*this = std::move(rhs);
+}
+
+DDS::Reader& DDS::Reader::operator=(Reader&& rhs) noexcept
+{
+	if (this != &rhs)
+	{
+		Close();
+		mData = rhs.mData;
+		mSize = rhs.mSize;
+		mMapped = rhs.mMapped;
+#if defined(_WIN32)
+		mFile = rhs.mFile;
+		mMapping = rhs.mMapping;
+		rhs.mFile = nullptr;
+		rhs.mMapping = nullptr;
+#endif
+		mDesc = rhs.mDesc;
+		mSubresources = std::move(rhs.mSubresources);
+
+		rhs.mData = nullptr;
+		rhs.mSize = 0;
+		rhs.mMapped = false;
+		rhs.mSubresources.clear();
+	}
+	return *this;
+}
+
+DDS::Reader::~Reader()
+{
+	Close();
+}
+
+#if defined(_WIN32)
+DDS::Result DDS::Reader::Open(const char* fileName)
+{
+	// Narrow names are UTF-8 on every platform
+	int length = MultiByteToWideChar(CP_UTF8, 0, fileName, -1, nullptr, 0);
+	if (length <= 0)
+		return Result::FileNotFound;
+	std::vector<wchar_t> wide(length);
+	MultiByteToWideChar(CP_UTF8, 0, fileName, -1, wide.data(), length);
+	return Open(wide.data());
+}
+
+DDS::Result DDS::Reader::Open(const wchar_t* fileName)
+{
+	Close();
+
+	HANDLE file = CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return Result::FileNotFound;
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return fileSize.QuadPart == 0 ? Result::Truncated : Result::MapFailed;
+	}
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		CloseHandle(file);
+		return Result::MapFailed;
+	}
+
+	const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return Result::MapFailed;
+	}
+
+	mFile = file;
+	mMapping = mapping;
+	mMapped = true;
+	mData = static_cast<const uint8_t*>(view);
+	mSize = (size_t)fileSize.QuadPart;
+
+	Result result = Parse();
+	if (result != Result::Ok)
+		Close();
+	return result;
+}
+#else
+DDS::Result DDS::Reader::Open(const char* fileName)
+{
+	Close();
+
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0)
+		return Result::FileNotFound;
+
+	struct stat st = {};
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return st.st_size == 0 ? Result::Truncated : Result::MapFailed;
+	}
+
+	void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping keeps the file alive
+	if (view == MAP_FAILED)
+		return Result::MapFailed;
+
+	mMapped = true;
+	mData = static_cast<const uint8_t*>(view);
+	mSize = (size_t)st.st_size;
+
+	Result result = Parse();
+	if (result != Result::Ok)
+		Close();
+	return result;
+}
+#endif
+
+DDS::Result DDS::Reader::OpenMemory(const void* data, size_t size)
+{
+	Close();
+	if (data == nullptr)
+		return Result::Truncated;
+
+	mData = static_cast<const uint8_t*>(data);
+	mSize = size;
+
+	Result result = Parse();
+	if (result != Result::Ok)
+		Close();
+	return result;
+}
+
+void DDS::Reader::Close()
+{
+	if (mMapped && mData != nullptr)
+	{
+#if defined(_WIN32)
+		UnmapViewOfFile(mData);
+		CloseHandle(mMapping);
+		CloseHandle(mFile);
+		mMapping = nullptr;
+		mFile = nullptr;
+#else
+		munmap(const_cast<uint8_t*>(mData), mSize);
+#endif
+	}
+
+	mData = nullptr;
+	mSize = 0;
+	mMapped = false;
+	mDesc = TextureDesc();
+	mSubresources.clear();
+}
+
+const DDS::Subresource& DDS::Reader::GetSubresource(uint32_t mipLevel, uint32_t arraySlice) const
+{
+	assert(mipLevel < mDesc.MipLevels && arraySlice < mDesc.ArraySize);
+	return mSubresources[(size_t)arraySlice * mDesc.MipLevels + mipLevel];
+}
+
+DDS::Result DDS::Reader::Parse()
+{
+	if (mSize < sizeof(uint32_t) + sizeof(Header))
+		return Result::Truncated;
+
+	uint32_t magic = 0;
+	memcpy(&magic, mData, sizeof(magic));
+	if (magic != Magic)
+		return Result::InvalidHeader;
+
+	// The mapping is page aligned and the header starts at byte 4, so it can be read in place.
+	const Header* header = reinterpret_cast<const Header*>(mData + sizeof(uint32_t));
+	if (header->Size != sizeof(Header) || header->Ddspf.Size != sizeof(PixelFormat))
+		return Result::InvalidHeader;
+
+	size_t offset = sizeof(uint32_t) + sizeof(Header);
+
+	TextureDesc desc;
+	desc.Width = header->Width;
+	desc.Height = header->Height;
+	desc.Depth = header->Depth;
+	desc.MipLevels = std::max(header->MipMapCount, 1u);
+	desc.ArraySize = 1;
+
+	if ((header->Ddspf.Flags & PixelFourCC) && header->Ddspf.FourCC == MakeFourCC('D', 'X', '1', '0'))
+	{
+		if (mSize < offset + sizeof(HeaderDXT10))
+			return Result::Truncated;
+		const HeaderDXT10* dx10 = reinterpret_cast<const HeaderDXT10*>(mData + offset);
+		offset += sizeof(HeaderDXT10);
+
+		desc.Format = (DXGI_FORMAT)dx10->DxgiFormat;
+		desc.ArraySize = dx10->ArraySize;
+		if (desc.ArraySize == 0)
+			return Result::InvalidHeader;
+
+		switch (dx10->ResourceDimension)
+		{
+		case ResourceDimensionTexture1D:
+			if ((header->Flags & HeaderFlagsHeight) && desc.Height != 1)
+				return Result::InvalidHeader;
+			desc.Dimension = TextureDimension::Texture1D;
+			desc.Height = desc.Depth = 1;
+			break;
+
+		case ResourceDimensionTexture2D:
+			if (dx10->MiscFlag & MiscTextureCube)
+			{
+				desc.ArraySize *= 6;
+				desc.IsCubeMap = true;
+			}
+			desc.Dimension = TextureDimension::Texture2D;
+			desc.Depth = 1;
+			break;
+
+		case ResourceDimensionTexture3D:
+			if (!(header->Flags & HeaderFlagsVolume) || desc.ArraySize > 1)
+				return Result::InvalidHeader;
+			desc.Dimension = TextureDimension::Texture3D;
+			break;
+
+		default:
+			return Result::InvalidHeader;
+		}
+	}
+	else
+	{
+		desc.Format = GetDXGIFormat(header->Ddspf);
+
+		if (header->Flags & HeaderFlagsVolume)
+		{
+			desc.Dimension = TextureDimension::Texture3D;
+		}
+		else
+		{
+			if (header->Caps2 & Caps2CubeMap)
+			{
+				// Partial cube maps are not supported by D3D
+				if ((header->Caps2 & Caps2CubeMapAllFaces) != Caps2CubeMapAllFaces)
+					return Result::UnsupportedFormat;
+				desc.ArraySize = 6;
+				desc.IsCubeMap = true;
+			}
+			desc.Dimension = TextureDimension::Texture2D;
+			desc.Depth = 1;
+		}
+	}
+
+	if (BitsPerPixel(desc.Format) == 0)
+		return Result::UnsupportedFormat;
+
+	if (desc.Width == 0 || desc.Height == 0 || desc.Depth == 0 || desc.MipLevels > MaxMipLevels)
+		return Result::InvalidHeader;
+
+	switch (desc.Dimension)
+	{
+	case TextureDimension::Texture1D:
+		if (desc.Width > MaxTextureDimension1D || desc.ArraySize > MaxTextureArraySize)
+			return Result::UnsupportedFormat;
+		break;
+	case TextureDimension::Texture2D:
+		if (desc.Width > MaxTextureDimension2D || desc.Height > MaxTextureDimension2D ||
+			desc.ArraySize > MaxTextureArraySize)
+			return Result::UnsupportedFormat;
+		if (desc.IsCubeMap && desc.Width != desc.Height)
+			return Result::InvalidHeader;
+		break;
+	case TextureDimension::Texture3D:
+		if (desc.Width > MaxTextureDimension3D || desc.Height > MaxTextureDimension3D ||
+			desc.Depth > MaxTextureDimension3D)
+			return Result::UnsupportedFormat;
+		break;
+	}
+
+	// Walk the subresources in file order: every mip of slice 0, then every mip of slice 1, ...
+	std::vector<Subresource> subresources;
+	subresources.reserve((size_t)desc.ArraySize * desc.MipLevels);
+	for (uint32_t slice = 0; slice < desc.ArraySize; ++slice)
+	{
+		uint32_t w = desc.Width;
+		uint32_t h = desc.Height;
+		uint32_t d = desc.Depth;
+		for (uint32_t mip = 0; mip < desc.MipLevels; ++mip)
+		{
+			Subresource sub;
+			GetSurfaceInfo(w, h, desc.Format, &sub.SlicePitch, &sub.RowPitch, &sub.NumRows);
+			sub.Width = w;
+			sub.Height = h;
+			sub.Depth = d;
+			sub.MipLevel = mip;
+			sub.ArraySlice = slice;
+
+			const uint64_t bytes = (uint64_t)sub.SlicePitch * d;
+			if (offset + bytes > mSize)
+				return Result::Truncated;
+			sub.Data = mData + offset;
+			offset += (size_t)bytes;
+			subresources.push_back(sub);
+
+			w = std::max(w >> 1, 1u);
+			h = std::max(h >> 1, 1u);
+			d = std::max(d >> 1, 1u);
+		}
+	}
+
+	mDesc = desc;
+	mSubresources = std::move(subresources);
+	return Result::Ok;
+}
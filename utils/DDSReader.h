@@ -0,0 +1,213 @@
+#pragma once
+
+// Platform neutral DDS container reader.
+// The file is memory mapped and every subresource is a view into the mapping, nothing is copied
+// until the caller moves the texels to where they are needed (staging memory, a decoder, ...).
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(_WIN32)
+#include <dxgiformat.h>
+#else
+// Values match dxgiformat.h, only the formats the reader understands are listed.
+enum DXGI_FORMAT : uint32_t
+{
+	DXGI_FORMAT_UNKNOWN = 0,
+	DXGI_FORMAT_R32G32B32A32_TYPELESS = 1,
+	DXGI_FORMAT_R32G32B32A32_FLOAT = 2,
+	DXGI_FORMAT_R32G32B32A32_UINT = 3,
+	DXGI_FORMAT_R32G32B32A32_SINT = 4,
+	DXGI_FORMAT_R32G32B32_TYPELESS = 5,
+	DXGI_FORMAT_R32G32B32_FLOAT = 6,
+	DXGI_FORMAT_R32G32B32_UINT = 7,
+	DXGI_FORMAT_R32G32B32_SINT = 8,
+	DXGI_FORMAT_R16G16B16A16_TYPELESS = 9,
+	DXGI_FORMAT_R16G16B16A16_FLOAT = 10,
+	DXGI_FORMAT_R16G16B16A16_UNORM = 11,
+	DXGI_FORMAT_R16G16B16A16_UINT = 12,
+	DXGI_FORMAT_R16G16B16A16_SNORM = 13,
+	DXGI_FORMAT_R16G16B16A16_SINT = 14,
+	DXGI_FORMAT_R32G32_TYPELESS = 15,
+	DXGI_FORMAT_R32G32_FLOAT = 16,
+	DXGI_FORMAT_R32G32_UINT = 17,
+	DXGI_FORMAT_R32G32_SINT = 18,
+	DXGI_FORMAT_R10G10B10A2_TYPELESS = 23,
+	DXGI_FORMAT_R10G10B10A2_UNORM = 24,
+	DXGI_FORMAT_R10G10B10A2_UINT = 25,
+	DXGI_FORMAT_R11G11B10_FLOAT = 26,
+	DXGI_FORMAT_R8G8B8A8_TYPELESS = 27,
+	DXGI_FORMAT_R8G8B8A8_UNORM = 28,
+	DXGI_FORMAT_R8G8B8A8_UNORM_SRGB = 29,
+	DXGI_FORMAT_R8G8B8A8_UINT = 30,
+	DXGI_FORMAT_R8G8B8A8_SNORM = 31,
+	DXGI_FORMAT_R8G8B8A8_SINT = 32,
+	DXGI_FORMAT_R16G16_TYPELESS = 33,
+	DXGI_FORMAT_R16G16_FLOAT = 34,
+	DXGI_FORMAT_R16G16_UNORM = 35,
+	DXGI_FORMAT_R16G16_UINT = 36,
+	DXGI_FORMAT_R16G16_SNORM = 37,
+	DXGI_FORMAT_R16G16_SINT = 38,
+	DXGI_FORMAT_R32_TYPELESS = 39,
+	DXGI_FORMAT_D32_FLOAT = 40,
+	DXGI_FORMAT_R32_FLOAT = 41,
+	DXGI_FORMAT_R32_UINT = 42,
+	DXGI_FORMAT_R32_SINT = 43,
+	DXGI_FORMAT_R8G8_TYPELESS = 48,
+	DXGI_FORMAT_R8G8_UNORM = 49,
+	DXGI_FORMAT_R8G8_UINT = 50,
+	DXGI_FORMAT_R8G8_SNORM = 51,
+	DXGI_FORMAT_R8G8_SINT = 52,
+	DXGI_FORMAT_R16_TYPELESS = 53,
+	DXGI_FORMAT_R16_FLOAT = 54,
+	DXGI_FORMAT_D16_UNORM = 55,
+	DXGI_FORMAT_R16_UNORM = 56,
+	DXGI_FORMAT_R16_UINT = 57,
+	DXGI_FORMAT_R16_SNORM = 58,
+	DXGI_FORMAT_R16_SINT = 59,
+	DXGI_FORMAT_R8_TYPELESS = 60,
+	DXGI_FORMAT_R8_UNORM = 61,
+	DXGI_FORMAT_R8_UINT = 62,
+	DXGI_FORMAT_R8_SNORM = 63,
+	DXGI_FORMAT_R8_SINT = 64,
+	DXGI_FORMAT_A8_UNORM = 65,
+	DXGI_FORMAT_R9G9B9E5_SHAREDEXP = 67,
+	DXGI_FORMAT_BC1_TYPELESS = 70,
+	DXGI_FORMAT_BC1_UNORM = 71,
+	DXGI_FORMAT_BC1_UNORM_SRGB = 72,
+	DXGI_FORMAT_BC2_TYPELESS = 73,
+	DXGI_FORMAT_BC2_UNORM = 74,
+	DXGI_FORMAT_BC2_UNORM_SRGB = 75,
+	DXGI_FORMAT_BC3_TYPELESS = 76,
+	DXGI_FORMAT_BC3_UNORM = 77,
+	DXGI_FORMAT_BC3_UNORM_SRGB = 78,
+	DXGI_FORMAT_BC4_TYPELESS = 79,
+	DXGI_FORMAT_BC4_UNORM = 80,
+	DXGI_FORMAT_BC4_SNORM = 81,
+	DXGI_FORMAT_BC5_TYPELESS = 82,
+	DXGI_FORMAT_BC5_UNORM = 83,
+	DXGI_FORMAT_BC5_SNORM = 84,
+	DXGI_FORMAT_B5G6R5_UNORM = 85,
+	DXGI_FORMAT_B5G5R5A1_UNORM = 86,
+	DXGI_FORMAT_B8G8R8A8_UNORM = 87,
+	DXGI_FORMAT_B8G8R8X8_UNORM = 88,
+	DXGI_FORMAT_B8G8R8A8_TYPELESS = 90,
+	DXGI_FORMAT_B8G8R8A8_UNORM_SRGB = 91,
+	DXGI_FORMAT_B8G8R8X8_TYPELESS = 92,
+	DXGI_FORMAT_B8G8R8X8_UNORM_SRGB = 93,
+	DXGI_FORMAT_BC6H_TYPELESS = 94,
+	DXGI_FORMAT_BC6H_UF16 = 95,
+	DXGI_FORMAT_BC6H_SF16 = 96,
+	DXGI_FORMAT_BC7_TYPELESS = 97,
+	DXGI_FORMAT_BC7_UNORM = 98,
+	DXGI_FORMAT_BC7_UNORM_SRGB = 99,
+	DXGI_FORMAT_B4G4R4A4_UNORM = 115,
+};
+#endif
+
+namespace DDS
+{
+	enum class Result
+	{
+		Ok = 0,
+		FileNotFound,
+		MapFailed,
+		InvalidHeader,
+		UnsupportedFormat,
+		Truncated,
+		WriteFailed,
+	};
+
+	enum class TextureDimension
+	{
+		Texture1D,
+		Texture2D,
+		Texture3D,
+	};
+
+	struct TextureDesc
+	{
+		TextureDimension Dimension = TextureDimension::Texture2D;
+		DXGI_FORMAT Format = DXGI_FORMAT_UNKNOWN;
+		uint32_t Width = 0;
+		uint32_t Height = 0;
+		uint32_t Depth = 0;
+		uint32_t MipLevels = 0;
+		uint32_t ArraySize = 0; // 6 per cube for cube maps
+		bool IsCubeMap = false;
+	};
+
+	// One mip of one array slice, pointing into the mapped file.
+	struct Subresource
+	{
+		const uint8_t* Data = nullptr;
+		size_t RowPitch = 0;   // bytes per row of texels, or per row of 4x4 blocks for BC formats
+		size_t SlicePitch = 0; // bytes per depth slice
+		size_t NumRows = 0;    // rows of texels or of blocks
+		uint32_t Width = 0;
+		uint32_t Height = 0;
+		uint32_t Depth = 0;
+		uint32_t MipLevel = 0;
+		uint32_t ArraySlice = 0;
+	};
+
+	class Reader
+	{
+	public:
+		Reader() = default;
+		Reader(const Reader& rhs) = delete;
+		Reader& operator=(const Reader& rhs) = delete;
+		Reader(Reader&& rhs) noexcept;
+		Reader& operator=(Reader&& rhs) noexcept;
+		~Reader();
+
+		// Maps the file read-only and validates it, the views stay valid until Close.
+		Result Open(const char* fileName);
+#if defined(_WIN32)
+		Result Open(const wchar_t* fileName);
+#endif
+		// Parses a DDS image already in memory, which must outlive the reader.
+		Result OpenMemory(const void* data, size_t size);
+		void Close();
+
+		bool IsOpen() const { return mData != nullptr; }
+		const TextureDesc& Desc() const { return mDesc; }
+		size_t FileSize() const { return mSize; }
+
+		// All subresources in D3D12 order, mip levels of slice 0 first.
+		const std::vector<Subresource>& Subresources() const { return mSubresources; }
+		const Subresource& GetSubresource(uint32_t mipLevel, uint32_t arraySlice) const;
+
+	private:
+		Result Parse();
+
+		const uint8_t* mData = nullptr;
+		size_t mSize = 0;
+		bool mMapped = false;
+#if defined(_WIN32)
+		void* mFile = nullptr;
+		void* mMapping = nullptr;
+#endif
+
+		TextureDesc mDesc;
+		std::vector<Subresource> mSubresources;
+	};
+
+	const char* ResultString(Result result);
+
+	// Bits per texel, 0 for formats the reader does not know.
+	size_t BitsPerPixel(DXGI_FORMAT format);
+	bool IsBlockCompressed(DXGI_FORMAT format);
+
+	// Same layout rules as GetSurfaceInfo in DDSTextureLoader.cpp.
+	void GetSurfaceInfo(size_t width, size_t height, DXGI_FORMAT format,
+		size_t* outNumBytes, size_t* outRowBytes, size_t* outNumRows);
+
+	// Copies a subresource row by row into memory with another pitch, e.g. a D3D12 upload footprint.
+	void CopySubresource(const Subresource& src, void* dst, size_t dstRowPitch, size_t dstSlicePitch);
+
+	// Writes a 2D texture with a DX10 header. mips[i] holds level i tightly packed (GetSurfaceInfo pitches).
+	Result WriteTexture2D(const char* fileName, DXGI_FORMAT format, uint32_t width, uint32_t height,
+		const std::vector<std::vector<uint8_t>>& mips);
+}
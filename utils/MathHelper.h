@@ -78,6 +78,29 @@ public:
         return DirectX::XMMatrixTranspose(DirectX::XMMatrixInverse(&det, A));
 	}
 
+	// Transpose of the inverse of an affine M (last column 0 0 0 1), translation included. The columns of
+	// the inverse of the upper 3x3 are the cross products of its rows over the determinant, which is much
+	// cheaper than the general 4x4 inverse for rigid, scaled and sheared world matrices.
+	static DirectX::XMMATRIX AffineInverseTranspose(DirectX::CXMMATRIX M)
+	{
+		using namespace DirectX;
+		XMVECTOR c0 = XMVector3Cross(M.r[1], M.r[2]);
+		XMVECTOR c1 = XMVector3Cross(M.r[2], M.r[0]);
+		XMVECTOR c2 = XMVector3Cross(M.r[0], M.r[1]);
+		XMVECTOR invDet = XMVectorReciprocal(XMVector3Dot(M.r[0], c0));
+		c0 = XMVectorMultiply(c0, invDet);
+		c1 = XMVectorMultiply(c1, invDet);
+		c2 = XMVectorMultiply(c2, invDet);
+
+		// Row j is column j of the inverse, the inverse translation -t * inverse ends up in w
+		XMMATRIX R;
+		R.r[0] = XMVectorSetW(c0, -XMVectorGetX(XMVector3Dot(M.r[3], c0)));
+		R.r[1] = XMVectorSetW(c1, -XMVectorGetX(XMVector3Dot(M.r[3], c1)));
+		R.r[2] = XMVectorSetW(c2, -XMVectorGetX(XMVector3Dot(M.r[3], c2)));
+		R.r[3] = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+		return R;
+	}
+
     static DirectX::XMFLOAT4X4 Identity4x4()
     {
         static DirectX::XMFLOAT4X4 I(